@@ -0,0 +1,34 @@
+#******************************************************************************
+#  SYNOPSIS:
+#    X_AC_CHECK_ATOMIC_BUILTINS
+#
+#  DESCRIPTION:
+#    Check to see if the compiler supports the __atomic builtins.
+#******************************************************************************
+
+AC_DEFUN([X_AC_CHECK_ATOMIC_BUILTINS], [
+  AC_CACHE_CHECK(
+    [for __atomic builtins],
+    [x_ac_cv_check_atomic_builtins], [
+    AC_LINK_IFELSE([
+      AC_LANG_PROGRAM([[
+unsigned long x;
+]],
+[[
+unsigned long y = 0;
+__atomic_store_n (&x, 1, __ATOMIC_RELEASE);
+(void) __atomic_compare_exchange_n (&x, &y, 2, 1,
+    __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+__atomic_thread_fence (__ATOMIC_SEQ_CST);
+return (__atomic_add_fetch (&x, 1, __ATOMIC_SEQ_CST) == 0);]]
+      )],
+      AS_VAR_SET(x_ac_cv_check_atomic_builtins, yes),
+      AS_VAR_SET(x_ac_cv_check_atomic_builtins, no)
+    )]
+  )
+  AS_IF([test AS_VAR_GET(x_ac_cv_check_atomic_builtins) = yes],
+    AC_DEFINE([HAVE_ATOMIC_BUILTINS], [1],
+      [Define to 1 if you have the __atomic builtins.]
+    )
+  )]
+)
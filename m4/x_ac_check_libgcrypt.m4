@@ -0,0 +1,20 @@
+#******************************************************************************
+#  SYNOPSIS:
+#    X_AC_CHECK_LIBGCRYPT
+#
+#  DESCRIPTION:
+#    Check for Libgcrypt behavior.
+#
+#  NOTES:
+#    This must be called after AM_PATH_LIBGCRYPT since it depends on the
+#    makefile variable LIBGCRYPT_CFLAGS.
+#******************************************************************************
+
+AC_DEFUN([X_AC_CHECK_LIBGCRYPT], [
+  ac_save_CFLAGS="${CFLAGS}"
+  CFLAGS="${CFLAGS} ${LIBGCRYPT_CFLAGS}"
+  AC_CHECK_DECLS([GCRY_CIPHER_MODE_GCM, GCRY_CIPHER_MODE_POLY1305,
+    GCRY_CIPHER_CHACHA20], [], [], [#include <gcrypt.h>])
+  CFLAGS="${ac_save_CFLAGS}"
+  ]
+)
@@ -48,10 +48,14 @@ AC_DEFUN([X_AC_CHECK_OPENSSL], [
     EVP_MD_CTX_init \
     EVP_MD_CTX_new \
     EVP_aes_128_cbc \
+    EVP_aes_128_gcm \
     EVP_aes_256_cbc \
+    EVP_aes_256_gcm \
+    EVP_chacha20_poly1305 \
     EVP_sha256 \
     EVP_sha512 \
     HMAC_CTX_cleanup \
+    HMAC_CTX_copy \
     HMAC_CTX_free \
     HMAC_CTX_init \
     HMAC_CTX_new \
@@ -0,0 +1,46 @@
+#******************************************************************************
+#  SYNOPSIS:
+#    X_AC_CHECK_X86_SIMD
+#
+#  DESCRIPTION:
+#    Check to see if the compiler can build SSSE3 and AVX2 functions via the
+#    target attribute, and select between them at runtime via the
+#    __builtin_cpu_supports builtin.
+#******************************************************************************
+
+AC_DEFUN([X_AC_CHECK_X86_SIMD], [
+  AC_CACHE_CHECK(
+    [for x86 SIMD target attributes],
+    [x_ac_cv_check_x86_simd], [
+    AC_LINK_IFELSE([
+      AC_LANG_PROGRAM([[
+#include <immintrin.h>
+__attribute__ ((target ("ssse3")))
+static int f (void) {
+    __m128i x = _mm_shuffle_epi8 (_mm_set1_epi8 (1), _mm_setzero_si128 ());
+    return (_mm_movemask_epi8 (x));
+}
+__attribute__ ((target ("avx2")))
+static int g (void) {
+    __m256i x = _mm256_shuffle_epi8 (_mm256_set1_epi8 (1),
+        _mm256_setzero_si256 ());
+    return (_mm256_movemask_epi8 (x));
+}
+]],
+[[
+if (__builtin_cpu_supports ("avx2"))
+    return (g ());
+if (__builtin_cpu_supports ("ssse3"))
+    return (f ());
+return (0);]]
+      )],
+      AS_VAR_SET(x_ac_cv_check_x86_simd, yes),
+      AS_VAR_SET(x_ac_cv_check_x86_simd, no)
+    )]
+  )
+  AS_IF([test AS_VAR_GET(x_ac_cv_check_x86_simd) = yes],
+    AC_DEFINE([HAVE_X86_SIMD], [1],
+      [Define to 1 if you can build x86 SIMD functions with runtime dispatch.]
+    )
+  )]
+)
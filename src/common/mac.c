@@ -31,10 +31,15 @@
 #endif /* HAVE_CONFIG_H */
 
 #include <assert.h>
+#include <stdlib.h>
 #include <string.h>
 #include "mac.h"
 #include "md.h"
 
+#if WITH_PTHREADS
+#  include <pthread.h>
+#endif /* WITH_PTHREADS */
+
 
 /*****************************************************************************
  *  Constants
@@ -42,6 +47,31 @@
 
 #define MAC_MAGIC 0xDEADACE2
 
+/*  Number of keyed contexts cached per thread.
+ */
+#define MAC_CACHE_SIZE 16
+
+
+/*****************************************************************************
+ *  Private Data
+ *****************************************************************************/
+
+/*  Per-thread cache of copies of keyed contexts, indexed by [keyed] addr.
+ */
+typedef struct {
+    struct {
+        mac_ctx        *keyed;
+        mac_ctx         ctx;
+        int             is_busy;
+    } entry [MAC_CACHE_SIZE];
+} mac_cache_t;
+
+#if WITH_PTHREADS
+static pthread_once_t _mac_cache_once = PTHREAD_ONCE_INIT;
+static pthread_key_t  _mac_cache_key;
+static int            _mac_cache_is_valid = 0;
+#endif /* WITH_PTHREADS */
+
 
 /*****************************************************************************
  *  Private Prototypes
@@ -51,6 +81,13 @@ static int _mac_init (mac_ctx *x, munge_mac_t md, const void *key, int keylen);
 static int _mac_update (mac_ctx *x, const void *src, int srclen);
 static int _mac_final (mac_ctx *x, void *dst, int *dstlen);
 static int _mac_cleanup (mac_ctx *x);
+static int _mac_copy (mac_ctx *xdst, mac_ctx *xsrc);
+static int _mac_reset (mac_ctx *x);
+static mac_cache_t * _mac_cache_get (void);
+#if WITH_PTHREADS
+static void _mac_cache_create_key (void);
+static void _mac_cache_destroy (void *arg);
+#endif /* WITH_PTHREADS */
 static int _mac_block (munge_mac_t md, const void *key, int keylen,
     void *dst, int *dstlen, const void *src, int srclen);
 
@@ -130,6 +167,116 @@ mac_cleanup (mac_ctx *x)
 }
 
 
+int
+mac_copy (mac_ctx *xdst, mac_ctx *xsrc)
+{
+    int rc;
+
+    assert (xdst != NULL);
+    assert (xsrc != NULL);
+    assert (xsrc->magic == MAC_MAGIC);
+    assert (xsrc->finalized != 1);
+
+    xdst->diglen = xsrc->diglen;
+    rc = _mac_copy (xdst, xsrc);
+    if (rc >= 0) {
+        assert (xdst->magic = MAC_MAGIC);
+        assert (!(xdst->finalized = 0));
+    }
+    return (rc);
+}
+
+
+int
+mac_ctx_acquire (mac_ctx **px, mac_ctx *keyed)
+{
+    mac_cache_t *cache;
+    mac_ctx     *x;
+    int          i;
+    int          i_free;
+
+    assert (px != NULL);
+    assert (keyed != NULL);
+    assert (keyed->magic == MAC_MAGIC);
+    assert (keyed->finalized != 1);
+
+    *px = NULL;
+    cache = _mac_cache_get ();
+
+    if (cache != NULL) {
+        i_free = -1;
+        for (i = 0; i < MAC_CACHE_SIZE; i++) {
+            if (cache->entry[i].keyed == keyed) {
+                if (!cache->entry[i].is_busy) {
+                    cache->entry[i].is_busy = 1;
+                    *px = &(cache->entry[i].ctx);
+                    return (0);
+                }
+            }
+            else if ((cache->entry[i].keyed == NULL) && (i_free < 0)) {
+                i_free = i;
+            }
+        }
+        if (i_free >= 0) {
+            if (mac_copy (&(cache->entry[i_free].ctx), keyed) < 0) {
+                return (-1);
+            }
+            cache->entry[i_free].keyed = keyed;
+            cache->entry[i_free].is_busy = 1;
+            *px = &(cache->entry[i_free].ctx);
+            return (0);
+        }
+    }
+    if (!(x = malloc (sizeof (*x)))) {
+        return (-1);
+    }
+    if (mac_copy (x, keyed) < 0) {
+        free (x);
+        return (-1);
+    }
+    *px = x;
+    return (0);
+}
+
+
+int
+mac_ctx_release (mac_ctx *x)
+{
+    mac_cache_t *cache;
+    int          i;
+    int          rc;
+
+    assert (x != NULL);
+    assert (x->magic == MAC_MAGIC);
+
+    cache = _mac_cache_get ();
+
+    if (cache != NULL) {
+        for (i = 0; i < MAC_CACHE_SIZE; i++) {
+            if (x != &(cache->entry[i].ctx)) {
+                continue;
+            }
+            assert (cache->entry[i].is_busy);
+            cache->entry[i].is_busy = 0;
+            /*
+             *  Restore the keyed state for the next acquisition.
+             *    If that fails, evict the entry.
+             */
+            if (_mac_reset (x) < 0) {
+                rc = mac_cleanup (x);
+                cache->entry[i].keyed = NULL;
+                return (rc);
+            }
+            assert (!(x->finalized = 0));
+            return (0);
+        }
+    }
+    rc = mac_cleanup (x);
+    free (x);
+    return (rc);
+}
+
+
 int
 mac_size (munge_mac_t md)
 {
@@ -164,6 +311,72 @@ mac_map_enum (munge_mac_t mac, void *dst)
 }
 
 
+/*****************************************************************************
+ *  Private Functions
+ *****************************************************************************/
+
+static mac_cache_t *
+_mac_cache_get (void)
+{
+/*  Returns a ptr to the calling thread's MAC context cache, or NULL if
+ *    the cache is unavailable.
+ */
+#if WITH_PTHREADS
+    mac_cache_t *cache;
+
+    if (pthread_once (&_mac_cache_once, _mac_cache_create_key) != 0) {
+        return (NULL);
+    }
+    if (!_mac_cache_is_valid) {
+        return (NULL);
+    }
+    cache = pthread_getspecific (_mac_cache_key);
+    if (cache == NULL) {
+        if (!(cache = calloc (1, sizeof (*cache)))) {
+            return (NULL);
+        }
+        if (pthread_setspecific (_mac_cache_key, cache) != 0) {
+            free (cache);
+            return (NULL);
+        }
+    }
+    return (cache);
+#else  /* !WITH_PTHREADS */
+    return (NULL);
+#endif /* !WITH_PTHREADS */
+}
+
+
+#if WITH_PTHREADS
+static void
+_mac_cache_create_key (void)
+{
+    if (pthread_key_create (&_mac_cache_key, _mac_cache_destroy) == 0) {
+        _mac_cache_is_valid = 1;
+    }
+    return;
+}
+
+
+static void
+_mac_cache_destroy (void *arg)
+{
+/*  Destroys the MAC context cache [arg] when its thread exits.
+ */
+    mac_cache_t *cache = arg;
+    int          i;
+
+    for (i = 0; i < MAC_CACHE_SIZE; i++) {
+        if (cache->entry[i].keyed != NULL) {
+            (void) mac_cleanup (&(cache->entry[i].ctx));
+        }
+    }
+    free (cache);
+    return;
+}
+#endif /* WITH_PTHREADS */
+
+
 /*****************************************************************************
  *  Private Functions (Libgcrypt)
  *****************************************************************************/
@@ -230,6 +443,30 @@ _mac_cleanup (mac_ctx *x)
 }
 
 
+static int
+_mac_reset (mac_ctx *x)
+{
+/*  For an HMAC, gcry_md_reset() restores the keyed state.
+ */
+    gcry_md_reset (x->ctx);
+    return (0);
+}
+
+
+static int
+_mac_copy (mac_ctx *xdst, mac_ctx *xsrc)
+{
+    gcry_error_t e;
+
+    if ((e = gcry_md_copy (&(xdst->ctx), xsrc->ctx)) != 0) {
+        log_msg (LOG_DEBUG, "gcry_md_copy failed for HMAC: %s",
+            gcry_strerror (e));
+        return (-1);
+    }
+    return (0);
+}
+
+
 static int
 _mac_block (munge_mac_t md, const void *key, int keylen,
             void *dst, int *dstlen, const void *src, int srclen)
@@ -285,17 +522,10 @@ _mac_block (munge_mac_t md, const void *key, int keylen,
 #include <openssl/hmac.h>
 
 static int
-_mac_init (mac_ctx *x, munge_mac_t md, const void *key, int keylen)
+_mac_ctx_create (mac_ctx *x)
 {
-    EVP_MD *algo;
-
     assert (x != NULL);
-    assert (key != NULL);
-    assert (keylen >= 0);
 
-    if (md_map_enum (md, &algo) < 0) {
-        return (-1);
-    }
 #if HAVE_HMAC_CTX_NEW
     /*  OpenSSL >= 1.1.0  */
     x->ctx = HMAC_CTX_new ();
@@ -311,6 +541,25 @@ _mac_init (mac_ctx *x, munge_mac_t md, const void *key, int keylen)
     if (x->ctx == NULL) {
         return (-1);
     }
+    return (0);
+}
+
+
+static int
+_mac_init (mac_ctx *x, munge_mac_t md, const void *key, int keylen)
+{
+    EVP_MD *algo;
+
+    assert (x != NULL);
+    assert (key != NULL);
+    assert (keylen >= 0);
+
+    if (md_map_enum (md, &algo) < 0) {
+        return (-1);
+    }
+    if (_mac_ctx_create (x) < 0) {
+        return (-1);
+    }
 
 #if HAVE_HMAC_INIT_EX_RETURN_INT
     /*  OpenSSL >= 1.0.0  */
@@ -409,6 +658,69 @@ _mac_cleanup (mac_ctx *x)
 }
 
 
+static int
+_mac_reset (mac_ctx *x)
+{
+/*  Calling HMAC_Init_ex() with a NULL key and message digest reuses those
+ *    of the existing context, thereby restoring its keyed state.
+ */
+    assert (x != NULL);
+    assert (x->ctx != NULL);
+
+#if HAVE_HMAC_INIT_EX_RETURN_INT
+    /*  OpenSSL >= 1.0.0  */
+    if (HMAC_Init_ex (x->ctx, NULL, 0, NULL, NULL) != 1) {
+        return (-1);
+    }
+#elif HAVE_HMAC_INIT_EX
+    /*  OpenSSL >= 0.9.7, < 1.0.0  */
+    HMAC_Init_ex (x->ctx, NULL, 0, NULL, NULL);
+#elif HAVE_HMAC_INIT
+    /*  OpenSSL >= 0.9.0  */
+    HMAC_Init (x->ctx, NULL, 0, NULL);
+#else  /* !HAVE_HMAC_INIT */
+#error "No OpenSSL HMAC_Init"
+#endif /* !HAVE_HMAC_INIT */
+
+    return (0);
+}
+
+
+static int
+_mac_copy (mac_ctx *xdst, mac_ctx *xsrc)
+{
+    assert (xdst != NULL);
+    assert (xsrc != NULL);
+    assert (xsrc->ctx != NULL);
+
+    if (_mac_ctx_create (xdst) < 0) {
+        return (-1);
+    }
+#if HAVE_HMAC_CTX_COPY
+    /*  OpenSSL >= 1.0.0  */
+    if (HMAC_CTX_copy (xdst->ctx, xsrc->ctx) != 1) {
+        _mac_cleanup (xdst);
+        return (-1);
+    }
+#elif HAVE_EVP_MD_CTX_COPY
+    /*  OpenSSL < 1.0.0 exposes the HMAC_CTX struct, so copy its members.  */
+    if ( !EVP_MD_CTX_copy (&xdst->ctx->md_ctx, &xsrc->ctx->md_ctx)
+      || !EVP_MD_CTX_copy (&xdst->ctx->i_ctx, &xsrc->ctx->i_ctx)
+      || !EVP_MD_CTX_copy (&xdst->ctx->o_ctx, &xsrc->ctx->o_ctx) ) {
+        _mac_cleanup (xdst);
+        return (-1);
+    }
+    memcpy (xdst->ctx->key, xsrc->ctx->key, sizeof (xsrc->ctx->key));
+    xdst->ctx->key_length = xsrc->ctx->key_length;
+    xdst->ctx->md = xsrc->ctx->md;
+#else  /* !HAVE_EVP_MD_CTX_COPY */
+#error "No OpenSSL HMAC_CTX_copy"
+#endif /* !HAVE_EVP_MD_CTX_COPY */
+
+    return (0);
+}
+
+
 static int
 _mac_block (munge_mac_t md, const void *key, int keylen,
             void *dst, int *dstlen, const void *src, int srclen)
@@ -108,6 +108,38 @@ int mac_cleanup (mac_ctx *x);
  *  Returns 0 on success, or -1 on error.
  */
 
+int mac_copy (mac_ctx *xdst, mac_ctx *xsrc);
+/*
+ *  Initializes a new MAC context [xdst], and copies the state from the
+ *    [xsrc] context to the new [xdst] context.
+ *  This allows a context that has been keyed once via mac_init() to serve
+ *    as a template, thereby avoiding the cost of re-deriving the padded key
+ *    state for each MAC computed with the same key.  The [xsrc] context is
+ *    not modified and can be shared across threads.
+ *  Returns 0 on success, or -1 on error.
+ */
+
+int mac_ctx_acquire (mac_ctx **px, mac_ctx *keyed);
+/*
+ *  Acquires a MAC context with the same keyed state as the [keyed] context
+ *    (ie, as if it had just been initialized via mac_init() with the same
+ *    message digest and key), and sets [px] to point to it.
+ *  When built with pthreads, each thread caches its copies of the [keyed]
+ *    contexts it has seen and resets them between uses instead of copying
+ *    them anew.  Since the cache is indexed by the address of [keyed],
+ *    a keyed context must not be replaced while threads that have acquired
+ *    copies of it remain.
+ *  The context must be returned via mac_ctx_release() by the same thread
+ *    that acquired it.
+ *  Returns 0 on success, or -1 on error.
+ */
+
+int mac_ctx_release (mac_ctx *x);
+/*
+ *  Releases the MAC context [x] acquired via mac_ctx_acquire().
+ *  Returns 0 on success, or -1 on error.
+ */
+
 int mac_size (munge_mac_t md);
 /*
  *  Returns the size (in bytes) of the message digest [md], or -1 on error.
@@ -54,6 +54,7 @@
 #define LOG_IDENTITY_MAXLEN     128
 #define LOG_PREFIX_MAXLEN       9
 #define LOG_TRUNC_SUFFIX        "+"
+#define LOG_WRITE_BUFFER_MAXLEN 16384
 
 
 /*****************************************************************************
@@ -61,13 +62,15 @@
  *****************************************************************************/
 
 struct log_ctx {
-    FILE *fp;
-    int   got_init;
-    int   got_syslog;
-    int   got_fprintf_error;
-    int   priority;
-    int   options;
-    char  id [LOG_IDENTITY_MAXLEN];
+    FILE        *fp;
+    int          got_init;
+    int          got_syslog;
+    int          got_fprintf_error;
+    int          priority;
+    int          options;
+    char         id [LOG_IDENTITY_MAXLEN];
+    log_queue_f  queue_f;
+    log_flush_f  flush_f;
 };
 
 
@@ -75,7 +78,12 @@ struct log_ctx {
  *  Static Variables
  *****************************************************************************/
 
-static struct log_ctx log_ctx = { NULL, 0, 0, 0, 0, 0, { '\0' } };
+static struct log_ctx log_ctx = { NULL, 0, 0, 0, 0, 0, { '\0' }, NULL, NULL };
+
+/*  Messages written via log_write() are buffered here until log_flush().
+ */
+static char log_wbuf [LOG_WRITE_BUFFER_MAXLEN];
+static int  log_wbuf_len = 0;
 
 
 /*****************************************************************************
@@ -85,6 +93,7 @@ static struct log_ctx log_ctx = { NULL, 0, 0, 0, 0, 0, { '\0' } };
 static void _log_aux (int errnum, int priority, char *msgbuf, int msgbuflen,
         const char *format, va_list vargs);
 static void _log_die (int status, int priority, const char *msg);
+static void _log_write_file (const char *msg, int len);
 static char * _log_prefix (int priority);
 
 
@@ -125,6 +134,7 @@ log_open_file (FILE *fp, const char *identity, int priority, int options)
 void
 log_close_file (void)
 {
+    log_flush ();
     if (log_ctx.fp) {
         (void) fclose (log_ctx.fp);
         log_ctx.fp = NULL;
@@ -172,6 +182,56 @@ log_close_all (void)
 }
 
 
+void
+log_set_queue (log_queue_f queue_f, log_flush_f flush_f)
+{
+    log_ctx.queue_f = queue_f;
+    log_ctx.flush_f = (queue_f != NULL) ? flush_f : NULL;
+    return;
+}
+
+
+void
+log_write (int priority, const char *msg, int sys_offset)
+{
+    int len;
+
+    if (!msg) {
+        return;
+    }
+    if (log_ctx.got_syslog && (sys_offset >= 0)) {
+        syslog (priority, "%s", msg + sys_offset);
+    }
+    if (log_ctx.fp && (priority <= log_ctx.priority)) {
+        len = strlen (msg);
+        if (log_wbuf_len + len > sizeof (log_wbuf)) {
+            log_flush ();
+        }
+        if (len > sizeof (log_wbuf)) {
+            _log_write_file (msg, len);
+        }
+        else {
+            memcpy (log_wbuf + log_wbuf_len, msg, len);
+            log_wbuf_len += len;
+        }
+    }
+    return;
+}
+
+
+void
+log_flush (void)
+{
+    if (log_wbuf_len > 0) {
+        if (log_ctx.fp) {
+            _log_write_file (log_wbuf, log_wbuf_len);
+        }
+        log_wbuf_len = 0;
+    }
+    return;
+}
+
+
 void
 log_err (int status, int priority, const char *format, ...)
 {
@@ -371,25 +431,46 @@ _log_aux (int errnum, int priority, char *msgbuf, int msgbuflen,
             msgbuf[0] = '\0';
         }
     }
+    /*  Divert message to the queue function (if set) unless it would be
+     *    discarded anyway.
+     */
+    if (log_ctx.queue_f) {
+        if (!(log_ctx.got_syslog && sbuf)
+                && !(log_ctx.fp && (priority <= log_ctx.priority))) {
+            return;
+        }
+        if (log_ctx.queue_f (priority, buf, p - buf,
+                (sbuf ? sbuf - buf : -1)) == 0) {
+            return;
+        }
+    }
     /*  Log message.
      */
     if (log_ctx.got_syslog && sbuf) {
         syslog (priority, "%s", sbuf);
     }
     if (log_ctx.fp && (priority <= log_ctx.priority)) {
-        errno = 0;
-        if (fprintf (log_ctx.fp, "%s", buf) == EOF) {
-            if (!log_ctx.got_fprintf_error) {
-                syslog (LOG_ERR,
-                    "Failed logfile write: %s: messages may have been dropped",
-                    (errno != 0) ? strerror (errno) : "Unspecified error");
-                log_ctx.got_fprintf_error = 1;
-            }
-        }
-        else if (log_ctx.got_fprintf_error) {
-            log_ctx.got_fprintf_error = 0;
+        _log_write_file (buf, p - buf);
+    }
+    return;
+}
+
+
+static void
+_log_write_file (const char *msg, int len)
+{
+    errno = 0;
+    if (fwrite (msg, 1, len, log_ctx.fp) != len) {
+        if (!log_ctx.got_fprintf_error) {
+            syslog (LOG_ERR,
+                "Failed logfile write: %s: messages may have been dropped",
+                (errno != 0) ? strerror (errno) : "Unspecified error");
+            log_ctx.got_fprintf_error = 1;
         }
     }
+    else if (log_ctx.got_fprintf_error) {
+        log_ctx.got_fprintf_error = 0;
+    }
     return;
 }
 
@@ -397,6 +478,11 @@ _log_aux (int errnum, int priority, char *msgbuf, int msgbuflen,
 static void
 _log_die (int status, int priority, const char *msg)
 {
+    /*  Write any diverted messages (including this one) before exiting.
+     */
+    if (log_ctx.flush_f) {
+        log_ctx.flush_f ();
+    }
     /*  If the daemonpipe is open between the (grand)child process and the
      *    parent process, relay the error message to the parent for output onto
      *    stderr.  But if the error message has already been written to stderr,
@@ -81,6 +81,41 @@ void log_close_all (void);
  *  Closes all logging devices that are open.
  */
 
+typedef int (*log_queue_f) (int priority, const char *msg, int len,
+        int sys_offset);
+/*
+ *  Function prototype for diverting the formatted message [msg] of [len]
+ *    chars at the specified [priority] level away from the logging thread.
+ *    [sys_offset] is the offset into [msg] of the text sent to syslog, or -1.
+ *  Returns 0 if the message was consumed (even if it was dropped), or -1 if
+ *    it must be written by the logging thread instead.
+ */
+
+typedef void (*log_flush_f) (void);
+/*
+ *  Function prototype for writing all diverted messages before returning.
+ */
+
+void log_set_queue (log_queue_f queue_f, log_flush_f flush_f);
+/*
+ *  Diverts formatted messages to [queue_f] instead of writing them from the
+ *    logging thread.  [flush_f] is invoked before a fatal error exits the
+ *    program so that diverted messages are not lost.
+ *  Passing NULL for [queue_f] restores writing messages synchronously.
+ */
+
+void log_write (int priority, const char *msg, int sys_offset);
+/*
+ *  Writes the formatted message [msg] previously diverted via log_queue_f.
+ *    Output to the file stream is buffered until log_flush() is called.
+ *  Only one thread at a time may call this routine or log_flush().
+ */
+
+void log_flush (void);
+/*
+ *  Writes messages buffered by log_write() to the file stream.
+ */
+
 void log_err (int status, int priority, const char *format, ...);
 /*
  *  Logs a fatal message at the specified [priority] level according to
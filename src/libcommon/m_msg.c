@@ -53,6 +53,14 @@
 typedef void ** vpp;
 
 
+/*****************************************************************************
+ *  Static Variables
+ *****************************************************************************/
+
+static void * (*_msg_alloc_f) (size_t) = malloc;
+static void   (*_msg_free_f) (void *) = free;
+
+
 /*****************************************************************************
  *  Prototypes
  *****************************************************************************/
@@ -63,10 +71,18 @@ static munge_err_t _msg_pack (m_msg_t m, m_msg_type_t type,
         void *dst, int dstlen);
 static munge_err_t _msg_unpack (m_msg_t m, m_msg_type_t type,
         const void *src, int srclen);
+static int _msg_batch_length (m_msg_t m);
+static munge_err_t _msg_batch_pack (m_msg_t m, void **pdst, const void *last);
+static munge_err_t _msg_batch_unpack (m_msg_t m, void **psrc,
+        const void *last);
+static int _msg_batch_type_is_valid (m_msg_type_t type, m_msg_type_t btype);
+static int _msg_is_ref (m_msg_t m);
 static int _alloc (void **pdst, int len);
 static int _copy (void *dst, void *src, int len,
         const void *first, const void *last, void **pinc);
 static int _pack (void **pdst, void *src, int len, const void *last);
+static int _ref (void **pdst, void *src, int len, const void *last,
+    void **pinc);
 static int _unpack (void *dst, void **psrc, int len, const void *last);
 
 
@@ -84,11 +100,13 @@ m_msg_create (m_msg_t *pm)
 
     assert (pm != NULL);
 
-    if (!(m = calloc (1, sizeof (*m)))) {
+    if (!(m = _msg_alloc_f (sizeof (*m)))) {
         *pm = NULL;
         return (EMUNGE_NO_MEMORY);
     }
+    memset (m, 0, sizeof (*m));
     m->sd = -1;
+    m->version = MUNGE_MSG_VERSION_MIN;
     m->type = MUNGE_MSG_UNDEF;
 
     *pm = m;
@@ -99,10 +117,21 @@ m_msg_create (m_msg_t *pm)
 void
 m_msg_destroy (m_msg_t m)
 {
-/*  Destroys the message [m].
+/*  Destroys the message [m] along with any batched messages.
  */
+    uint32_t i;
+
     assert (m != NULL);
 
+    if (m->batch) {
+        for (i = 0; i < m->batch_len; i++) {
+            if (m->batch[i]) {
+                m_msg_destroy (m->batch[i]);
+            }
+        }
+        free (m->batch);
+    }
+
     if (m->sd >= 0) {
         (void) close (m->sd);
     }
@@ -110,6 +139,9 @@ m_msg_destroy (m_msg_t m)
         assert (m->pkt_len > 0);
         free (m->pkt);
     }
+    if (m->rcv_pkt) {
+        free (m->rcv_pkt);
+    }
     if (m->realm_str && !m->realm_is_copy) {
         assert (m->realm_len > 0);
         free (m->realm_str);
@@ -130,7 +162,24 @@ m_msg_destroy (m_msg_t m)
         assert (m->auth_c_len > 0);
         free (m->auth_c_str);
     }
-    free (m);
+    _msg_free_f (m);
+    return;
+}
+
+
+void
+m_msg_set_allocator (void * (*alloc_f) (size_t), void (*free_f) (void *))
+{
+/*  Sets the functions used to allocate and free message structs.
+ *  If either is NULL, malloc() and free() are restored.
+ *  This must not be called while any messages exist.
+ */
+    if (!alloc_f || !free_f) {
+        alloc_f = malloc;
+        free_f = free;
+    }
+    _msg_alloc_f = alloc_f;
+    _msg_free_f = free_f;
     return;
 }
 
@@ -309,6 +358,7 @@ m_msg_recv (m_msg_t m, m_msg_type_t type, int maxlen)
  *    and an error returned.
  *  Returns a standard munge error code.
  */
+    munge_err_t     e;
     int             n, nrecv;
     uint8_t         hdr [MUNGE_MSG_HDR_SIZE];
     struct timeval  tv;
@@ -345,7 +395,48 @@ m_msg_recv (m_msg_t m, m_msg_type_t type, int maxlen)
             n, nrecv));
         return (EMUNGE_SOCKET);
     }
-    else if (_msg_unpack (m, MUNGE_MSG_HDR, hdr, sizeof (hdr))
+    else if ((e = m_msg_recv_hdr (m, hdr, type, maxlen)) != EMUNGE_SUCCESS) {
+        return (e);
+    }
+    else if ((errno = 0,
+              n = fd_timed_read_n (m->sd, m->pkt, m->pkt_len, &tv, 1)) < 0) {
+        m_msg_set_err (m, EMUNGE_SOCKET,
+            strdupf ("Failed to receive message body: %s", strerror (errno)));
+        return (EMUNGE_SOCKET);
+    }
+    else if (errno == ETIMEDOUT) {
+        m_msg_set_err (m, EMUNGE_SOCKET,
+            strdup ("Failed to receive message body: Timed-out"));
+        return (EMUNGE_SOCKET);
+    }
+    else if (n != m->pkt_len) {
+        m_msg_set_err (m, EMUNGE_SOCKET,
+            strdupf ("Received incomplete message body: %d of %d bytes",
+            n, nrecv));
+        return (EMUNGE_SOCKET);
+    }
+    return (m_msg_recv_body (m));
+}
+
+
+munge_err_t
+m_msg_recv_hdr (m_msg_t m, const void *hdr, m_msg_type_t type, int maxlen)
+{
+/*  Unpacks and validates the MUNGE_MSG_HDR_SIZE-byte message header [hdr]
+ *    into [m], and allocates [m->pkt] for receiving the [m->pkt_len]-byte
+ *    message body.
+ *  The [type] and [maxlen] args are as for m_msg_recv().
+ *  This allows the header and body to be read by a caller performing its own
+ *    (e.g., event-driven) I/O on the socket; m_msg_recv_body() must be called
+ *    once the body has been read into [m->pkt].
+ *  Returns a standard munge error code.
+ */
+    assert (m != NULL);
+    assert (hdr != NULL);
+    assert (m->pkt == NULL);
+    assert (m->pkt_is_copy == 0);
+
+    if (_msg_unpack (m, MUNGE_MSG_HDR, hdr, MUNGE_MSG_HDR_SIZE)
             != EMUNGE_SUCCESS) {
         m_msg_set_err (m, EMUNGE_SOCKET,
             strdup ("Failed to unpack message header"));
@@ -365,37 +456,48 @@ m_msg_recv (m_msg_t m, m_msg_type_t type, int maxlen)
     }
     else if (!(m->pkt = malloc (m->pkt_len))) {
         m_msg_set_err (m, EMUNGE_NO_MEMORY,
-            strdupf ("Failed to allocate %d bytes for receiving message", n));
+            strdupf ("Failed to allocate %d bytes for receiving message",
+                m->pkt_len));
         return (EMUNGE_NO_MEMORY);
     }
-    else if ((errno = 0,
-              n = fd_timed_read_n (m->sd, m->pkt, m->pkt_len, &tv, 1)) < 0) {
-        m_msg_set_err (m, EMUNGE_SOCKET,
-            strdupf ("Failed to receive message body: %s", strerror (errno)));
-        return (EMUNGE_SOCKET);
-    }
-    else if (errno == ETIMEDOUT) {
-        m_msg_set_err (m, EMUNGE_SOCKET,
-            strdup ("Failed to receive message body: Timed-out"));
-        return (EMUNGE_SOCKET);
+    return (EMUNGE_SUCCESS);
+}
+
+
+munge_err_t
+m_msg_recv_body (m_msg_t m)
+{
+/*  Unpacks the message body from [m->pkt] once all [m->pkt_len] bytes have
+ *    been received, and then discards the packed message.
+ *  Returns a standard munge error code.
+ */
+    munge_err_t e;
+
+    assert (m != NULL);
+    assert (m->pkt != NULL);
+    assert (m->pkt_is_copy == 0);
+    assert (m->rcv_pkt == NULL);
+
+    e = _msg_unpack (m, m->type, m->pkt, m->pkt_len);
+
+    /*  The packed message can be discarded now that it's been unpacked,
+     *    unless its data is referenced in place.  In that case, it is
+     *    retained until the message is destroyed.
+     */
+    if (_msg_is_ref (m)) {
+        m->rcv_pkt = m->pkt;
     }
-    else if (n != m->pkt_len) {
-        m_msg_set_err (m, EMUNGE_SOCKET,
-            strdupf ("Received incomplete message body: %d of %d bytes",
-            n, nrecv));
-        return (EMUNGE_SOCKET);
+    else {
+        free (m->pkt);
     }
-    else if (_msg_unpack (m, m->type, m->pkt, m->pkt_len) != EMUNGE_SUCCESS) {
+    m->pkt = NULL;
+    m->pkt_len = 0;
+
+    if (e != EMUNGE_SUCCESS) {
         m_msg_set_err (m, EMUNGE_SOCKET,
             strdup ("Failed to unpack message body"));
         return (EMUNGE_SOCKET);
     }
-    /*  The packed message can be discarded now that it's been unpacked.
-     */
-    free (m->pkt);
-    m->pkt = NULL;
-    m->pkt_len = 0;
-    assert (m->pkt_is_copy == 0);
     return (EMUNGE_SUCCESS);
 }
 
@@ -465,6 +567,9 @@ _msg_length (m_msg_t m, m_msg_type_t type)
 
     assert (m != NULL);
 
+    if ((type != MUNGE_MSG_HDR) && (m->version > MUNGE_MSG_VERSION_MIN)) {
+        n += sizeof (m->req_id);
+    }
     switch (type) {
         case MUNGE_MSG_HDR:
             n += sizeof (m_msg_magic_t);
@@ -523,6 +628,15 @@ _msg_length (m_msg_t m, m_msg_type_t type)
             n += sizeof (m->auth_c_len);
             n += m->auth_c_len;
             break;
+        case MUNGE_MSG_BATCH_REQ:
+            n += _msg_batch_length (m);
+            break;
+        case MUNGE_MSG_BATCH_RSP:
+            n += sizeof (m->error_num);
+            n += sizeof (m->error_len);
+            n += m->error_len;
+            n += _msg_batch_length (m);
+            break;
         default:
             return (-1);
             break;
@@ -538,12 +652,18 @@ _msg_pack (m_msg_t m, m_msg_type_t type, void *dst, int dstlen)
  *    of length [dstlen] for transport across the munge socket.
  */
     m_msg_magic_t    magic = MUNGE_MSG_MAGIC;
-    m_msg_version_t  version = MUNGE_MSG_VERSION;
+    m_msg_version_t  version;
     void            *p = dst;
     void            *q = (unsigned char *) dst + dstlen;
 
     assert (m != NULL);
 
+    version = m->version;
+    if ((type != MUNGE_MSG_HDR) && (version > MUNGE_MSG_VERSION_MIN)) {
+        if (!_pack (&p, &(m->req_id), sizeof (m->req_id), q)) {
+            goto err;
+        }
+    }
     switch (type) {
         case MUNGE_MSG_HDR:
             if      (!_pack (&p, &magic, sizeof (magic), q)) ;
@@ -608,6 +728,17 @@ _msg_pack (m_msg_t m, m_msg_type_t type, void *dst, int dstlen)
             else if ( _copy (p, m->auth_c_str, m->auth_c_len, p, q, &p) < 0) ;
             else break;
             goto err;
+        case MUNGE_MSG_BATCH_REQ:
+            if (_msg_batch_pack (m, &p, q) != EMUNGE_SUCCESS) ;
+            else break;
+            goto err;
+        case MUNGE_MSG_BATCH_RSP:
+            if      (!_pack (&p, &(m->error_num), sizeof (m->error_num), q)) ;
+            else if (!_pack (&p, &(m->error_len), sizeof (m->error_len), q)) ;
+            else if ( _copy (p, m->error_str, m->error_len, p, q, &p) < 0) ;
+            else if (_msg_batch_pack (m, &p, q) != EMUNGE_SUCCESS) ;
+            else break;
+            goto err;
         default:
             goto err;
     }
@@ -630,9 +761,15 @@ _msg_unpack (m_msg_t m, m_msg_type_t type, const void *src, int srclen)
     m_msg_version_t  version;
     void            *p = (void *) src;
     void            *q = (unsigned char *) src + srclen;
+    munge_err_t      e;
 
     assert (m != NULL);
 
+    if ((type != MUNGE_MSG_HDR) && (m->version > MUNGE_MSG_VERSION_MIN)) {
+        if (!_unpack (&(m->req_id), &p, sizeof (m->req_id), q)) {
+            goto err;
+        }
+    }
     switch (type) {
         case MUNGE_MSG_HDR:
             if      (!_unpack (&magic, &p, sizeof (magic), q)) ;
@@ -669,9 +806,11 @@ _msg_unpack (m_msg_t m, m_msg_type_t type, const void *src, int srclen)
             goto err;
         case MUNGE_MSG_DEC_REQ:
             if      (!_unpack (&(m->data_len), &p, sizeof (m->data_len), q)) ;
-            else if (!_alloc (&(m->data), m->data_len)) goto nomem;
-            else if ( _copy (m->data, p, m->data_len, p, q, &p) < 0) ;
-            else break;
+            else if ( _ref (&(m->data), p, m->data_len, q, &p) < 0) ;
+            else {
+                m->data_is_copy = 1;
+                break;
+            }
             goto err;
         case MUNGE_MSG_DEC_RSP:
             if      (!_unpack (&(m->error_num), &p, sizeof (m->error_num), q));
@@ -707,10 +846,28 @@ _msg_unpack (m_msg_t m, m_msg_type_t type, const void *src, int srclen)
             else if ( _copy (m->auth_c_str, p, m->auth_c_len, p, q, &p) < 0) ;
             else break;
             goto err;
+        case MUNGE_MSG_BATCH_REQ:
+            if ((e = _msg_batch_unpack (m, &p, q)) == EMUNGE_NO_MEMORY)
+                goto nomem;
+            else if (e != EMUNGE_SUCCESS) ;
+            else break;
+            goto err;
+        case MUNGE_MSG_BATCH_RSP:
+            if      (!_unpack (&(m->error_num), &p, sizeof (m->error_num), q));
+            else if (!_unpack (&(m->error_len), &p, sizeof (m->error_len), q));
+            else if (!_alloc ((vpp) &(m->error_str), m->error_len)) goto nomem;
+            else if ( _copy (m->error_str, p, m->error_len, p, q, &p) < 0) ;
+            else if ((e = _msg_batch_unpack (m, &p, q)) == EMUNGE_NO_MEMORY)
+                goto nomem;
+            else if (e != EMUNGE_SUCCESS) ;
+            else break;
+            goto err;
         default:
             goto err;
     }
-    assert (p == (unsigned char *) src + srclen);
+    if (p != (unsigned char *) src + srclen) {
+        goto err;
+    }
 
     if (type == MUNGE_MSG_HDR) {
         if (magic != MUNGE_MSG_MAGIC) {
@@ -718,11 +875,13 @@ _msg_unpack (m_msg_t m, m_msg_type_t type, const void *src, int srclen)
                 strdupf ("Received invalid message magic %d", magic));
             return (EMUNGE_SOCKET);
         }
-        else if (version != MUNGE_MSG_VERSION) {
+        else if ((version < MUNGE_MSG_VERSION_MIN) ||
+                 (version > MUNGE_MSG_VERSION)) {
             m_msg_set_err (m, EMUNGE_SOCKET,
                 strdupf ("Received invalid message version %d", version));
             return (EMUNGE_SOCKET);
         }
+        m->version = version;
     }
     return (EMUNGE_SUCCESS);
 
@@ -737,6 +896,169 @@ nomem:
 }
 
 
+static int
+_msg_batch_length (m_msg_t m)
+{
+/*  Returns the length needed to pack the batched messages of [m],
+ *    each of which is prefixed by its packed length.
+ */
+    int       n = 0;
+    int       k;
+    uint32_t  i;
+
+    assert (m != NULL);
+
+    n += sizeof (m->batch_type);
+    n += sizeof (m->batch_len);
+    for (i = 0; i < m->batch_len; i++) {
+        assert (m->batch != NULL);
+        assert (m->batch[i] != NULL);
+        assert (m->batch[i]->version == MUNGE_MSG_VERSION_MIN);
+        if ((k = _msg_length (m->batch[i], m->batch_type)) < 0) {
+            return (-1);
+        }
+        n += sizeof (uint32_t) + k;
+    }
+    return (n);
+}
+
+
+static munge_err_t
+_msg_batch_pack (m_msg_t m, void **pdst, const void *last)
+{
+/*  Packs the batched messages of [m] into [pdst], advancing it on success.
+ */
+    uint32_t  i;
+    uint32_t  k;
+    int       n;
+
+    assert (m != NULL);
+    assert (pdst != NULL);
+
+    if (!_msg_batch_type_is_valid (m->type, m->batch_type)) {
+        return (EMUNGE_SNAFU);
+    }
+    if (!_pack (pdst, &(m->batch_type), sizeof (m->batch_type), last)) {
+        return (EMUNGE_SNAFU);
+    }
+    if (!_pack (pdst, &(m->batch_len), sizeof (m->batch_len), last)) {
+        return (EMUNGE_SNAFU);
+    }
+    for (i = 0; i < m->batch_len; i++) {
+        if ((n = _msg_length (m->batch[i], m->batch_type)) < 0) {
+            return (EMUNGE_SNAFU);
+        }
+        k = n;
+        if (!_pack (pdst, &k, sizeof (k), last)) {
+            return (EMUNGE_SNAFU);
+        }
+        if ((unsigned char *) *pdst + k > (unsigned char *) last) {
+            return (EMUNGE_SNAFU);
+        }
+        if (_msg_pack (m->batch[i], m->batch_type, *pdst, k)
+                != EMUNGE_SUCCESS) {
+            return (EMUNGE_SNAFU);
+        }
+        *pdst = (unsigned char *) *pdst + k;
+    }
+    return (EMUNGE_SUCCESS);
+}
+
+
+static munge_err_t
+_msg_batch_unpack (m_msg_t m, void **psrc, const void *last)
+{
+/*  Unpacks the batched messages of [m] from [psrc], advancing it on success.
+ *  Each batched message must exactly fill its length-prefixed slice.
+ */
+    uint32_t     i;
+    uint32_t     k;
+    munge_err_t  e;
+
+    assert (m != NULL);
+    assert (psrc != NULL);
+    assert (m->batch == NULL);
+
+    if (!_unpack (&(m->batch_type), psrc, sizeof (m->batch_type), last)) {
+        return (EMUNGE_SNAFU);
+    }
+    if (!_msg_batch_type_is_valid (m->type, m->batch_type)) {
+        return (EMUNGE_SNAFU);
+    }
+    if (!_unpack (&(m->batch_len), psrc, sizeof (m->batch_len), last)) {
+        return (EMUNGE_SNAFU);
+    }
+    /*  Bound the count by the remaining length before allocating anything
+     *    since each batched message requires at least its length prefix.
+     */
+    if (m->batch_len > ((unsigned char *) last - (unsigned char *) *psrc)
+            / sizeof (k)) {
+        m->batch_len = 0;
+        return (EMUNGE_SNAFU);
+    }
+    if (m->batch_len == 0) {
+        return (EMUNGE_SUCCESS);
+    }
+    if (!(m->batch = calloc (m->batch_len, sizeof (*m->batch)))) {
+        m->batch_len = 0;
+        return (EMUNGE_NO_MEMORY);
+    }
+    for (i = 0; i < m->batch_len; i++) {
+        if (!_unpack (&k, psrc, sizeof (k), last)) {
+            return (EMUNGE_SNAFU);
+        }
+        if (k > (unsigned char *) last - (unsigned char *) *psrc) {
+            return (EMUNGE_SNAFU);
+        }
+        if ((e = m_msg_create (&(m->batch[i]))) != EMUNGE_SUCCESS) {
+            return (e);
+        }
+        m->batch[i]->type = m->batch_type;
+        e = _msg_unpack (m->batch[i], m->batch_type, *psrc, k);
+        if (e != EMUNGE_SUCCESS) {
+            return (e);
+        }
+        *psrc = (unsigned char *) *psrc + k;
+    }
+    return (EMUNGE_SUCCESS);
+}
+
+
+static int
+_msg_batch_type_is_valid (m_msg_type_t type, m_msg_type_t btype)
+{
+/*  Returns non-zero if a batch message of type [type] may carry
+ *    messages of type [btype].
+ */
+    if (type == MUNGE_MSG_BATCH_REQ) {
+        return ((btype == MUNGE_MSG_ENC_REQ) || (btype == MUNGE_MSG_DEC_REQ));
+    }
+    if (type == MUNGE_MSG_BATCH_RSP) {
+        return ((btype == MUNGE_MSG_ENC_RSP) || (btype == MUNGE_MSG_DEC_RSP));
+    }
+    return (0);
+}
+
+
+static int
+_msg_is_ref (m_msg_t m)
+{
+/*  Returns non-zero if the unpacked message [m] references data within its
+ *    packed message body (ie, _msg_unpack() used _ref() for its type).
+ *  The credential of a decode request is referenced in place so munged can
+ *    decode it without first copying it out of the received packet.
+ */
+    if (m->type == MUNGE_MSG_DEC_REQ) {
+        return (1);
+    }
+    if ((m->type == MUNGE_MSG_BATCH_REQ)
+            && (m->batch_type == MUNGE_MSG_DEC_REQ)) {
+        return (1);
+    }
+    return (0);
+}
+
+
 static int
 _alloc (void **pdst, int len)
 {
@@ -796,6 +1118,34 @@ _copy (void *dst, void *src, int len,
 }
 
 
+static int
+_ref (void **pdst, void *src, int len, const void *last, void **pinc)
+{
+/*  Sets [pdst] to reference [len] bytes of data at [src] in place,
+ *    checking to ensure [len] bytes of data resides prior to [last].
+ *  Unlike _alloc() & _copy(), the data is not NUL-terminated.
+ *  Returns the number of bytes referenced, or -1 on error.
+ *    On success (ie, >= 0), the [inc] ptr is advanced by [len].
+ */
+    assert (pdst != NULL);
+    assert (*pdst == NULL);
+    assert (pinc != NULL);
+
+    if (len < 0) {
+        return (-1);
+    }
+    if (len == 0) {
+        return (0);
+    }
+    if ((unsigned char *) src + len > (unsigned char *) last) {
+        return (-1);
+    }
+    *pdst = src;
+    *pinc = (unsigned char *) *pinc + len;
+    return (len);
+}
+
+
 static int
 _pack (void **pdst, void *src, int len, const void *last)
 {
@@ -37,6 +37,7 @@
 #include <inttypes.h>
 #include <munge.h>
 #include <netinet/in.h>                 /* for struct in_addr                */
+#include <stddef.h>
 
 
 /*****************************************************************************
@@ -56,8 +57,16 @@
 /*  Current version of the munge client-server message format.
  *  This must be incremented whenever the client/server msg format changes;
  *    otherwise, the message may be parsed incorrectly when decoded.
+ *  Version 5 prefixes each message body with a request ID.  This allows a
+ *    client to keep its connection open and pipeline multiple requests, the
+ *    responses to which may be returned out of order.
  */
-#define MUNGE_MSG_VERSION               4
+#define MUNGE_MSG_VERSION               5
+
+/*  Oldest version of the munge client-server message format still supported.
+ *  Version 4 messages carry a single request per connection.
+ */
+#define MUNGE_MSG_VERSION_MIN           4
 
 
 /*****************************************************************************
@@ -71,15 +80,21 @@ enum m_msg_type {                       /* message type                      */
     MUNGE_MSG_ENC_RSP,                  /*  encode response message          */
     MUNGE_MSG_DEC_REQ,                  /*  decode request message           */
     MUNGE_MSG_DEC_RSP,                  /*  decode response message          */
-    MUNGE_MSG_AUTH_FD_REQ               /*  auth via fd request message      */
+    MUNGE_MSG_AUTH_FD_REQ,              /*  auth via fd request message      */
+    MUNGE_MSG_BATCH_REQ,                /*  batch of enc/dec request msgs    */
+    MUNGE_MSG_BATCH_RSP                 /*  batch of enc/dec response msgs   */
 };
 
 struct m_msg {
     int                sd;              /* munge socket descriptor           */
+    void              *conn;            /* persistent conn sharing sd if any */
+    uint8_t            version;         /* client-server msg format version  */
     uint8_t            type;            /* enum m_msg_type                   */
     uint8_t            retry;           /* retry count for this transaction  */
+    uint32_t           req_id;          /* request ID for pipelined requests */
     uint32_t           pkt_len;         /* length of msg pkt mem allocation  */
     void              *pkt;             /* ptr to msg for xfer over socket   */
+    void              *rcv_pkt;         /* recv'd msg pkt referenced by data */
     uint8_t            cipher;          /* munge_cipher_t enum               */
     uint8_t            mac;             /* munge_mac_t enum                  */
     uint8_t            zip;             /* munge_zip_t enum                  */
@@ -105,6 +120,9 @@ struct m_msg {
     uint8_t            error_num;       /* munge_err_t for encode/decode op  */
     uint8_t            error_len;       /* length of err msg str with NUL    */
     char              *error_str;       /* descriptive err msg str with NUL  */
+    uint8_t            batch_type;      /* m_msg_type of each batched msg    */
+    uint32_t           batch_len;       /* number of batched msgs            */
+    struct m_msg     **batch;           /* array of batched msgs             */
     unsigned           pkt_is_copy:1;   /* true if mem for pkt is a copy     */
     unsigned           realm_is_copy:1; /* true if mem for realm is a copy   */
     unsigned           data_is_copy:1;  /* true if mem for data is a copy    */
@@ -127,6 +145,8 @@ munge_err_t m_msg_create (m_msg_t *pm);
 
 void m_msg_destroy (m_msg_t m);
 
+void m_msg_set_allocator (void * (*alloc_f) (size_t), void (*free_f) (void *));
+
 void m_msg_reset (m_msg_t m);
 
 munge_err_t m_msg_bind (m_msg_t m, int sd);
@@ -135,6 +155,11 @@ munge_err_t m_msg_send (m_msg_t m, m_msg_type_t type, int maxlen);
 
 munge_err_t m_msg_recv (m_msg_t m, m_msg_type_t type, int maxlen);
 
+munge_err_t m_msg_recv_hdr (m_msg_t m, const void *hdr, m_msg_type_t type,
+    int maxlen);
+
+munge_err_t m_msg_recv_body (m_msg_t m);
+
 int m_msg_set_err (m_msg_t m, munge_err_t e, char *s);
 
 
@@ -89,6 +89,10 @@
  */
 #define MUNGE_MAXIMUM_BLK_LEN           16
 
+/*  Integer for the size (in bytes) of an AEAD cipher's authentication tag.
+ */
+#define MUNGE_AEAD_TAG_LEN              16
+
 /*  Integer for the maximum size (in bytes) of a cipher key.
  */
 #define MUNGE_MAXIMUM_KEY_LEN           32
@@ -119,6 +123,19 @@
  */
 #define MUNGE_GROUP_UPDATE_SECS         3600
 
+/*  Flag to denote whether "/etc/group" and "/etc/passwd" are watched for
+ *    changes (via inotify).  If set, a change to either file triggers an
+ *    update of the group information once the files have been quiescent for
+ *    MUNGE_GROUP_WATCH_MSECS, in addition to the periodic updates.
+ */
+#define MUNGE_GROUP_WATCH_FLAG          0
+
+/*  Integer for the number of milliseconds to wait after the last observed
+ *    change to "/etc/group" or "/etc/passwd" before updating group
+ *    information.  This coalesces a burst of changes into a single update.
+ */
+#define MUNGE_GROUP_WATCH_MSECS         2000
+
 /*  Integer for the number of seconds between purging the replay hash
  *    of expired credentials.
  */
@@ -178,13 +195,51 @@
 #define MUNGE_SOCKET_RETRY_MSECS        10
 
 /*  Number of milliseconds until a socket read/write is timed-out.
+ *  The server also closes a persistent client connection after it has been
+ *    idle for this long.
  */
 #define MUNGE_SOCKET_TIMEOUT_MSECS      2000
 
+/*  Number of seconds a client may leave a persistent connection to the server
+ *    idle before reconnecting instead of reusing it.  This must be less than
+ *    MUNGE_SOCKET_TIMEOUT_MSECS to avoid racing the server closing it.
+ */
+#define MUNGE_SOCKET_IDLE_SECS          1
+
+/*  Number of event loops to create for accepting client connections and
+ *    reading their requests.  Each loop has its own share of the threads
+ *    for processing credential requests.
+ */
+#define MUNGE_ACCEPT_LOOPS              1
+
+/*  Number of log messages that can be queued for writing by a background
+ *    thread instead of by the thread logging them.  Messages logged while the
+ *    queue is full are dropped (and counted).
+ *  If set to 0, log messages are written synchronously.
+ */
+#define MUNGE_LOG_QUEUE_LEN             0
+
 /*  Number of threads to create for processing credential requests.
  */
 #define MUNGE_THREADS                   2
 
+/*  Number of seconds an idle thread in excess of MUNGE_THREADS may wait for
+ *    a credential request before exiting when munged is allowed to start
+ *    additional threads (via --max-threads).
+ */
+#define MUNGE_THREADS_IDLE_SECS         60
+
+/*  Number of queued credential requests beyond which munged starts an
+ *    additional thread (up to --max-threads) if none are idle.
+ */
+#define MUNGE_THREADS_QUEUE_DEPTH       8
+
+/*  Number of milliseconds a credential request may wait in the queue before
+ *    munged starts an additional thread (up to --max-threads) if none
+ *    are idle.
+ */
+#define MUNGE_THREADS_QUEUE_MSECS       5
+
 /*  Flag to allow root to decode any credential regardless of its
  *    UID/GID restrictions.
  */
@@ -238,5 +293,10 @@
  */
 #define MUNGE_SEEDFILE_PATH             LOCALSTATEDIR "/lib/munge/munged.seed"
 
+/*  String specifying the pathname of the daemon's supplementary group map
+ *    snapshot file.
+ */
+#define MUNGE_GROUPMAPFILE_PATH         LOCALSTATEDIR "/lib/munge/munged.gidmap"
+
 
 #endif /* !MUNGE_DEFS_H */
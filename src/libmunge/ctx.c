@@ -36,6 +36,7 @@
 #include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include <munge.h>
 #include "ctx.h"
 #include "munge_defs.h"
@@ -64,6 +65,12 @@ munge_ctx_create (void)
     ctx->auth_uid = MUNGE_UID_ANY;
     ctx->auth_gid = MUNGE_GID_ANY;
     ctx->socket_str = strdup (MUNGE_SOCKET_NAME);
+    ctx->persist = 0;
+    ctx->sd = -1;
+    ctx->sd_pid = 0;
+    ctx->sd_time = 0;
+    ctx->req_id = 0;
+    ctx->msg_version = 0;
     ctx->error_num = EMUNGE_SUCCESS;
     ctx->error_str = NULL;
 
@@ -97,6 +104,10 @@ munge_ctx_copy (munge_ctx_t src)
     dst->realm_str = NULL;
     dst->socket_str = NULL;
     dst->error_str = NULL;
+    /*
+     *  A persistent connection is never shared between contexts.
+     */
+    dst->sd = -1;
     /*
      *  Reset the error condition.
      */
@@ -124,6 +135,8 @@ munge_ctx_destroy (munge_ctx_t ctx)
     if (!ctx) {
         return;
     }
+    _munge_ctx_disconnect (ctx);
+
     if (ctx->realm_str) {
         free (ctx->realm_str);
     }
@@ -219,6 +232,10 @@ munge_ctx_get (munge_ctx_t ctx, int opt, ...)
             p2gid = va_arg (vargs, gid_t *);
             *p2gid = ctx->auth_gid;
             break;
+        case MUNGE_OPT_PERSISTENT:
+            p2int = va_arg (vargs, int *);
+            *p2int = ctx->persist;
+            break;
         default:
             ctx->error_num = EMUNGE_BAD_ARG;
             break;
@@ -290,6 +307,8 @@ munge_ctx_set (munge_ctx_t ctx, int opt, ...)
                 free (ctx->socket_str);
             }
             ctx->socket_str = p;
+            _munge_ctx_disconnect (ctx);
+            ctx->msg_version = 0;
             break;
         case MUNGE_OPT_UID_RESTRICTION:
             ctx->auth_uid = va_arg (vargs, uid_t);
@@ -297,6 +316,12 @@ munge_ctx_set (munge_ctx_t ctx, int opt, ...)
         case MUNGE_OPT_GID_RESTRICTION:
             ctx->auth_gid = va_arg (vargs, gid_t);
             break;
+        case MUNGE_OPT_PERSISTENT:
+            ctx->persist = (va_arg (vargs, int) != 0);
+            if (!ctx->persist) {
+                _munge_ctx_disconnect (ctx);
+            }
+            break;
         case MUNGE_OPT_ADDR4:
             /* this option cannot be set; fall through to error case */
         case MUNGE_OPT_ENCODE_TIME:
@@ -341,3 +366,16 @@ _munge_ctx_set_err (munge_ctx_t ctx, munge_err_t e, char *s)
     }
     return (e);
 }
+
+
+void
+_munge_ctx_disconnect (munge_ctx_t ctx)
+{
+/*  Closes the persistent connection to the daemon (if any) held by [ctx].
+ */
+    if (ctx && (ctx->sd >= 0)) {
+        (void) close (ctx->sd);
+        ctx->sd = -1;
+    }
+    return;
+}
@@ -30,6 +30,7 @@
 #define MUNGE_CTX_H
 
 
+#include <inttypes.h>                   /* for uint32_t                      */
 #include <netinet/in.h>                 /* for struct in_addr                */
 #include <sys/types.h>                  /* for uid_t, gid_t                  */
 #include <time.h>                       /* for time_t                        */
@@ -52,6 +53,12 @@ struct munge_ctx {
     uid_t               auth_uid;       /* UID of client allowed to decode   */
     gid_t               auth_gid;       /* GID of client allowed to decode   */
     char               *socket_str;     /* munge domain sock filename w/ NUL */
+    int                 persist;        /* true to keep daemon conn open     */
+    int                 sd;             /* persistent daemon conn, or -1     */
+    pid_t               sd_pid;         /* PID of process that opened conn   */
+    time_t              sd_time;        /* time at which conn was last used  */
+    uint32_t            req_id;         /* ID of last pipelined request      */
+    int                 msg_version;    /* msg version for daemon, 0 if unk  */
     munge_err_t         error_num;      /* munge error status                */
     char               *error_str;      /* munge error string with NUL       */
 };
@@ -63,5 +70,7 @@ struct munge_ctx {
 
 munge_err_t _munge_ctx_set_err (munge_ctx_t ctx, munge_err_t e, char *s);
 
+void _munge_ctx_disconnect (munge_ctx_t ctx);
+
 
 #endif /* !MUNGE_CTX_H */
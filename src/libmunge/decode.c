@@ -56,6 +56,11 @@ static munge_err_t _decode_req (m_msg_t m, munge_ctx_t ctx,
 static munge_err_t _decode_rsp (m_msg_t m, munge_ctx_t ctx,
     void **buf, int *len, uid_t *uid, gid_t *gid);
 
+static munge_err_t _decode_batch_req (m_msg_t m, const char **creds, int n);
+
+static munge_err_t _decode_batch_rsp (m_msg_t m, munge_err_t *errs,
+    void **bufs, int *lens, uid_t *uids, gid_t *gids, int n);
+
 
 /*****************************************************************************
  *  Public Functions
@@ -100,6 +105,82 @@ munge_decode (const char *cred, munge_ctx_t ctx,
 }
 
 
+munge_err_t
+munge_decode_batch (int n, const char **creds, munge_err_t *errs,
+                    munge_ctx_t ctx, void **bufs, int *lens,
+                    uid_t *uids, gid_t *gids)
+{
+    munge_err_t  e;
+    m_msg_t      m = NULL;
+    int          i;
+
+    /*  Init output parms in case of early return.
+     */
+    _decode_init (ctx, NULL, NULL, NULL, NULL);
+    for (i = 0; i < n; i++) {
+        _decode_init (NULL,
+            (bufs != NULL) ? &bufs[i] : NULL,
+            (lens != NULL) ? &lens[i] : NULL,
+            (uids != NULL) ? &uids[i] : NULL,
+            (gids != NULL) ? &gids[i] : NULL);
+        if (errs) {
+            errs[i] = EMUNGE_SUCCESS;
+        }
+    }
+    /*  Ensure the credentials exist for decoding.
+     */
+    if (n < 0) {
+        return (_munge_ctx_set_err (ctx, EMUNGE_BAD_ARG,
+            strdupf ("Invalid number of credentials %d", n)));
+    }
+    if (!errs) {
+        return (_munge_ctx_set_err (ctx, EMUNGE_BAD_ARG,
+            strdup ("No address specified for returning the errors")));
+    }
+    for (i = 0; i < n; i++) {
+        if (!creds || (creds[i] == NULL) || (*creds[i] == '\0')) {
+            e = _munge_ctx_set_err (ctx, EMUNGE_BAD_ARG,
+                strdupf ("No credential specified at index %d", i));
+            for (i = 0; i < n; i++) {
+                errs[i] = EMUNGE_BAD_ARG;
+            }
+            return (e);
+        }
+    }
+    if (n == 0) {
+        return (EMUNGE_SUCCESS);
+    }
+    /*  Ask the daemon to decode all of the credentials in a single request.
+     */
+    if ((e = m_msg_create (&m)) != EMUNGE_SUCCESS)
+        ;
+    else if ((e = _decode_batch_req (m, creds, n)) != EMUNGE_SUCCESS)
+        ;
+    else if ((e = m_msg_client_xfer (&m, MUNGE_MSG_BATCH_REQ, ctx))
+            != EMUNGE_SUCCESS)
+        ;
+    if (e == EMUNGE_SUCCESS) {
+        e = _decode_batch_rsp (m, errs, bufs, lens, uids, gids, n);
+    }
+    else {
+        for (i = 0; i < n; i++) {
+            errs[i] = e;
+        }
+    }
+    /*  Clean up and return.
+     */
+    if (!m) {
+        return (_munge_ctx_set_err (ctx, e, NULL));
+    }
+    if (ctx) {
+        _munge_ctx_set_err (ctx, e, m->error_str);
+        m->error_is_copy = 1;
+    }
+    m_msg_destroy (m);
+    return (e);
+}
+
+
 /*****************************************************************************
  *  Private Functions
  *****************************************************************************/
@@ -217,3 +298,88 @@ _decode_rsp (m_msg_t m, munge_ctx_t ctx,
     }
     return (m->error_num);
 }
+
+
+static munge_err_t
+_decode_batch_req (m_msg_t m, const char **creds, int n)
+{
+/*  Creates a Batch Request message of [n] Decode Requests to be sent to the
+ *    local munge daemon.
+ */
+    munge_err_t  e;
+    int          i;
+
+    assert (m != NULL);
+    assert (creds != NULL);
+    assert (n > 0);
+
+    if (!(m->batch = calloc (n, sizeof (*m->batch)))) {
+        return (EMUNGE_NO_MEMORY);
+    }
+    m->batch_type = MUNGE_MSG_DEC_REQ;
+    m->batch_len = n;
+
+    for (i = 0; i < n; i++) {
+        if ((e = m_msg_create (&(m->batch[i]))) != EMUNGE_SUCCESS) {
+            return (e);
+        }
+        if ((e = _decode_req (m->batch[i], NULL, creds[i]))
+                != EMUNGE_SUCCESS) {
+            return (e);
+        }
+    }
+    return (EMUNGE_SUCCESS);
+}
+
+
+static munge_err_t
+_decode_batch_rsp (m_msg_t m, munge_err_t *errs,
+                   void **bufs, int *lens, uid_t *uids, gid_t *gids, int n)
+{
+/*  Extracts a Batch Response message of Decode Responses received from the
+ *    local munge daemon.
+ *  If the batch as a whole failed, every credential fails with it.
+ *  The error of the first credential that failed (if any) is set in [m]
+ *    so it will be reported by _munge_ctx_set_err() called from
+ *    munge_decode_batch() (ie, the parent of this stack frame).
+ */
+    int      i;
+    m_msg_t  mi;
+
+    assert (m != NULL);
+    assert (errs != NULL);
+
+    /*  Perform sanity checks.
+     */
+    if (m->type != MUNGE_MSG_BATCH_RSP) {
+        m_msg_set_err (m, EMUNGE_SNAFU,
+            strdupf ("Client received invalid message type %d", m->type));
+    }
+    else if ((m->error_num == EMUNGE_SUCCESS) &&
+            ((m->batch_type != MUNGE_MSG_DEC_RSP) || (m->batch_len != n))) {
+        m_msg_set_err (m, EMUNGE_SNAFU,
+            strdupf ("Client received invalid batch of %d message type %d",
+                m->batch_len, m->batch_type));
+    }
+    if (m->error_num != EMUNGE_SUCCESS) {
+        for (i = 0; i < n; i++) {
+            errs[i] = m->error_num;
+        }
+        return (m->error_num);
+    }
+    /*  Return the results to the caller.
+     */
+    for (i = 0; i < n; i++) {
+        mi = m->batch[i];
+        errs[i] = _decode_rsp (mi, NULL,
+            (bufs != NULL) ? &bufs[i] : NULL,
+            (lens != NULL) ? &lens[i] : NULL,
+            (uids != NULL) ? &uids[i] : NULL,
+            (gids != NULL) ? &gids[i] : NULL);
+        if (errs[i] != EMUNGE_SUCCESS) {
+            m_msg_set_err (m, errs[i],
+                (mi->error_str != NULL) ? strdup (mi->error_str) : NULL);
+        }
+    }
+    return (m->error_num);
+}
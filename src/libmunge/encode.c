@@ -53,6 +53,12 @@ static munge_err_t _encode_req (m_msg_t m, munge_ctx_t ctx,
 
 static munge_err_t _encode_rsp (m_msg_t m, char **cred);
 
+static munge_err_t _encode_batch_req (m_msg_t m, munge_ctx_t ctx,
+    const void **bufs, const int *lens, int n);
+
+static munge_err_t _encode_batch_rsp (m_msg_t m, char **creds,
+    munge_err_t *errs, int n);
+
 
 /*****************************************************************************
  *  Public Functions
@@ -96,6 +102,67 @@ munge_encode (char **cred, munge_ctx_t ctx, const void *buf, int len)
 }
 
 
+munge_err_t
+munge_encode_batch (int n, char **creds, munge_err_t *errs, munge_ctx_t ctx,
+                    const void **bufs, const int *lens)
+{
+    munge_err_t  e;
+    m_msg_t      m = NULL;
+    int          i;
+
+    /*  Init output parms in case of early return.
+     */
+    _encode_init (NULL, ctx);
+    if (creds && errs) {
+        for (i = 0; i < n; i++) {
+            creds[i] = NULL;
+            errs[i] = EMUNGE_SUCCESS;
+        }
+    }
+    /*  Ensure ptrs exist for returning the credentials to the caller.
+     */
+    if (n < 0) {
+        return (_munge_ctx_set_err (ctx, EMUNGE_BAD_ARG,
+            strdupf ("Invalid number of credentials %d", n)));
+    }
+    if (!creds || !errs) {
+        return (_munge_ctx_set_err (ctx, EMUNGE_BAD_ARG,
+            strdup ("No address specified for returning the credentials")));
+    }
+    if (n == 0) {
+        return (EMUNGE_SUCCESS);
+    }
+    /*  Ask the daemon to encode all of the credentials in a single request.
+     */
+    if ((e = m_msg_create (&m)) != EMUNGE_SUCCESS)
+        ;
+    else if ((e = _encode_batch_req (m, ctx, bufs, lens, n)) != EMUNGE_SUCCESS)
+        ;
+    else if ((e = m_msg_client_xfer (&m, MUNGE_MSG_BATCH_REQ, ctx))
+            != EMUNGE_SUCCESS)
+        ;
+    if (e == EMUNGE_SUCCESS) {
+        e = _encode_batch_rsp (m, creds, errs, n);
+    }
+    else {
+        for (i = 0; i < n; i++) {
+            errs[i] = e;
+        }
+    }
+    /*  Clean up and return.
+     */
+    if (!m) {
+        return (_munge_ctx_set_err (ctx, e, NULL));
+    }
+    if (ctx) {
+        _munge_ctx_set_err (ctx, e, m->error_str);
+        m->error_is_copy = 1;
+    }
+    m_msg_destroy (m);
+    return (e);
+}
+
+
 /*****************************************************************************
  *  Private Functions
  *****************************************************************************/
@@ -199,3 +266,91 @@ _encode_rsp (m_msg_t m, char **cred)
     m->data_is_copy = 1;
     return (m->error_num);
 }
+
+
+static munge_err_t
+_encode_batch_req (m_msg_t m, munge_ctx_t ctx,
+                   const void **bufs, const int *lens, int n)
+{
+/*  Creates a Batch Request message of [n] Encode Requests to be sent to the
+ *    local munge daemon.  Each is created with the same opts from [ctx].
+ */
+    munge_err_t  e;
+    int          i;
+
+    assert (m != NULL);
+    assert (n > 0);
+
+    if (!(m->batch = calloc (n, sizeof (*m->batch)))) {
+        return (EMUNGE_NO_MEMORY);
+    }
+    m->batch_type = MUNGE_MSG_ENC_REQ;
+    m->batch_len = n;
+
+    for (i = 0; i < n; i++) {
+        if ((e = m_msg_create (&(m->batch[i]))) != EMUNGE_SUCCESS) {
+            return (e);
+        }
+        e = _encode_req (m->batch[i], ctx,
+            (bufs != NULL) ? bufs[i] : NULL,
+            ((bufs != NULL) && (lens != NULL)) ? lens[i] : 0);
+        if (e != EMUNGE_SUCCESS) {
+            return (e);
+        }
+    }
+    return (EMUNGE_SUCCESS);
+}
+
+
+static munge_err_t
+_encode_batch_rsp (m_msg_t m, char **creds, munge_err_t *errs, int n)
+{
+/*  Extracts a Batch Response message of Encode Responses received from the
+ *    local munge daemon.
+ *  If the batch as a whole failed, every credential fails with it.
+ *  The error of the first credential that failed (if any) is set in [m]
+ *    so it will be reported by _munge_ctx_set_err() called from
+ *    munge_encode_batch() (ie, the parent of this stack frame).
+ */
+    int      i;
+    m_msg_t  mi;
+
+    assert (m != NULL);
+    assert (creds != NULL);
+    assert (errs != NULL);
+
+    /*  Perform sanity checks.
+     */
+    if (m->type != MUNGE_MSG_BATCH_RSP) {
+        m_msg_set_err (m, EMUNGE_SNAFU,
+            strdupf ("Client received invalid message type %d", m->type));
+    }
+    else if ((m->error_num == EMUNGE_SUCCESS) &&
+            ((m->batch_type != MUNGE_MSG_ENC_RSP) || (m->batch_len != n))) {
+        m_msg_set_err (m, EMUNGE_SNAFU,
+            strdupf ("Client received invalid batch of %d message type %d",
+                m->batch_len, m->batch_type));
+    }
+    if (m->error_num != EMUNGE_SUCCESS) {
+        for (i = 0; i < n; i++) {
+            errs[i] = m->error_num;
+        }
+        return (m->error_num);
+    }
+    /*  Return the credentials to the caller.
+     */
+    for (i = 0; i < n; i++) {
+        mi = m->batch[i];
+        if (mi->error_num != EMUNGE_SUCCESS) {
+            errs[i] = mi->error_num;
+        }
+        else {
+            errs[i] = _encode_rsp (mi, &creds[i]);
+        }
+        if (errs[i] != EMUNGE_SUCCESS) {
+            m_msg_set_err (m, errs[i],
+                (mi->error_str != NULL) ? strdup (mi->error_str) : NULL);
+        }
+    }
+    return (m->error_num);
+}
@@ -54,6 +54,27 @@
 #  define MUNGE_CIPHER_AES256_FLAG      0
 #endif
 
+#if (HAVE_LIBGCRYPT && HAVE_DECL_GCRY_CIPHER_MODE_GCM) || HAVE_EVP_AES_128_GCM
+#  define MUNGE_CIPHER_AES128_GCM_FLAG  1
+#else
+#  define MUNGE_CIPHER_AES128_GCM_FLAG  0
+#endif
+
+#if (HAVE_LIBGCRYPT && HAVE_DECL_GCRY_CIPHER_MODE_GCM) \
+        || (HAVE_EVP_AES_256_GCM && HAVE_EVP_SHA256)
+#  define MUNGE_CIPHER_AES256_GCM_FLAG  1
+#else
+#  define MUNGE_CIPHER_AES256_GCM_FLAG  0
+#endif
+
+#if (HAVE_LIBGCRYPT && HAVE_DECL_GCRY_CIPHER_MODE_POLY1305 \
+            && HAVE_DECL_GCRY_CIPHER_CHACHA20) \
+        || (HAVE_EVP_CHACHA20_POLY1305 && HAVE_EVP_SHA256)
+#  define MUNGE_CIPHER_CHACHA20_FLAG    1
+#else
+#  define MUNGE_CIPHER_CHACHA20_FLAG    0
+#endif
+
 #if HAVE_LIBGCRYPT || HAVE_EVP_SHA256
 #  define MUNGE_MAC_SHA256_FLAG         1
 #else
@@ -103,6 +124,11 @@ static struct munge_enum_table _munge_cipher_table[] = {
     { MUNGE_CIPHER_CAST5,       "cast5",        1                        },
     { MUNGE_CIPHER_AES128,      "aes128",       MUNGE_CIPHER_AES128_FLAG },
     { MUNGE_CIPHER_AES256,      "aes256",       MUNGE_CIPHER_AES256_FLAG },
+    { MUNGE_CIPHER_AES128_GCM,  "aes128-gcm",   MUNGE_CIPHER_AES128_GCM_FLAG },
+    { MUNGE_CIPHER_AES256_GCM,  "aes256-gcm",   MUNGE_CIPHER_AES256_GCM_FLAG },
+    { MUNGE_CIPHER_CHACHA20_POLY1305,
+                                "chacha20-poly1305",
+                                                MUNGE_CIPHER_CHACHA20_FLAG },
     { -1,                        NULL,         -1                        }
 };
 
@@ -32,6 +32,7 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <poll.h>
 #include <string.h>
 #include <sys/types.h>                  /* include before socket.h for bsd */
 #include <sys/socket.h>
@@ -53,8 +54,10 @@
  *  Prototypes
  *****************************************************************************/
 
+static int _m_msg_client_persist (m_msg_t m, munge_ctx_t ctx);
 static munge_err_t _m_msg_client_connect (m_msg_t m, char *path);
 static munge_err_t _m_msg_client_disconnect (m_msg_t m);
+static int _m_msg_client_is_rejected (m_msg_t m);
 static munge_err_t _m_msg_client_millisleep (m_msg_t m, unsigned long msecs);
 
 
@@ -67,6 +70,8 @@ m_msg_client_xfer (m_msg_t *pm, m_msg_type_t mreq_type, munge_ctx_t ctx)
 {
     char         *socket;
     int           i;
+    int           is_persistent;
+    int           is_rejected;
     munge_err_t   e;
     m_msg_t       mreq, mrsp;
     m_msg_type_t  mrsp_type;
@@ -85,13 +90,25 @@ m_msg_client_xfer (m_msg_t *pm, m_msg_type_t mreq_type, munge_ctx_t ctx)
     else if (mreq_type == MUNGE_MSG_DEC_REQ) {
         mrsp_type = MUNGE_MSG_DEC_RSP;
     }
+    else if (mreq_type == MUNGE_MSG_BATCH_REQ) {
+        mrsp_type = MUNGE_MSG_BATCH_RSP;
+    }
     else {
         return (EMUNGE_SNAFU);
     }
 
+    /*  A request ID is only used when pipelining requests over a persistent
+     *    connection.  It stays the same across retries.
+     */
+    if (ctx && ctx->persist) {
+        mreq->req_id = ++ctx->req_id;
+    }
     i = 1;
     while (1) {
-        if ((e = _m_msg_client_connect (mreq, socket)) != EMUNGE_SUCCESS) {
+        is_persistent = _m_msg_client_persist (mreq, ctx);
+
+        if ((mreq->sd < 0) &&
+                (e = _m_msg_client_connect (mreq, socket)) != EMUNGE_SUCCESS) {
             break;
         }
         else if ((e = m_msg_send (mreq, mreq_type, MUNGE_MAXIMUM_REQ_LEN))
@@ -110,6 +127,22 @@ m_msg_client_xfer (m_msg_t *pm, m_msg_type_t mreq_type, munge_ctx_t ctx)
         else if ((e = m_msg_recv (mrsp, mrsp_type, 0)) != EMUNGE_SUCCESS) {
             ; /* empty */
         }
+        else if (is_persistent && (mrsp->req_id != mreq->req_id)) {
+            (void) m_msg_set_err (mrsp, EMUNGE_SOCKET,
+                strdupf ("Received response for request %u: expected %u",
+                    mrsp->req_id, mreq->req_id));
+            e = EMUNGE_SOCKET;
+        }
+        else if (is_persistent) {
+            /*  Keep the connection open for the next request.
+             */
+            ctx->sd = mrsp->sd;
+            ctx->sd_pid = getpid ();
+            ctx->sd_time = time (NULL);
+            ctx->msg_version = mrsp->version;
+            mrsp->sd = -1;
+            break;
+        }
         else if ((e = _m_msg_client_disconnect (mrsp)) != EMUNGE_SUCCESS) {
             break;
         }
@@ -117,10 +150,24 @@ m_msg_client_xfer (m_msg_t *pm, m_msg_type_t mreq_type, munge_ctx_t ctx)
             break;
         }
 
-        if (i >= MUNGE_SOCKET_RETRY_ATTEMPTS) {
+        /*  If the server closes the connection without responding to the
+         *    first pipelined request, assume it predates persistent
+         *    connections (since it will have rejected the message version)
+         *    and fall back to one request per connection.  This is not
+         *    counted as a retry.  Other failures (e.g., a timeout) are
+         *    retried without changing the message version.
+         */
+        is_rejected = is_persistent && (ctx->msg_version == 0)
+            && (mrsp != NULL) && (e == EMUNGE_SOCKET)
+            && _m_msg_client_is_rejected (mrsp);
+
+        if (is_rejected) {
+            ctx->msg_version = MUNGE_MSG_VERSION_MIN;
+        }
+        else if (i >= MUNGE_SOCKET_RETRY_ATTEMPTS) {
             break;
         }
-        if (e == EMUNGE_BAD_LENGTH) {
+        else if (e == EMUNGE_BAD_LENGTH) {
             break;
         }
         if (mrsp != NULL) {
@@ -132,6 +179,9 @@ m_msg_client_xfer (m_msg_t *pm, m_msg_type_t mreq_type, munge_ctx_t ctx)
             (void) close (mreq->sd);
             mreq->sd = -1;
         }
+        if (is_rejected) {
+            continue;
+        }
         mreq->retry = i;
         e = _m_msg_client_millisleep (mreq, i * MUNGE_SOCKET_RETRY_MSECS);
         if (e != EMUNGE_SUCCESS) {
@@ -152,6 +202,68 @@ m_msg_client_xfer (m_msg_t *pm, m_msg_type_t mreq_type, munge_ctx_t ctx)
  *  Private Functions
  *****************************************************************************/
 
+static int
+_m_msg_client_persist (m_msg_t m, munge_ctx_t ctx)
+{
+/*  Prepares the request [m] for being sent over a persistent connection if
+ *    enabled for [ctx] and supported by the server, binding [m] to the
+ *    connection held by [ctx] if it can be reused.
+ *  Returns non-zero if [m] is to be sent over a persistent connection.
+ */
+    m_msg_version_t  version = MUNGE_MSG_VERSION_MIN;
+    struct pollfd    pfd;
+    time_t           now;
+    int              n;
+
+    assert (m != NULL);
+
+    /*  Persistent connections require the client identity to be obtained
+     *    from the socket itself; the fd-passing auth methods need their own
+     *    exchange over the socket for every request.
+     */
+#if !defined(AUTH_METHOD_RECVFD_MKFIFO) && !defined(AUTH_METHOD_RECVFD_MKNOD)
+    if (ctx && ctx->persist && (ctx->msg_version != MUNGE_MSG_VERSION_MIN)) {
+        version = MUNGE_MSG_VERSION;
+    }
+#endif /* !AUTH_METHOD_RECVFD_MKFIFO && !AUTH_METHOD_RECVFD_MKNOD */
+
+    /*  Force the message body to be repacked if the version has changed.
+     */
+    if (m->version != version) {
+        m->version = version;
+        m->type = MUNGE_MSG_UNDEF;
+    }
+    if (version == MUNGE_MSG_VERSION_MIN) {
+        return (0);
+    }
+    /*  Reuse the existing connection unless it was opened by another process
+     *    (i.e., before a fork), has been idle long enough that the server may
+     *    close it, or has pending input (e.g., the server already closed it).
+     */
+    if (ctx->sd >= 0) {
+        now = time (NULL);
+        pfd.fd = ctx->sd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        do {
+            n = poll (&pfd, 1, 0);
+        } while ((n < 0) && (errno == EINTR));
+
+        if ((ctx->sd_pid == getpid ())
+                && (now >= ctx->sd_time)
+                && (now - ctx->sd_time < MUNGE_SOCKET_IDLE_SECS)
+                && (n == 0)) {
+            m->sd = ctx->sd;
+            ctx->sd = -1;
+        }
+        else {
+            _munge_ctx_disconnect (ctx);
+        }
+    }
+    return (1);
+}
+
+
 static munge_err_t
 _m_msg_client_connect (m_msg_t m, char *path)
 {
@@ -185,6 +297,17 @@ _m_msg_client_connect (m_msg_t m, char *path)
             strdupf ("Failed to create socket: %s", strerror (errno)));
         return (EMUNGE_SOCKET);
     }
+    /*  A persistent connection is kept open across calls, so it must not be
+     *    inherited by a child that execs: the server only authenticates the
+     *    client identity once per connection.
+     */
+    if (fd_set_close_on_exec (sd) < 0) {
+        close (sd);
+        m_msg_set_err (m, EMUNGE_SOCKET,
+            strdupf ("Failed to set close-on-exec for socket: %s",
+            strerror (errno)));
+        return (EMUNGE_SOCKET);
+    }
     if (fd_set_nonblocking (sd) < 0) {
         close (sd);
         m_msg_set_err (m, EMUNGE_SOCKET,
@@ -262,6 +385,29 @@ _m_msg_client_disconnect (m_msg_t m) {
 }
 
 
+static int
+_m_msg_client_is_rejected (m_msg_t m)
+{
+/*  Checks whether the server closed the connection for [m] without sending a
+ *    response, as is the case when it rejects the message version.
+ *  Returns non-zero if the connection was closed by the server.
+ */
+    char    c;
+    ssize_t n;
+
+    assert (m != NULL);
+
+    if (m->sd < 0) {
+        return (0);
+    }
+    do {
+        n = recv (m->sd, &c, sizeof (c), MSG_PEEK | MSG_DONTWAIT);
+    } while ((n < 0) && (errno == EINTR));
+
+    return ((n == 0) || ((n < 0) && (errno == ECONNRESET)));
+}
+
+
 static munge_err_t
 _m_msg_client_millisleep (m_msg_t m, unsigned long msecs)
 {
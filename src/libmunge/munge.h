@@ -68,7 +68,8 @@ typedef enum munge_opt {
     MUNGE_OPT_DECODE_TIME       =  7,   /* time when cred decoded (time_t)   */
     MUNGE_OPT_SOCKET            =  8,   /* socket for comm w/ daemon (str)   */
     MUNGE_OPT_UID_RESTRICTION   =  9,   /* UID able to decode cred (uid_t)   */
-    MUNGE_OPT_GID_RESTRICTION   = 10    /* GID able to decode cred (gid_t)   */
+    MUNGE_OPT_GID_RESTRICTION   = 10,   /* GID able to decode cred (gid_t)   */
+    MUNGE_OPT_PERSISTENT        = 11    /* keep daemon conn open (int)       */
 } munge_opt_t;
 
 /*  MUNGE symmetric cipher types
@@ -80,6 +81,9 @@ typedef enum munge_cipher {
     MUNGE_CIPHER_CAST5          =  3,   /* CAST5 CBC w/ 64b-blk/128b-key     */
     MUNGE_CIPHER_AES128         =  4,   /* AES CBC w/ 128b-blk/128b-key      */
     MUNGE_CIPHER_AES256         =  5,   /* AES CBC w/ 128b-blk/256b-key      */
+    MUNGE_CIPHER_AES128_GCM     =  6,   /* AES GCM w/ 128b-key (AEAD)        */
+    MUNGE_CIPHER_AES256_GCM     =  7,   /* AES GCM w/ 256b-key (AEAD)        */
+    MUNGE_CIPHER_CHACHA20_POLY1305 = 8, /* ChaCha20-Poly1305 w/ 256b-key     */
     MUNGE_CIPHER_LAST_ITEM
 } munge_cipher_t;
 
@@ -207,6 +211,43 @@ munge_err_t munge_decode (const char *cred, munge_ctx_t ctx,
  *    more detailed error message accessible via munge_ctx_strerror().
  */
 
+munge_err_t munge_encode_batch (int n, char **creds, munge_err_t *errs,
+                                munge_ctx_t ctx,
+                                const void **bufs, const int *lens);
+/*
+ *  Creates [n] credentials with a single request to the daemon.
+ *    If [bufs] is not NULL, the i-th credential encapsulates the payload
+ *    specified by the buffer [bufs[i]] of length [lens[i]].
+ *  Each credential is created according to the munge context [ctx] as
+ *    with munge_encode().
+ *  A pointer to the i-th credential is returned via [creds[i]], and its
+ *    munge error number via [errs[i]]; the caller is responsible for
+ *    freeing the memory of each credential that is not NULL.
+ *  Returns EMUNGE_SUCCESS if all credentials are successfully created;
+ *    o/w, returns the munge error number of the first credential that
+ *    failed.  If a [ctx] was specified, it may contain a more detailed
+ *    error message for that credential accessible via munge_ctx_strerror().
+ */
+
+munge_err_t munge_decode_batch (int n, const char **creds, munge_err_t *errs,
+                                munge_ctx_t ctx, void **bufs, int *lens,
+                                uid_t *uids, gid_t *gids);
+/*
+ *  Validates the [n] NUL-terminated credentials [creds] with a single request
+ *    to the daemon.
+ *  The munge error number of the i-th credential is returned via [errs[i]].
+ *  If [bufs] and [lens], or [uids], or [gids] are not NULL, the payload,
+ *    UID, and GID of the i-th credential are returned via the i-th element
+ *    of each array as with munge_decode().  The caller is responsible for
+ *    freeing the memory of each payload that is not NULL.
+ *  Unlike munge_decode(), the munge context [ctx] is not set to that used
+ *    to encode the credentials.
+ *  Returns EMUNGE_SUCCESS if all credentials are valid; o/w, returns the
+ *    munge error number of the first credential that failed.  If a [ctx]
+ *    was specified, it may contain a more detailed error message for that
+ *    credential accessible via munge_ctx_strerror().
+ */
+
 const char * munge_strerror (munge_err_t e);
 /*
  *  Returns a descriptive string describing the munge errno [e].
@@ -66,7 +66,7 @@
  *  Command-Line Options
  *****************************************************************************/
 
-const char * const short_opts = ":hLVqc:Cm:Mz:Zedl:u:g:t:S:D:N:T:W:";
+const char * const short_opts = ":hLVqc:Cm:Mz:Zedl:u:g:t:S:PB:D:N:T:W:";
 
 #include <getopt.h>
 struct option long_opts[] = {
@@ -87,6 +87,8 @@ struct option long_opts[] = {
     { "restrict-gid", required_argument, NULL, 'g' },
     { "ttl",          required_argument, NULL, 't' },
     { "socket",       required_argument, NULL, 'S' },
+    { "persistent",   no_argument,       NULL, 'P' },
+    { "batch",        required_argument, NULL, 'B' },
     { "duration",     required_argument, NULL, 'D' },
     { "num-creds",    required_argument, NULL, 'N' },
     { "num-threads",  required_argument, NULL, 'T' },
@@ -110,6 +112,7 @@ struct conf {
     int             do_decode;          /* true to decode/validate all creds */
     char           *payload;            /* payload to be encoded into cred   */
     int             num_payload;        /* number of bytes for cred payload  */
+    int             num_batch;          /* number of creds per request       */
     int             max_threads;        /* max number of threads available   */
     int             num_threads;        /* number of threads to spawn        */
     int             num_running;        /* number of threads now running     */
@@ -165,6 +168,10 @@ void    start_threads (conf_t conf);
 void    process_creds (conf_t conf);
 void    stop_threads (conf_t conf);
 void *  remunge (conf_t conf);
+void    remunge_single (tdata_t tdata, unsigned long n,
+            unsigned long *got_encode_err, unsigned long *got_decode_err);
+void    remunge_batch (tdata_t tdata, unsigned long n, int k,
+            unsigned long *got_encode_err, unsigned long *got_decode_err);
 void    remunge_cleanup (tdata_t tdata);
 void    output_msg (const char *format, ...);
 
@@ -247,6 +254,7 @@ create_conf (void)
     conf->do_decode = DEF_DO_DECODE;
     conf->payload = NULL;
     conf->num_payload = DEF_PAYLOAD_LENGTH;;
+    conf->num_batch = 0;
     conf->num_threads = DEF_NUM_THREADS;
     conf->num_running = 0;
     conf->num_seconds = 0;
@@ -530,6 +538,29 @@ parse_cmdline (conf_t conf, int argc, char **argv)
                         munge_ctx_strerror (conf->ctx));
                 }
                 break;
+            case 'P':
+                e = munge_ctx_set (conf->ctx, MUNGE_OPT_PERSISTENT, 1);
+                if (e != EMUNGE_SUCCESS) {
+                    log_err (EMUNGE_SNAFU, LOG_ERR,
+                        "Failed to set persistent connection: %s",
+                        munge_ctx_strerror (conf->ctx));
+                }
+                break;
+            case 'B':
+                errno = 0;
+                l = strtol (optarg, &p, 10);
+                if ((optarg == p) || (*p != '\0') || (l <= 0)) {
+                    log_err (EMUNGE_SNAFU, LOG_ERR,
+                        "Invalid number of credentials per request '%s'",
+                        optarg);
+                }
+                if (((errno == ERANGE) && (l == LONG_MAX)) || (l > INT_MAX)) {
+                    log_err (EMUNGE_SNAFU, LOG_ERR,
+                        "Exceeded maximum number of %d credentials per request",
+                        INT_MAX);
+                }
+                conf->num_batch = (int) l;
+                break;
             case 'D':
                 errno = 0;
                 l = strtol (optarg, &p, 10);
@@ -738,6 +769,12 @@ display_help (char *prog)
     printf ("  %*s %s\n", w, "-S, --socket=STRING",
             "Specify local domain socket for munged");
 
+    printf ("  %*s %s\n", w, "-P, --persistent",
+            "Reuse connection to munged for each thread");
+
+    printf ("  %*s %s\n", w, "-B, --batch=INTEGER",
+            "Specify number of credentials per request");
+
     printf ("\n");
 
     printf ("  %*s %s\n", w, "-D, --duration=INTEGER",
@@ -1077,17 +1114,9 @@ remunge (conf_t conf)
     tdata_t         tdata;
     int             cancel_state;
     unsigned long   n;
+    int             k;
     unsigned long   got_encode_err;
     unsigned long   got_decode_err;
-    struct timeval  t_start;
-    struct timeval  t_stop;
-    double          delta;
-    munge_err_t     e;
-    char           *cred;
-    void           *data;
-    int             dlen;
-    uid_t           uid;
-    gid_t           gid;
 
     tdata = create_tdata (conf);
 
@@ -1105,45 +1134,91 @@ remunge (conf_t conf)
             log_errno (EMUNGE_SNAFU, LOG_ERR,
                 "Failed to disable thread cancellation");
         }
-        n = ++conf->shared.num_creds_done;
+        k = 1;
+        if (conf->num_batch > 1) {
+            k = (conf->num_creds - conf->shared.num_creds_done
+                    < (unsigned long) conf->num_batch)
+                ? (int) (conf->num_creds - conf->shared.num_creds_done)
+                : conf->num_batch;
+        }
+        n = conf->shared.num_creds_done + 1;
+        conf->shared.num_creds_done += k;
 
         if ((errno = pthread_mutex_unlock (&conf->mutex)) != 0) {
             log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to unlock mutex");
         }
         got_encode_err = 0;
         got_decode_err = 0;
-        data = NULL;
+
+        if (conf->num_batch > 0) {
+            remunge_batch (tdata, n, k, &got_encode_err, &got_decode_err);
+        }
+        else {
+            remunge_single (tdata, n, &got_encode_err, &got_decode_err);
+        }
+        if ((errno = pthread_setcancelstate
+                    (cancel_state, &cancel_state)) != 0) {
+            log_errno (EMUNGE_SNAFU, LOG_ERR,
+                "Failed to enable thread cancellation");
+        }
+        if ((errno = pthread_mutex_lock (&conf->mutex)) != 0) {
+            log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to lock mutex");
+        }
+        conf->shared.num_encode_errs += got_encode_err;
+        conf->shared.num_decode_errs += got_decode_err;
+    }
+    pthread_cleanup_pop (1);
+    return (NULL);
+}
+
+
+void
+remunge_single (tdata_t tdata, unsigned long n,
+                unsigned long *got_encode_err, unsigned long *got_decode_err)
+{
+/*  Encodes/decodes credential #[n] with a request for each operation.
+ */
+    conf_t          conf = tdata->conf;
+    struct timeval  t_start;
+    struct timeval  t_stop;
+    double          delta;
+    munge_err_t     e;
+    char           *cred;
+    void           *data = NULL;
+    int             dlen;
+    uid_t           uid;
+    gid_t           gid;
+
+    GET_TIMEVAL (t_start);
+    e = munge_encode(&cred, tdata->ectx, conf->payload, conf->num_payload);
+    GET_TIMEVAL (t_stop);
+
+    delta = DIFF_TIMEVAL (t_stop, t_start);
+    if (delta > conf->warn_time) {
+        output_msg ("Credential #%lu encoding took %0.3f seconds",
+            n, delta);
+    }
+    if (e != EMUNGE_SUCCESS) {
+        output_msg ("Credential #%lu encoding failed: %s (err=%d)",
+            n, munge_ctx_strerror (tdata->ectx), e);
+        ++*got_encode_err;
+    }
+    else if (conf->do_decode) {
 
         GET_TIMEVAL (t_start);
-        e = munge_encode(&cred, tdata->ectx, conf->payload, conf->num_payload);
+        e = munge_decode (cred, tdata->dctx, &data, &dlen, &uid, &gid);
         GET_TIMEVAL (t_stop);
 
         delta = DIFF_TIMEVAL (t_stop, t_start);
         if (delta > conf->warn_time) {
-            output_msg ("Credential #%lu encoding took %0.3f seconds",
+            output_msg ("Credential #%lu decoding took %0.3f seconds",
                 n, delta);
         }
         if (e != EMUNGE_SUCCESS) {
-            output_msg ("Credential #%lu encoding failed: %s (err=%d)",
-                n, munge_ctx_strerror (tdata->ectx), e);
-            ++got_encode_err;
+            output_msg ("Credential #%lu decoding failed: %s (err=%d)",
+                n, munge_ctx_strerror (tdata->dctx), e);
+            ++*got_decode_err;
         }
-        else if (conf->do_decode) {
-
-            GET_TIMEVAL (t_start);
-            e = munge_decode (cred, tdata->dctx, &data, &dlen, &uid, &gid);
-            GET_TIMEVAL (t_stop);
-
-            delta = DIFF_TIMEVAL (t_stop, t_start);
-            if (delta > conf->warn_time) {
-                output_msg ("Credential #%lu decoding took %0.3f seconds",
-                    n, delta);
-            }
-            if (e != EMUNGE_SUCCESS) {
-                output_msg ("Credential #%lu decoding failed: %s (err=%d)",
-                    n, munge_ctx_strerror (tdata->dctx), e);
-                ++got_decode_err;
-            }
 
 /*  FIXME:
  *    The following block does some validating of the decoded credential.
@@ -1157,53 +1232,121 @@ remunge (conf_t conf)
  *    into the tdata struct to facilitate parameter passing.
  */
 #if 0
-            else if (conf->do_validate) {
-                if (getuid () != uid) {
+        else if (conf->do_validate) {
+            if (getuid () != uid) {
+            output_msg (
+                "Credential #%lu UID %d does not match process UID %d",
+                n, uid, getuid ());
+            }
+            if (getgid () != gid) {
                 output_msg (
-                    "Credential #%lu UID %d does not match process UID %d",
-                    n, uid, getuid ());
-                }
-                if (getgid () != gid) {
-                    output_msg (
-                        "Credential #%lu GID %d does not match process GID %d",
-                        n, gid, getgid ());
-                }
-                if (conf->num_payload != dlen) {
-                    output_msg (
-                        "Credential #%lu payload length mismatch (%d/%d)",
-                        n, conf->num_payload, dlen);
-                }
-                else if (data && memcmp (conf->payload, data, dlen) != 0) {
-                    output_msg ("Credential #%lu payload mismatch", n);
-                }
+                    "Credential #%lu GID %d does not match process GID %d",
+                    n, gid, getgid ());
+            }
+            if (conf->num_payload != dlen) {
+                output_msg (
+                    "Credential #%lu payload length mismatch (%d/%d)",
+                    n, conf->num_payload, dlen);
             }
+            else if (data && memcmp (conf->payload, data, dlen) != 0) {
+                output_msg ("Credential #%lu payload mismatch", n);
+            }
+        }
 #endif /* 0 */
 
-            /*  The 'data' parm can still be set on certain munge errors.
-             */
-            if (data != NULL) {
-                free (data);
-            }
+        /*  The 'data' parm can still be set on certain munge errors.
+         */
+        if (data != NULL) {
+            free (data);
         }
-        if (cred != NULL) {
-            free (cred);
+    }
+    if (cred != NULL) {
+        free (cred);
+    }
+    return;
+}
+
+
+void
+remunge_batch (tdata_t tdata, unsigned long n, int k,
+               unsigned long *got_encode_err, unsigned long *got_decode_err)
+{
+/*  Encodes/decodes the [k] credentials starting at #[n] with a single
+ *    batch request for each operation.
+ */
+    conf_t          conf = tdata->conf;
+    struct timeval  t_start;
+    struct timeval  t_stop;
+    double          delta;
+    munge_err_t     e;
+    int             i;
+    char          **creds;
+    munge_err_t    *errs;
+    const void    **bufs;
+    int            *lens;
+    void          **data;
+
+    creds = calloc (k, sizeof (*creds));
+    errs = calloc (k, sizeof (*errs));
+    bufs = calloc (k, sizeof (*bufs));
+    lens = calloc (k, sizeof (*lens));
+    data = calloc (k, sizeof (*data));
+    if (!creds || !errs || !bufs || !lens || !data) {
+        log_errno (EMUNGE_NO_MEMORY, LOG_ERR,
+            "Failed to allocate batch of %d credentials", k);
+    }
+    for (i = 0; i < k; i++) {
+        bufs[i] = conf->payload;
+        lens[i] = conf->num_payload;
+    }
+    GET_TIMEVAL (t_start);
+    e = munge_encode_batch (k, creds, errs, tdata->ectx, bufs, lens);
+    GET_TIMEVAL (t_stop);
+
+    delta = DIFF_TIMEVAL (t_stop, t_start);
+    if (delta > conf->warn_time) {
+        output_msg ("Credentials #%lu-%lu encoding took %0.3f seconds",
+            n, n + k - 1, delta);
+    }
+    for (i = 0; (e != EMUNGE_SUCCESS) && (i < k); i++) {
+        if (errs[i] != EMUNGE_SUCCESS) {
+            output_msg ("Credential #%lu encoding failed: %s (err=%d)",
+                n + i, munge_strerror (errs[i]), errs[i]);
+            ++*got_encode_err;
         }
-        if ((errno = pthread_setcancelstate
-                    (cancel_state, &cancel_state)) != 0) {
-            log_errno (EMUNGE_SNAFU, LOG_ERR,
-                "Failed to enable thread cancellation");
+    }
+    if ((e == EMUNGE_SUCCESS) && conf->do_decode) {
+
+        GET_TIMEVAL (t_start);
+        e = munge_decode_batch (k, (const char **) creds, errs, tdata->dctx,
+            data, lens, NULL, NULL);
+        GET_TIMEVAL (t_stop);
+
+        delta = DIFF_TIMEVAL (t_stop, t_start);
+        if (delta > conf->warn_time) {
+            output_msg ("Credentials #%lu-%lu decoding took %0.3f seconds",
+                n, n + k - 1, delta);
         }
-        if ((errno = pthread_mutex_lock (&conf->mutex)) != 0) {
-            log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to lock mutex");
+        for (i = 0; (e != EMUNGE_SUCCESS) && (i < k); i++) {
+            if (errs[i] != EMUNGE_SUCCESS) {
+                output_msg ("Credential #%lu decoding failed: %s (err=%d)",
+                    n + i, munge_strerror (errs[i]), errs[i]);
+                ++*got_decode_err;
+            }
         }
-        conf->shared.num_encode_errs += got_encode_err;
-        conf->shared.num_decode_errs += got_decode_err;
     }
-    pthread_cleanup_pop (1);
-    return (NULL);
+    for (i = 0; i < k; i++) {
+        free (creds[i]);
+        free (data[i]);
+    }
+    free (creds);
+    free (errs);
+    free (bufs);
+    free (lens);
+    free (data);
+    return;
 }
 
-
 void
 remunge_cleanup (tdata_t tdata)
 {
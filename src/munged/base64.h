@@ -39,6 +39,13 @@
  *  Data Types
  *****************************************************************************/
 
+typedef enum {
+    BASE64_IMPL_AUTO,                   /* fastest impl supported by cpu     */
+    BASE64_IMPL_SCALAR,                 /* portable table-driven impl        */
+    BASE64_IMPL_SSSE3,                  /* x86 SSSE3 impl                    */
+    BASE64_IMPL_AVX2                    /* x86 AVX2 impl                     */
+} base64_impl_t;
+
 typedef struct {
     unsigned char       buf[3];
     int                 num;
@@ -54,6 +61,16 @@ typedef struct {
  *  Prototypes
  *****************************************************************************/
 
+int base64_set_impl (base64_impl_t impl);
+/*
+ *  Selects the implementation [impl] used for subsequent base64 encoding and
+ *    decoding.  By default, the fastest implementation supported by the cpu
+ *    is selected at runtime.  All implementations produce identical output.
+ *  This is intended for testing; it must not be called while other threads
+ *    are encoding or decoding.
+ *  Returns 0 on success, or -1 if [impl] is not supported on this system.
+ */
+
 int base64_init (base64_ctx *x);
 /*
  *  Initializes the base64 context [x] for base64 encoding/decoding of data.
@@ -115,6 +132,7 @@ int base64_decode_block (void *dst, int *dstlen, const void *src, int srclen);
 /*
  *  Base64-decodes [srclen] bytes from the contiguous [src] into [dst],
  *    and sets [dstlen] to the number of bytes written.
+ *  [dst] may be the same as [src] to decode in place.
  *  Returns 0 on success, or -1 on error.
  */
 
@@ -44,6 +44,9 @@ int encode_block (char *dst, int *dstlen, const void *src, int srclen);
 int encode_context (char *dst, int *dstlen, const void *src, int srclen);
 int decode_block (char *dst, int *dstlen, const void *src, int srclen);
 int decode_context (char *dst, int *dstlen, const void *src, int srclen);
+int cross_check_encode (base64_impl_t impl);
+int cross_check_decode (base64_impl_t impl);
+int cross_check_decode_invalid (base64_impl_t impl);
 
 
 int
@@ -57,7 +60,16 @@ main (int argc, char *argv[])
     const char dst2[] = "FPucA9k=";
     const char dst3[] = "FPucAw==";
 
-    plan (3);
+    const struct {
+        base64_impl_t impl;
+        const char *name;
+    } impls[] = {
+        { BASE64_IMPL_SSSE3, "ssse3" },
+        { BASE64_IMPL_AVX2,  "avx2"  },
+    };
+    int i;
+
+    plan (3 + (3 * (sizeof (impls) / sizeof (impls[0]))));
 
     ok (validate (dst1, src1, sizeof (src1)) == 0,
             "Input data 0x14fb9c03d97e");
@@ -68,6 +80,19 @@ main (int argc, char *argv[])
     ok (validate (dst3, src3, sizeof (src3)) == 0,
             "Input data 0x14fb9c03");
 
+    for (i = 0; i < sizeof (impls) / sizeof (impls[0]); i++) {
+        skip (base64_set_impl (impls[i].impl) < 0, 3,
+                "%s not supported", impls[i].name);
+        ok (cross_check_encode (impls[i].impl) == 0,
+                "%s encoding matches scalar", impls[i].name);
+        ok (cross_check_decode (impls[i].impl) == 0,
+                "%s decoding matches scalar", impls[i].name);
+        ok (cross_check_decode_invalid (impls[i].impl) == 0,
+                "%s decoding of invalid input matches scalar", impls[i].name);
+        end_skip;
+    }
+    base64_set_impl (BASE64_IMPL_AUTO);
+
     done_testing ();
 
     exit (EXIT_SUCCESS);
@@ -178,3 +203,171 @@ decode_context (char *dst, int *dstlen, const void *src, int srclen)
     *dstlen = n;
     return (0);
 }
+
+
+/*****************************************************************************
+ *  Cross-checks of the SIMD implementations against the scalar one
+ *    over a range of lengths and alignments.
+ *****************************************************************************/
+
+#define XCHECK_MAX_LEN  65536
+
+static unsigned char xsrc[XCHECK_MAX_LEN + 2];
+static char          xdst[2][((XCHECK_MAX_LEN + 2) / 3) * 4 + 1];
+static char          xbuf[2][XCHECK_MAX_LEN + 1];
+
+
+static int
+xcheck_len (int i)
+{
+/*  Returns the [i]th length to check, or -1 when done.
+ *  This covers every length up to 300 bytes, then a few large ones.
+ */
+    const int big[] = { 1021, 4096, 65535, XCHECK_MAX_LEN };
+
+    if (i <= 300)
+        return (i);
+    i -= 301;
+    if (i < sizeof (big) / sizeof (big[0]))
+        return (big[i]);
+    return (-1);
+}
+
+
+static void
+xcheck_fill (void)
+{
+    int i;
+
+    srand (1);
+    for (i = 0; i < sizeof (xsrc); i++)
+        xsrc[i] = rand () & 0xff;
+}
+
+
+static int
+encode_chunked (char *dst, int *dstlen, const void *src, int srclen, int chunk)
+{
+    base64_ctx x;
+    int n;
+    int m;
+    int len;
+    const unsigned char *p = src;
+
+    if (base64_init (&x) < 0)
+        return (-1);
+    for (n = 0; srclen > 0; p += len, srclen -= len) {
+        len = (srclen < chunk) ? srclen : chunk;
+        if (base64_encode_update (&x, dst + n, &m, p, len) < 0)
+            return (-1);
+        n += m;
+    }
+    if (base64_encode_final (&x, dst + n, &m) < 0)
+        return (-1);
+    if (base64_cleanup (&x) < 0)
+        return (-1);
+    *dstlen = n + m;
+    return (0);
+}
+
+
+int
+cross_check_encode (base64_impl_t impl)
+{
+    int i, len, k;
+    int n[2];
+    const int chunks[] = { 1, 7, 50, 100000 };
+
+    xcheck_fill ();
+    for (i = 0; (len = xcheck_len (i)) >= 0; i++) {
+        for (k = 0; k < 2; k++) {
+            base64_set_impl (k ? impl : BASE64_IMPL_SCALAR);
+            if (encode_block (xdst[k], &n[k], xsrc + (i % 3), len) < 0)
+                return (-1);
+        }
+        if ((n[0] != n[1]) || (memcmp (xdst[0], xdst[1], n[0] + 1) != 0)) {
+            diag ("encode block len=%d mismatch", len);
+            return (-1);
+        }
+        if (len > 1024)
+            continue;
+        for (k = 0; k < sizeof (chunks) / sizeof (chunks[0]); k++) {
+            base64_set_impl (impl);
+            if (encode_chunked (xdst[1], &n[1], xsrc + (i % 3), len,
+                    chunks[k]) < 0)
+                return (-1);
+            if ((n[0] != n[1]) || (memcmp (xdst[0], xdst[1], n[0]) != 0)) {
+                diag ("encode len=%d chunk=%d mismatch", len, chunks[k]);
+                return (-1);
+            }
+        }
+    }
+    return (0);
+}
+
+
+int
+cross_check_decode (base64_impl_t impl)
+{
+    int i, len, k;
+    int n, m[2];
+    int rc[2];
+
+    xcheck_fill ();
+    for (i = 0; (len = xcheck_len (i)) >= 0; i++) {
+        base64_set_impl (BASE64_IMPL_SCALAR);
+        if (encode_block (xdst[0], &n, xsrc, len) < 0)
+            return (-1);
+        for (k = 0; k < 2; k++) {
+            base64_set_impl (k ? impl : BASE64_IMPL_SCALAR);
+            rc[k] = decode_block (xbuf[k], &m[k], xdst[0], n);
+        }
+        if ((rc[0] != 0) || (rc[1] != 0) || (m[0] != len) || (m[1] != len)
+                || (memcmp (xbuf[0], xsrc, len) != 0)
+                || (memcmp (xbuf[1], xsrc, len) != 0)) {
+            diag ("decode len=%d mismatch", len);
+            return (-1);
+        }
+    }
+    return (0);
+}
+
+
+int
+cross_check_decode_invalid (base64_impl_t impl)
+{
+/*  Corrupts a single char of an encoded block with whitespace, padding,
+ *    or garbage at every position, and checks both implementations agree
+ *    on the result.
+ */
+    const char bad[] = { ' ', '\n', '=', '.', '\0', '\x80', '\xff' };
+    int len = 200;
+    int i, j, k;
+    int n, m[2];
+    int rc[2];
+    char c;
+
+    xcheck_fill ();
+    base64_set_impl (BASE64_IMPL_SCALAR);
+    if (encode_block (xdst[0], &n, xsrc, len) < 0)
+        return (-1);
+    for (i = 0; i < n; i++) {
+        for (j = 0; j < sizeof (bad); j++) {
+            c = xdst[0][i];
+            xdst[0][i] = bad[j];
+            for (k = 0; k < 2; k++) {
+                base64_set_impl (k ? impl : BASE64_IMPL_SCALAR);
+                memset (xbuf[k], 0, n);
+                rc[k] = decode_block (xbuf[k], &m[k], xdst[0], n);
+            }
+            xdst[0][i] = c;
+            if ((rc[0] != rc[1]) || (m[0] != m[1])
+                    || (memcmp (xbuf[0], xbuf[1], m[0]) != 0)) {
+                diag ("decode with 0x%02x at %d mismatch",
+                        (unsigned char) bad[j], i);
+                return (-1);
+            }
+        }
+    }
+    return (0);
+}
@@ -32,9 +32,14 @@
 
 #include <assert.h>
 #include <munge.h>
+#include <stdlib.h>
 #include <string.h>
 #include "cipher.h"
 
+#if WITH_PTHREADS
+#  include <pthread.h>
+#endif /* WITH_PTHREADS */
+
 
 /*****************************************************************************
  *  Constants
@@ -49,6 +54,20 @@
 
 static int _cipher_is_initialized = 0;
 
+/*  Per-thread cache of cipher contexts indexed by munge_cipher_t.
+ */
+typedef struct {
+    cipher_ctx          ctx [MUNGE_CIPHER_LAST_ITEM];
+    unsigned char       is_init [MUNGE_CIPHER_LAST_ITEM];
+    unsigned char       is_busy [MUNGE_CIPHER_LAST_ITEM];
+} cipher_cache_t;
+
+#if WITH_PTHREADS
+static pthread_once_t _cipher_cache_once = PTHREAD_ONCE_INIT;
+static pthread_key_t  _cipher_cache_key;
+static int            _cipher_cache_is_valid = 0;
+#endif /* WITH_PTHREADS */
+
 
 /*****************************************************************************
  *  Private Prototypes
@@ -59,9 +78,21 @@ static int _cipher_init (cipher_ctx *x, munge_cipher_t cipher,
     unsigned char *key, unsigned char *iv, int enc);
 static int _cipher_update (cipher_ctx *x, void *dst, int *dstlen,
     const void *src, int srclen);
+static int _cipher_update_aad (cipher_ctx *x, const void *src, int srclen);
 static int _cipher_final (cipher_ctx *x, void *dst, int *dstlen);
+static int _cipher_get_tag (cipher_ctx *x, void *tag, int taglen);
+static int _cipher_set_tag (cipher_ctx *x, const void *tag, int taglen);
 static int _cipher_cleanup (cipher_ctx *x);
+static int _cipher_reinit (cipher_ctx *x, munge_cipher_t cipher,
+    unsigned char *key, unsigned char *iv, int enc);
+static cipher_cache_t * _cipher_cache_get (void);
+#if WITH_PTHREADS
+static void _cipher_cache_create_key (void);
+static void _cipher_cache_destroy (void *arg);
+#endif /* WITH_PTHREADS */
 static int _cipher_block_size (munge_cipher_t cipher);
+static int _cipher_is_aead (munge_cipher_t cipher);
+static int _cipher_tag_size (munge_cipher_t cipher);
 static int _cipher_iv_size (munge_cipher_t cipher);
 static int _cipher_key_size (munge_cipher_t cipher);
 static int _cipher_map_enum (munge_cipher_t cipher, void *dst);
@@ -130,6 +161,25 @@ cipher_update (cipher_ctx *x, void *dst, int *dstlen,
 }
 
 
+int
+cipher_update_aad (cipher_ctx *x, const void *src, int srclen)
+{
+    int rc;
+
+    assert (_cipher_is_initialized);
+    assert (x != NULL);
+    assert (x->magic == CIPHER_MAGIC);
+    assert (x->finalized != 1);
+    assert (src != NULL);
+
+    if (srclen <= 0) {
+        return (0);
+    }
+    rc = _cipher_update_aad (x, src, srclen);
+    return (rc);
+}
+
+
 int
 cipher_final (cipher_ctx *x, void *dst, int *dstlen)
 {
@@ -151,6 +201,44 @@ cipher_final (cipher_ctx *x, void *dst, int *dstlen)
 }
 
 
+int
+cipher_get_tag (cipher_ctx *x, void *tag, int taglen)
+{
+    int rc;
+
+    assert (_cipher_is_initialized);
+    assert (x != NULL);
+    assert (x->magic == CIPHER_MAGIC);
+    assert (x->finalized == 1);
+    assert (tag != NULL);
+
+    if (taglen <= 0) {
+        return (-1);
+    }
+    rc = _cipher_get_tag (x, tag, taglen);
+    return (rc);
+}
+
+
+int
+cipher_set_tag (cipher_ctx *x, const void *tag, int taglen)
+{
+    int rc;
+
+    assert (_cipher_is_initialized);
+    assert (x != NULL);
+    assert (x->magic == CIPHER_MAGIC);
+    assert (x->finalized != 1);
+    assert (tag != NULL);
+
+    if (taglen <= 0) {
+        return (-1);
+    }
+    rc = _cipher_set_tag (x, tag, taglen);
+    return (rc);
+}
+
+
 int
 cipher_cleanup (cipher_ctx *x)
 {
@@ -167,6 +255,93 @@ cipher_cleanup (cipher_ctx *x)
 }
 
 
+int
+cipher_ctx_acquire (cipher_ctx **px, munge_cipher_t cipher,
+                    unsigned char *key, unsigned char *iv, int enc)
+{
+    cipher_cache_t *cache;
+    cipher_ctx     *x;
+    int             rc;
+
+    assert (_cipher_is_initialized);
+    assert (px != NULL);
+    assert (key != NULL);
+    assert (iv != NULL);
+    assert ((enc == 0) || (enc == 1));
+
+    *px = NULL;
+    if (_cipher_map_enum (cipher, NULL) < 0) {
+        return (-1);
+    }
+    cache = _cipher_cache_get ();
+
+    if ((cache != NULL) && (!cache->is_busy [cipher])) {
+        x = &(cache->ctx [cipher]);
+        if (cache->is_init [cipher]) {
+            rc = _cipher_reinit (x, cipher, key, iv, enc);
+        }
+        else {
+            rc = _cipher_init (x, cipher, key, iv, enc);
+        }
+        if (rc < 0) {
+            if (x->ctx != NULL) {
+                (void) _cipher_cleanup (x);
+            }
+            memset (x, 0, sizeof (*x));
+            cache->is_init [cipher] = 0;
+            return (-1);
+        }
+        cache->is_init [cipher] = 1;
+        cache->is_busy [cipher] = 1;
+    }
+    else {
+        if (!(x = malloc (sizeof (*x)))) {
+            return (-1);
+        }
+        memset (x, 0, sizeof (*x));
+        if (_cipher_init (x, cipher, key, iv, enc) < 0) {
+            if (x->ctx != NULL) {
+                (void) _cipher_cleanup (x);
+            }
+            free (x);
+            return (-1);
+        }
+    }
+    assert (x->magic = CIPHER_MAGIC);
+    assert (!(x->finalized = 0));
+    *px = x;
+    return (0);
+}
+
+
+int
+cipher_ctx_release (cipher_ctx *x)
+{
+    cipher_cache_t *cache;
+    int             i;
+    int             rc;
+
+    assert (_cipher_is_initialized);
+    assert (x != NULL);
+    assert (x->magic == CIPHER_MAGIC);
+
+    cache = _cipher_cache_get ();
+
+    if ((cache != NULL)
+            && (x >= &(cache->ctx [0]))
+            && (x < &(cache->ctx [MUNGE_CIPHER_LAST_ITEM]))) {
+        i = x - &(cache->ctx [0]);
+        assert (cache->is_busy [i]);
+        cache->is_busy [i] = 0;
+        return (0);
+    }
+    rc = _cipher_cleanup (x);
+    memset (x, 0, sizeof (*x));
+    free (x);
+    return (rc);
+}
+
+
 int
 cipher_block_size (munge_cipher_t cipher)
 {
@@ -175,6 +350,22 @@ cipher_block_size (munge_cipher_t cipher)
 }
 
 
+int
+cipher_is_aead (munge_cipher_t cipher)
+{
+    assert (_cipher_is_initialized);
+    return (_cipher_is_aead (cipher));
+}
+
+
+int
+cipher_tag_size (munge_cipher_t cipher)
+{
+    assert (_cipher_is_initialized);
+    return (_cipher_tag_size (cipher));
+}
+
+
 int
 cipher_iv_size (munge_cipher_t cipher)
 {
@@ -199,6 +390,73 @@ cipher_map_enum (munge_cipher_t cipher, void *dst)
 }
 
 
+/*****************************************************************************
+ *  Private Functions
+ *****************************************************************************/
+
+static cipher_cache_t *
+_cipher_cache_get (void)
+{
+/*  Returns a ptr to the calling thread's cipher context cache, or NULL if
+ *    the cache is unavailable.
+ */
+#if WITH_PTHREADS
+    cipher_cache_t *cache;
+
+    if (pthread_once (&_cipher_cache_once, _cipher_cache_create_key) != 0) {
+        return (NULL);
+    }
+    if (!_cipher_cache_is_valid) {
+        return (NULL);
+    }
+    cache = pthread_getspecific (_cipher_cache_key);
+    if (cache == NULL) {
+        if (!(cache = calloc (1, sizeof (*cache)))) {
+            return (NULL);
+        }
+        if (pthread_setspecific (_cipher_cache_key, cache) != 0) {
+            free (cache);
+            return (NULL);
+        }
+    }
+    return (cache);
+#else  /* !WITH_PTHREADS */
+    return (NULL);
+#endif /* !WITH_PTHREADS */
+}
+
+
+#if WITH_PTHREADS
+static void
+_cipher_cache_create_key (void)
+{
+    if (pthread_key_create (&_cipher_cache_key, _cipher_cache_destroy) == 0) {
+        _cipher_cache_is_valid = 1;
+    }
+    return;
+}
+
+
+static void
+_cipher_cache_destroy (void *arg)
+{
+/*  Destroys the cipher context cache [arg] when its thread exits.
+ */
+    cipher_cache_t *cache = arg;
+    int             i;
+
+    for (i = 0; i < MUNGE_CIPHER_LAST_ITEM; i++) {
+        if (cache->is_init [i]) {
+            (void) _cipher_cleanup (&(cache->ctx [i]));
+        }
+    }
+    memset (cache, 0, sizeof (*cache));
+    free (cache);
+    return;
+}
+#endif /* WITH_PTHREADS */
+
+
 /*****************************************************************************
  *  Private Functions (Libgcrypt)
  *****************************************************************************/
@@ -210,7 +468,12 @@ cipher_map_enum (munge_cipher_t cipher, void *dst)
 #include "common.h"
 #include "log.h"
 
+/*  Length (in bytes) of the nonce used by the AEAD cipher modes.
+ */
+#define CIPHER_AEAD_NONCE_LEN 12
+
 static int _cipher_map [MUNGE_CIPHER_LAST_ITEM];
+static int _cipher_mode [MUNGE_CIPHER_LAST_ITEM];
 
 static int _cipher_update_aux (cipher_ctx *x, void *dst, int *dstlen,
     const void *src, int srclen);
@@ -223,11 +486,25 @@ _cipher_init_subsystem (void)
 
     for (i = 0; i < MUNGE_CIPHER_LAST_ITEM; i++) {
         _cipher_map [i] = -1;
+        _cipher_mode [i] = GCRY_CIPHER_MODE_CBC;
     }
     _cipher_map [MUNGE_CIPHER_BLOWFISH] = GCRY_CIPHER_BLOWFISH;
     _cipher_map [MUNGE_CIPHER_CAST5] = GCRY_CIPHER_CAST5;
     _cipher_map [MUNGE_CIPHER_AES128] = GCRY_CIPHER_AES128;
     _cipher_map [MUNGE_CIPHER_AES256] = GCRY_CIPHER_AES256;
+
+#if HAVE_DECL_GCRY_CIPHER_MODE_GCM
+    _cipher_map [MUNGE_CIPHER_AES128_GCM] = GCRY_CIPHER_AES128;
+    _cipher_mode [MUNGE_CIPHER_AES128_GCM] = GCRY_CIPHER_MODE_GCM;
+    _cipher_map [MUNGE_CIPHER_AES256_GCM] = GCRY_CIPHER_AES256;
+    _cipher_mode [MUNGE_CIPHER_AES256_GCM] = GCRY_CIPHER_MODE_GCM;
+#endif /* HAVE_DECL_GCRY_CIPHER_MODE_GCM */
+
+#if HAVE_DECL_GCRY_CIPHER_MODE_POLY1305 && HAVE_DECL_GCRY_CIPHER_CHACHA20
+    _cipher_map [MUNGE_CIPHER_CHACHA20_POLY1305] = GCRY_CIPHER_CHACHA20;
+    _cipher_mode [MUNGE_CIPHER_CHACHA20_POLY1305] = GCRY_CIPHER_MODE_POLY1305;
+#endif /* HAVE_DECL_GCRY_CIPHER_MODE_POLY1305 && ... */
+
     return;
 }
 
@@ -243,7 +520,7 @@ _cipher_init (cipher_ctx *x, munge_cipher_t cipher,
     if (_cipher_map_enum (cipher, &algo) < 0) {
         return (-1);
     }
-    e = gcry_cipher_open (&(x->ctx), algo, GCRY_CIPHER_MODE_CBC, 0);
+    e = gcry_cipher_open (&(x->ctx), algo, _cipher_mode [cipher], 0);
     if (e != 0) {
         log_msg (LOG_DEBUG, "gcry_cipher_open failed for cipher=%d: %s",
             cipher, gcry_strerror (e));
@@ -269,15 +546,56 @@ _cipher_init (cipher_ctx *x, munge_cipher_t cipher,
             cipher, gcry_strerror (e));
         return (-1);
     }
-    e = gcry_cipher_setiv (x->ctx, iv, nbytes);
+    x->blklen = (int) nbytes;
+    x->is_aead = _cipher_is_aead (cipher);
+    e = gcry_cipher_setiv (x->ctx, iv, _cipher_iv_size (cipher));
     if (e != 0) {
         log_msg (LOG_DEBUG, "gcry_cipher_setiv failed for cipher=%d: %s",
             cipher, gcry_strerror (e));
         return (-1);
     }
     x->do_encrypt = enc;
+    x->is_updated = 0;
+    x->len = 0;
+    return (0);
+}
+
+
+static int
+_cipher_reinit (cipher_ctx *x, munge_cipher_t cipher,
+                unsigned char *key, unsigned char *iv, int enc)
+{
+    gcry_error_t  e;
+    int           algo;
+    size_t        nbytes;
+
+    if (_cipher_map_enum (cipher, &algo) < 0) {
+        return (-1);
+    }
+    gcry_cipher_reset (x->ctx);
+
+    e = gcry_cipher_algo_info (algo, GCRYCTL_GET_KEYLEN, NULL, &nbytes);
+    if (e != 0) {
+        log_msg (LOG_DEBUG,
+            "gcry_cipher_algo_info failed for cipher=%d key length: %s",
+            cipher, gcry_strerror (e));
+        return (-1);
+    }
+    e = gcry_cipher_setkey (x->ctx, key, nbytes);
+    if (e != 0) {
+        log_msg (LOG_DEBUG, "gcry_cipher_setkey failed for cipher=%d: %s",
+            cipher, gcry_strerror (e));
+        return (-1);
+    }
+    e = gcry_cipher_setiv (x->ctx, iv, _cipher_iv_size (cipher));
+    if (e != 0) {
+        log_msg (LOG_DEBUG, "gcry_cipher_setiv failed for cipher=%d: %s",
+            cipher, gcry_strerror (e));
+        return (-1);
+    }
+    x->do_encrypt = enc;
+    x->is_updated = 0;
     x->len = 0;
-    x->blklen = (int) nbytes;
     return (0);
 }
 
@@ -301,6 +619,22 @@ _cipher_update (cipher_ctx *x, void *vdst, int *dstlen,
     unsigned char *dst = vdst;
     unsigned char *src = (void *) vsrc;
 
+    /*  An AEAD cipher mode processes all of its data in one call since
+     *    Libgcrypt requires gcry_cipher_final() to precede the last one.
+     */
+    if (x->is_aead) {
+        if (x->is_updated || (*dstlen < srclen)) {
+            goto err;
+        }
+        gcry_cipher_final (x->ctx);
+        x->is_updated = 1;
+        n = srclen;
+        if (_cipher_update_aux (x, dst, &n, src, srclen) < 0) {
+            goto err;
+        }
+        *dstlen = n;
+        return (0);
+    }
     n_written = 0;
     /*
      *  Continue processing a partial block if one exists.
@@ -406,13 +740,54 @@ _cipher_update_aux (cipher_ctx *x, void *dst, int *dstlen_ptr,
 }
 
 
+static int
+_cipher_update_aad (cipher_ctx *x, const void *src, int srclen)
+{
+    gcry_error_t e;
+
+    if (!x->is_aead || x->is_updated) {
+        return (-1);
+    }
+    e = gcry_cipher_authenticate (x->ctx, src, srclen);
+    if (e != 0) {
+        log_msg (LOG_DEBUG, "gcry_cipher_authenticate failed: %s",
+            gcry_strerror (e));
+        return (-1);
+    }
+    return (0);
+}
+
+
 static int
 _cipher_final (cipher_ctx *x, void *dst, int *dstlen)
 {
-    int n;
-    int i;
-    int pad;
+    gcry_error_t e;
+    int          n;
+    int          i;
+    int          pad;
 
+    if (x->is_aead) {
+        /*  Process the (empty) data if cipher_update() was never called.
+         */
+        if (!x->is_updated) {
+            gcry_cipher_final (x->ctx);
+            x->is_updated = 1;
+            n = 0;
+            if (_cipher_update_aux (x, x->buf, &n, NULL, 0) < 0) {
+                return (-1);
+            }
+        }
+        if (!x->do_encrypt) {
+            e = gcry_cipher_checktag (x->ctx, x->buf, x->len);
+            if (e != 0) {
+                log_msg (LOG_DEBUG, "gcry_cipher_checktag failed: %s",
+                    gcry_strerror (e));
+                return (-1);
+            }
+        }
+        *dstlen = 0;
+        return (0);
+    }
     if (x->do_encrypt) {
         assert (x->len < x->blklen);
         pad = x->blklen - x->len;
@@ -470,6 +845,39 @@ _cipher_final (cipher_ctx *x, void *dst, int *dstlen)
 }
 
 
+static int
+_cipher_get_tag (cipher_ctx *x, void *tag, int taglen)
+{
+    gcry_error_t e;
+
+    if (!x->is_aead || !x->do_encrypt) {
+        return (-1);
+    }
+    e = gcry_cipher_gettag (x->ctx, tag, taglen);
+    if (e != 0) {
+        log_msg (LOG_DEBUG, "gcry_cipher_gettag failed: %s",
+            gcry_strerror (e));
+        return (-1);
+    }
+    return (0);
+}
+
+
+static int
+_cipher_set_tag (cipher_ctx *x, const void *tag, int taglen)
+{
+/*  The expected tag is saved in the partial block buffer (which is otherwise
+ *    unused by an AEAD cipher mode) until it is checked by _cipher_final().
+ */
+    if (!x->is_aead || x->do_encrypt || (taglen > sizeof (x->buf))) {
+        return (-1);
+    }
+    memcpy (x->buf, tag, taglen);
+    x->len = taglen;
+    return (0);
+}
+
+
 static int
 _cipher_cleanup (cipher_ctx *x)
 {
@@ -499,10 +907,37 @@ _cipher_block_size (munge_cipher_t cipher)
 }
 
 
+static int
+_cipher_is_aead (munge_cipher_t cipher)
+{
+    if (_cipher_map_enum (cipher, NULL) < 0) {
+        return (-1);
+    }
+    return (_cipher_mode [cipher] != GCRY_CIPHER_MODE_CBC);
+}
+
+
+static int
+_cipher_tag_size (munge_cipher_t cipher)
+{
+    int is_aead;
+
+    if ((is_aead = _cipher_is_aead (cipher)) < 0) {
+        return (-1);
+    }
+    return (is_aead ? MUNGE_AEAD_TAG_LEN : 0);
+}
+
+
 static int
 _cipher_iv_size (munge_cipher_t cipher)
 {
-    return (_cipher_block_size (cipher));
+    int is_aead;
+
+    if ((is_aead = _cipher_is_aead (cipher)) < 0) {
+        return (-1);
+    }
+    return (is_aead ? CIPHER_AEAD_NONCE_LEN : _cipher_block_size (cipher));
 }
 
 
@@ -556,6 +991,16 @@ _cipher_map_enum (munge_cipher_t cipher, void *dst)
 #include <openssl/crypto.h>
 #include <openssl/evp.h>
 
+/*  EVP_CTRL_AEAD_* supersedes EVP_CTRL_GCM_* as of OpenSSL 1.1.0.
+ */
+#if defined (EVP_CTRL_AEAD_SET_TAG)
+#  define CIPHER_CTRL_GET_TAG EVP_CTRL_AEAD_GET_TAG
+#  define CIPHER_CTRL_SET_TAG EVP_CTRL_AEAD_SET_TAG
+#elif defined (EVP_CTRL_GCM_SET_TAG)
+#  define CIPHER_CTRL_GET_TAG EVP_CTRL_GCM_GET_TAG
+#  define CIPHER_CTRL_SET_TAG EVP_CTRL_GCM_SET_TAG
+#endif /* EVP_CTRL_GCM_SET_TAG */
+
 static const EVP_CIPHER *_cipher_map [MUNGE_CIPHER_LAST_ITEM];
 
 
@@ -578,6 +1023,18 @@ _cipher_init_subsystem (void)
     _cipher_map [MUNGE_CIPHER_AES256] = EVP_aes_256_cbc ();
 #endif /* HAVE_EVP_AES_256_CBC && HAVE_EVP_SHA256 */
 
+#if HAVE_EVP_AES_128_GCM
+    _cipher_map [MUNGE_CIPHER_AES128_GCM] = EVP_aes_128_gcm ();
+#endif /* HAVE_EVP_AES_128_GCM */
+
+#if HAVE_EVP_AES_256_GCM && HAVE_EVP_SHA256
+    _cipher_map [MUNGE_CIPHER_AES256_GCM] = EVP_aes_256_gcm ();
+#endif /* HAVE_EVP_AES_256_GCM && HAVE_EVP_SHA256 */
+
+#if HAVE_EVP_CHACHA20_POLY1305 && HAVE_EVP_SHA256
+    _cipher_map [MUNGE_CIPHER_CHACHA20_POLY1305] = EVP_chacha20_poly1305 ();
+#endif /* HAVE_EVP_CHACHA20_POLY1305 && HAVE_EVP_SHA256 */
+
     return;
 }
 
@@ -633,6 +1090,39 @@ _cipher_init (cipher_ctx *x, munge_cipher_t cipher,
 }
 
 
+static int
+_cipher_reinit (cipher_ctx *x, munge_cipher_t cipher,
+                unsigned char *key, unsigned char *iv, int enc)
+{
+/*  Re-keys the context [x] previously initialized for [cipher].
+ */
+    assert (x != NULL);
+    assert (x->ctx != NULL);
+    assert (key != NULL);
+    assert (iv != NULL);
+    assert ((enc == 0) || (enc == 1));
+
+#if HAVE_EVP_CIPHERINIT_EX
+    /*  OpenSSL >= 0.9.7  */
+    /*  A NULL cipher retains the one previously set, along with any state
+     *    the library associates with it.
+     */
+    if (EVP_CipherInit_ex (x->ctx, NULL, NULL, key, iv, enc) != 1) {
+        return (-1);
+    }
+#else  /* !HAVE_EVP_CIPHERINIT_EX */
+    if (_cipher_cleanup (x) < 0) {
+        return (-1);
+    }
+    if (_cipher_init (x, cipher, key, iv, enc) < 0) {
+        return (-1);
+    }
+#endif /* !HAVE_EVP_CIPHERINIT_EX */
+
+    return (0);
+}
+
+
 static int
 _cipher_update (cipher_ctx *x, void *dst, int *dstlen,
                 const void *src, int srclen)
@@ -685,6 +1175,67 @@ _cipher_final (cipher_ctx *x, void *dst, int *dstlen)
 }
 
 
+static int
+_cipher_update_aad (cipher_ctx *x, const void *src, int srclen)
+{
+    int n;
+
+    assert (x != NULL);
+    assert (x->ctx != NULL);
+    assert (src != NULL);
+    assert (srclen >= 0);
+
+    /*  A NULL dst designates the src as additional authenticated data.
+     */
+#if HAVE_EVP_CIPHERUPDATE_RETURN_INT
+    if (EVP_CipherUpdate (x->ctx, NULL, &n, (void *) src, srclen) != 1) {
+        return (-1);
+    }
+#else  /* !HAVE_EVP_CIPHERUPDATE_RETURN_INT */
+    EVP_CipherUpdate (x->ctx, NULL, &n, (void *) src, srclen);
+#endif /* !HAVE_EVP_CIPHERUPDATE_RETURN_INT */
+
+    return (0);
+}
+
+
+static int
+_cipher_get_tag (cipher_ctx *x, void *tag, int taglen)
+{
+    assert (x != NULL);
+    assert (x->ctx != NULL);
+    assert (tag != NULL);
+
+#if defined (CIPHER_CTRL_GET_TAG)
+    if (EVP_CIPHER_CTX_ctrl (x->ctx, CIPHER_CTRL_GET_TAG, taglen, tag) != 1) {
+        return (-1);
+    }
+    return (0);
+#else  /* !CIPHER_CTRL_GET_TAG */
+    return (-1);
+#endif /* !CIPHER_CTRL_GET_TAG */
+}
+
+
+static int
+_cipher_set_tag (cipher_ctx *x, const void *tag, int taglen)
+{
+    assert (x != NULL);
+    assert (x->ctx != NULL);
+    assert (tag != NULL);
+
+#if defined (CIPHER_CTRL_SET_TAG)
+    if (EVP_CIPHER_CTX_ctrl (x->ctx, CIPHER_CTRL_SET_TAG, taglen,
+            (void *) tag) != 1) {
+        return (-1);
+    }
+    return (0);
+#else  /* !CIPHER_CTRL_SET_TAG */
+    return (-1);
+#endif /* !CIPHER_CTRL_SET_TAG */
+}
+
+
 static int
 _cipher_cleanup (cipher_ctx *x)
 {
@@ -726,6 +1277,35 @@ _cipher_block_size (munge_cipher_t cipher)
 }
 
 
+static int
+_cipher_is_aead (munge_cipher_t cipher)
+{
+    EVP_CIPHER *algo;
+
+    if (_cipher_map_enum (cipher, &algo) < 0) {
+        return (-1);
+    }
+#if defined (EVP_CIPH_FLAG_AEAD_CIPHER)
+    /*  OpenSSL >= 1.0.1  */
+    return ((EVP_CIPHER_flags (algo) & EVP_CIPH_FLAG_AEAD_CIPHER) ? 1 : 0);
+#else  /* !EVP_CIPH_FLAG_AEAD_CIPHER */
+    return (0);
+#endif /* !EVP_CIPH_FLAG_AEAD_CIPHER */
+}
+
+
+static int
+_cipher_tag_size (munge_cipher_t cipher)
+{
+    int is_aead;
+
+    if ((is_aead = _cipher_is_aead (cipher)) < 0) {
+        return (-1);
+    }
+    return (is_aead ? MUNGE_AEAD_TAG_LEN : 0);
+}
+
+
 static int
 _cipher_iv_size (munge_cipher_t cipher)
 {
@@ -49,6 +49,8 @@
 typedef struct {
     gcry_cipher_hd_t    ctx;
     int                 do_encrypt;
+    int                 is_aead;
+    int                 is_updated;
     int                 len;
     int                 blklen;
     unsigned char       buf [MUNGE_MAXIMUM_BLK_LEN];
@@ -109,10 +111,21 @@ int cipher_update (cipher_ctx *x, void *dst, int *dstlen,
  *    multiple times to process successive blocks of data.
  *  The number of bytes written will be from 0 to (srclen + cipher_block_size)
  *    depending on the cipher block alignment.
+ *  For an AEAD cipher, exactly [srclen] bytes will be written, but only
+ *    a single call is supported per initialization.
+ *  When decrypting, [dst] may be the same as [src] to decrypt in place.
  *  Returns 0 on success, or -1 on error; in addition, [dstlen] will be set
  *    to the number of bytes written to [dst].
  */
 
+int cipher_update_aad (cipher_ctx *x, const void *src, int srclen);
+/*
+ *  Updates the AEAD cipher context [x], reading [srclen] bytes of additional
+ *    data from [src] that is to be authenticated but not encrypted.
+ *  This must be called before cipher_update().
+ *  Returns 0 on success, or -1 on error.
+ */
+
 int cipher_final (cipher_ctx *x, void *dst, int *dstlen);
 /*
  *  Finalizes the cipher context [x], processing the "final" data
@@ -121,21 +134,72 @@ int cipher_final (cipher_ctx *x, void *dst, int *dstlen);
  *  The number of bytes written will be at most cipher_block_size() bytes
  *    depending on the cipher block alignment.
  *  After this function, no further calls to cipher_update() should be made.
+ *  For an AEAD cipher, no bytes are written; during decryption, this fails
+ *    if the authentication tag set via cipher_set_tag() does not match.
  *  Returns 0 on success, or -1 on error; in addition, [dstlen] will be set
  *    to the number of bytes written to [dst].
  */
 
+int cipher_get_tag (cipher_ctx *x, void *tag, int taglen);
+/*
+ *  Writes the authentication tag of [taglen] bytes computed by the AEAD
+ *    cipher context [x] into [tag].
+ *  This must be called after encryption has been finalized.
+ *  Returns 0 on success, or -1 on error.
+ */
+
+int cipher_set_tag (cipher_ctx *x, const void *tag, int taglen);
+/*
+ *  Sets the expected authentication tag of [taglen] bytes from [tag] for
+ *    the AEAD cipher context [x].
+ *  This must be called before decryption is finalized.
+ *  Returns 0 on success, or -1 on error.
+ */
+
 int cipher_cleanup (cipher_ctx *x);
 /*
  *  Clears the cipher context [x].
  *  Returns 0 on success, or -1 on error.
  */
 
+int cipher_ctx_acquire (cipher_ctx **px, munge_cipher_t cipher,
+                        unsigned char *key, unsigned char *iv, int enc);
+/*
+ *  Acquires a cipher context for [cipher] that is initialized with the
+ *    symmetric key [key] and initialization vector [iv], and sets [px]
+ *    to point to it.
+ *  The [enc] parm is set to 1 for encryption, and 0 for decryption.
+ *  Each thread caches one context per cipher that is re-keyed on each
+ *    acquisition instead of being created anew; if the cached context
+ *    is already in use by the calling thread, a new one is created instead.
+ *  The context must be returned via cipher_ctx_release() by the same thread
+ *    that acquired it.
+ *  Returns 0 on success, or -1 on error.
+ */
+
+int cipher_ctx_release (cipher_ctx *x);
+/*
+ *  Releases the cipher context [x] acquired via cipher_ctx_acquire().
+ *  Returns 0 on success, or -1 on error.
+ */
+
 int cipher_block_size (munge_cipher_t cipher);
 /*
  *  Returns the block size (in bytes) of the cipher [cipher], or -1 on error.
  */
 
+int cipher_is_aead (munge_cipher_t cipher);
+/*
+ *  Returns 1 if [cipher] is an authenticated encryption with associated data
+ *    (AEAD) cipher, 0 if it is not, or -1 on error.
+ */
+
+int cipher_tag_size (munge_cipher_t cipher);
+/*
+ *  Returns the authentication tag length (in bytes) of the cipher [cipher],
+ *    0 if the cipher is not an AEAD cipher, or -1 on error.
+ */
+
 int cipher_iv_size (munge_cipher_t cipher);
 /*
  *  Returns the initialization vector length (in bytes) of the cipher [cipher],
@@ -48,6 +48,7 @@
 #include "license.h"
 #include "lock.h"
 #include "log.h"
+#include "mac.h"
 #include "md.h"
 #include "missing.h"                    /* for inet_ntop() */
 #include "munge_defs.h"
@@ -77,7 +78,15 @@
 #define OPT_SEED_FILE           268
 #define OPT_TRUSTED_GROUP       269
 #define OPT_ORIGIN              270
-#define OPT_LAST                271
+#define OPT_MAX_THREADS         271
+#define OPT_THREAD_IDLE_TIME    272
+#define OPT_THREAD_QUEUE_DEPTH  273
+#define OPT_THREAD_QUEUE_WAIT   274
+#define OPT_NUM_ACCEPT_LOOPS    275
+#define OPT_GROUP_WATCH         276
+#define OPT_GROUP_MAP_FILE      277
+#define OPT_LOG_QUEUE_LEN       278
+#define OPT_LAST                279
 
 const char * const short_opts = ":hLVfFMsS:v";
 
@@ -99,15 +108,23 @@ struct option long_opts[] = {
 #endif /* AUTH_METHOD_RECVFD_MKFIFO || AUTH_METHOD_RECVFD_MKNOD */
     { "benchmark",         no_argument,       NULL, OPT_BENCHMARK     },
     { "group-check-mtime", required_argument, NULL, OPT_GROUP_CHECK   },
+    { "group-map-file",    required_argument, NULL, OPT_GROUP_MAP_FILE },
     { "group-update-time", required_argument, NULL, OPT_GROUP_UPDATE  },
+    { "group-watch",       required_argument, NULL, OPT_GROUP_WATCH   },
     { "key-file",          required_argument, NULL, OPT_KEY_FILE      },
     { "log-file",          required_argument, NULL, OPT_LOG_FILE      },
+    { "log-queue-len",     required_argument, NULL, OPT_LOG_QUEUE_LEN },
+    { "max-threads",       required_argument, NULL, OPT_MAX_THREADS   },
     { "max-ttl",           required_argument, NULL, OPT_MAX_TTL       },
+    { "num-accept-loops",  required_argument, NULL, OPT_NUM_ACCEPT_LOOPS },
     { "num-threads",       required_argument, NULL, OPT_NUM_THREADS   },
     { "origin",            required_argument, NULL, OPT_ORIGIN        },
     { "pid-file",          required_argument, NULL, OPT_PID_FILE      },
     { "seed-file",         required_argument, NULL, OPT_SEED_FILE     },
     { "syslog",            no_argument,       NULL, OPT_SYSLOG        },
+    { "thread-idle-time",  required_argument, NULL, OPT_THREAD_IDLE_TIME },
+    { "thread-queue-depth", required_argument, NULL, OPT_THREAD_QUEUE_DEPTH },
+    { "thread-queue-wait", required_argument, NULL, OPT_THREAD_QUEUE_WAIT },
     { "trusted-group",     required_argument, NULL, OPT_TRUSTED_GROUP },
     {  NULL,               0,                 NULL, 0                 }
 };
@@ -127,6 +144,11 @@ static void _conf_set_origin_addr (conf_t conf);
 
 static int _conf_open_keyfile (const char *keyfile, int got_force);
 
+static void _conf_create_hmacs (mac_ctx **hmacs,
+    const unsigned char *key, int keylen);
+
+static void _conf_destroy_hmacs (mac_ctx **hmacs);
+
 
 /*****************************************************************************
  *  Global Variables
@@ -153,6 +175,7 @@ create_conf (void)
     conf->got_force = 0;
     conf->got_foreground = 0;
     conf->got_group_stat = !! MUNGE_GROUP_STAT_FLAG;
+    conf->got_group_watch = !! MUNGE_GROUP_WATCH_FLAG;
     conf->got_stop = 0;
     conf->got_mlockall = 0;
     conf->got_root_auth = !! MUNGE_AUTH_ROOT_ALLOW_FLAG;
@@ -187,6 +210,10 @@ create_conf (void)
         log_errno (EMUNGE_NO_MEMORY, LOG_ERR,
             "Failed to copy seed name string");
     }
+    if (!(conf->group_map_name = strdup (MUNGE_GROUPMAPFILE_PATH))) {
+        log_errno (EMUNGE_NO_MEMORY, LOG_ERR,
+            "Failed to copy group map name string");
+    }
     if (!(conf->key_name = strdup (MUNGE_KEYFILE_PATH))) {
         log_errno (EMUNGE_NO_MEMORY, LOG_ERR,
             "Failed to copy key name string");
@@ -195,12 +222,20 @@ create_conf (void)
     conf->dek_key_len = 0;
     conf->mac_key = NULL;
     conf->mac_key_len = 0;
+    memset (conf->dek_hmac, 0, sizeof (conf->dek_hmac));
+    memset (conf->mac_hmac, 0, sizeof (conf->mac_hmac));
     conf->origin_name = NULL;
     conf->origin_ifname = NULL;
     memset (&conf->addr, 0, sizeof (conf->addr));
     conf->gids = NULL;
     conf->gids_update_secs = MUNGE_GROUP_UPDATE_SECS;
+    conf->naccept_loops = MUNGE_ACCEPT_LOOPS;
+    conf->log_queue_len = MUNGE_LOG_QUEUE_LEN;
     conf->nthreads = MUNGE_THREADS;
+    conf->nthreads_max = 0;
+    conf->threads_idle_secs = MUNGE_THREADS_IDLE_SECS;
+    conf->threads_queue_depth = MUNGE_THREADS_QUEUE_DEPTH;
+    conf->threads_queue_msecs = MUNGE_THREADS_QUEUE_MSECS;
     conf->auth_server_dir = NULL;
     conf->auth_client_dir = NULL;
     conf->auth_rnd_bytes = MUNGE_AUTH_RND_BYTES;
@@ -254,10 +289,16 @@ destroy_conf (conf_t conf, int do_unlink)
         free (conf->seed_name);
         conf->seed_name = NULL;
     }
+    if (conf->group_map_name) {
+        free (conf->group_map_name);
+        conf->group_map_name = NULL;
+    }
     if (conf->key_name) {
         free (conf->key_name);
         conf->key_name = NULL;
     }
+    _conf_destroy_hmacs (conf->dek_hmac);
+    _conf_destroy_hmacs (conf->mac_hmac);
     if (conf->dek_key) {
         memburn (conf->dek_key, 0, conf->dek_key_len);
         free (conf->dek_key);
@@ -378,6 +419,13 @@ parse_cmdline (conf_t conf, int argc, char **argv)
                 }
                 conf->got_group_stat = !! l;
                 break;
+            case OPT_GROUP_MAP_FILE:
+                if (conf->group_map_name)
+                    free (conf->group_map_name);
+                if (!(conf->group_map_name = strdup (optarg)))
+                    log_errno (EMUNGE_NO_MEMORY, LOG_ERR,
+                        "Failed to copy group-map-file name string");
+                break;
             case OPT_GROUP_UPDATE:
                 errno = 0;
                 l = strtol (optarg, &p, 10);
@@ -389,6 +437,16 @@ parse_cmdline (conf_t conf, int argc, char **argv)
                 }
                 conf->gids_update_secs = l;
                 break;
+            case OPT_GROUP_WATCH:
+                errno = 0;
+                l = strtol (optarg, &p, 10);
+                if (((errno == ERANGE) && ((l == LONG_MIN) || (l == LONG_MAX)))
+                        || (optarg == p) || (*p != '\0')) {
+                    log_err (EMUNGE_SNAFU, LOG_ERR,
+                        "Invalid value \"%s\" for group-watch", optarg);
+                }
+                conf->got_group_watch = !! l;
+                break;
             case OPT_KEY_FILE:
                 if (conf->key_name)
                     free (conf->key_name);
@@ -403,6 +461,28 @@ parse_cmdline (conf_t conf, int argc, char **argv)
                     log_errno (EMUNGE_NO_MEMORY, LOG_ERR,
                         "Failed to copy log-file name string");
                 break;
+            case OPT_LOG_QUEUE_LEN:
+                errno = 0;
+                l = strtol (optarg, &p, 10);
+                if (((errno == ERANGE) && ((l == LONG_MIN) || (l == LONG_MAX)))
+                        || (optarg == p) || (*p != '\0')
+                        || (l < 0) || (l > INT_MAX)) {
+                    log_err (EMUNGE_SNAFU, LOG_ERR,
+                        "Invalid value \"%s\" for log-queue-len", optarg);
+                }
+                conf->log_queue_len = l;
+                break;
+            case OPT_MAX_THREADS:
+                errno = 0;
+                l = strtol (optarg, &p, 10);
+                if (((errno == ERANGE) && ((l == LONG_MIN) || (l == LONG_MAX)))
+                        || (optarg == p) || (*p != '\0')
+                        || (l <= 0) || (l > INT_MAX)) {
+                    log_err (EMUNGE_SNAFU, LOG_ERR,
+                        "Invalid value \"%s\" for max-threads", optarg);
+                }
+                conf->nthreads_max = l;
+                break;
             case OPT_MAX_TTL:
                 l = strtol (optarg, &p, 10);
                 if (((errno == ERANGE) && ((l == LONG_MIN) || (l == LONG_MAX)))
@@ -413,6 +493,17 @@ parse_cmdline (conf_t conf, int argc, char **argv)
                 }
                 conf->max_ttl = l;
                 break;
+            case OPT_NUM_ACCEPT_LOOPS:
+                errno = 0;
+                l = strtol (optarg, &p, 10);
+                if (((errno == ERANGE) && ((l == LONG_MIN) || (l == LONG_MAX)))
+                        || (optarg == p) || (*p != '\0')
+                        || (l <= 0) || (l > INT_MAX)) {
+                    log_err (EMUNGE_SNAFU, LOG_ERR,
+                        "Invalid value \"%s\" for num-accept-loops", optarg);
+                }
+                conf->naccept_loops = l;
+                break;
             case OPT_NUM_THREADS:
                 errno = 0;
                 l = strtol (optarg, &p, 10);
@@ -448,6 +539,41 @@ parse_cmdline (conf_t conf, int argc, char **argv)
             case OPT_SYSLOG:
                 conf->got_syslog = 1;
                 break;
+            case OPT_THREAD_IDLE_TIME:
+                errno = 0;
+                l = strtol (optarg, &p, 10);
+                if (((errno == ERANGE) && ((l == LONG_MIN) || (l == LONG_MAX)))
+                        || (optarg == p) || (*p != '\0')
+                        || (l <= 0) || (l > INT_MAX)) {
+                    log_err (EMUNGE_SNAFU, LOG_ERR,
+                        "Invalid value \"%s\" for thread-idle-time", optarg);
+                }
+                conf->threads_idle_secs = l;
+                break;
+            case OPT_THREAD_QUEUE_DEPTH:
+                errno = 0;
+                l = strtol (optarg, &p, 10);
+                if (((errno == ERANGE) && ((l == LONG_MIN) || (l == LONG_MAX)))
+                        || (optarg == p) || (*p != '\0')
+                        || (l < 0) || (l > INT_MAX)) {
+                    log_err (EMUNGE_SNAFU, LOG_ERR,
+                        "Invalid value \"%s\" for thread-queue-depth",
+                        optarg);
+                }
+                conf->threads_queue_depth = l;
+                break;
+            case OPT_THREAD_QUEUE_WAIT:
+                errno = 0;
+                l = strtol (optarg, &p, 10);
+                if (((errno == ERANGE) && ((l == LONG_MIN) || (l == LONG_MAX)))
+                        || (optarg == p) || (*p != '\0')
+                        || (l < 0) || (l > INT_MAX)) {
+                    log_err (EMUNGE_SNAFU, LOG_ERR,
+                        "Invalid value \"%s\" for thread-queue-wait",
+                        optarg);
+                }
+                conf->threads_queue_msecs = l;
+                break;
             case OPT_TRUSTED_GROUP:
                 if (path_set_trusted_group (optarg) < 0) {
                     log_err (EMUNGE_SNAFU, LOG_ERR,
@@ -501,6 +627,20 @@ parse_cmdline (conf_t conf, int argc, char **argv)
         log_err (EMUNGE_SNAFU, LOG_ERR,
             "Unrecognized parameter \"%s\"", argv[optind]);
     }
+    if (conf->nthreads_max == 0) {
+        conf->nthreads_max = conf->nthreads;
+    }
+    else if (conf->nthreads_max < conf->nthreads) {
+        log_err (EMUNGE_SNAFU, LOG_ERR,
+            "Invalid value %d for max-threads: less than num-threads %d",
+            conf->nthreads_max, conf->nthreads);
+    }
+    if (conf->naccept_loops > conf->nthreads) {
+        log_err (EMUNGE_SNAFU, LOG_ERR,
+            "Invalid value %d for num-accept-loops: "
+            "greater than num-threads %d",
+            conf->naccept_loops, conf->nthreads);
+    }
 }
 
 
@@ -633,6 +773,10 @@ create_subkeys (conf_t conf)
     }
     assert (n <= conf->mac_key_len);
 
+    /*  Precompute the keyed HMAC state for each MAC algorithm.
+     */
+    _conf_create_hmacs (conf->dek_hmac, conf->dek_key, conf->dek_key_len);
+    _conf_create_hmacs (conf->mac_hmac, conf->mac_key, conf->mac_key_len);
     return;
 }
 
@@ -699,19 +843,37 @@ _conf_display_help (char *prog)
             w, "--group-check-mtime=BOOL", GIDS_GROUP_FILE,
             MUNGE_GROUP_STAT_FLAG);
 
+    printf ("  %*s %s [%s]\n", w, "--group-map-file=PATH",
+            "Specify group map snapshot file", MUNGE_GROUPMAPFILE_PATH);
+
     printf ("  %*s %s [%d]\n", w, "--group-update-time=INT",
             "Specify seconds between group info updates",
             MUNGE_GROUP_UPDATE_SECS);
 
+    printf ("  %*s Specify whether to watch \"%s\" for changes [%d]\n",
+            w, "--group-watch=BOOL", GIDS_GROUP_FILE,
+            MUNGE_GROUP_WATCH_FLAG);
+
     printf ("  %*s %s [%s]\n", w, "--key-file=PATH",
             "Specify key file", MUNGE_KEYFILE_PATH);
 
     printf ("  %*s %s [%s]\n", w, "--log-file=PATH",
             "Specify log file", MUNGE_LOGFILE_PATH);
 
+    printf ("  %*s %s [%d]\n", w, "--log-queue-len=INT",
+            "Specify number of log messages to queue for writing",
+            MUNGE_LOG_QUEUE_LEN);
+
+    printf ("  %*s %s [%s]\n", w, "--max-threads=INT",
+            "Specify max threads to spawn as load increases", "num-threads");
+
     printf ("  %*s %s [%d]\n", w, "--max-ttl=INT",
             "Specify maximum time-to-live (in seconds)", MUNGE_MAXIMUM_TTL);
 
+    printf ("  %*s %s [%d]\n", w, "--num-accept-loops=INT",
+            "Specify number of loops accepting connections",
+            MUNGE_ACCEPT_LOOPS);
+
     printf ("  %*s %s [%d]\n", w, "--num-threads=INT",
             "Specify number of threads to spawn", MUNGE_THREADS);
 
@@ -727,6 +889,18 @@ _conf_display_help (char *prog)
     printf ("  %*s %s\n", w, "--syslog",
             "Redirect log messages to syslog");
 
+    printf ("  %*s %s [%d]\n", w, "--thread-idle-time=INT",
+            "Specify seconds before an excess idle thread exits",
+            MUNGE_THREADS_IDLE_SECS);
+
+    printf ("  %*s %s [%d]\n", w, "--thread-queue-depth=INT",
+            "Specify queued requests before spawning a thread",
+            MUNGE_THREADS_QUEUE_DEPTH);
+
+    printf ("  %*s %s [%d]\n", w, "--thread-queue-wait=INT",
+            "Specify queue wait msecs before spawning a thread",
+            MUNGE_THREADS_QUEUE_MSECS);
+
     printf ("  %*s %s\n", w, "--trusted-group=GROUP",
             "Specify trusted group/GID for directory checks");
 
@@ -957,3 +1131,60 @@ _conf_open_keyfile (const char *keyfile, int got_force)
     }
     return (fd);
 }
+
+
+static void
+_conf_create_hmacs (mac_ctx **hmacs, const unsigned char *key, int keylen)
+{
+/*  Initializes an HMAC context keyed with [key] of [keylen] bytes for each
+ *    supported MAC algorithm, storing it in the [hmacs] array indexed by
+ *    munge_mac_t.  These contexts are never finalized; instead, they serve
+ *    as templates to be cloned via mac_copy() for each credential.
+ *  An algorithm whose context cannot be initialized is left NULL so that
+ *    credentials requesting it fail just as they would have with mac_init().
+ *  Any previously-created contexts in [hmacs] are destroyed first.
+ */
+    munge_mac_t md;
+
+    assert (hmacs != NULL);
+    assert (key != NULL);
+
+    _conf_destroy_hmacs (hmacs);
+
+    for (md = MUNGE_MAC_DEFAULT + 1; md < MUNGE_MAC_LAST_ITEM; md++) {
+        if (mac_map_enum (md, NULL) < 0) {
+            continue;
+        }
+        if (!(hmacs[md] = malloc (sizeof (mac_ctx)))) {
+            log_errno (EMUNGE_NO_MEMORY, LOG_ERR,
+                "Failed to allocate HMAC context for MAC=%d", md);
+        }
+        if (mac_init (hmacs[md], md, key, keylen) < 0) {
+            log_msg (LOG_INFO,
+                "Failed to initialize HMAC context for MAC=%d", md);
+            free (hmacs[md]);
+            hmacs[md] = NULL;
+        }
+    }
+    return;
+}
+
+
+static void
+_conf_destroy_hmacs (mac_ctx **hmacs)
+{
+/*  Destroys the keyed HMAC contexts in the [hmacs] array.
+ */
+    int i;
+
+    assert (hmacs != NULL);
+
+    for (i = 0; i < MUNGE_MAC_LAST_ITEM; i++) {
+        if (hmacs[i] != NULL) {
+            (void) mac_cleanup (hmacs[i]);
+            free (hmacs[i]);
+            hmacs[i] = NULL;
+        }
+    }
+    return;
+}
@@ -34,6 +34,7 @@
 #include <munge.h>
 #include <netinet/in.h>
 #include "gids.h"
+#include "mac.h"
 
 
 /*****************************************************************************
@@ -47,6 +48,7 @@ struct conf {
     unsigned        got_force:1;        /* flag for FORCE option             */
     unsigned        got_foreground:1;   /* flag for FOREGROUND option        */
     unsigned        got_group_stat:1;   /* flag for gids stat'ing /etc/group */
+    unsigned        got_group_watch:1;  /* flag for gids watching /etc/group */
     unsigned        got_stop:1;         /* flag for stopping daemon          */
     unsigned        got_mlockall:1;     /* flag for locking all memory pages */
     unsigned        got_root_auth:1;    /* flag if root can decode any cred  */
@@ -65,17 +67,26 @@ struct conf {
     char           *pidfile_name;       /* daemon pidfile name               */
     char           *socket_name;        /* unix domain socket filename       */
     char           *seed_name;          /* random seed filename              */
+    char           *group_map_name;     /* gids map snapshot filename        */
     char           *key_name;           /* symmetric key filename            */
     unsigned char  *dek_key;            /* subkey for cipher ops             */
     int             dek_key_len;        /* length of cipher subkey           */
     unsigned char  *mac_key;            /* subkey for mac ops                */
     int             mac_key_len;        /* length of mac subkey              */
+    mac_ctx        *dek_hmac [MUNGE_MAC_LAST_ITEM]; /* keyed w/ dek_key     */
+    mac_ctx        *mac_hmac [MUNGE_MAC_LAST_ITEM]; /* keyed w/ mac_key     */
     char           *origin_name;        /* origin addr hostname/IP string    */
     char           *origin_ifname;      /* origin addr n/w interface name    */
     struct in_addr  addr;               /* origin addr in n/w byte order     */
     gids_t          gids;               /* supplementary group information   */
     int             gids_update_secs;   /* gids update interval in seconds   */
+    int             naccept_loops;      /* num loops for accepting conns     */
+    int             log_queue_len;      /* num log msgs queued for writing   */
     int             nthreads;           /* num threads for processing creds  */
+    int             nthreads_max;       /* max threads when load increases   */
+    int             threads_idle_secs;  /* secs before excess thread exits   */
+    int             threads_queue_depth;/* queue depth to add a thread       */
+    int             threads_queue_msecs;/* queue wait msecs to add a thread  */
     char           *auth_server_dir;    /* dir in which to create auth pipe  */
     char           *auth_client_dir;    /* dir in which to create auth file  */
     int             auth_rnd_bytes;     /* num rnd bytes in auth pipe name   */
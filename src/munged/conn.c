@@ -0,0 +1,213 @@
+/*****************************************************************************
+ *  This file is part of the MUNGE Uid 'N' Gid Emporium (MUNGE).
+ *  For details, see <https://dun.github.io/munge/>.
+ *
+ *  MUNGE is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.  Additionally for the MUNGE library (libmunge), you
+ *  can redistribute it and/or modify it under the terms of the GNU Lesser
+ *  General Public License as published by the Free Software Foundation,
+ *  either version 3 of the License, or (at your option) any later version.
+ *
+ *  MUNGE is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  and GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  and GNU Lesser General Public License along with MUNGE.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *****************************************************************************
+ *  Refer to "conn.h" for documentation on public functions.
+ *****************************************************************************/
+
+
+#if HAVE_CONFIG_H
+#  include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <munge.h>
+#include "auth_recv.h"
+#include "conn.h"
+#include "log.h"
+#include "m_msg.h"
+
+
+/*****************************************************************************
+ *  Private Data Types
+ *****************************************************************************/
+
+struct conn {
+    pthread_mutex_t     mutex;          /* mutex for accessing struct        */
+    pthread_mutex_t     send_mutex;     /* mutex for serializing responses   */
+    int                 sd;             /* client socket descriptor          */
+    int                 refs;           /* number of references held         */
+    uid_t               uid;            /* UID of client process             */
+    gid_t               gid;            /* GID of client process             */
+    unsigned            got_auth:1;     /* true if UID/GID has been cached   */
+};
+
+
+/*****************************************************************************
+ *  Public Functions
+ *****************************************************************************/
+
+conn_p
+conn_create (int sd)
+{
+    conn_p cp;
+
+    if (sd < 0) {
+        errno = EINVAL;
+        return (NULL);
+    }
+    if (!(cp = malloc (sizeof (*cp)))) {
+        return (NULL);
+    }
+    if ((errno = pthread_mutex_init (&cp->mutex, NULL)) != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to init conn mutex");
+    }
+    if ((errno = pthread_mutex_init (&cp->send_mutex, NULL)) != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to init conn send mutex");
+    }
+    cp->sd = sd;
+    cp->refs = 1;
+    cp->got_auth = 0;
+    return (cp);
+}
+
+
+void
+conn_release (conn_p cp)
+{
+    int refs;
+
+    assert (cp != NULL);
+
+    if ((errno = pthread_mutex_lock (&cp->mutex)) != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to lock conn mutex");
+    }
+    assert (cp->refs > 0);
+    refs = --cp->refs;
+
+    if ((errno = pthread_mutex_unlock (&cp->mutex)) != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to unlock conn mutex");
+    }
+    if (refs > 0) {
+        return;
+    }
+    (void) close (cp->sd);
+    (void) pthread_mutex_destroy (&cp->send_mutex);
+    (void) pthread_mutex_destroy (&cp->mutex);
+    free (cp);
+    return;
+}
+
+
+void
+conn_attach (conn_p cp, m_msg_t m)
+{
+    assert (cp != NULL);
+    assert (m != NULL);
+    assert (m->conn == NULL);
+    assert (m->sd < 0);
+
+    if ((errno = pthread_mutex_lock (&cp->mutex)) != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to lock conn mutex");
+    }
+    cp->refs++;
+
+    if ((errno = pthread_mutex_unlock (&cp->mutex)) != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to unlock conn mutex");
+    }
+    m->conn = cp;
+    m->sd = cp->sd;
+    return;
+}
+
+
+void
+conn_detach (m_msg_t m)
+{
+    conn_p cp;
+
+    assert (m != NULL);
+
+    if ((cp = m->conn) == NULL) {
+        return;
+    }
+    /*  The socket belongs to the connection, so it must not be closed when
+     *    the request is destroyed.
+     */
+    m->conn = NULL;
+    m->sd = -1;
+    conn_release (cp);
+    return;
+}
+
+
+munge_err_t
+conn_send (m_msg_t m, m_msg_type_t type, int maxlen)
+{
+    conn_p      cp;
+    munge_err_t e;
+
+    assert (m != NULL);
+
+    if ((cp = m->conn) == NULL) {
+        return (m_msg_send (m, type, maxlen));
+    }
+    if ((errno = pthread_mutex_lock (&cp->send_mutex)) != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to lock conn send mutex");
+    }
+    e = m_msg_send (m, type, maxlen);
+
+    if ((errno = pthread_mutex_unlock (&cp->send_mutex)) != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to unlock conn send mutex");
+    }
+    return (e);
+}
+
+
+int
+conn_auth_recv (m_msg_t m, uid_t *uid, gid_t *gid)
+{
+/*  The client identity is obtained from the socket itself (e.g., via
+ *    SO_PEERCRED) and is fixed when the connection is established, so it
+ *    need only be determined once per connection.
+ *  Persistent connections are only negotiated by clients using such an
+ *    auth method since the fd-passing methods require their own exchange
+ *    over the socket for each request.
+ */
+    conn_p  cp;
+    int     rv;
+
+    assert (m != NULL);
+
+    if ((cp = m->conn) == NULL) {
+        return (auth_recv (m, uid, gid));
+    }
+    if ((errno = pthread_mutex_lock (&cp->mutex)) != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to lock conn mutex");
+    }
+    if (cp->got_auth) {
+        *uid = cp->uid;
+        *gid = cp->gid;
+        rv = 0;
+    }
+    else if ((rv = auth_recv (m, uid, gid)) == 0) {
+        cp->uid = *uid;
+        cp->gid = *gid;
+        cp->got_auth = 1;
+    }
+    if ((errno = pthread_mutex_unlock (&cp->mutex)) != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to unlock conn mutex");
+    }
+    return (rv);
+}
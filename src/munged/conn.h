@@ -0,0 +1,90 @@
+/*****************************************************************************
+ *  This file is part of the MUNGE Uid 'N' Gid Emporium (MUNGE).
+ *  For details, see <https://dun.github.io/munge/>.
+ *
+ *  MUNGE is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.  Additionally for the MUNGE library (libmunge), you
+ *  can redistribute it and/or modify it under the terms of the GNU Lesser
+ *  General Public License as published by the Free Software Foundation,
+ *  either version 3 of the License, or (at your option) any later version.
+ *
+ *  MUNGE is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  and GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  and GNU Lesser General Public License along with MUNGE.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+
+#ifndef MUNGE_CONN_H
+#define MUNGE_CONN_H
+
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <sys/types.h>
+#include "m_msg.h"
+
+
+/*****************************************************************************
+ *  Data Types
+ *****************************************************************************/
+
+typedef struct conn * conn_p;
+
+
+/*****************************************************************************
+ *  Functions
+ *****************************************************************************/
+
+conn_p conn_create (int sd);
+/*
+ *  Creates a persistent connection for the client socket [sd], taking
+ *    ownership of the socket.  The connection is shared by all pipelined
+ *    requests received on it, and the socket is closed once the last
+ *    reference to the connection is released.  The caller holds the
+ *    initial reference.
+ *  Returns a ptr to the new connection, or NULL on error (with errno set).
+ */
+
+void conn_release (conn_p cp);
+/*
+ *  Releases a reference to the connection [cp].
+ */
+
+void conn_attach (conn_p cp, m_msg_t m);
+/*
+ *  Attaches the received request [m] to the connection [cp], adding a
+ *    reference to the connection for the lifetime of the request.
+ */
+
+void conn_detach (m_msg_t m);
+/*
+ *  Detaches the request [m] from its connection (if any), releasing its
+ *    reference.  This must be called before [m] is destroyed.
+ */
+
+munge_err_t conn_send (m_msg_t m, m_msg_type_t type, int maxlen);
+/*
+ *  Sends the response [m] as per m_msg_send().  If [m] is attached to a
+ *    persistent connection, the send is serialized against responses to
+ *    other requests pipelined on that connection.
+ *  Returns a standard munge error code.
+ */
+
+int conn_auth_recv (m_msg_t m, uid_t *uid, gid_t *gid);
+/*
+ *  Receives the identity of the client that sent [m] as per auth_recv().
+ *    If [m] is attached to a persistent connection, the identity is only
+ *    determined for the first request and cached for subsequent ones.
+ */
+
+
+#endif /* !MUNGE_CONN_H */
@@ -31,25 +31,114 @@
 #endif /* HAVE_CONFIG_H */
 
 #include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include "cred.h"
+#include "log.h"
 #include "m_msg.h"
 #include "munge_defs.h"
+#include "slab.h"
 #include "str.h"
 
 
+/*****************************************************************************
+ *  Constants
+ *****************************************************************************/
+
+/*  Alignment (in bytes) of memory allocated by cred_alloc().
+ */
+#define CRED_ALLOC_ALIGN                8
+
+
+/*****************************************************************************
+ *  Data Types
+ *****************************************************************************/
+
+struct cred_block {
+    struct cred_block  *next;           /* next block in list                */
+    int                 len;            /* length of data                    */
+    unsigned char       data[];         /* block memory                      */
+};
+
+
+/*****************************************************************************
+ *  Static Variables
+ *****************************************************************************/
+
+static slab_t cred_slab = NULL;         /* cache of munge_cred structs       */
+static slab_t msg_slab = NULL;          /* cache of m_msg structs            */
+
+
+/*****************************************************************************
+ *  Static Prototypes
+ *****************************************************************************/
+
+static void * _msg_alloc (size_t size);
+
+static void _msg_free (void *ptr);
+
+
+/*****************************************************************************
+ *  Extern Functions
+ *****************************************************************************/
+
+void
+cred_init (void)
+{
+/*  Initializes the caches for credential and message structs.
+ *  Messages are allocated by the reactor threads and freed by the workers,
+ *    so they are cached in the same manner as credentials.
+ */
+    if (cred_slab != NULL) {
+        return;
+    }
+    if (!(cred_slab = slab_create (sizeof (struct munge_cred), 0, 0))) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to create cred cache");
+    }
+    if (!(msg_slab = slab_create (sizeof (struct m_msg), 0, 0))) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to create msg cache");
+    }
+    m_msg_set_allocator (_msg_alloc, _msg_free);
+    return;
+}
+
+
+void
+cred_fini (void)
+{
+/*  Destroys the caches for credential and message structs.
+ *  This must not be called until the worker threads have exited.
+ */
+    if (cred_slab == NULL) {
+        return;
+    }
+    m_msg_set_allocator (NULL, NULL);
+    slab_destroy (msg_slab);
+    msg_slab = NULL;
+    slab_destroy (cred_slab);
+    cred_slab = NULL;
+    return;
+}
+
+
 munge_cred_t
 cred_create (m_msg_t m)
 {
     munge_cred_t c;
 
     assert (m != NULL);
+    assert (cred_slab != NULL);
 
-    if (!(c = calloc (1, sizeof (*c)))) {
+    if (!(c = slab_alloc (cred_slab))) {
         m_msg_set_err (m, EMUNGE_NO_MEMORY, NULL);
         return (NULL);
     }
+    /*  Only clear the struct up to the arena; the arena is cleared as it
+     *    is allocated and burned in cred_destroy().
+     */
+    memset (c, 0, offsetof (struct munge_cred, arena));
     c->version = MUNGE_CRED_VERSION;
     c->msg = m;
     return (c);
@@ -59,25 +148,75 @@ cred_create (m_msg_t m)
 void
 cred_destroy (munge_cred_t c)
 {
+    struct cred_block *b;
+
     if (!c) {
         return;
     }
-    if (c->outer_mem) {
+    if (c->outer_mem && c->outer_mem_is_copy) {
         assert (c->outer_mem_len > 0);
         memset (c->outer_mem, 0, c->outer_mem_len);
-        free (c->outer_mem);
     }
-    if (c->inner_mem) {
-        assert (c->inner_mem_len > 0);
-        memset (c->inner_mem, 0, c->inner_mem_len);
-        free (c->inner_mem);
+    while ((b = c->blocks) != NULL) {
+        c->blocks = b->next;
+        memburn (b->data, 0, b->len);
+        free (b);
+    }
+    if (c->arena_used > 0) {
+        memburn (c->arena, 0, c->arena_used);
+    }
+    memburn (c, 0, offsetof (struct munge_cred, arena)); /* nuke the dek */
+    slab_free (cred_slab, c);
+    return;
+}
+
+
+void *
+cred_alloc (munge_cred_t c, int len)
+{
+/*  Returns a ptr to [len] bytes of uninitialized memory owned by cred [c],
+ *    or NULL if memory allocation fails.
+ *  This memory is burned and released by cred_destroy().
+ */
+    struct cred_block *b;
+    int                pad;
+    unsigned char     *p;
+
+    assert (c != NULL);
+    assert (len > 0);
+
+    p = c->arena + c->arena_used;
+    pad = (CRED_ALLOC_ALIGN - ((uintptr_t) p % CRED_ALLOC_ALIGN))
+        % CRED_ALLOC_ALIGN;
+    if (len <= MUNGE_CRED_ARENA_LEN - c->arena_used - pad) {
+        c->arena_used += pad + len;
+        return (p + pad);
     }
-    if (c->realm_mem) {
-        assert (c->realm_mem_len > 0);
-        memset (c->realm_mem, 0, c->realm_mem_len);
-        free (c->realm_mem);
+    if (!(b = malloc (sizeof (*b) + len))) {
+        return (NULL);
     }
-    memburn (c, 0, sizeof (*c));        /* nuke the msg dek */
-    free (c);
+    b->len = len;
+    b->next = c->blocks;
+    c->blocks = b;
+    return (b->data);
+}
+
+
+/*****************************************************************************
+ *  Static Functions
+ *****************************************************************************/
+
+static void *
+_msg_alloc (size_t size)
+{
+    assert (size == sizeof (struct m_msg));
+    return (slab_alloc (msg_slab));
+}
+
+
+static void
+_msg_free (void *ptr)
+{
+    slab_free (msg_slab, ptr);
     return;
 }
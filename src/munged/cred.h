@@ -44,11 +44,25 @@
  */
 #define MUNGE_CRED_VERSION              3
 
+/*  Version of the munge credential format for AEAD ciphers.
+ *  The "inner" data is encrypted and authenticated in a single pass with the
+ *    "outer" data as associated data.  The cipher's authentication tag takes
+ *    the place of the MAC, and the IV is the AEAD nonce.
+ */
+#define MUNGE_CRED_VERSION_AEAD         4
+
 #define MAX_DEK                         MUNGE_MAXIMUM_MD_LEN
 #define MAX_IV                          MUNGE_MAXIMUM_BLK_LEN
 #define MAX_MAC                         MUNGE_MAXIMUM_MD_LEN
 #define MAX_SALT                        MUNGE_CRED_SALT_LEN
 
+/*  Length of the per-credential memory arena (in bytes).
+ *  Credential buffers are carved from the arena; larger buffers overflow
+ *    into separately allocated blocks.  The arena is sized to hold the
+ *    buffers for a typical credential with a small payload.
+ */
+#define MUNGE_CRED_ARENA_LEN            2048
+
 
 /*****************************************************************************
  *  Data Types
@@ -61,21 +75,23 @@ struct munge_cred {
     unsigned char      *outer_mem;      /* outer cred memory allocation      */
     int                 outer_len;      /* length of outer credential data   */
     unsigned char      *outer;          /* ptr to outer credential data      */
-    int                 inner_mem_len;  /* length of inner credential memory */
-    unsigned char      *inner_mem;      /* inner cred memory allocation      */
     int                 inner_len;      /* length of inner credential data   */
     unsigned char      *inner;          /* ptr to inner credential data      */
-    int                 realm_mem_len;  /* length of realm string memory     */
-    unsigned char      *realm_mem;      /* realm string memory allocation    */
+    int                 work_len;       /* length of each inner work region  */
+    unsigned char      *work;           /* ptr to pair of inner work regions */
     int                 salt_len;       /* length of salt data               */
     unsigned char       salt[MAX_SALT]; /* cryptographic seasoning salt      */
-    int                 mac_len;        /* length of mac data                */
+    int                 mac_len;        /* length of mac data (or aead tag)  */
     unsigned char       mac[MAX_MAC];   /* message authentication code       */
     int                 dek_len;        /* length of dek data                */
     unsigned char       dek[MAX_DEK];   /* symmetric data encryption key     */
     int                 iv_len;         /* length of iv data                 */
     unsigned char       iv[MAX_IV];     /* initialization vector             */
     unsigned char      *outer_zip_ref;  /* ref to zip_t in outer cred memory */
+    unsigned            outer_mem_is_copy:1; /* true if mem is msg data */
+    struct cred_block  *blocks;         /* list of arena overflow blocks     */
+    int                 arena_used;     /* num bytes allocated from arena    */
+    unsigned char       arena[MUNGE_CRED_ARENA_LEN]; /* cred memory arena    */
 };
 
 typedef struct munge_cred * munge_cred_t;
@@ -85,9 +101,15 @@ typedef struct munge_cred * munge_cred_t;
  *  Extern Functions
  *****************************************************************************/
 
+void cred_init (void);
+
+void cred_fini (void);
+
 munge_cred_t cred_create (m_msg_t m);
 
 void cred_destroy (munge_cred_t c);
 
+void * cred_alloc (munge_cred_t c, int len);
+
 
 #endif /* !CRED_H */
@@ -38,10 +38,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
-#include "auth_recv.h"
 #include "base64.h"
 #include "cipher.h"
 #include "conf.h"
+#include "conn.h"
 #include "cred.h"
 #include "crypto.h"
 #include "dec.h"
@@ -60,10 +60,12 @@
  *  Static Prototypes
  *****************************************************************************/
 
+static int dec_process_cred (m_msg_t m, munge_cred_t *pc);
+static void dec_reset_msg (m_msg_t m);
 static int dec_validate_msg (m_msg_t m);
 static int dec_timestamp (munge_cred_t c);
-static int dec_authenticate (munge_cred_t c);
-static int dec_check_retry (munge_cred_t c);
+static int dec_authenticate (m_msg_t m);
+static int dec_check_retry (m_msg_t m);
 static int dec_unarmor (munge_cred_t c);
 static int dec_unpack_outer (munge_cred_t c);
 static int dec_decrypt (munge_cred_t c);
@@ -85,16 +87,122 @@ dec_process_msg (m_msg_t m)
     munge_cred_t c = NULL;              /* aux data for processing this cred */
     int          rc = -1;               /* return code                       */
 
+    if (dec_authenticate (m) < 0)
+        ;
+    else if (dec_check_retry (m) < 0)
+        ;
+    else if (dec_process_cred (m, &c) < 0)
+        ;
+    else /* success */
+        rc = 0;
+
+    if (rc != 0) {
+        dec_reset_msg (m);
+    }
+    /*  If the successfully decoded credential isn't successfully returned to
+     *    the client, remove it from the replay hash.
+     *
+     *  If two instances of the same credential are being decoded at the same
+     *    time, dec_validate_replay() will mark the "first" as successful, and
+     *    the "second" as replayed.  But if the successful response to the
+     *    "first" client fails, that credential will then be marked as
+     *    "unplayed", and the replayed reponse to the "second" client will now
+     *    be in error.
+     */
+    if (conn_send (m, MUNGE_MSG_DEC_RSP, 0) != EMUNGE_SUCCESS) {
+        if (rc == 0) {
+            replay_remove (c);
+        }
+        rc = -1;
+    }
+    cred_destroy (c);
+    return (rc);
+}
+
+
+int
+dec_process_batch (m_msg_t m)
+{
+    munge_cred_t *cs = NULL;            /* aux data for each batched cred    */
+    m_msg_t       mi;                   /* batched msg                       */
+    uint32_t      i;
+    int           rc = -1;              /* return code                       */
+
+    assert (m != NULL);
+    assert (m->type == MUNGE_MSG_BATCH_REQ);
+    assert (m->batch_type == MUNGE_MSG_DEC_REQ);
+
+    if ((m->batch_len > 0) && !(cs = calloc (m->batch_len, sizeof (*cs)))) {
+        (void) m_msg_set_err (m, EMUNGE_NO_MEMORY, NULL);
+    }
+    else if (dec_authenticate (m) < 0)
+        ;
+    else if (dec_check_retry (m) < 0)
+        ;
+    else /* success */
+        rc = 0;
+
+    /*  The client identity and retry count are determined once for the whole
+     *    batch.  Each credential succeeds or fails independently of the others.
+     */
+    for (i = 0; i < m->batch_len; i++) {
+        mi = m->batch[i];
+        if (rc == 0) {
+            mi->client_uid = m->client_uid;
+            mi->client_gid = m->client_gid;
+            mi->retry = m->retry;
+            if (dec_process_cred (mi, &cs[i]) == 0) {
+                continue;
+            }
+            dec_reset_msg (mi);
+        }
+        else {
+            m_msg_reset (mi);
+        }
+    }
+    /*  If the batch isn't successfully returned to the client, remove each
+     *    successfully decoded credential from the replay hash.
+     */
+    m->batch_type = MUNGE_MSG_DEC_RSP;
+    if (conn_send (m, MUNGE_MSG_BATCH_RSP, 0) != EMUNGE_SUCCESS) {
+        for (i = 0; (rc == 0) && (i < m->batch_len); i++) {
+            if (m->batch[i]->error_num == EMUNGE_SUCCESS) {
+                replay_remove (cs[i]);
+            }
+        }
+        rc = -1;
+    }
+    if (cs != NULL) {
+        for (i = 0; i < m->batch_len; i++) {
+            cred_destroy (cs[i]);
+        }
+        free (cs);
+    }
+    return (rc);
+}
+
+
+/*****************************************************************************
+ *  Static Functions
+ *****************************************************************************/
+
+static int
+dec_process_cred (m_msg_t m, munge_cred_t *pc)
+{
+/*  Decodes the credential in the request [m] from an authenticated client,
+ *    storing the aux data for processing it in [pc].
+ */
+    munge_cred_t c = NULL;              /* aux data for processing this cred */
+    int          rc = -1;               /* return code                       */
+
+    assert (pc != NULL);
+
     if (dec_validate_msg (m) < 0)
         ;
     else if (!(c = cred_create (m)))
         ;
     else if (dec_timestamp (c) < 0)
         ;
-    else if (dec_authenticate (c) < 0)
-        ;
-    else if (dec_check_retry (c) < 0)
-        ;
     else if (dec_unarmor (c) < 0)
         ;
     else if (dec_unpack_outer (c) < 0)
@@ -116,42 +224,28 @@ dec_process_msg (m_msg_t m)
     else /* success */
         rc = 0;
 
-    /*  Since the same m_msg struct is used for both the request and response,
-     *    the response message data must be sanitized for most errors.
-     *  The exception to this is for a credential that has been successfully
-     *    decoded but is invalid due to being expired, rewound, or replayed.
-     */
-    if ((rc != 0)
-            && (m->error_num != EMUNGE_CRED_EXPIRED)
+    *pc = c;
+    return (rc);
+}
+
+
+static void
+dec_reset_msg (m_msg_t m)
+{
+/*  Since the same m_msg struct is used for both the request and response,
+ *    the response message data must be sanitized for most errors.
+ *  The exception to this is for a credential that has been successfully
+ *    decoded but is invalid due to being expired, rewound, or replayed.
+ */
+    if ((m->error_num != EMUNGE_CRED_EXPIRED)
             && (m->error_num != EMUNGE_CRED_REWOUND)
             && (m->error_num != EMUNGE_CRED_REPLAYED) ) {
         m_msg_reset (m);
     }
-    /*  If the successfully decoded credential isn't successfully returned to
-     *    the client, remove it from the replay hash.
-     *
-     *  If two instances of the same credential are being decoded at the same
-     *    time, dec_validate_replay() will mark the "first" as successful, and
-     *    the "second" as replayed.  But if the successful response to the
-     *    "first" client fails, that credential will then be marked as
-     *    "unplayed", and the replayed reponse to the "second" client will now
-     *    be in error.
-     */
-    if (m_msg_send (m, MUNGE_MSG_DEC_RSP, 0) != EMUNGE_SUCCESS) {
-        if (rc == 0) {
-            replay_remove (c);
-        }
-        rc = -1;
-    }
-    cred_destroy (c);
-    return (rc);
+    return;
 }
 
 
-/*****************************************************************************
- *  Static Functions
- *****************************************************************************/
-
 static int
 dec_validate_msg (m_msg_t m)
 {
@@ -189,11 +283,10 @@ dec_timestamp (munge_cred_t c)
 
 
 static int
-dec_authenticate (munge_cred_t c)
+dec_authenticate (m_msg_t m)
 {
 /*  Ascertains the UID/GID of the client process.
  */
-    m_msg_t  m = c->msg;
     uid_t   *p_uid;
     gid_t   *p_gid;
 
@@ -202,7 +295,7 @@ dec_authenticate (munge_cred_t c)
 
     /*  Determine identity of client process.
      */
-    if (auth_recv (m, p_uid, p_gid) != EMUNGE_SUCCESS) {
+    if (conn_auth_recv (m, p_uid, p_gid) != EMUNGE_SUCCESS) {
         return (m_msg_set_err (m, EMUNGE_SNAFU,
             strdup ("Failed to determine client identity")));
     }
@@ -211,12 +304,10 @@ dec_authenticate (munge_cred_t c)
 
 
 static int
-dec_check_retry (munge_cred_t c)
+dec_check_retry (m_msg_t m)
 {
 /*  Checks whether the transaction is being retried.
  */
-    m_msg_t  m = c->msg;
-
     if (m->retry > 0) {
         log_msg (LOG_INFO,
             "Decode retry #%d for client UID=%u GID=%u", m->retry,
@@ -264,7 +355,8 @@ dec_unarmor (munge_cred_t c)
      *  The prefix specifies the start of the base64-encoded data.
      */
     if (prefix_len > 0) {
-        if (strncmp ((char *) base64_ptr, MUNGE_CRED_PREFIX, prefix_len)) {
+        if ((base64_len < prefix_len) ||
+                strncmp ((char *) base64_ptr, MUNGE_CRED_PREFIX, prefix_len)) {
             return (m_msg_set_err (m, EMUNGE_BAD_CRED,
                 strdup ("Failed to match armor prefix")));
         }
@@ -296,31 +388,34 @@ dec_unarmor (munge_cred_t c)
         }
         base64_len = base64_tmp - base64_ptr;
     }
-    /*  Allocate memory for unarmor'd data.
-     */
-    c->outer_mem_len = base64_decode_length (base64_len);
-    if (!(c->outer_mem = malloc (c->outer_mem_len))) {
-        return (m_msg_set_err (m, EMUNGE_NO_MEMORY, NULL));
-    }
-    /*  Base64-decode the chewy-internals of the credential.
-     */
-    if (base64_decode_block (c->outer_mem, &n, base64_ptr, base64_len) < 0) {
+    if (base64_len == 0) {
         return (m_msg_set_err (m, EMUNGE_BAD_CRED,
-            strdup ("Failed to base64-decode credential")));
+            strdup ("Truncated credential version")));
     }
-    assert (n < c->outer_mem_len);
-
-    /*  Now that the "request data" has been unarmored, it can be free()d.
+    /*  Take over the "request data" as the cred memory.
+     *  This may reside within the received message packet, in which case it
+     *    is only cleared by cred_destroy() and not free()d.
      */
-    free (m->data);
+    c->outer_mem = m->data;
+    c->outer_mem_len = m->data_len;
+    c->outer_mem_is_copy = m->data_is_copy;
     m->data = NULL;
     m->data_len = 0;
-    assert (m->data_is_copy == 0);
+    m->data_is_copy = 0;
+
+    /*  Base64-decode the chewy-internals of the credential in place.
+     *    The decoded data is always shorter than the base64 data it
+     *    overwrites, so no additional memory is needed.
+     */
+    if (base64_decode_block (base64_ptr, &n, base64_ptr, base64_len) < 0) {
+        return (m_msg_set_err (m, EMUNGE_BAD_CRED,
+            strdup ("Failed to base64-decode credential")));
+    }
 
     /*  Note outer_len is an upper bound which will be refined when unpacked.
      *  It currently includes OUTER + MAC + INNER.
      */
-    c->outer = c->outer_mem;
+    c->outer = base64_ptr;
     c->outer_len = n;
     return (0);
 }
@@ -345,6 +440,7 @@ dec_unpack_outer (munge_cred_t c)
     m_msg_t           m = c->msg;
     unsigned char    *p;                /* ptr into packed data              */
     int               len;              /* length of packed data remaining   */
+    char             *realm;            /* NUL-terminated realm string       */
     int               n;                /* all-purpose int                   */
 
     assert (c->outer != NULL);
@@ -355,10 +451,10 @@ dec_unpack_outer (munge_cred_t c)
     len = c->outer_len;
     /*
      *  Unpack the credential version.
-     *  Note that only one version (ie, the latest) of the credential format
-     *    is currently supported.  Support for multiple versions would
-     *    require a switch on the version number to invoke the appropriate
-     *    unpack routine, but it doesn't really seem worth the effort.
+     *  Note that only the latest version of the credential format is
+     *    supported, along with the AEAD version which shares its layout.
+     *    The AEAD version differs only in how the MAC and inner data are
+     *    interpreted, and it must be paired with an AEAD cipher.
      */
     n = sizeof (c->version);
     assert (n == 1);
@@ -367,7 +463,8 @@ dec_unpack_outer (munge_cred_t c)
             strdup ("Truncated credential version")));
     }
     c->version = *p;
-    if (c->version != MUNGE_CRED_VERSION) {
+    if ((c->version != MUNGE_CRED_VERSION)
+            && (c->version != MUNGE_CRED_VERSION_AEAD)) {
         return (m_msg_set_err (m, EMUNGE_BAD_VERSION,
             strdupf ("Invalid credential version %d", c->version)));
     }
@@ -391,6 +488,15 @@ dec_unpack_outer (munge_cred_t c)
             return (m_msg_set_err (m, EMUNGE_BAD_CIPHER,
                 strdupf ("Invalid cipher type %d", m->cipher)));
         }
+    }
+    if ((c->version == MUNGE_CRED_VERSION_AEAD) !=
+            ((m->cipher != MUNGE_CIPHER_NONE)
+                && (cipher_is_aead (m->cipher) > 0))) {
+        return (m_msg_set_err (m, EMUNGE_BAD_CIPHER,
+            strdupf ("Invalid cipher type %d for credential version %d",
+            m->cipher, c->version)));
+    }
+    if (m->cipher != MUNGE_CIPHER_NONE) {
         c->iv_len = cipher_iv_size (m->cipher);
         if (c->iv_len < 0) {
             return (m_msg_set_err (m, EMUNGE_SNAFU,
@@ -415,7 +521,12 @@ dec_unpack_outer (munge_cred_t c)
         return (m_msg_set_err (m, EMUNGE_BAD_MAC,
             strdupf ("Invalid MAC type %d", m->mac)));
     }
-    c->mac_len = mac_size (m->mac);
+    if (c->version == MUNGE_CRED_VERSION_AEAD) {
+        c->mac_len = cipher_tag_size (m->cipher);
+    }
+    else {
+        c->mac_len = mac_size (m->mac);
+    }
     if (c->mac_len <= 0) {
         return (m_msg_set_err (m, EMUNGE_SNAFU,
             strdupf ("Failed to determine digest length for MAC type %d",
@@ -476,23 +587,22 @@ dec_unpack_outer (munge_cred_t c)
             return (m_msg_set_err (m, EMUNGE_BAD_CRED,
                 strdup ("Truncated security realm string")));
         }
-        c->realm_mem_len = m->realm_len + 1;
         /*
-         *  Since the realm len is a uint8, the max memory malloc'd here
+         *  Since the realm len is a uint8, the max memory allocated here
          *    for the realm string is 256 bytes.
          */
-        if (!(c->realm_mem = malloc (c->realm_mem_len))) {
+        if (!(realm = cred_alloc (c, m->realm_len + 1))) {
             return (m_msg_set_err (m, EMUNGE_NO_MEMORY, NULL));
         }
-        memcpy (c->realm_mem, p, m->realm_len);
-        c->realm_mem[m->realm_len] = '\0';
+        memcpy (realm, p, m->realm_len);
+        realm[m->realm_len] = '\0';
         p += m->realm_len;
         len -= m->realm_len;
         /*
          *  Update realm & realm_len to refer to the string in "cred memory".
          */
-        m->realm_str = (char *) c->realm_mem;
-        m->realm_len = c->realm_mem_len;
+        m->realm_str = realm;
+        m->realm_len++;
         m->realm_is_copy = 1;
     }
     /*  Unpack the cipher initialization vector (if needed).
@@ -512,8 +622,12 @@ dec_unpack_outer (munge_cred_t c)
      */
     c->outer_len = p - c->outer;
     /*
-     *  Unpack the MAC.
+     *  Unpack the MAC (or the AEAD authentication tag).
      */
+    if (c->mac_len > len) {
+        return (m_msg_set_err (m, EMUNGE_BAD_CRED,
+            strdup ("Truncated MAC")));
+    }
     memcpy (c->mac, p, c->mac_len);
     p += c->mac_len;
     len -= c->mac_len;
@@ -549,7 +663,10 @@ dec_decrypt (munge_cred_t c)
     int               buf_len;          /* length of plaintext buffer        */
     unsigned char    *buf;              /* plaintext buffer                  */
     unsigned char    *buf_ptr;          /* ptr into plaintext buffer         */
-    cipher_ctx        x;                /* cipher context                    */
+    cipher_ctx       *x;                /* cipher context                    */
+    mac_ctx          *y;                /* message auth code context for DEK */
+    unsigned char    *dek_src;          /* data from which DEK is derived    */
+    int               dek_src_len;      /* length of DEK source data         */
     int               n_written;        /* number of bytes written to buf    */
     int               n;                /* all-purpose int                   */
 
@@ -560,6 +677,10 @@ dec_decrypt (munge_cred_t c)
     }
     /*  Compute DEK.
      *  msg-dek = MAC (msg-mac) using DEK subkey
+     *  For an AEAD cipher, the MAC is superseded by the authentication tag
+     *    which is not known until after encryption, so the "outer" data
+     *    (which includes the random nonce) is used instead:
+     *  msg-dek = MAC (msg-outer) using DEK subkey
      */
     c->dek_len = mac_size (m->mac);
     if (c->dek_len <= 0) {
@@ -569,68 +690,89 @@ dec_decrypt (munge_cred_t c)
     }
     assert (c->dek_len <= sizeof (c->dek));
 
+    assert (m->mac < MUNGE_MAC_LAST_ITEM);
     n = c->dek_len;
-    if (mac_block (m->mac, conf->dek_key, conf->dek_key_len,
-            c->dek, &n, c->mac, c->mac_len) < 0) {
+    if ( (conf->dek_hmac[m->mac] == NULL)
+      || (mac_ctx_acquire (&y, conf->dek_hmac[m->mac]) < 0) ) {
         return (m_msg_set_err (m, EMUNGE_SNAFU,
             strdup ("Failed to compute DEK")));
     }
-    assert (n <= c->dek_len);
-    assert (n >= cipher_key_size (m->cipher));
-
-    /*  Allocate memory for plaintext.
-     *  Ensure enough space by allocating an additional cipher block.
-     */
-    n = cipher_block_size (m->cipher);
-    if (n <= 0) {
+    if (c->version == MUNGE_CRED_VERSION_AEAD) {
+        dek_src = c->outer;
+        dek_src_len = c->outer_len;
+    }
+    else {
+        dek_src = c->mac;
+        dek_src_len = c->mac_len;
+    }
+    if ( (mac_update (y, dek_src, dek_src_len) < 0)
+      || (mac_final (y, c->dek, &n) < 0) ) {
+        mac_ctx_release (y);
         return (m_msg_set_err (m, EMUNGE_SNAFU,
-            strdupf ("Failed to determine block size for cipher type %d",
-                m->cipher)));
+            strdup ("Failed to compute DEK")));
     }
-    buf_len = c->inner_len + n;
-    if (!(buf = malloc (buf_len))) {
-        return (m_msg_set_err (m, EMUNGE_NO_MEMORY, NULL));
+    if (mac_ctx_release (y) < 0) {
+        return (m_msg_set_err (m, EMUNGE_SNAFU,
+            strdup ("Failed to compute DEK")));
     }
-    /*  Decrypt "inner" data.
+    assert (n <= c->dek_len);
+    assert (n >= cipher_key_size (m->cipher));
+
+    /*  Decrypt "inner" data in place.
+     *  The plaintext is never longer than the ciphertext, and the cipher
+     *    writes no further than the ciphertext it has already consumed.
+     *  The remainder of the cred memory is included in the buffer length
+     *    since cipher_final() requires a non-empty buffer even when the
+     *    ciphertext has been entirely consumed.
      */
-    if (cipher_init (&x, m->cipher, c->dek, c->iv, CIPHER_DECRYPT) < 0) {
+    buf = c->inner;
+    buf_len = (c->outer_mem + c->outer_mem_len) - c->inner;
+    assert (buf_len > c->inner_len);
+
+    if (cipher_ctx_acquire (&x, m->cipher, c->dek, c->iv,
+            CIPHER_DECRYPT) < 0) {
         goto err;
     }
+    if (c->version == MUNGE_CRED_VERSION_AEAD) {
+        if (cipher_update_aad (x, c->outer, c->outer_len) < 0) {
+            goto err_cleanup;
+        }
+        if (cipher_set_tag (x, c->mac, c->mac_len) < 0) {
+            goto err_cleanup;
+        }
+    }
     buf_ptr = buf;
     n_written = 0;
     n = buf_len;
-    if (cipher_update (&x, buf_ptr, &n, c->inner, c->inner_len) < 0) {
+    if (cipher_update (x, buf_ptr, &n, c->inner, c->inner_len) < 0) {
         goto err_cleanup;
     }
     buf_ptr += n;
     n_written += n;
     n = buf_len - n_written;
-    if (cipher_final (&x, buf_ptr, &n) < 0) {
-        /*  Set but defer error until dec_validate_mac().  */
+    if (cipher_final (x, buf_ptr, &n) < 0) {
+        /*  Set but defer error until dec_validate_mac().
+         *  For an AEAD cipher, this is where the authentication tag is
+         *    verified, so dec_validate_mac() merely reports the error.
+         */
         m_msg_set_err (m, EMUNGE_CRED_INVALID, NULL);
+        n = 0;
     }
     buf_ptr += n;
     n_written += n;
-    if (cipher_cleanup (&x) < 0) {
+    if (cipher_ctx_release (x) < 0) {
         goto err;
     }
-    assert (n_written <= buf_len);
+    assert (n_written <= c->inner_len);
 
-    /*  Replace "inner" ciphertext with plaintext.
+    /*  The "inner" ciphertext has been replaced with plaintext.
      */
-    assert (c->inner_mem == NULL);
-    assert (c->inner_mem_len == 0);
-    c->inner_mem = buf;
-    c->inner_mem_len = buf_len;
-    c->inner = buf;
     c->inner_len = n_written;
     return (0);
 
 err_cleanup:
-    cipher_cleanup (&x);
+    cipher_ctx_release (x);
 err:
-    memset (buf, 0, buf_len);
-    free (buf);
     return (m_msg_set_err (m, EMUNGE_SNAFU,
         strdup ("Failed to decrypt credential")));
 }
@@ -643,26 +785,43 @@ dec_validate_mac (munge_cred_t c)
  *    (ie, both "outer" and "inner" data).
  */
     m_msg_t        m = c->msg;
-    mac_ctx        x;                   /* message auth code context         */
+    mac_ctx       *x;                   /* message auth code context         */
     unsigned char  mac[MAX_MAC];        /* message authentication code       */
     int            n;                   /* all-purpose int                   */
 
+    /*  For an AEAD cipher, the authentication tag has already been verified
+     *    by dec_decrypt().
+     */
+    if (c->version == MUNGE_CRED_VERSION_AEAD) {
+        if (m->error_num != EMUNGE_SUCCESS) {
+            return (-1);
+        }
+        return (0);
+    }
+
     /*  Compute MAC.
+     *  The context is acquired from this thread's cache of contexts sharing
+     *    the precomputed state keyed by the MAC subkey in order to avoid
+     *    re-deriving it for each credential.
      */
-    if (mac_init (&x, m->mac, conf->mac_key, conf->mac_key_len) < 0) {
+    assert (m->mac < MUNGE_MAC_LAST_ITEM);
+    if (conf->mac_hmac[m->mac] == NULL) {
+        goto err;
+    }
+    if (mac_ctx_acquire (&x, conf->mac_hmac[m->mac]) < 0) {
         goto err;
     }
-    if (mac_update (&x, c->outer, c->outer_len) < 0) {
+    if (mac_update (x, c->outer, c->outer_len) < 0) {
         goto err_cleanup;
     }
-    if (mac_update (&x, c->inner, c->inner_len) < 0) {
+    if (mac_update (x, c->inner, c->inner_len) < 0) {
         goto err_cleanup;
     }
     n = sizeof (mac);
-    if (mac_final (&x, mac, &n) < 0) {
+    if (mac_final (x, mac, &n) < 0) {
         goto err_cleanup;
     }
-    if (mac_cleanup (&x) < 0) {
+    if (mac_ctx_release (x) < 0) {
         goto err;
     }
     assert (n <= sizeof (mac));
@@ -681,7 +840,7 @@ dec_validate_mac (munge_cred_t c)
     return (0);
 
 err_cleanup:
-    mac_cleanup (&x);
+    mac_ctx_release (x);
 err:
     return (m_msg_set_err (m, EMUNGE_SNAFU,
         strdup ("Failed to MAC credential")));
@@ -714,7 +873,7 @@ dec_decompress (munge_cred_t c)
     if (buf_len <= 0) {
         goto err;
     }
-    if (!(buf = malloc (buf_len))) {
+    if (!(buf = cred_alloc (c, buf_len))) {
         m_msg_set_err (m, EMUNGE_NO_MEMORY, NULL);
         goto err;
     }
@@ -728,13 +887,6 @@ dec_decompress (munge_cred_t c)
     /*
      *  Replace compressed data with "inner" data.
      */
-    if (c->inner_mem) {
-        assert (c->inner_mem_len > 0);
-        memset (c->inner_mem, 0, c->inner_mem_len);
-        free (c->inner_mem);
-    }
-    c->inner_mem = buf;
-    c->inner_mem_len = buf_len;
     c->inner = buf;
     c->inner_len = n;
     return (0);
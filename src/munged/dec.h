@@ -35,5 +35,7 @@
 
 int dec_process_msg (m_msg_t m);
 
+int dec_process_batch (m_msg_t m);
+
 
 #endif /* !MUNGE_DEC_H */
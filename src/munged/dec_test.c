@@ -0,0 +1,253 @@
+/*****************************************************************************
+ *  This file is part of the MUNGE Uid 'N' Gid Emporium (MUNGE).
+ *  For details, see <https://dun.github.io/munge/>.
+ *
+ *  MUNGE is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.  Additionally for the MUNGE library (libmunge), you
+ *  can redistribute it and/or modify it under the terms of the GNU Lesser
+ *  General Public License as published by the Free Software Foundation,
+ *  either version 3 of the License, or (at your option) any later version.
+ *
+ *  MUNGE is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  and GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  and GNU Lesser General Public License along with MUNGE.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+
+
+#if HAVE_CONFIG_H
+#  include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <munge.h>
+#include "cipher.h"
+#include "conf.h"
+#include "cred.h"
+#include "crypto.h"
+#include "dec.h"
+#include "enc.h"
+#include "log.h"
+#include "m_msg.h"
+#include "md.h"
+#include "munge_defs.h"
+#include "random.h"
+#include "replay.h"
+#include "tap.h"
+#include "timer.h"
+
+
+/*****************************************************************************
+ *  Exercises batch decode requests passed over a socketpair, including a
+ *    batch retried by the client after its response was lost and a
+ *    credential with an empty payload.
+ *****************************************************************************/
+
+#define NUM_CREDS       8
+#define KEY_LEN         1024
+
+
+static int sv[2];                       /* client & server ends of socketpair */
+
+
+static void
+setup (void)
+{
+/*  Initializes the subsystems needed by the daemon to encode and decode
+ *    credentials, using a temporary key.
+ */
+    char key_name[] = "dec_test.key.XXXXXX";
+    unsigned char key[KEY_LEN];
+    int fd;
+    int i;
+
+    if (log_open_file (stderr, NULL, LOG_ERR, LOG_OPT_PRIORITY) < 0) {
+        BAIL_OUT ("Failed to open log");
+    }
+    conf = create_conf ();
+    conf->got_force = 1;
+
+    if ((fd = mkstemp (key_name)) < 0) {
+        BAIL_OUT ("Failed to create key");
+    }
+    for (i = 0; i < KEY_LEN; i++) {
+        key[i] = (unsigned char) (i * 131 + 7);
+    }
+    if ((fchmod (fd, S_IRUSR | S_IWUSR) < 0)
+            || (write (fd, key, sizeof (key)) != sizeof (key))
+            || (close (fd) < 0)) {
+        BAIL_OUT ("Failed to write key");
+    }
+    conf->key_name = strdup (key_name);
+
+    crypto_init ();
+    cipher_init_subsystem ();
+    md_init_subsystem ();
+    (void) random_init (NULL);
+    create_subkeys (conf);
+    (void) unlink (key_name);
+    cred_init ();
+    replay_init ();
+    timer_init ();
+
+    if (socketpair (AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+        BAIL_OUT ("Failed to create socketpair");
+    }
+}
+
+
+static m_msg_t
+xfer (m_msg_t mreq, m_msg_type_t mreq_type, m_msg_type_t mrsp_type,
+      int (*process_f) (m_msg_t))
+{
+/*  Sends the request [mreq] to the daemon, processes it with [process_f],
+ *    and returns the response received by the client.  [mreq] is destroyed.
+ */
+    m_msg_t m;
+    m_msg_t mrsp;
+
+    if ((m_msg_bind (mreq, sv[0]) != EMUNGE_SUCCESS)
+            || (m_msg_send (mreq, mreq_type, 0) != EMUNGE_SUCCESS)) {
+        BAIL_OUT ("Failed to send request");
+    }
+    if ((m_msg_create (&m) != EMUNGE_SUCCESS)
+            || (m_msg_bind (m, sv[1]) != EMUNGE_SUCCESS)
+            || (m_msg_recv (m, MUNGE_MSG_UNDEF, 0) != EMUNGE_SUCCESS)) {
+        BAIL_OUT ("Failed to receive request");
+    }
+    (void) process_f (m);
+
+    if ((m_msg_create (&mrsp) != EMUNGE_SUCCESS)
+            || (m_msg_bind (mrsp, sv[0]) != EMUNGE_SUCCESS)
+            || (m_msg_recv (mrsp, mrsp_type, 0) != EMUNGE_SUCCESS)) {
+        BAIL_OUT ("Failed to receive response");
+    }
+    m->sd = -1;                         /* prevent socket close by destroy() */
+    m_msg_destroy (m);
+    mreq->sd = -1;
+    m_msg_destroy (mreq);
+    mrsp->sd = -1;
+    return (mrsp);
+}
+
+
+static char *
+encode (void)
+{
+/*  Returns a new credential encoded by the daemon.
+ */
+    m_msg_t m;
+    char *cred;
+
+    if (m_msg_create (&m) != EMUNGE_SUCCESS) {
+        BAIL_OUT ("Failed to create encode request");
+    }
+    m->cipher = MUNGE_CIPHER_DEFAULT;
+    m->mac = MUNGE_MAC_DEFAULT;
+    m->zip = MUNGE_ZIP_DEFAULT;
+    m->ttl = MUNGE_TTL_DEFAULT;
+    m->auth_uid = MUNGE_UID_ANY;
+    m->auth_gid = MUNGE_GID_ANY;
+
+    m = xfer (m, MUNGE_MSG_ENC_REQ, MUNGE_MSG_ENC_RSP, enc_process_msg);
+    if ((m->error_num != EMUNGE_SUCCESS) || !(cred = strdup (m->data))) {
+        BAIL_OUT ("Failed to encode credential");
+    }
+    m_msg_destroy (m);
+    return (cred);
+}
+
+
+static int
+decode_batch (char **creds, int n, int retry, munge_err_t e)
+{
+/*  Decodes the batch of [n] credentials [creds] as retry number [retry].
+ *  Returns the number of credentials for which the error [e] is returned.
+ */
+    m_msg_t m;
+    m_msg_t mi;
+    int cnt = 0;
+    int i;
+
+    if ((m_msg_create (&m) != EMUNGE_SUCCESS)
+            || !(m->batch = calloc (n, sizeof (*m->batch)))) {
+        BAIL_OUT ("Failed to create batch decode request");
+    }
+    m->retry = retry;
+    m->batch_type = MUNGE_MSG_DEC_REQ;
+    m->batch_len = n;
+    for (i = 0; i < n; i++) {
+        if (m_msg_create (&mi) != EMUNGE_SUCCESS) {
+            BAIL_OUT ("Failed to create batched decode request");
+        }
+        mi->data_len = strlen (creds[i]) + 1;
+        mi->data = creds[i];
+        mi->data_is_copy = 1;
+        m->batch[i] = mi;
+    }
+    m = xfer (m, MUNGE_MSG_BATCH_REQ, MUNGE_MSG_BATCH_RSP, dec_process_batch);
+    if ((m->batch_type != MUNGE_MSG_DEC_RSP) || (m->batch_len != n)) {
+        BAIL_OUT ("Received invalid batch decode response");
+    }
+    for (i = 0; i < n; i++) {
+        if (m->batch[i]->error_num == e) {
+            cnt++;
+        }
+    }
+    m_msg_destroy (m);
+    return (cnt);
+}
+
+
+int
+main (int argc, char *argv[])
+{
+    char *creds[NUM_CREDS];
+    char *empty_cred;
+    int i;
+
+#if defined(AUTH_METHOD_RECVFD_MKFIFO) || defined(AUTH_METHOD_RECVFD_MKNOD)
+    plan (SKIP_ALL, "client identity requires an fd-passing exchange");
+#endif /* AUTH_METHOD_RECVFD_MKFIFO || AUTH_METHOD_RECVFD_MKNOD */
+
+    plan (4);
+    setup ();
+
+    for (i = 0; i < NUM_CREDS; i++) {
+        creds[i] = encode ();
+    }
+    ok (decode_batch (creds, NUM_CREDS, 0, EMUNGE_SUCCESS) == NUM_CREDS,
+            "Decoded batch of %d credentials", NUM_CREDS);
+
+    ok (decode_batch (creds, NUM_CREDS, 0, EMUNGE_CRED_REPLAYED) == NUM_CREDS,
+            "Rejected replayed batch");
+
+    ok (decode_batch (creds, NUM_CREDS, 1, EMUNGE_SUCCESS) == NUM_CREDS,
+            "Allowed replayed batch on retry");
+
+    if (!(empty_cred = strdup (MUNGE_CRED_PREFIX MUNGE_CRED_SUFFIX))) {
+        BAIL_OUT ("Failed to copy empty credential");
+    }
+    ok (decode_batch (&empty_cred, 1, 0, EMUNGE_BAD_CRED) == 1,
+            "Rejected credential with empty payload");
+    free (empty_cred);
+
+    for (i = 0; i < NUM_CREDS; i++) {
+        free (creds[i]);
+    }
+    (void) close (sv[0]);
+    (void) close (sv[1]);
+    done_testing ();
+}
@@ -0,0 +1,196 @@
+/*****************************************************************************
+ *  This file is part of the MUNGE Uid 'N' Gid Emporium (MUNGE).
+ *  For details, see <https://dun.github.io/munge/>.
+ *
+ *  MUNGE is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.  Additionally for the MUNGE library (libmunge), you
+ *  can redistribute it and/or modify it under the terms of the GNU Lesser
+ *  General Public License as published by the Free Software Foundation,
+ *  either version 3 of the License, or (at your option) any later version.
+ *
+ *  MUNGE is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  and GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  and GNU Lesser General Public License along with MUNGE.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *****************************************************************************
+ *  Refer to "drbg.h" for documentation on public functions.
+ *****************************************************************************/
+
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+#include "drbg.h"
+#include "str.h"
+
+
+/*****************************************************************************
+ *  Macros
+ *****************************************************************************/
+
+#define DRBG_ROTL32(v, n)       (((v) << (n)) | ((v) >> (32 - (n))))
+
+#define DRBG_QUARTERROUND(a, b, c, d)                                         \
+    do {                                                                      \
+        a += b; d ^= a; d = DRBG_ROTL32 (d, 16);                              \
+        c += d; b ^= c; b = DRBG_ROTL32 (b, 12);                              \
+        a += b; d ^= a; d = DRBG_ROTL32 (d, 8);                               \
+        c += d; b ^= c; b = DRBG_ROTL32 (b, 7);                               \
+    } while (0)
+
+
+/*****************************************************************************
+ *  Private Prototypes
+ *****************************************************************************/
+
+static void _drbg_refill (drbg_t *d);
+
+static void _drbg_load_key (uint32_t key[8], const unsigned char *src);
+
+
+/*****************************************************************************
+ *  Public Functions
+ *****************************************************************************/
+
+void
+drbg_seed (drbg_t *d, const unsigned char *seed)
+{
+    assert (d != NULL);
+    assert (seed != NULL);
+
+    _drbg_load_key (d->key, seed);
+    memburn (d->buf, 0, sizeof (d->buf));
+    d->buf_len = 0;
+    return;
+}
+
+
+void
+drbg_generate (drbg_t *d, void *dst, int n)
+{
+    unsigned char *p = dst;
+    unsigned char *src;
+    int            m;
+
+    assert (d != NULL);
+
+    if (!dst || (n <= 0)) {
+        return;
+    }
+    while (n > 0) {
+        if (d->buf_len == 0) {
+            _drbg_refill (d);
+        }
+        m = (n < d->buf_len) ? n : d->buf_len;
+        src = d->buf + sizeof (d->buf) - d->buf_len;
+        memcpy (p, src, m);
+        memburn (src, 0, m);
+        d->buf_len -= m;
+        p += m;
+        n -= m;
+    }
+    return;
+}
+
+
+void
+drbg_chacha20_block (const uint32_t key[8], uint32_t counter,
+        const uint32_t nonce[3], unsigned char *dst)
+{
+    uint32_t in [16];
+    uint32_t x [16];
+    uint32_t v;
+    int      i;
+
+    assert (key != NULL);
+    assert (dst != NULL);
+
+    in[0] = 0x61707865;                 /* "expand 32-byte k"                */
+    in[1] = 0x3320646e;
+    in[2] = 0x79622d32;
+    in[3] = 0x6b206574;
+    for (i = 0; i < 8; i++) {
+        in[4 + i] = key[i];
+    }
+    in[12] = counter;
+    for (i = 0; i < 3; i++) {
+        in[13 + i] = (nonce != NULL) ? nonce[i] : 0;
+    }
+    memcpy (x, in, sizeof (x));
+
+    for (i = 0; i < 10; i++) {
+        DRBG_QUARTERROUND (x[0], x[4], x[8],  x[12]);
+        DRBG_QUARTERROUND (x[1], x[5], x[9],  x[13]);
+        DRBG_QUARTERROUND (x[2], x[6], x[10], x[14]);
+        DRBG_QUARTERROUND (x[3], x[7], x[11], x[15]);
+        DRBG_QUARTERROUND (x[0], x[5], x[10], x[15]);
+        DRBG_QUARTERROUND (x[1], x[6], x[11], x[12]);
+        DRBG_QUARTERROUND (x[2], x[7], x[8],  x[13]);
+        DRBG_QUARTERROUND (x[3], x[4], x[9],  x[14]);
+    }
+    for (i = 0; i < 16; i++) {
+        v = x[i] + in[i];
+        dst[4*i]     = (unsigned char) (v);
+        dst[4*i + 1] = (unsigned char) (v >> 8);
+        dst[4*i + 2] = (unsigned char) (v >> 16);
+        dst[4*i + 3] = (unsigned char) (v >> 24);
+    }
+    memburn (x, 0, sizeof (x));
+    memburn (in, 0, sizeof (in));
+    return;
+}
+
+
+/*****************************************************************************
+ *  Private Functions
+ *****************************************************************************/
+
+static void
+_drbg_refill (drbg_t *d)
+{
+/*  Refills the keystream buffer of the DRBG [d], replacing its key with the
+ *    first DRBG_KEY_LEN bytes of the generated keystream.
+ */
+    unsigned char blocks [DRBG_BLOCKS * DRBG_BLOCK_LEN];
+    int           i;
+
+    assert (d != NULL);
+    assert (sizeof (d->buf) == sizeof (blocks) - DRBG_KEY_LEN);
+
+    for (i = 0; i < DRBG_BLOCKS; i++) {
+        drbg_chacha20_block (d->key, (uint32_t) i, NULL,
+                blocks + (DRBG_BLOCK_LEN * i));
+    }
+    _drbg_load_key (d->key, blocks);
+    memcpy (d->buf, blocks + DRBG_KEY_LEN, sizeof (d->buf));
+    d->buf_len = sizeof (d->buf);
+    memburn (blocks, 0, sizeof (blocks));
+    return;
+}
+
+
+static void
+_drbg_load_key (uint32_t key[8], const unsigned char *src)
+{
+/*  Loads the DRBG_KEY_LEN bytes of [src] into [key] as little-endian words.
+ */
+    int i;
+
+    for (i = 0; i < 8; i++) {
+        key[i] = (uint32_t) src[4*i]
+                | ((uint32_t) src[4*i + 1] << 8)
+                | ((uint32_t) src[4*i + 2] << 16)
+                | ((uint32_t) src[4*i + 3] << 24);
+    }
+    return;
+}
@@ -0,0 +1,104 @@
+/*****************************************************************************
+ *  This file is part of the MUNGE Uid 'N' Gid Emporium (MUNGE).
+ *  For details, see <https://dun.github.io/munge/>.
+ *
+ *  MUNGE is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.  Additionally for the MUNGE library (libmunge), you
+ *  can redistribute it and/or modify it under the terms of the GNU Lesser
+ *  General Public License as published by the Free Software Foundation,
+ *  either version 3 of the License, or (at your option) any later version.
+ *
+ *  MUNGE is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  and GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  and GNU Lesser General Public License along with MUNGE.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+
+#ifndef DRBG_H
+#define DRBG_H
+
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <stdint.h>
+
+
+/*****************************************************************************
+ *  Notes
+ *****************************************************************************/
+/*
+ *  A DRBG generates pseudo-random bytes from the ChaCha20 keystream (RFC 8439)
+ *    of a 256-bit key using "fast key erasure": each refill of its keystream
+ *    buffer replaces the key with the first DRBG_KEY_LEN bytes of the new
+ *    keystream, and each byte of output is erased from the buffer once it
+ *    has been returned.  A compromise of the DRBG state therefore does not
+ *    reveal output that has already been generated.
+ *
+ *  A DRBG is not thread-safe; it is intended to be owned by a single thread.
+ *    Reseeding it from an entropy source is the caller's responsibility.
+ */
+
+
+/*****************************************************************************
+ *  Constants
+ *****************************************************************************/
+
+#define DRBG_KEY_LEN            32      /* num bytes in a DRBG seed or key   */
+
+#define DRBG_BLOCK_LEN          64      /* num bytes in a ChaCha20 block     */
+
+#define DRBG_BLOCKS             8       /* num blocks generated per refill   */
+
+
+/*****************************************************************************
+ *  Data Types
+ *****************************************************************************/
+
+struct drbg {
+    uint32_t        key [DRBG_KEY_LEN / 4];             /* ChaCha20 key      */
+    unsigned char   buf [(DRBG_BLOCKS * DRBG_BLOCK_LEN) - DRBG_KEY_LEN];
+    int             buf_len;            /* num bytes of keystream unused     */
+};
+
+typedef struct drbg drbg_t;
+/*
+ *  DRBG data type.  It is not opaque so it can be embedded in the caller's
+ *    per-thread state, but its fields should only be accessed by drbg.c.
+ */
+
+
+/*****************************************************************************
+ *  Functions
+ *****************************************************************************/
+
+void drbg_seed (drbg_t *d, const unsigned char *seed);
+/*
+ *  Rekeys the DRBG [d] with the DRBG_KEY_LEN bytes of [seed], discarding
+ *    (and erasing) any unused keystream.
+ */
+
+void drbg_generate (drbg_t *d, void *dst, int n);
+/*
+ *  Places [n] bytes of pseudo-random data from the DRBG [d] into [dst].
+ */
+
+void drbg_chacha20_block (const uint32_t key[8], uint32_t counter,
+        const uint32_t nonce[3], unsigned char *dst);
+/*
+ *  Computes the DRBG_BLOCK_LEN-byte ChaCha20 block (RFC 8439 Section 2.3)
+ *    for the [key], block [counter], and [nonce], writing it to [dst].
+ *    The key and nonce are given as little-endian 32-bit words.
+ *  If [nonce] is NULL, an all-zero nonce is used.
+ */
+
+
+#endif /* !DRBG_H */
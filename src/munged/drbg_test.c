@@ -0,0 +1,191 @@
+/*****************************************************************************
+ *  This file is part of the MUNGE Uid 'N' Gid Emporium (MUNGE).
+ *  For details, see <https://dun.github.io/munge/>.
+ *
+ *  MUNGE is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.  Additionally for the MUNGE library (libmunge), you
+ *  can redistribute it and/or modify it under the terms of the GNU Lesser
+ *  General Public License as published by the Free Software Foundation,
+ *  either version 3 of the License, or (at your option) any later version.
+ *
+ *  MUNGE is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  and GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  and GNU Lesser General Public License along with MUNGE.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+
+#if HAVE_CONFIG_H
+#  include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <stdint.h>
+#include <string.h>
+#include "drbg.h"
+#include "tap.h"
+
+
+/*****************************************************************************
+ *  Exercises the ChaCha20 block function against RFC 8439 test vectors, and
+ *    the keystream, fast key erasure, and rekeying of the DRBG.
+ *****************************************************************************/
+
+#define OUT_LEN         16
+
+
+/*  RFC 8439 Section 2.3.2: key 00:01:...:1f, nonce 00:00:00:09:00:00:00:4a:
+ *    00:00:00:00, and block count 1.
+ */
+static const unsigned char rfc_2_3_2_block[DRBG_BLOCK_LEN] = {
+    0x10, 0xf1, 0xe7, 0xe4, 0xd1, 0x3b, 0x59, 0x15,
+    0x50, 0x0f, 0xdd, 0x1f, 0xa3, 0x20, 0x71, 0xc4,
+    0xc7, 0xd1, 0xf4, 0xc7, 0x33, 0xc0, 0x68, 0x03,
+    0x04, 0x22, 0xaa, 0x9a, 0xc3, 0xd4, 0x6c, 0x4e,
+    0xd2, 0x82, 0x64, 0x46, 0x07, 0x9f, 0xaa, 0x09,
+    0x14, 0xc2, 0xd7, 0x05, 0xd9, 0x8b, 0x02, 0xa2,
+    0xb5, 0x12, 0x9c, 0xd1, 0xde, 0x16, 0x4e, 0xb9,
+    0xcb, 0xd0, 0x83, 0xe8, 0xa2, 0x50, 0x3c, 0x4e
+};
+
+/*  RFC 8439 Appendix A.1 Test Vector #1: all-zero key, all-zero nonce, and
+ *    block count 0.  The DRBG uses an all-zero nonce.
+ */
+static const unsigned char rfc_a_1_1_block[DRBG_BLOCK_LEN] = {
+    0x76, 0xb8, 0xe0, 0xad, 0xa0, 0xf1, 0x3d, 0x90,
+    0x40, 0x5d, 0x6a, 0xe5, 0x53, 0x86, 0xbd, 0x28,
+    0xbd, 0xd2, 0x19, 0xb8, 0xa0, 0x8d, 0xed, 0x1a,
+    0xa8, 0x36, 0xef, 0xcc, 0x8b, 0x77, 0x0d, 0xc7,
+    0xda, 0x41, 0x59, 0x7c, 0x51, 0x57, 0x48, 0x8d,
+    0x77, 0x24, 0xe0, 0x3f, 0xb8, 0xd8, 0x4a, 0x37,
+    0x6a, 0x43, 0xb8, 0xf4, 0x15, 0x18, 0xa1, 0x1c,
+    0xc3, 0x87, 0xb6, 0x69, 0xb2, 0xee, 0x65, 0x86
+};
+
+
+static void
+load_key (uint32_t key[8], const unsigned char *src)
+{
+    int i;
+
+    for (i = 0; i < 8; i++) {
+        key[i] = (uint32_t) src[4*i]
+                | ((uint32_t) src[4*i + 1] << 8)
+                | ((uint32_t) src[4*i + 2] << 16)
+                | ((uint32_t) src[4*i + 3] << 24);
+    }
+}
+
+
+static void
+keystream (const unsigned char *seed,
+        unsigned char ks[DRBG_BLOCKS * DRBG_BLOCK_LEN])
+{
+/*  Computes the keystream generated by a refill of a DRBG keyed by [seed].
+ */
+    uint32_t key[8];
+    int i;
+
+    load_key (key, seed);
+    for (i = 0; i < DRBG_BLOCKS; i++) {
+        drbg_chacha20_block (key, (uint32_t) i, NULL,
+                ks + (DRBG_BLOCK_LEN * i));
+    }
+}
+
+
+static int
+is_zero (const unsigned char *buf, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+        if (buf[i] != 0) {
+            return (0);
+        }
+    }
+    return (1);
+}
+
+
+int
+main (int argc, char *argv[])
+{
+    unsigned char seed[DRBG_KEY_LEN];
+    unsigned char seed2[DRBG_KEY_LEN];
+    unsigned char ks[DRBG_BLOCKS * DRBG_BLOCK_LEN];
+    unsigned char ks2[DRBG_BLOCKS * DRBG_BLOCK_LEN];
+    unsigned char block[DRBG_BLOCK_LEN];
+    unsigned char out[sizeof (((drbg_t *) 0)->buf) + OUT_LEN];
+    uint32_t key[8];
+    uint32_t nonce[3];
+    drbg_t d;
+    int n;
+    int i;
+
+    plan (9);
+
+    for (i = 0; i < DRBG_KEY_LEN; i++) {
+        seed[i] = (unsigned char) i;
+        seed2[i] = (unsigned char) (0xff - i);
+    }
+    load_key (key, seed);
+    nonce[0] = 0x09000000;
+    nonce[1] = 0x4a000000;
+    nonce[2] = 0x00000000;
+    drbg_chacha20_block (key, 1, nonce, block);
+    cmp_mem (block, rfc_2_3_2_block, DRBG_BLOCK_LEN,
+            "Computed RFC 8439 Section 2.3.2 block");
+
+    memset (key, 0, sizeof (key));
+    drbg_chacha20_block (key, 0, NULL, block);
+    cmp_mem (block, rfc_a_1_1_block, DRBG_BLOCK_LEN,
+            "Computed RFC 8439 Appendix A.1 Test Vector #1 block");
+
+    /*  The first DRBG_KEY_LEN bytes of each refill's keystream become the
+     *    next key; the remainder is returned as output.
+     */
+    keystream (seed, ks);
+    memset (&d, 0xA5, sizeof (d));
+    drbg_seed (&d, seed);
+    drbg_generate (&d, out, OUT_LEN);
+    cmp_mem (out, ks + DRBG_KEY_LEN, OUT_LEN,
+            "Generated keystream following the rekey bytes");
+
+    load_key (key, ks);
+    cmp_mem (d.key, key, sizeof (key),
+            "Replaced key with first %d bytes of keystream", DRBG_KEY_LEN);
+
+    ok (is_zero (d.buf, OUT_LEN), "Erased returned keystream from buffer");
+
+    /*  Exhaust the buffer so the next refill uses the replacement key.
+     */
+    n = d.buf_len;
+    keystream (ks, ks2);
+    drbg_generate (&d, out, n + OUT_LEN);
+    ok ((memcmp (out, ks + DRBG_KEY_LEN + OUT_LEN, n) == 0)
+            && (memcmp (out + n, ks2 + DRBG_KEY_LEN, OUT_LEN) == 0),
+            "Generated keystream across refill with replacement key");
+
+    /*  Rekeying discards the unused keystream.
+     */
+    drbg_seed (&d, seed2);
+    ok ((d.buf_len == 0) && is_zero (d.buf, sizeof (d.buf)),
+            "Erased unused keystream when rekeyed");
+
+    keystream (seed2, ks2);
+    drbg_generate (&d, out, OUT_LEN);
+    cmp_mem (out, ks2 + DRBG_KEY_LEN, OUT_LEN,
+            "Generated keystream from new seed when rekeyed");
+
+    memset (out, 0, sizeof (out));
+    drbg_generate (&d, out, 0);
+    ok (is_zero (out, sizeof (out)), "Generated nothing for zero bytes");
+
+    done_testing ();
+}
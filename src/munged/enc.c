@@ -36,10 +36,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
-#include "auth_recv.h"
 #include "base64.h"
 #include "cipher.h"
 #include "conf.h"
+#include "conn.h"
 #include "cred.h"
 #include "enc.h"
 #include "log.h"
@@ -55,11 +55,13 @@
  *  Static Prototypes
  *****************************************************************************/
 
+static int enc_process_cred (m_msg_t m, munge_cred_t *pc);
 static int enc_validate_msg (m_msg_t m);
 static int enc_init (munge_cred_t c);
-static int enc_authenticate (munge_cred_t c);
-static int enc_check_retry (munge_cred_t c);
+static int enc_authenticate (m_msg_t m);
+static int enc_check_retry (m_msg_t m);
 static int enc_timestamp (munge_cred_t c);
+static int enc_alloc (munge_cred_t c);
 static int enc_pack_outer (munge_cred_t c);
 static int enc_pack_inner (munge_cred_t c);
 static int enc_compress (munge_cred_t c);
@@ -67,6 +69,7 @@ static int enc_mac (munge_cred_t c);
 static int enc_encrypt (munge_cred_t c);
 static int enc_armor (munge_cred_t c);
 static int enc_fini (munge_cred_t c);
+static unsigned char * enc_work_other (munge_cred_t c);
 
 
 /*****************************************************************************
@@ -79,18 +82,106 @@ enc_process_msg (m_msg_t m)
     munge_cred_t c = NULL;              /* aux data for processing this cred */
     int          rc = -1;               /* return code                       */
 
+    if (enc_authenticate (m) < 0)
+        ;
+    else if (enc_check_retry (m) < 0)
+        ;
+    else if (enc_process_cred (m, &c) < 0)
+        ;
+    else /* success */
+        rc = 0;
+
+    /*  Since the same m_msg struct is used for both the request and response,
+     *    the response message data must be sanitized for most errors.
+     */
+    if (rc != 0) {
+        m_msg_reset (m);
+    }
+    if (conn_send (m, MUNGE_MSG_ENC_RSP, 0) != EMUNGE_SUCCESS) {
+        rc = -1;
+    }
+    cred_destroy (c);
+    return (rc);
+}
+
+
+int
+enc_process_batch (m_msg_t m)
+{
+    munge_cred_t *cs = NULL;            /* aux data for each batched cred    */
+    m_msg_t       mi;                   /* batched msg                       */
+    uint32_t      i;
+    int           rc = -1;              /* return code                       */
+
+    assert (m != NULL);
+    assert (m->type == MUNGE_MSG_BATCH_REQ);
+    assert (m->batch_type == MUNGE_MSG_ENC_REQ);
+
+    if ((m->batch_len > 0) && !(cs = calloc (m->batch_len, sizeof (*cs)))) {
+        (void) m_msg_set_err (m, EMUNGE_NO_MEMORY, NULL);
+    }
+    else if (enc_authenticate (m) < 0)
+        ;
+    else if (enc_check_retry (m) < 0)
+        ;
+    else /* success */
+        rc = 0;
+
+    /*  The client identity and retry count are determined once for the whole
+     *    batch.  Each credential succeeds or fails independently of the others.
+     */
+    for (i = 0; i < m->batch_len; i++) {
+        mi = m->batch[i];
+        if (rc == 0) {
+            mi->client_uid = m->client_uid;
+            mi->client_gid = m->client_gid;
+            mi->retry = m->retry;
+            if (enc_process_cred (mi, &cs[i]) == 0) {
+                continue;
+            }
+        }
+        m_msg_reset (mi);
+    }
+    m->batch_type = MUNGE_MSG_ENC_RSP;
+    if (conn_send (m, MUNGE_MSG_BATCH_RSP, 0) != EMUNGE_SUCCESS) {
+        rc = -1;
+    }
+    if (cs != NULL) {
+        for (i = 0; i < m->batch_len; i++) {
+            cred_destroy (cs[i]);
+        }
+        free (cs);
+    }
+    return (rc);
+}
+
+
+/*****************************************************************************
+ *  Static Functions
+ *****************************************************************************/
+
+static int
+enc_process_cred (m_msg_t m, munge_cred_t *pc)
+{
+/*  Encodes a credential for the request [m] from an authenticated client,
+ *    storing the aux data for processing it in [pc].
+ *  The aux data must outlive the response since [m] may reference its memory.
+ */
+    munge_cred_t c = NULL;              /* aux data for processing this cred */
+    int          rc = -1;               /* return code                       */
+
+    assert (pc != NULL);
+
     if (enc_validate_msg (m) < 0)
         ;
     else if (!(c = cred_create (m)))
         ;
     else if (enc_init (c) < 0)
         ;
-    else if (enc_authenticate (c) < 0)
-        ;
-    else if (enc_check_retry (c) < 0)
-        ;
     else if (enc_timestamp (c) < 0)
         ;
+    else if (enc_alloc (c) < 0)
+        ;
     else if (enc_pack_outer (c) < 0)
         ;
     else if (enc_pack_inner (c) < 0)
@@ -108,24 +199,11 @@ enc_process_msg (m_msg_t m)
     else /* success */
         rc = 0;
 
-    /*  Since the same m_msg struct is used for both the request and response,
-     *    the response message data must be sanitized for most errors.
-     */
-    if (rc != 0) {
-        m_msg_reset (m);
-    }
-    if (m_msg_send (m, MUNGE_MSG_ENC_RSP, 0) != EMUNGE_SUCCESS) {
-        rc = -1;
-    }
-    cred_destroy (c);
+    *pc = c;
     return (rc);
 }
 
 
-/*****************************************************************************
- *  Static Functions
- *****************************************************************************/
-
 static int
 enc_validate_msg (m_msg_t m)
 {
@@ -210,6 +288,12 @@ enc_init (munge_cred_t c)
  */
     m_msg_t  m = c->msg;
 
+    /*  Select the credential format according to the cipher type.
+     */
+    if ((m->cipher != MUNGE_CIPHER_NONE) && (cipher_is_aead (m->cipher) > 0)) {
+        c->version = MUNGE_CRED_VERSION_AEAD;
+    }
+
     /*  Generate salt.
      */
     c->salt_len = MUNGE_CRED_SALT_LEN;
@@ -237,11 +321,10 @@ enc_init (munge_cred_t c)
 
 
 static int
-enc_authenticate (munge_cred_t c)
+enc_authenticate (m_msg_t m)
 {
 /*  Ascertains the UID/GID of the client process.
  */
-    m_msg_t  m = c->msg;
     uid_t   *p_uid;
     gid_t   *p_gid;
 
@@ -250,7 +333,7 @@ enc_authenticate (munge_cred_t c)
 
     /*  Determine identity of client process.
      */
-    if (auth_recv (m, p_uid, p_gid) != EMUNGE_SUCCESS) {
+    if (conn_auth_recv (m, p_uid, p_gid) != EMUNGE_SUCCESS) {
         return (m_msg_set_err (m, EMUNGE_SNAFU,
             strdup ("Failed to determine client identity")));
     }
@@ -259,12 +342,10 @@ enc_authenticate (munge_cred_t c)
 
 
 static int
-enc_check_retry (munge_cred_t c)
+enc_check_retry (m_msg_t m)
 {
 /*  Checks whether the transaction is being retried.
  */
-    m_msg_t  m = c->msg;
-
     if (m->retry > 0) {
         log_msg (LOG_INFO,
             "Encode retry #%d for client UID=%u GID=%u", m->retry,
@@ -298,6 +379,86 @@ enc_timestamp (munge_cred_t c)
 }
 
 
+static int
+enc_alloc (munge_cred_t c)
+{
+/*  Allocates a single buffer for all stages of encoding the credential.
+ *  It is partitioned into the "outer" data, a pair of "inner" work regions,
+ *    and the armor'd credential.  Each transformation of the "inner" data
+ *    (ie, compression and encryption) reads from one work region and writes
+ *    to the other, so no stage needs to allocate, copy, or free memory.
+ *  Each work region must hold the packed "inner" data plus an additional
+ *    cipher block, or the worst-case compressed "inner" data.  The armor
+ *    must hold the base64-encoding of the "outer" data, MAC, and the largest
+ *    "inner" data, along with the prefix and suffix strings.
+ *  The entire buffer is cleared by cred_destroy().
+ */
+    m_msg_t        m = c->msg;
+    int            outer_len;           /* length of "outer" data            */
+    int            inner_len;           /* length of packed "inner" data     */
+    int            armor_len;           /* length of armor'd cred region     */
+    int            n;                   /* all-purpose int                   */
+
+    assert (c->outer_mem == NULL);
+
+    outer_len  = sizeof (c->version);
+    outer_len += sizeof (m->cipher);
+    outer_len += sizeof (m->mac);
+    outer_len += sizeof (m->zip);
+    outer_len += sizeof (m->realm_len);
+    outer_len += m->realm_len;
+    outer_len += c->iv_len;
+
+    inner_len  = c->salt_len;
+    inner_len += sizeof (m->addr_len);
+    inner_len += sizeof (m->addr);
+    inner_len += sizeof (m->time0);
+    inner_len += sizeof (m->ttl);
+    inner_len += sizeof (m->client_uid);
+    inner_len += sizeof (m->client_gid);
+    inner_len += sizeof (m->auth_uid);
+    inner_len += sizeof (m->auth_gid);
+    inner_len += sizeof (m->data_len);
+    inner_len += m->data_len;
+
+    c->work_len = inner_len;
+    if (m->cipher != MUNGE_CIPHER_NONE) {
+        n = cipher_block_size (m->cipher);
+        if (n <= 0) {
+            return (m_msg_set_err (m, EMUNGE_SNAFU,
+                strdupf ("Failed to determine block size for cipher type %d",
+                    m->cipher)));
+        }
+        c->work_len += n;
+    }
+    if (m->zip != MUNGE_ZIP_NONE) {
+        n = zip_compress_length (m->zip, m->data, inner_len);
+        if (n < 0) {
+            return (m_msg_set_err (m, EMUNGE_SNAFU,
+                strdup ("Failed to compress credential")));
+        }
+        if (n > c->work_len) {
+            c->work_len = n;
+        }
+    }
+    armor_len  = strlen (MUNGE_CRED_PREFIX);
+    armor_len += base64_encode_length (outer_len + MAX_MAC + c->work_len);
+    armor_len += strlen (MUNGE_CRED_SUFFIX);
+
+    c->outer_mem_len = outer_len + (2 * c->work_len) + armor_len;
+    if (!(c->outer_mem = cred_alloc (c, c->outer_mem_len))) {
+        c->outer_mem_len = 0;
+        return (m_msg_set_err (m, EMUNGE_NO_MEMORY, NULL));
+    }
+    c->outer = c->outer_mem;
+    c->outer_len = outer_len;
+    c->work = c->outer + outer_len;
+    c->inner = c->work;
+    c->inner_len = inner_len;
+    return (0);
+}
+
+
 static int
 enc_pack_outer (munge_cred_t c)
 {
@@ -311,20 +472,8 @@ enc_pack_outer (munge_cred_t c)
     m_msg_t        m = c->msg;
     unsigned char *p;                   /* ptr into packed data              */
 
-    assert (c->outer_mem == NULL);
-
-    c->outer_mem_len += sizeof (c->version);
-    c->outer_mem_len += sizeof (m->cipher);
-    c->outer_mem_len += sizeof (m->mac);
-    c->outer_mem_len += sizeof (m->zip);
-    c->outer_mem_len += sizeof (m->realm_len);
-    c->outer_mem_len += m->realm_len;
-    c->outer_mem_len += c->iv_len;
-    if (!(c->outer_mem = malloc (c->outer_mem_len))) {
-        return (m_msg_set_err (m, EMUNGE_NO_MEMORY, NULL));
-    }
-    p = c->outer = c->outer_mem;
-    c->outer_len = c->outer_mem_len;
+    assert (c->outer != NULL);
+    p = c->outer;
 
     assert (sizeof (c->version) == 1);
     *p = c->version;
@@ -373,24 +522,8 @@ enc_pack_inner (munge_cred_t c)
     unsigned char *p;                   /* ptr into packed data              */
     uint32_t       u32;                 /* tmp for packing into MSBF         */
 
-    assert (c->inner_mem == NULL);
-
-    c->inner_mem_len += c->salt_len;
-    c->inner_mem_len += sizeof (m->addr_len);
-    c->inner_mem_len += sizeof (m->addr);
-    c->inner_mem_len += sizeof (m->time0);
-    c->inner_mem_len += sizeof (m->ttl);
-    c->inner_mem_len += sizeof (m->client_uid);
-    c->inner_mem_len += sizeof (m->client_gid);
-    c->inner_mem_len += sizeof (m->auth_uid);
-    c->inner_mem_len += sizeof (m->auth_gid);
-    c->inner_mem_len += sizeof (m->data_len);
-    c->inner_mem_len += m->data_len;
-    if (!(c->inner_mem = malloc (c->inner_mem_len))) {
-        return (m_msg_set_err (m, EMUNGE_NO_MEMORY, NULL));
-    }
-    p = c->inner = c->inner_mem;
-    c->inner_len = c->inner_mem_len;
+    assert (c->inner == c->work);
+    p = c->inner;
 
     assert (c->salt_len > 0);
     memcpy (p, c->salt, c->salt_len);
@@ -460,7 +593,6 @@ enc_compress (munge_cred_t c)
  */
     m_msg_t        m = c->msg;
     unsigned char *buf;                 /* compression buffer                */
-    int            buf_len;             /* length of compression buffer      */
     int            n;                   /* length of compressed data         */
 
     /*  Is compression disabled?
@@ -468,22 +600,13 @@ enc_compress (munge_cred_t c)
     if (m->zip == MUNGE_ZIP_NONE) {
         return (0);
     }
-    /*  Allocate memory for compressed "inner" data.
-     */
-    buf = NULL;
-    buf_len = zip_compress_length (m->zip, c->inner, c->inner_len);
-    if (buf_len < 0) {
-        goto err;
-    }
-    if (!(buf = malloc (buf_len))) {
-        m_msg_set_err (m, EMUNGE_NO_MEMORY, NULL);
-        goto err;
-    }
-    /*  Compress "inner" data.
+    /*  Compress "inner" data into the other work region.
      */
-    n = buf_len;
+    buf = enc_work_other (c);
+    n = c->work_len;
     if (zip_compress_block (m->zip, buf, &n, c->inner, c->inner_len) < 0) {
-        goto err;
+        return (m_msg_set_err (m, EMUNGE_SNAFU,
+            strdup ("Failed to compress credential")));
     }
     /*  Disable compression and discard compressed data if it's larger.
      *    Replace "inner" data with compressed data if it's not.
@@ -491,28 +614,12 @@ enc_compress (munge_cred_t c)
     if (n >= c->inner_len) {
         m->zip = MUNGE_ZIP_NONE;
         *c->outer_zip_ref = m->zip;
-        memset (buf, 0, buf_len);
-        free (buf);
     }
     else {
-        assert (c->inner_mem_len > 0);
-        memset (c->inner_mem, 0, c->inner_mem_len);
-        free (c->inner_mem);
-
-        c->inner_mem = buf;
-        c->inner_mem_len = buf_len;
         c->inner = buf;
         c->inner_len = n;
     }
     return (0);
-
-err:
-    if ((buf_len > 0) && (buf != NULL)) {
-        memset (buf, 0, buf_len);
-        free (buf);
-    }
-    return (m_msg_set_err (m, EMUNGE_SNAFU,
-        strdup ("Failed to compress credential")));
 }
 
 
@@ -521,11 +628,17 @@ enc_mac (munge_cred_t c)
 {
 /*  Computes the Message Authentication Code (MAC) over the entire message
  *    (ie, both "outer" and "inner" data).
+ *  For an AEAD cipher, the authentication tag computed by enc_encrypt()
+ *    is used instead.
  */
     m_msg_t       m = c->msg;
-    mac_ctx       x;                    /* message auth code context         */
+    mac_ctx      *x;                    /* message auth code context         */
     int           n;                    /* all-purpose int                   */
 
+    if (c->version == MUNGE_CRED_VERSION_AEAD) {
+        return (0);
+    }
+
     /*  Init MAC.
      */
     c->mac_len = mac_size (m->mac);
@@ -538,28 +651,35 @@ enc_mac (munge_cred_t c)
     memset (c->mac, 0, c->mac_len);
 
     /*  Compute MAC.
+     *  The context is acquired from this thread's cache of contexts sharing
+     *    the precomputed state keyed by the MAC subkey in order to avoid
+     *    re-deriving it for each credential.
      */
-    if (mac_init (&x, m->mac, conf->mac_key, conf->mac_key_len) < 0) {
+    assert (m->mac < MUNGE_MAC_LAST_ITEM);
+    if (conf->mac_hmac[m->mac] == NULL) {
+        goto err;
+    }
+    if (mac_ctx_acquire (&x, conf->mac_hmac[m->mac]) < 0) {
         goto err;
     }
-    if (mac_update (&x, c->outer, c->outer_len) < 0) {
+    if (mac_update (x, c->outer, c->outer_len) < 0) {
         goto err_cleanup;
     }
-    if (mac_update (&x, c->inner, c->inner_len) < 0) {
+    if (mac_update (x, c->inner, c->inner_len) < 0) {
         goto err_cleanup;
     }
     n = c->mac_len;
-    if (mac_final (&x, c->mac, &n) < 0) {
+    if (mac_final (x, c->mac, &n) < 0) {
         goto err_cleanup;
     }
-    if (mac_cleanup (&x) < 0) {
+    if (mac_ctx_release (x) < 0) {
         goto err;
     }
     assert (n == c->mac_len);
     return (0);
 
 err_cleanup:
-    mac_cleanup (&x);
+    mac_ctx_release (x);
 err:
     return (m_msg_set_err (m, EMUNGE_SNAFU,
         strdup ("Failed to MAC credential")));
@@ -575,7 +695,10 @@ enc_encrypt (munge_cred_t c)
     int               buf_len;          /* length of ciphertext buffer       */
     unsigned char    *buf;              /* ciphertext buffer                 */
     unsigned char    *buf_ptr;          /* ptr into ciphertext buffer        */
-    cipher_ctx        x;                /* cipher context                    */
+    cipher_ctx       *x;                /* cipher context                    */
+    mac_ctx          *y;                /* message auth code context for DEK */
+    unsigned char    *dek_src;          /* data from which DEK is derived    */
+    int               dek_src_len;      /* length of DEK source data         */
     int               n_written;        /* number of bytes written to buf    */
     int               n;                /* all-purpose int                   */
 
@@ -586,6 +709,10 @@ enc_encrypt (munge_cred_t c)
     }
     /*  Compute DEK.
      *  msg-dek = MAC (msg-mac) using DEK subkey
+     *  For an AEAD cipher, the MAC is superseded by the authentication tag
+     *    which is not known until after encryption, so the "outer" data
+     *    (which includes the random nonce) is used instead:
+     *  msg-dek = MAC (msg-outer) using DEK subkey
      */
     c->dek_len = mac_size (m->mac);
     if (c->dek_len <= 0) {
@@ -595,69 +722,88 @@ enc_encrypt (munge_cred_t c)
     }
     assert (c->dek_len <= sizeof (c->dek));
 
+    assert (m->mac < MUNGE_MAC_LAST_ITEM);
     n = c->dek_len;
-    if (mac_block (m->mac, conf->dek_key, conf->dek_key_len,
-            c->dek, &n, c->mac, c->mac_len) < 0) {
+    if ( (conf->dek_hmac[m->mac] == NULL)
+      || (mac_ctx_acquire (&y, conf->dek_hmac[m->mac]) < 0) ) {
         return (m_msg_set_err (m, EMUNGE_SNAFU,
             strdup ("Failed to compute DEK")));
     }
-    assert (n <= c->dek_len);
-    assert (n >= cipher_key_size (m->cipher));
-
-    /*  Allocate memory for ciphertext.
-     *  Ensure enough space by allocating an additional cipher block.
-     */
-    n = cipher_block_size (m->cipher);
-    if (n <= 0) {
+    if (c->version == MUNGE_CRED_VERSION_AEAD) {
+        dek_src = c->outer;
+        dek_src_len = c->outer_len;
+    }
+    else {
+        dek_src = c->mac;
+        dek_src_len = c->mac_len;
+    }
+    if ( (mac_update (y, dek_src, dek_src_len) < 0)
+      || (mac_final (y, c->dek, &n) < 0) ) {
+        mac_ctx_release (y);
         return (m_msg_set_err (m, EMUNGE_SNAFU,
-            strdupf ("Failed to determine block size for cipher type %d",
-                m->cipher)));
+            strdup ("Failed to compute DEK")));
     }
-    buf_len = c->inner_len + n;
-    if (!(buf = malloc (buf_len))) {
-        return (m_msg_set_err (m, EMUNGE_NO_MEMORY, NULL));
+    if (mac_ctx_release (y) < 0) {
+        return (m_msg_set_err (m, EMUNGE_SNAFU,
+            strdup ("Failed to compute DEK")));
     }
-    /*  Encrypt "inner" data.
+    assert (n <= c->dek_len);
+    assert (n >= cipher_key_size (m->cipher));
+
+    /*  Encrypt "inner" data into the other work region.
+     *  enc_alloc() ensured it has space for an additional cipher block.
      */
-    if (cipher_init (&x, m->cipher, c->dek, c->iv, CIPHER_ENCRYPT) < 0) {
+    buf = enc_work_other (c);
+    buf_len = c->work_len;
+
+    if (cipher_ctx_acquire (&x, m->cipher, c->dek, c->iv,
+            CIPHER_ENCRYPT) < 0) {
         goto err;
     }
+    if (c->version == MUNGE_CRED_VERSION_AEAD) {
+        if (cipher_update_aad (x, c->outer, c->outer_len) < 0) {
+            goto err_cleanup;
+        }
+    }
     buf_ptr = buf;
     n_written = 0;
     n = buf_len;
-    if (cipher_update (&x, buf_ptr, &n, c->inner, c->inner_len) < 0) {
+    if (cipher_update (x, buf_ptr, &n, c->inner, c->inner_len) < 0) {
         goto err_cleanup;
     }
     buf_ptr += n;
     n_written += n;
     n = buf_len - n_written;
-    if (cipher_final (&x, buf_ptr, &n) < 0) {
+    if (cipher_final (x, buf_ptr, &n) < 0) {
         goto err_cleanup;
     }
     buf_ptr += n;
     n_written += n;
-    if (cipher_cleanup (&x) < 0) {
+    /*
+     *  Store the AEAD authentication tag in place of the MAC.
+     */
+    if (c->version == MUNGE_CRED_VERSION_AEAD) {
+        c->mac_len = cipher_tag_size (m->cipher);
+        assert (c->mac_len > 0);
+        assert (c->mac_len <= sizeof (c->mac));
+        if (cipher_get_tag (x, c->mac, c->mac_len) < 0) {
+            goto err_cleanup;
+        }
+    }
+    if (cipher_ctx_release (x) < 0) {
         goto err;
     }
     assert (n_written <= buf_len);
 
     /*  Replace "inner" plaintext with ciphertext.
      */
-    assert (c->inner_mem_len > 0);
-    memset (c->inner_mem, 0, c->inner_mem_len);
-    free (c->inner_mem);
-
-    c->inner_mem = buf;
-    c->inner_mem_len = buf_len;
     c->inner = buf;
     c->inner_len = n_written;
     return (0);
 
 err_cleanup:
-    cipher_cleanup (&x);
+    cipher_ctx_release (x);
 err:
-    memset (buf, 0, buf_len);
-    free (buf);
     return (m_msg_set_err (m, EMUNGE_SNAFU,
         strdup ("Failed to encrypt credential")));
 }
@@ -681,13 +827,14 @@ enc_armor (munge_cred_t c)
     prefix_len = strlen (MUNGE_CRED_PREFIX);
     suffix_len = strlen (MUNGE_CRED_SUFFIX);
 
-    /*  Allocate memory for armor'd data.
+    /*  Armor the credential into the region following the work regions.
      */
+    buf = c->work + (2 * c->work_len);
+    buf_len = c->outer_mem_len - (buf - c->outer_mem);
     n = c->outer_len + c->mac_len + c->inner_len;
-    buf_len = prefix_len + base64_encode_length (n) + suffix_len;
-
-    if (!(buf = malloc (buf_len))) {
-        return (m_msg_set_err (m, EMUNGE_NO_MEMORY, NULL));
+    if (buf_len < prefix_len + base64_encode_length (n) + suffix_len) {
+        return (m_msg_set_err (m, EMUNGE_SNAFU,
+            strdup ("Insufficient space to armor credential")));
     }
     buf_ptr = buf;
 
@@ -739,28 +886,15 @@ enc_armor (munge_cred_t c)
 
     /*  Replace "outer+inner" data with armor'd data.
      */
-    assert (c->outer_mem_len > 0);
-    memset (c->outer_mem, 0, c->outer_mem_len);
-    free (c->outer_mem);
-
-    c->outer_mem = buf;
-    c->outer_mem_len = buf_len;
     c->outer = buf;
     c->outer_len = buf_ptr - buf + 1;
-
-    assert (c->inner_mem_len > 0);
-    memset (c->inner_mem, 0, c->inner_mem_len);
-    free (c->inner_mem);
-
-    c->inner_mem = NULL;
-    c->inner_mem_len = 0;
+    c->inner = NULL;
+    c->inner_len = 0;
     return (0);
 
 err_cleanup:
     base64_cleanup (&x);
 err:
-    memset (buf, 0, buf_len);
-    free (buf);
     return (m_msg_set_err (m, EMUNGE_SNAFU,
         strdup ("Failed to base64-encode credential")));
 }
@@ -789,3 +923,15 @@ enc_fini (munge_cred_t c)
     m->data_is_copy = 1;
     return (0);
 }
+
+
+static unsigned char *
+enc_work_other (munge_cred_t c)
+{
+/*  Returns a ptr to the work region not currently holding the "inner" data.
+ */
+    assert (c->work != NULL);
+    assert ((c->inner == c->work) || (c->inner == c->work + c->work_len));
+
+    return ((c->inner == c->work) ? c->work + c->work_len : c->work);
+}
@@ -35,5 +35,7 @@
 
 int enc_process_msg (m_msg_t m);
 
+int enc_process_batch (m_msg_t m);
+
 
 #endif /* !MUNGE_ENC_H */
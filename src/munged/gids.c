@@ -35,18 +35,31 @@
 #include <sys/types.h>                  /* include before grp.h for bsd */
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <pthread.h>
+#include <signal.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
 #include <munge.h>
+#if HAVE_SYS_INOTIFY_H
+#  include <sys/inotify.h>
+#endif /* HAVE_SYS_INOTIFY_H */
 #include "common.h"
 #include "conf.h"
+#include "fd.h"
 #include "gids.h"
 #include "hash.h"
 #include "log.h"
+#include "missing.h"
 #include "munge_defs.h"
 #include "timer.h"
 #include "xgetgr.h"
@@ -57,27 +70,73 @@
  *  Notes
  *****************************************************************************
  *
- *  The gid_hash is used to quickly lookup whether a given UID is a member of a
- *  particular supplementary group GID.  It contains a gid_head for each UID
- *  pointing to a singly-linked list of gid_nodes for each supplementary group
- *  of which that UID is a member.  The list of gid_nodes is sorted in
- *  increasing order of GIDs without duplicates.  This hash is constructed
- *  outside of the gids mutex, and switched in while the mutex is held during
- *  an update to replace the old gid_hash.
+ *  The gid_map is used to quickly lookup whether a given UID is a member of a
+ *  particular supplementary group GID.  It is a single allocation containing
+ *  a sorted array of UIDs, and for each UID an offset into a contiguous array
+ *  of GIDs where that UID's supplementary groups are stored in increasing
+ *  order without duplicates.  A lookup is a binary search for the UID
+ *  followed by a binary search of its GIDs.  This map is constructed outside
+ *  of the gids mutex, and switched in while the mutex is held during an
+ *  update to replace the old gid_map.
+ *
+ *  The gid_hash is used to collect the supplementary groups of each UID
+ *  during the construction of a gid_map, after which it is destroyed.  It
+ *  contains a gid_head for each UID pointing to a singly-linked list of
+ *  gid_nodes for each supplementary group of which that UID is a member.
+ *  The list of gid_nodes is sorted in increasing order of GIDs without
+ *  duplicates.
+ *
+ *  A gid_map is never modified once it has been switched in, so lookups via
+ *  gids_is_member() read it without taking the gids mutex.  Instead, each
+ *  reader registers in one of two reader counts selected by the current epoch
+ *  before loading the gid_map ptr, and deregisters when the lookup is done.
+ *  After an update switches in the new gid_map, _gids_map_synchronize()
+ *  waits for the reader count of each epoch in turn to drain while directing
+ *  new readers to the other count; once both have drained, no reader can
+ *  still hold a ref to the old gid_map, and it is destroyed.  Without atomic
+ *  builtins, lookups fall back to holding the gids mutex.
  *
  *  The uid_hash is used to cache positive & negative user lookups during
- *  the construction of a gid_hash, after which it is destroyed.  It contains
+ *  the construction of a gid_map, after which it is destroyed.  It contains
  *  uid_nodes mapping a unique null-terminated user string to a UID.  It is not
- *  persistent across gid_hash updates.
+ *  persistent across gid_map updates.
+ *
+ *  A gid_map is constructed in three passes.  The group database is scanned
+ *  sequentially (since getgrent() is a stream), collecting a gid_member for
+ *  each user listed in each group along with a uid_node for each unique user.
+ *  The users are then resolved to UIDs via xgetpwnam() by a crew of up to
+ *  GIDS_RESOLVE_THREADS threads, each claiming batches of GIDS_RESOLVE_BATCH
+ *  users at a time; this hides the latency of a remote passwd database (e.g.,
+ *  LDAP via sssd).  Finally, the ghost_hash is updated and the gid_members of
+ *  resolved users are added to the gid_hash by the calling thread.
+ *
+ *  After each successful update, the gid_map is written to a snapshot file.
+ *  At startup, the snapshot is mmap()d and switched in as the initial gid_map
+ *  (if valid) so GID-restricted credentials can be decoded while the first
+ *  update is in progress.  The snapshot is only trusted if it is a regular
+ *  file owned by the daemon's EUID, not writable by group or other, not older
+ *  than the group file, and not older than the update interval (or
+ *  MUNGE_GROUP_UPDATE_SECS if updates are disabled).  The group file mtime
+ *  alone cannot bound its age since a remote group database (e.g., LDAP via
+ *  sssd) can change without modifying it.  When an update is skipped because
+ *  the group file is unchanged, the snapshot's mtime is refreshed since it
+ *  still matches the gid_map being used.
  *
  *  The ghost_hash is used to identify when a user first goes missing from the
  *  passwd file in order for the event to be logged only once; if the user is
- *  later added, the next gid_hash update will clear this user from the
+ *  later added, the next gid_map update will clear this user from the
  *  ghost_hash thereby allowing the event to be re-logged should the user
  *  disappear again.  This hash contains unique null-terminated user strings
  *  from calls to xgetpwnam() that fail with ENOENT.  Users are added when
  *  xgetpwnam() fails, and removed when xgetpwnam() succeeds.  A mutex is not
- *  needed when accessing this hash.  It is persistent across gid_hash updates.
+ *  needed when accessing this hash.  It is persistent across gid_map updates.
+ *
+ *  If group watching is enabled, a watch thread blocks reading inotify events
+ *  for the directories containing the group and passwd files.  When either
+ *  file is modified or replaced, the thread (re)schedules a map update for
+ *  MUNGE_GROUP_WATCH_MSECS later; a burst of changes thereby results in a
+ *  single update once the files are quiescent.  Such an update bypasses the
+ *  group file mtime check since a passwd change does not modify it.
  *
  *  The use of non-reentrant passwd/group functions (i.e., getpwnam & getgrent)
  *  here should not cause problems since they are only called in/from
@@ -95,6 +154,14 @@
 #define GID_HASH_SIZE   2053
 #define UID_HASH_SIZE   4099
 
+#define GIDS_SYNC_MSECS 1
+
+#define GIDS_RESOLVE_BATCH      32
+#define GIDS_RESOLVE_THREADS    8
+
+#define GIDS_MAP_FILE_MAGIC     0x6D474944      /* "mGID" */
+#define GIDS_MAP_FILE_VERSION   1
+
 #ifndef _GIDS_DEBUG
 #define _GIDS_DEBUG     0
 #endif /* !_GIDS_DEBUG */
@@ -104,14 +171,44 @@
  *  Data Types
  *****************************************************************************/
 
+struct gid_map {
+    int                 n_uids;         /* number of UIDs in map             */
+    int                 n_gids;         /* total number of GIDs in map       */
+    uid_t              *uids;           /* sorted array of UIDs              */
+    uint32_t           *offsets;        /* idx of each UID's GIDs (n_uids+1) */
+    gid_t              *gids;           /* sorted GIDs of each UID in turn   */
+    void               *mmap_mem;       /* mmap'd snapshot if loaded from it */
+    size_t              mmap_len;       /* length of mmap'd snapshot         */
+};
+
+struct gid_map_file_hdr {
+    uint32_t            magic;          /* GIDS_MAP_FILE_MAGIC               */
+    uint32_t            version;        /* GIDS_MAP_FILE_VERSION             */
+    uint32_t            uid_size;       /* sizeof (uid_t)                    */
+    uint32_t            gid_size;       /* sizeof (gid_t)                    */
+    uint32_t            n_uids;         /* number of UIDs in map             */
+    uint32_t            n_gids;         /* total number of GIDs in map       */
+};
+
 struct gids {
     pthread_mutex_t     mutex;          /* mutex for accessing struct        */
-    hash_t              gid_hash;       /* hash of GIDs mappings             */
+    struct gid_map     *gid_map;        /* map of UIDs to supplementary GIDs */
+    char               *map_path;       /* pathname of gid_map snapshot file */
     hash_t              ghost_hash;     /* hash of missing users (ghosts!)   */
     long                timer;          /* timer ID for next GIDs map update */
     int                 interval_secs;  /* seconds between GIDs map updates  */
     int                 do_group_stat;  /* true if updates stat group file   */
+    int                 got_change;     /* true if watch saw a file change   */
+    int                 got_snapshot;   /* true if snapshot matches gid_map  */
     time_t              t_last_update;  /* time of last good GIDs map update */
+#if HAVE_SYS_INOTIFY_H
+    int                 watch_fd;       /* inotify fd for group/passwd files */
+    pthread_t           watch_tid;      /* thread for reading inotify events */
+#endif /* HAVE_SYS_INOTIFY_H */
+#if HAVE_ATOMIC_BUILTINS
+    unsigned int        epoch;          /* index of readers count for lookup */
+    unsigned int        readers[2];     /* num lookups in progress per epoch */
+#endif /* HAVE_ATOMIC_BUILTINS */
 };
 
 struct gid_head {
@@ -127,11 +224,32 @@ struct gid_node {
 struct uid_node {
     char               *user;           /* uid_hash key                      */
     uid_t               uid;
+    int                 errnum;         /* errno if user cannot be resolved  */
 };
 
-typedef struct uid_node * uid_node_p;
-typedef struct gid_node * gid_node_p;
-typedef struct gid_head * gid_head_p;
+struct gid_member {
+    struct uid_node    *u;              /* user listed as a member of group  */
+    gid_t               gid;            /* GID of group                      */
+};
+
+struct gid_resolve {
+    pthread_mutex_t     mutex;          /* mutex for claiming batches        */
+    struct uid_node   **users;          /* array of users to resolve         */
+    int                 n_users;        /* number of users in array          */
+    int                 next;           /* idx of next user to be claimed    */
+    size_t              pwbuflen;       /* max len of passwd entry buffers   */
+};
+
+struct gid_map_arg {
+    struct gid_head   **headp;          /* next slot in array of gid_heads   */
+    int                 n_gids;         /* number of GIDs collected          */
+};
+
+typedef struct gid_map    * gid_map_p;
+typedef struct gid_member * gid_member_p;
+typedef struct uid_node   * uid_node_p;
+typedef struct gid_node   * gid_node_p;
+typedef struct gid_head   * gid_head_p;
 
 
 /*****************************************************************************
@@ -139,9 +257,30 @@ typedef struct gid_head * gid_head_p;
  *****************************************************************************/
 
 static void         _gids_map_update (gids_t gids);
-static hash_t       _gids_map_create (hash_t ghost_hash);
-static int          _gids_user_to_uid (hash_t uid_hash, hash_t ghost_hash,
-                        const char *user, uid_t *uid_resultp, xpwbuf_p pwbufp);
+static void         _gids_map_synchronize (gids_t gids);
+#if HAVE_SYS_INOTIFY_H
+static int          _gids_watch_create (gids_t gids);
+static void         _gids_watch_destroy (gids_t gids);
+static void *       _gids_watch_thread (gids_t gids);
+static int          _gids_watch_is_match (const char *name);
+#endif /* HAVE_SYS_INOTIFY_H */
+static gid_map_p    _gids_map_create (hash_t ghost_hash);
+static void         _gids_map_destroy (gid_map_p gid_map);
+static gid_map_p    _gids_map_load (const char *path, int max_age_secs);
+static int          _gids_map_save (gid_map_p gid_map, const char *path);
+static gid_map_p    _gids_map_compact (hash_t gid_hash);
+static int          _gids_map_collect (gid_head_p g, const uid_t *uidp,
+                        struct gid_map_arg *argp);
+static int          _gids_map_cmp (const void *p1, const void *p2);
+static int          _gids_map_is_member (gid_map_p gid_map,
+                        uid_t uid, gid_t gid);
+static int          _gids_users_resolve (uid_node_p *users, int n_users,
+                        size_t *pwbuflenp);
+static void *       _gids_users_resolve_thread (struct gid_resolve *rp);
+static void         _gids_user_resolve (uid_node_p u, xpwbuf_p pwbufp);
+static void         _gids_user_check_ghost (hash_t ghost_hash, uid_node_p u);
+static int          _gids_array_grow (void **pp, int *sizep, int n,
+                        size_t size);
 static int          _gids_gid_add (hash_t gid_hash, uid_t uid, gid_t gid);
 static int          _gids_uid_add (hash_t uid_hash,
                         const char *user, uid_t uid);
@@ -174,7 +313,8 @@ static void         _gids_ghost_node_dump (const char *data, const char *user,
  *****************************************************************************/
 
 gids_t
-gids_create (int interval_secs, int do_group_stat)
+gids_create (int interval_secs, int do_group_stat, int do_group_watch,
+        const char *map_path)
 {
     gids_t gids;
 
@@ -189,7 +329,16 @@ gids_create (int interval_secs, int do_group_stat)
     if ((errno = pthread_mutex_init (&gids->mutex, NULL)) != 0) {
         log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to init gids mutex");
     }
-    gids->gid_hash = NULL;
+    gids->gid_map = NULL;
+    gids->map_path = NULL;
+    if ((map_path != NULL) && (*map_path != '\0')) {
+        if (!(gids->map_path = strdup (map_path))) {
+            log_errno (EMUNGE_NO_MEMORY, LOG_ERR,
+                    "Failed to copy gid map snapshot name string");
+        }
+        gids->gid_map = _gids_map_load (gids->map_path,
+                (interval_secs > 0) ? interval_secs : MUNGE_GROUP_UPDATE_SECS);
+    }
     gids->ghost_hash = hash_create (GHOST_HASH_SIZE,
             (hash_key_f) hash_key_string,
             (hash_cmp_f) strcmp,
@@ -200,7 +349,17 @@ gids_create (int interval_secs, int do_group_stat)
     gids->timer = 0;
     gids->interval_secs = interval_secs;
     gids->do_group_stat = do_group_stat;
+    gids->got_change = 0;
+    gids->got_snapshot = (gids->gid_map != NULL);
     gids->t_last_update = 0;
+#if HAVE_SYS_INOTIFY_H
+    gids->watch_fd = -1;
+#endif /* HAVE_SYS_INOTIFY_H */
+#if HAVE_ATOMIC_BUILTINS
+    gids->epoch = 0;
+    gids->readers[0] = 0;
+    gids->readers[1] = 0;
+#endif /* HAVE_ATOMIC_BUILTINS */
     gids_update (gids);
 
     if (interval_secs == 0) {
@@ -214,6 +373,19 @@ gids_create (int interval_secs, int do_group_stat)
     log_msg (LOG_INFO, "%s supplementary group mtime check of \"%s\"",
             (do_group_stat ? "Enabled" : "Disabled"), GIDS_GROUP_FILE);
 
+    if (do_group_watch) {
+#if HAVE_SYS_INOTIFY_H
+        if (_gids_watch_create (gids) == 0) {
+            log_msg (LOG_INFO,
+                    "Enabled supplementary group watch of \"%s\" & \"%s\"",
+                    GIDS_GROUP_FILE, GIDS_PASSWD_FILE);
+        }
+#else  /* !HAVE_SYS_INOTIFY_H */
+        log_msg (LOG_WARNING,
+                "Supplementary group watch is not supported on this platform");
+#endif /* !HAVE_SYS_INOTIFY_H */
+    }
+
     return (gids);
 }
 
@@ -224,6 +396,10 @@ gids_destroy (gids_t gids)
     if (!gids) {
         return;
     }
+#if HAVE_SYS_INOTIFY_H
+    _gids_watch_destroy (gids);
+#endif /* HAVE_SYS_INOTIFY_H */
+
     if ((errno = pthread_mutex_lock (&gids->mutex)) != 0) {
         log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to lock gids mutex");
     }
@@ -231,8 +407,10 @@ gids_destroy (gids_t gids)
         timer_cancel (gids->timer);
         gids->timer = 0;
     }
-    hash_destroy (gids->gid_hash);
-    gids->gid_hash = NULL;
+    _gids_map_destroy (gids->gid_map);
+    gids->gid_map = NULL;
+    free (gids->map_path);
+    gids->map_path = NULL;
     hash_destroy (gids->ghost_hash);
     gids->ghost_hash = NULL;
 
@@ -283,28 +461,38 @@ gids_update (gids_t gids)
 int
 gids_is_member (gids_t gids, uid_t uid, gid_t gid)
 {
-    int        is_member = 0;
-    gid_head_p g;
-    gid_node_p node;
+    int          is_member;
+    gid_map_p    gid_map;
+#if HAVE_ATOMIC_BUILTINS
+    unsigned int epoch;
+#endif /* HAVE_ATOMIC_BUILTINS */
 
     if (!gids) {
         return (0);
     }
+#if HAVE_ATOMIC_BUILTINS
+    /*  Register as a reader before loading the gid_map ptr so the gid_map
+     *    cannot be destroyed while the lookup is in progress.
+     */
+    epoch = __atomic_load_n (&gids->epoch, __ATOMIC_RELAXED);
+    (void) __atomic_fetch_add (&gids->readers[epoch], 1, __ATOMIC_SEQ_CST);
+    gid_map = __atomic_load_n (&gids->gid_map, __ATOMIC_SEQ_CST);
+#else  /* !HAVE_ATOMIC_BUILTINS */
     if ((errno = pthread_mutex_lock (&gids->mutex)) != 0) {
         log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to lock gids mutex");
     }
-    if ((gids->gid_hash) && (g = hash_find (gids->gid_hash, &uid))) {
-        assert (g->uid == uid);
-        for (node = g->next; node && node->gid <= gid; node = node->next) {
-            if (node->gid == gid) {
-                is_member = 1;
-                break;
-            }
-        }
-    }
+    gid_map = gids->gid_map;
+#endif /* !HAVE_ATOMIC_BUILTINS */
+
+    is_member = _gids_map_is_member (gid_map, uid, gid);
+
+#if HAVE_ATOMIC_BUILTINS
+    (void) __atomic_fetch_sub (&gids->readers[epoch], 1, __ATOMIC_RELEASE);
+#else  /* !HAVE_ATOMIC_BUILTINS */
     if ((errno = pthread_mutex_unlock (&gids->mutex)) != 0) {
         log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to unlock gids mutex");
     }
+#endif /* !HAVE_ATOMIC_BUILTINS */
     return (is_member);
 }
 
@@ -318,11 +506,12 @@ _gids_map_update (gids_t gids)
 {
 /*  Update the GIDs mapping [gids] and schedule the next update.
  */
-    int    do_group_stat;
-    time_t t_last_update;
-    time_t t_now;
-    int    do_update = 1;
-    hash_t gid_hash = NULL;
+    int       do_group_stat;
+    int       got_change;
+    time_t    t_last_update;
+    time_t    t_now;
+    int       do_update = 1;
+    gid_map_p gid_map = NULL;
 
     assert (gids != NULL);
 
@@ -331,6 +520,13 @@ _gids_map_update (gids_t gids)
     }
     do_group_stat = gids->do_group_stat;
     t_last_update = gids->t_last_update;
+    got_change = gids->got_change;
+    gids->got_change = 0;
+    /*
+     *  Clear the timer ID of this expired timer so a subsequent update
+     *    scheduled while the map is being created can be detected below.
+     */
+    gids->timer = 0;
 
     if ((errno = pthread_mutex_unlock (&gids->mutex)) != 0) {
         log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to unlock gids mutex");
@@ -338,7 +534,7 @@ _gids_map_update (gids_t gids)
     if (time (&t_now) == (time_t) -1) {
         log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to query current time");
     }
-    if (do_group_stat > 0) {
+    if ((do_group_stat > 0) && (!got_change)) {
 
         struct stat st;
 
@@ -356,18 +552,36 @@ _gids_map_update (gids_t gids)
     /*  Update the GIDs mapping without holding the mutex.
      */
     if (do_update) {
-        gid_hash = _gids_map_create (gids->ghost_hash);
+        gid_map = _gids_map_create (gids->ghost_hash);
+        if ((gid_map != NULL) && (gids->map_path != NULL)) {
+            gids->got_snapshot =
+                (_gids_map_save (gid_map, gids->map_path) == 0);
+        }
+    }
+    /*  Refresh the snapshot's mtime so it is not rejected as too old at the
+     *    next startup while the group file remains unchanged.
+     */
+    else if ((gids->map_path != NULL) && (gids->got_snapshot)) {
+        if (utimes (gids->map_path, NULL) < 0) {
+            log_msg (LOG_WARNING, "Failed to update mtime of \"%s\": %s",
+                    gids->map_path, strerror (errno));
+        }
     }
     if ((errno = pthread_mutex_lock (&gids->mutex)) != 0) {
         log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to lock gids mutex");
     }
     /*  Replace the old GIDs mapping if the update was successful.
      */
-    if (gid_hash != NULL) {
+    if (gid_map != NULL) {
 
-        hash_t gid_hash_bak = gids->gid_hash;
-        gids->gid_hash = gid_hash;
-        gid_hash = gid_hash_bak;
+#if HAVE_ATOMIC_BUILTINS
+        gid_map = __atomic_exchange_n (&gids->gid_map, gid_map,
+                __ATOMIC_SEQ_CST);
+#else  /* !HAVE_ATOMIC_BUILTINS */
+        gid_map_p gid_map_bak = gids->gid_map;
+        gids->gid_map = gid_map;
+        gid_map = gid_map_bak;
+#endif /* !HAVE_ATOMIC_BUILTINS */
 
         gids->t_last_update = t_now;
     }
@@ -380,10 +594,10 @@ _gids_map_update (gids_t gids)
     if (do_group_stat < -1) {
         gids->do_group_stat = -1;
     }
-    /*  Schedule the next GIDs map update (if applicable).
+    /*  Schedule the next GIDs map update (if applicable) unless one has
+     *    already been scheduled by gids_update() or the watch thread.
      */
-    gids->timer = 0;
-    if (gids->interval_secs > 0) {
+    if ((gids->timer == 0) && (gids->interval_secs > 0)) {
         gids->timer = timer_set_relative ((callback_f) _gids_map_update, gids,
                 gids->interval_secs * 1000);
         if (gids->timer < 0) {
@@ -394,23 +608,231 @@ _gids_map_update (gids_t gids)
     if ((errno = pthread_mutex_unlock (&gids->mutex)) != 0) {
         log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to unlock gids mutex");
     }
-    /*  Clean up the old hash now that the mutex has been released.
+    /*  Clean up the old map now that the mutex has been released
+     *    and no lookups still reference it.
      */
-    if (gid_hash != NULL) {
-        hash_destroy (gid_hash);
+    if (gid_map != NULL) {
+        _gids_map_synchronize (gids);
+        _gids_map_destroy (gid_map);
     }
     return;
 }
 
 
-static hash_t
+static void
+_gids_map_synchronize (gids_t gids)
+{
+/*  Wait for a grace period in which all gids_is_member() lookups that may
+ *    have loaded the previous gid_map ptr have completed.
+ *  The reader count of the inactive epoch is drained first, then new readers
+ *    are directed to it while the reader count of the active epoch drains.
+ *  This is only called from _gids_map_update(), so the epoch is not changed
+ *    concurrently.
+ */
+#if HAVE_ATOMIC_BUILTINS
+    struct timespec ts;
+    unsigned int    epoch;
+    int             i;
+
+    ts.tv_sec = 0;
+    ts.tv_nsec = GIDS_SYNC_MSECS * 1000 * 1000;
+
+    epoch = __atomic_load_n (&gids->epoch, __ATOMIC_RELAXED);
+    for (i = 0; i < 2; i++) {
+        epoch ^= 1;
+        while (__atomic_load_n (&gids->readers[epoch], __ATOMIC_SEQ_CST) > 0) {
+            (void) nanosleep (&ts, NULL);
+        }
+        __atomic_store_n (&gids->epoch, epoch, __ATOMIC_SEQ_CST);
+    }
+#endif /* HAVE_ATOMIC_BUILTINS */
+    return;
+}
+
+
+#if HAVE_SYS_INOTIFY_H
+
+static int
+_gids_watch_create (gids_t gids)
+{
+/*  Create an inotify watch on the directories containing the group and
+ *    passwd files, and start the thread for reading its events.
+ *  The directories are watched instead of the files themselves since these
+ *    files are generally replaced via rename() when modified.
+ *  Return 0 on success, or -1 on error.
+ */
+    const char *paths[] = { GIDS_GROUP_FILE, GIDS_PASSWD_FILE, NULL };
+    const char **pathp;
+    char         dir[PATH_MAX];
+    char        *p;
+    uint32_t     mask;
+
+    assert (gids != NULL);
+    assert (gids->watch_fd < 0);
+
+    if ((gids->watch_fd = inotify_init1 (IN_CLOEXEC)) < 0) {
+        log_msg (LOG_WARNING, "Failed to create inotify instance: %s",
+                strerror (errno));
+        return (-1);
+    }
+    mask = IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE
+        | IN_MOVED_FROM | IN_MOVED_TO;
+
+    for (pathp = paths; *pathp != NULL; pathp++) {
+        if (strlcpy (dir, *pathp, sizeof (dir)) >= sizeof (dir)) {
+            errno = ENAMETOOLONG;
+            goto err;
+        }
+        if ((p = strrchr (dir, '/')) != NULL) {
+            *p = '\0';
+        }
+        if (inotify_add_watch (gids->watch_fd, dir, mask) < 0) {
+            goto err;
+        }
+    }
+    errno = pthread_create (&gids->watch_tid, NULL,
+            (void *(*)(void *)) _gids_watch_thread, gids);
+    if (errno != 0) {
+        log_msg (LOG_WARNING, "Failed to create gids watch thread: %s",
+                strerror (errno));
+        (void) close (gids->watch_fd);
+        gids->watch_fd = -1;
+        return (-1);
+    }
+    return (0);
+
+err:
+    log_msg (LOG_WARNING, "Failed to watch \"%s\": %s",
+            *pathp, strerror (errno));
+    (void) close (gids->watch_fd);
+    gids->watch_fd = -1;
+    return (-1);
+}
+
+
+static void
+_gids_watch_destroy (gids_t gids)
+{
+/*  Stop the watch thread and close the inotify instance.
+ */
+    if (gids->watch_fd < 0) {
+        return;
+    }
+    if ((errno = pthread_cancel (gids->watch_tid)) != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to cancel gids watch thread");
+    }
+    if ((errno = pthread_join (gids->watch_tid, NULL)) != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to join gids watch thread");
+    }
+    (void) close (gids->watch_fd);
+    gids->watch_fd = -1;
+    return;
+}
+
+
+static void *
+_gids_watch_thread (gids_t gids)
+{
+/*  The watch thread.  It blocks reading inotify events, and (re)schedules
+ *    a GIDs map update whenever the group or passwd file changes.
+ *  The thread is canceled while blocked in read().
+ */
+    sigset_t                sigset;
+    int                     cancel_state;
+    char                    buf[4096]
+        __attribute__ ((aligned (__alignof__ (struct inotify_event))));
+    const struct inotify_event *ev;
+    ssize_t                 n;
+    char                   *p;
+    int                     got_change;
+
+    if (sigfillset (&sigset)) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to init gids watch sigset");
+    }
+    if (pthread_sigmask (SIG_SETMASK, &sigset, NULL) != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to set gids watch sigset");
+    }
+    while (1) {
+        n = read (gids->watch_fd, buf, sizeof (buf));
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            log_msg (LOG_ERR, "Failed to read inotify events: %s",
+                    strerror (errno));
+            break;
+        }
+        got_change = 0;
+        for (p = buf; p < buf + n; p += sizeof (*ev) + ev->len) {
+            ev = (const struct inotify_event *) p;
+            if (ev->mask & IN_Q_OVERFLOW) {
+                got_change = 1;
+            }
+            else if ((ev->len > 0) && _gids_watch_is_match (ev->name)) {
+                got_change = 1;
+            }
+        }
+        if (!got_change) {
+            continue;
+        }
+        /*  Defer cancellation while holding the gids mutex.
+         */
+        (void) pthread_setcancelstate (PTHREAD_CANCEL_DISABLE, &cancel_state);
+
+        if ((errno = pthread_mutex_lock (&gids->mutex)) != 0) {
+            log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to lock gids mutex");
+        }
+        if (gids->timer > 0) {
+            timer_cancel (gids->timer);
+        }
+        gids->got_change = 1;
+        gids->timer = timer_set_relative ((callback_f) _gids_map_update, gids,
+                MUNGE_GROUP_WATCH_MSECS);
+        if (gids->timer < 0) {
+            log_errno (EMUNGE_SNAFU, LOG_ERR,
+                    "Failed to schedule gids map update");
+        }
+        if ((errno = pthread_mutex_unlock (&gids->mutex)) != 0) {
+            log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to unlock gids mutex");
+        }
+        (void) pthread_setcancelstate (cancel_state, &cancel_state);
+    }
+    return (NULL);
+}
+
+
+static int
+_gids_watch_is_match (const char *name)
+{
+/*  Return true (non-zero) if the directory entry [name] is the basename of
+ *    the group or passwd file; o/w, return false.
+ */
+    const char *paths[] = { GIDS_GROUP_FILE, GIDS_PASSWD_FILE, NULL };
+    const char **pathp;
+    const char  *p;
+
+    for (pathp = paths; *pathp != NULL; pathp++) {
+        p = strrchr (*pathp, '/');
+        p = (p != NULL) ? p + 1 : *pathp;
+        if (strcmp (name, p) == 0) {
+            return (1);
+        }
+    }
+    return (0);
+}
+
+#endif /* HAVE_SYS_INOTIFY_H */
+
+
+static gid_map_p
 _gids_map_create (hash_t ghost_hash)
 {
-/*  Create a new gid_hash to map UIDs to their supplementary groups.
- *  Return a pointer to the new hash on success, or NULL on error.
+/*  Create a new gid_map to map UIDs to their supplementary groups.
+ *  Return a pointer to the new map on success, or NULL on error.
  */
     static size_t   grbuflen = 0;
     static size_t   pwbuflen = 0;
+    gid_map_p       gid_map = NULL;
     hash_t          gid_hash = NULL;
     hash_t          uid_hash = NULL;
     struct timeval  t_start;
@@ -420,10 +842,15 @@ _gids_map_create (hash_t ghost_hash)
     const int       max_inits = 16;
     struct group    gr;
     xgrbuf_p        grbufp = NULL;
-    xpwbuf_p        pwbufp = NULL;
+    gid_member_p    members = NULL;
+    int             n_members = 0;
+    int             max_members = 0;
+    uid_node_p     *users = NULL;
+    int             n_users = 0;
+    int             max_users = 0;
+    uid_node_p      u;
     char          **userp;
-    uid_t           uid;
-    int             n_users;
+    int             i;
     double          n_seconds;
 
     gid_hash = hash_create (GID_HASH_SIZE,
@@ -448,19 +875,10 @@ _gids_map_create (hash_t ghost_hash)
         log_msg (LOG_ERR, "Failed to query current time");
         goto err;
     }
-    /*  Allocate memory for both the xgetgrent() and xgetpwnam() buffers here.
-     *    The xgetpwnam() buffer will be passed to _gids_user_to_uid() where it
-     *    is used, but allocating it here allows the same buffer to be reused
-     *    throughout a given gid_hash creation cycle.
-     */
     if (!(grbufp = xgetgrbuf_create (grbuflen))) {
         log_msg (LOG_ERR, "Failed to allocate group entry buffer");
         goto err;
     }
-    if (!(pwbufp = xgetpwbuf_create (pwbuflen))) {
-        log_msg (LOG_ERR, "Failed to allocate passwd entry buffer");
-        goto err;
-    }
     do_group_db_close = 1;
 restart:
     xgetgrent_init ();
@@ -475,7 +893,7 @@ restart:
                 continue;
             }
             if ((errno == ERANGE) && (num_inits < max_inits)) {
-                hash_reset (gid_hash);
+                n_members = 0;
                 goto restart;
             }
             log_msg (LOG_ERR, "Failed to query group info: %s",
@@ -484,30 +902,64 @@ restart:
         }
         /*  gr_mem is a null-terminated array of pointers to the
          *    null-terminated user strings belonging to the group.
+         *  Each unique user is added to the uid_hash (and the array of users
+         *    to be resolved) the first time it is seen.
          */
         for (userp = gr.gr_mem; userp && *userp; userp++) {
 
-            int rv = _gids_user_to_uid (uid_hash, ghost_hash,
-                    *userp, &uid, pwbufp);
-
-            if (rv == 0) {
-                if (_gids_gid_add (gid_hash, uid, gr.gr_gid) < 0) {
+            if (!(u = hash_find (uid_hash, *userp))) {
+                if (_gids_uid_add (uid_hash, *userp, UID_SENTINEL) < 0) {
+                    continue;
+                }
+                u = hash_find (uid_hash, *userp);
+                assert (u != NULL);
+                if (_gids_array_grow ((void **) &users, &max_users,
+                            n_users + 1, sizeof (*users)) < 0) {
+                    log_msg (LOG_ERR, "Failed to allocate user array");
                     goto err;
                 }
+                users[n_users++] = u;
             }
+            if (_gids_array_grow ((void **) &members, &max_members,
+                        n_members + 1, sizeof (*members)) < 0) {
+                log_msg (LOG_ERR, "Failed to allocate group member array");
+                goto err;
+            }
+            members[n_members].u = u;
+            members[n_members].gid = gr.gr_gid;
+            n_members++;
         }
     }
     xgetgrent_fini ();
+    do_group_db_close = 0;
     /*
-     *  Record the final size of the xgetpwnam() and xgetgrent() buffers.
-     *    This allows subsequent scans to start with buffers that will
+     *  Record the final size of the xgetgrent() buffer.
+     *    This allows subsequent scans to start with a buffer that will
      *    generally not need to be realloc()d.
      */
-    pwbuflen = xgetpwbuf_get_len (pwbufp);
-    xgetpwbuf_destroy (pwbufp);
     grbuflen = xgetgrbuf_get_len (grbufp);
     xgetgrbuf_destroy (grbufp);
+    grbufp = NULL;
 
+    /*  Resolve the users to UIDs in parallel.
+     */
+    if (_gids_users_resolve (users, n_users, &pwbuflen) < 0) {
+        goto err;
+    }
+    for (i = 0; i < n_users; i++) {
+        _gids_user_check_ghost (ghost_hash, users[i]);
+    }
+    for (i = 0; i < n_members; i++) {
+        if (members[i].u->uid == UID_SENTINEL) {
+            continue;
+        }
+        if (_gids_gid_add (gid_hash, members[i].u->uid, members[i].gid) < 0) {
+            goto err;
+        }
+    }
+    if (!(gid_map = _gids_map_compact (gid_hash))) {
+        goto err;
+    }
     if (gettimeofday (&t_stop, NULL) < 0) {
         log_msg (LOG_ERR, "Failed to query current time");
         goto err;
@@ -519,79 +971,642 @@ restart:
     _gids_ghost_hash_dump (ghost_hash);
 #endif /* _GIDS_DEBUG */
 
-    n_users = hash_count (gid_hash);
-    if (n_users < 0) {
-        log_err (EMUNGE_SNAFU, LOG_ERR,
-                "Failed _gids_map_create: Invalid gid hash ptr");
-    }
     n_seconds = (t_stop.tv_sec - t_start.tv_sec)
         + ((t_stop.tv_usec - t_start.tv_usec) / 1e6);
     log_msg (LOG_INFO,
             "Found %d user%s with supplementary groups in %0.3f seconds",
-            n_users, ((n_users == 1) ? "" : "s"), n_seconds);
+            gid_map->n_uids, ((gid_map->n_uids == 1) ? "" : "s"), n_seconds);
 
+    free (members);
+    free (users);
     hash_destroy (uid_hash);
-    return (gid_hash);
+    hash_destroy (gid_hash);
+    return (gid_map);
 
 err:
     if (do_group_db_close) {
         xgetgrent_fini ();
     }
-    if (pwbufp != NULL) {
-        xgetpwbuf_destroy (pwbufp);
-    }
     if (grbufp != NULL) {
         xgetgrbuf_destroy (grbufp);
     }
+    free (members);
+    free (users);
     if (uid_hash != NULL) {
         hash_destroy (uid_hash);
     }
     if (gid_hash != NULL) {
         hash_destroy (gid_hash);
     }
+    _gids_map_destroy (gid_map);
+    return (NULL);
+}
+
+
+static void
+_gids_map_destroy (gid_map_p gid_map)
+{
+/*  De-allocate the gid_map [gid_map], unmapping its snapshot if mmap'd.
+ */
+    if (!gid_map) {
+        return;
+    }
+    if (gid_map->mmap_mem != NULL) {
+        if (munmap (gid_map->mmap_mem, gid_map->mmap_len) < 0) {
+            log_msg (LOG_WARNING, "Failed to unmap gid map snapshot: %s",
+                    strerror (errno));
+        }
+    }
+    free (gid_map);
+    return;
+}
+
+
+static gid_map_p
+_gids_map_load (const char *path, int max_age_secs)
+{
+/*  Load a gid_map from the snapshot file [path] via mmap().
+ *  The snapshot is rejected if it was last modified more than [max_age_secs]
+ *    seconds ago.
+ *  Return a pointer to the new map on success, or NULL on error or if the
+ *    snapshot does not exist or cannot be trusted.
+ */
+    int                      fd;
+    struct stat              st;
+    struct stat              st_group;
+    time_t                   t_now;
+    void                    *mem = MAP_FAILED;
+    const struct gid_map_file_hdr *hdr;
+    gid_map_p                gid_map = NULL;
+    size_t                   len;
+    const char              *errmsg = NULL;
+    uint32_t                 i;
+    uint32_t                 j;
+
+    assert (path != NULL);
+
+    /*  Do not allow symbolic links in [path] since the parent directories in
+     *    the path of the actual file have not been checked to ensure they are
+     *    secure.
+     */
+    if ((lstat (path, &st) == 0) && S_ISLNK (st.st_mode)) {
+        log_msg (LOG_WARNING,
+                "Ignoring gid map snapshot \"%s\": must not be a symbolic link",
+                path);
+        return (NULL);
+    }
+retry_open:
+    fd = open (path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno == EINTR) {
+            goto retry_open;
+        }
+        if (errno != ENOENT) {
+            log_msg (LOG_WARNING, "Failed to open gid map snapshot \"%s\": %s",
+                    path, strerror (errno));
+        }
+        return (NULL);
+    }
+    /*  A forged snapshot could grant group membership, so the snapshot must
+     *    be owned by the daemon and not writable by anyone else.
+     */
+    if (fstat (fd, &st) < 0) {
+        errmsg = strerror (errno);
+    }
+    else if (!S_ISREG (st.st_mode)) {
+        errmsg = "must be a regular file";
+    }
+    else if (st.st_uid != geteuid ()) {
+        errmsg = "must be owned by the daemon's EUID";
+    }
+    else if (st.st_mode & (S_IWGRP | S_IWOTH)) {
+        errmsg = "must not be writable by group or other";
+    }
+    else if (st.st_size < (off_t) sizeof (*hdr)) {
+        errmsg = "truncated header";
+    }
+    /*  A snapshot older than the group file predates a change to the group
+     *    database and may grant memberships that have since been revoked.
+     */
+    else if (stat (GIDS_GROUP_FILE, &st_group) < 0) {
+        errmsg = "unable to stat group file";
+    }
+    else if (st.st_mtime < st_group.st_mtime) {
+        errmsg = "older than group file";
+    }
+    /*  The group file mtime does not change when a remote group database is
+     *    updated, so the snapshot's age must be bounded as well.
+     */
+    else if (time (&t_now) == (time_t) -1) {
+        errmsg = "unable to query current time";
+    }
+    else if (st.st_mtime > t_now) {
+        errmsg = "modified in the future";
+    }
+    else if ((t_now - st.st_mtime) > max_age_secs) {
+        errmsg = "older than maximum age";
+    }
+    else if ((mem = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0))
+            == MAP_FAILED) {
+        errmsg = strerror (errno);
+    }
+    (void) close (fd);
+
+    if (errmsg != NULL) {
+        goto err;
+    }
+    hdr = mem;
+    if (hdr->magic != GIDS_MAP_FILE_MAGIC) {
+        errmsg = "invalid magic";
+        goto err;
+    }
+    if (hdr->version != GIDS_MAP_FILE_VERSION) {
+        errmsg = "unsupported version";
+        goto err;
+    }
+    if ((hdr->uid_size != sizeof (uid_t)) || (hdr->gid_size != sizeof (gid_t))
+            || (hdr->n_uids > INT_MAX) || (hdr->n_gids > INT_MAX)) {
+        errmsg = "incompatible format";
+        goto err;
+    }
+    len = sizeof (*hdr)
+        + ((size_t) hdr->n_uids * sizeof (uid_t))
+        + (((size_t) hdr->n_uids + 1) * sizeof (uint32_t))
+        + ((size_t) hdr->n_gids * sizeof (gid_t));
+    if (len != (size_t) st.st_size) {
+        errmsg = "invalid length";
+        goto err;
+    }
+    if (!(gid_map = malloc (sizeof (*gid_map)))) {
+        errmsg = strerror (ENOMEM);
+        goto err;
+    }
+    gid_map->n_uids = hdr->n_uids;
+    gid_map->n_gids = hdr->n_gids;
+    gid_map->uids = (uid_t *) (hdr + 1);
+    gid_map->offsets = (uint32_t *) (gid_map->uids + gid_map->n_uids);
+    gid_map->gids = (gid_t *) (gid_map->offsets + gid_map->n_uids + 1);
+    gid_map->mmap_mem = mem;
+    gid_map->mmap_len = st.st_size;
+    /*
+     *  Validate the ordering invariants relied upon by the binary searches.
+     */
+    if ((gid_map->offsets[0] != 0)
+            || (gid_map->offsets[gid_map->n_uids] != hdr->n_gids)) {
+        errmsg = "invalid offsets";
+        goto err;
+    }
+    for (i = 0; i < hdr->n_uids; i++) {
+        if ((gid_map->offsets[i] > gid_map->offsets[i + 1])
+                || (gid_map->offsets[i + 1] > hdr->n_gids)
+                || ((i > 0) && (gid_map->uids[i - 1] >= gid_map->uids[i]))) {
+            errmsg = "invalid ordering";
+            goto err;
+        }
+        for (j = gid_map->offsets[i] + 1; j < gid_map->offsets[i + 1]; j++) {
+            if (gid_map->gids[j - 1] >= gid_map->gids[j]) {
+                errmsg = "invalid ordering";
+                goto err;
+            }
+        }
+    }
+    log_msg (LOG_INFO, "Loaded %d user%s with supplementary groups from \"%s\"",
+            gid_map->n_uids, ((gid_map->n_uids == 1) ? "" : "s"), path);
+    return (gid_map);
+
+err:
+    log_msg (LOG_WARNING, "Ignoring gid map snapshot \"%s\": %s",
+            path, errmsg);
+    if (gid_map != NULL) {
+        _gids_map_destroy (gid_map);
+    }
+    else if (mem != MAP_FAILED) {
+        (void) munmap (mem, st.st_size);
+    }
     return (NULL);
 }
 
 
 static int
-_gids_user_to_uid (hash_t uid_hash, hash_t ghost_hash,
-        const char *user, uid_t *uid_resultp, xpwbuf_p pwbufp)
+_gids_map_save (gid_map_p gid_map, const char *path)
 {
-/*  Lookup the UID of [user].
- *    [pwbufp] is a pre-allocated buffer for xgetpwnam() (see above comments).
- *  Set [*uid_resultp] (if non-NULL), and return 0 on success or -1 on error.
+/*  Write the gid_map [gid_map] to the snapshot file [path].
+ *  The snapshot is written to a temporary file which is then renamed over
+ *    [path] so a concurrent or subsequent load never sees a partial file.
+ *  Return 0 on success, or -1 on error.
+ */
+    struct gid_map_file_hdr hdr;
+    char                    tmp_path[PATH_MAX];
+    int                     fd;
+    size_t                  len;
+    int                     n;
+
+    assert (gid_map != NULL);
+    assert (gid_map->mmap_mem == NULL);
+    assert (path != NULL);
+
+    n = snprintf (tmp_path, sizeof (tmp_path), "%s.tmp", path);
+    if ((n < 0) || ((size_t) n >= sizeof (tmp_path))) {
+        log_msg (LOG_WARNING, "Failed to write gid map snapshot \"%s\": %s",
+                path, strerror (ENAMETOOLONG));
+        return (-1);
+    }
+    if ((unlink (tmp_path) < 0) && (errno != ENOENT)) {
+        log_msg (LOG_WARNING, "Failed to unlink \"%s\": %s",
+                tmp_path, strerror (errno));
+    }
+retry_open:
+    fd = open (tmp_path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        if (errno == EINTR) {
+            goto retry_open;
+        }
+        log_msg (LOG_WARNING, "Failed to create gid map snapshot \"%s\": %s",
+                tmp_path, strerror (errno));
+        return (-1);
+    }
+    memset (&hdr, 0, sizeof (hdr));
+    hdr.magic = GIDS_MAP_FILE_MAGIC;
+    hdr.version = GIDS_MAP_FILE_VERSION;
+    hdr.uid_size = sizeof (uid_t);
+    hdr.gid_size = sizeof (gid_t);
+    hdr.n_uids = gid_map->n_uids;
+    hdr.n_gids = gid_map->n_gids;
+
+    /*  The UID, offset, and GID arrays of a compacted map are contiguous.
+     */
+    len = ((size_t) gid_map->n_uids * sizeof (uid_t))
+        + (((size_t) gid_map->n_uids + 1) * sizeof (uint32_t))
+        + ((size_t) gid_map->n_gids * sizeof (gid_t));
+    assert ((unsigned char *) (gid_map->gids + gid_map->n_gids)
+            == (unsigned char *) gid_map->uids + len);
+
+    if ((fd_write_n (fd, &hdr, sizeof (hdr)) < 0)
+            || (fd_write_n (fd, gid_map->uids, len) < 0)) {
+        log_msg (LOG_WARNING, "Failed to write gid map snapshot \"%s\": %s",
+                tmp_path, strerror (errno));
+        goto err;
+    }
+    if (close (fd) < 0) {
+        fd = -1;
+        log_msg (LOG_WARNING, "Failed to close gid map snapshot \"%s\": %s",
+                tmp_path, strerror (errno));
+        goto err;
+    }
+    fd = -1;
+    if (rename (tmp_path, path) < 0) {
+        log_msg (LOG_WARNING, "Failed to rename \"%s\" to \"%s\": %s",
+                tmp_path, path, strerror (errno));
+        goto err;
+    }
+    return (0);
+
+err:
+    if (fd >= 0) {
+        (void) close (fd);
+    }
+    (void) unlink (tmp_path);
+    return (-1);
+}
+
+
+static gid_map_p
+_gids_map_compact (hash_t gid_hash)
+{
+/*  Create a new gid_map from the UIDs and supplementary groups in [gid_hash].
+ *  The map is allocated as a single block so its arrays are contiguous.
+ *  Return a pointer to the new map on success, or NULL on error.
+ */
+    gid_map_p           gid_map = NULL;
+    gid_head_p         *heads = NULL;
+    struct gid_map_arg  arg;
+    gid_node_p          node;
+    int                 n_uids;
+    int                 n_gids;
+    size_t              len;
+    int                 i, j;
+
+    n_uids = hash_count (gid_hash);
+    if (n_uids < 0) {
+        log_err (EMUNGE_SNAFU, LOG_ERR,
+                "Failed _gids_map_compact: Invalid gid hash ptr");
+    }
+    if ((n_uids > 0) && !(heads = malloc (n_uids * sizeof (*heads)))) {
+        log_msg (LOG_ERR, "Failed to allocate gid map index");
+        goto err;
+    }
+    arg.headp = heads;
+    arg.n_gids = 0;
+    (void) hash_for_each (gid_hash, (hash_arg_f) _gids_map_collect, &arg);
+    assert (arg.headp == heads + n_uids);
+    n_gids = arg.n_gids;
+
+    if (n_uids > 1) {
+        qsort (heads, n_uids, sizeof (*heads), _gids_map_cmp);
+    }
+    len = sizeof (*gid_map)
+        + (n_uids * sizeof (uid_t))
+        + ((n_uids + 1) * sizeof (uint32_t))
+        + (n_gids * sizeof (gid_t));
+
+    if (!(gid_map = malloc (len))) {
+        log_msg (LOG_ERR, "Failed to allocate gid map");
+        goto err;
+    }
+    gid_map->n_uids = n_uids;
+    gid_map->n_gids = n_gids;
+    gid_map->uids = (uid_t *) (gid_map + 1);
+    gid_map->offsets = (uint32_t *) (gid_map->uids + n_uids);
+    gid_map->gids = (gid_t *) (gid_map->offsets + n_uids + 1);
+    gid_map->mmap_mem = NULL;
+    gid_map->mmap_len = 0;
+
+    for (i = 0, j = 0; i < n_uids; i++) {
+        gid_map->uids[i] = heads[i]->uid;
+        gid_map->offsets[i] = j;
+        for (node = heads[i]->next; node; node = node->next) {
+            gid_map->gids[j++] = node->gid;
+        }
+    }
+    gid_map->offsets[n_uids] = j;
+    assert (j == n_gids);
+
+    free (heads);
+    return (gid_map);
+
+err:
+    free (heads);
+    return (NULL);
+}
+
+
+static int
+_gids_map_collect (gid_head_p g, const uid_t *uidp, struct gid_map_arg *argp)
+{
+/*  Append the gid_head [g] to the array of gid_heads in [argp],
+ *    and add the number of GIDs in its list to the GID count.
+ *  Return 1 to count the gid_head.
+ */
+    gid_node_p node;
+
+    *argp->headp++ = g;
+    for (node = g->next; node; node = node->next) {
+        argp->n_gids++;
+    }
+    return (1);
+}
+
+
+static int
+_gids_map_cmp (const void *p1, const void *p2)
+{
+/*  qsort() comparison function for sorting gid_head ptrs by UID.
+ */
+    const gid_head_p g1 = *(const gid_head_p *) p1;
+    const gid_head_p g2 = *(const gid_head_p *) p2;
+
+    return (_gids_gid_head_cmp (&g1->uid, &g2->uid));
+}
+
+
+static int
+_gids_map_is_member (gid_map_p gid_map, uid_t uid, gid_t gid)
+{
+/*  Return true (non-zero) if user [uid] is a member of the supplementary
+ *    group [gid] according to [gid_map]; o/w, return false.
+ */
+    int lo, hi, mid, end;
+
+    if (!gid_map) {
+        return (0);
+    }
+    lo = 0;
+    hi = gid_map->n_uids;
+    while (lo < hi) {
+        mid = lo + ((hi - lo) / 2);
+        if (gid_map->uids[mid] < uid) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    if ((lo >= gid_map->n_uids) || (gid_map->uids[lo] != uid)) {
+        return (0);
+    }
+    end = hi = gid_map->offsets[lo + 1];
+    lo = gid_map->offsets[lo];
+    while (lo < hi) {
+        mid = lo + ((hi - lo) / 2);
+        if (gid_map->gids[mid] < gid) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    return ((lo < end) && (gid_map->gids[lo] == gid));
+}
+
+
+static int
+_gids_users_resolve (uid_node_p *users, int n_users, size_t *pwbuflenp)
+{
+/*  Resolve the [n_users] users in the [users] array to UIDs.
+ *    [*pwbuflenp] is the initial length of each passwd entry buffer; it is
+ *    updated with the largest length needed so subsequent updates can start
+ *    with buffers that will generally not need to be realloc()d.
+ *  Up to GIDS_RESOLVE_THREADS threads are spawned to resolve users in
+ *    batches of GIDS_RESOLVE_BATCH.  If no threads can be spawned, the
+ *    calling thread resolves all users.
+ *  Return 0 on success, or -1 on error.
+ */
+    struct gid_resolve r;
+    pthread_t          tids[GIDS_RESOLVE_THREADS];
+    int                n_threads;
+    int                i;
+
+    if (n_users <= 0) {
+        return (0);
+    }
+    if ((errno = pthread_mutex_init (&r.mutex, NULL)) != 0) {
+        log_msg (LOG_ERR, "Failed to init gids resolve mutex: %s",
+                strerror (errno));
+        return (-1);
+    }
+    r.users = users;
+    r.n_users = n_users;
+    r.next = 0;
+    r.pwbuflen = *pwbuflenp;
+
+    n_threads = (n_users + GIDS_RESOLVE_BATCH - 1) / GIDS_RESOLVE_BATCH;
+    if (n_threads > GIDS_RESOLVE_THREADS) {
+        n_threads = GIDS_RESOLVE_THREADS;
+    }
+    /*  A single batch is resolved by the calling thread.
+     */
+    if (n_threads <= 1) {
+        n_threads = 0;
+    }
+    for (i = 0; i < n_threads; i++) {
+        errno = pthread_create (&tids[i], NULL,
+                (void *(*)(void *)) _gids_users_resolve_thread, &r);
+        if (errno != 0) {
+            log_msg (LOG_WARNING, "Failed to create gids resolve thread: %s",
+                    strerror (errno));
+            break;
+        }
+    }
+    n_threads = i;
+    if (n_threads == 0) {
+        (void) _gids_users_resolve_thread (&r);
+    }
+    for (i = 0; i < n_threads; i++) {
+        if ((errno = pthread_join (tids[i], NULL)) != 0) {
+            log_errno (EMUNGE_SNAFU, LOG_ERR,
+                    "Failed to join gids resolve thread");
+        }
+    }
+    if ((errno = pthread_mutex_destroy (&r.mutex)) != 0) {
+        log_msg (LOG_ERR, "Failed to destroy gids resolve mutex: %s",
+                strerror (errno));
+    }
+    *pwbuflenp = r.pwbuflen;
+    return ((r.next < n_users) ? -1 : 0);
+}
+
+
+static void *
+_gids_users_resolve_thread (struct gid_resolve *rp)
+{
+/*  Resolve batches of users claimed from [rp] until none remain.
+ *  Each thread uses its own passwd entry buffer.
+ */
+    xpwbuf_p pwbufp;
+    size_t   len;
+    int      i, n;
+
+    if ((errno = pthread_mutex_lock (&rp->mutex)) != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to lock gids resolve mutex");
+    }
+    len = rp->pwbuflen;
+
+    if ((errno = pthread_mutex_unlock (&rp->mutex)) != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR,
+                "Failed to unlock gids resolve mutex");
+    }
+    if (!(pwbufp = xgetpwbuf_create (len))) {
+        log_msg (LOG_ERR, "Failed to allocate passwd entry buffer");
+        return (NULL);
+    }
+    while (1) {
+        if ((errno = pthread_mutex_lock (&rp->mutex)) != 0) {
+            log_errno (EMUNGE_SNAFU, LOG_ERR,
+                    "Failed to lock gids resolve mutex");
+        }
+        i = rp->next;
+        n = rp->n_users - i;
+        if (n > GIDS_RESOLVE_BATCH) {
+            n = GIDS_RESOLVE_BATCH;
+        }
+        rp->next += n;
+
+        if ((errno = pthread_mutex_unlock (&rp->mutex)) != 0) {
+            log_errno (EMUNGE_SNAFU, LOG_ERR,
+                    "Failed to unlock gids resolve mutex");
+        }
+        if (n <= 0) {
+            break;
+        }
+        while (n-- > 0) {
+            _gids_user_resolve (rp->users[i++], pwbufp);
+        }
+    }
+    len = xgetpwbuf_get_len (pwbufp);
+    xgetpwbuf_destroy (pwbufp);
+
+    if ((errno = pthread_mutex_lock (&rp->mutex)) != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to lock gids resolve mutex");
+    }
+    if (len > rp->pwbuflen) {
+        rp->pwbuflen = len;
+    }
+    if ((errno = pthread_mutex_unlock (&rp->mutex)) != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR,
+                "Failed to unlock gids resolve mutex");
+    }
+    return (NULL);
+}
+
+
+static void
+_gids_user_resolve (uid_node_p u, xpwbuf_p pwbufp)
+{
+/*  Lookup the UID of the user in uid_node [u], setting its uid on success
+ *    or its errnum on error.
+ *    [pwbufp] is this thread's buffer for xgetpwnam().
  */
-    uid_node_p    u;
-    uid_t         uid = UID_SENTINEL;
     struct passwd pw;
 
-    if ((u = hash_find (uid_hash, user))) {
-        uid = u->uid;
+    if (xgetpwnam (u->user, &pw, pwbufp) == 0) {
+        u->uid = pw.pw_uid;
+        u->errnum = 0;
     }
-    else if (xgetpwnam (user, &pw, pwbufp) == 0) {
-        uid = pw.pw_uid;
-        (void) _gids_uid_add (uid_hash, user, uid);
-        (void) _gids_ghost_del (ghost_hash, user);
+    else {
+        u->uid = UID_SENTINEL;
+        u->errnum = errno;
+    }
+    return;
+}
+
+
+static void
+_gids_user_check_ghost (hash_t ghost_hash, uid_node_p u)
+{
+/*  Update the [ghost_hash] for the resolved user in uid_node [u], logging
+ *    the first time a user goes missing from the passwd file.
+ */
+    if (u->uid != UID_SENTINEL) {
+        (void) _gids_ghost_del (ghost_hash, u->user);
     }
-    else if (errno == ENOENT) {
-        (void) _gids_uid_add (uid_hash, user, uid);
-        if (!hash_find (ghost_hash, user)) {
-            (void) _gids_ghost_add (ghost_hash, user);
+    else if (u->errnum == ENOENT) {
+        if (!hash_find (ghost_hash, u->user)) {
+            (void) _gids_ghost_add (ghost_hash, u->user);
             log_msg (LOG_INFO,
                     "Failed to query passwd file for \"%s\": User not found",
-                    user);
+                    u->user);
         }
     }
     else {
         log_msg (LOG_INFO, "Failed to query passwd file for \"%s\": %s",
-                user, strerror (errno));
+                u->user, strerror (u->errnum));
     }
-    if (uid == UID_SENTINEL) {
-        return (-1);
+    return;
+}
+
+
+static int
+_gids_array_grow (void **pp, int *sizep, int n, size_t size)
+{
+/*  Grow the array [*pp] of [*sizep] elements of [size] bytes each (if
+ *    needed) to hold at least [n] elements.
+ *  Return 0 on success, or -1 on error.
+ */
+    void *p;
+    int   new_size;
+
+    if (n <= *sizep) {
+        return (0);
     }
-    if (uid_resultp != NULL) {
-        *uid_resultp = uid;
+    new_size = (*sizep > 0) ? *sizep * 2 : 1024;
+    while (new_size < n) {
+        new_size *= 2;
+    }
+    if (!(p = realloc (*pp, (size_t) new_size * size))) {
+        return (-1);
     }
+    *pp = p;
+    *sizep = new_size;
     return (0);
 }
 
@@ -811,6 +1826,7 @@ _gids_uid_node_create (const char *user, uid_t uid)
         return (NULL);
     }
     u->uid = uid;
+    u->errnum = 0;
     return (u);
 }
 
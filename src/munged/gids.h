@@ -35,6 +35,7 @@
  *****************************************************************************/
 
 #define GIDS_GROUP_FILE         "/etc/group"
+#define GIDS_PASSWD_FILE        "/etc/passwd"
 
 
 /*****************************************************************************
@@ -51,13 +52,21 @@ typedef struct gids * gids_t;
  *  Functions
  *****************************************************************************/
 
-gids_t gids_create (int interval_secs, int do_group_stat);
+gids_t gids_create (int interval_secs, int do_group_stat, int do_group_watch,
+    const char *map_path);
 /*
  *  Creates a list of supplementary GIDs for each UID based on information
  *    from getgrent().
  *  The [interval_secs] is the number of seconds between updates.
  *  The [do_group_stat] flag specifies whether the /etc/group mtime is
  *    checked to determine if updates are needed.
+ *  The [do_group_watch] flag specifies whether /etc/group and /etc/passwd
+ *    are watched for changes that trigger an update.
+ *  The [map_path] is the pathname of the snapshot file from which the
+ *    initial mapping is loaded and to which each update is written;
+ *    if NULL or empty, no snapshot is used.  A snapshot last modified more
+ *    than [interval_secs] seconds ago (or MUNGE_GROUP_UPDATE_SECS if updates
+ *    are disabled) is not loaded.
  *  Returns a GIDs mapping or dies trying.
  */
 
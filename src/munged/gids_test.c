@@ -0,0 +1,271 @@
+/*****************************************************************************
+ *  This file is part of the MUNGE Uid 'N' Gid Emporium (MUNGE).
+ *  For details, see <https://dun.github.io/munge/>.
+ *
+ *  MUNGE is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.  Additionally for the MUNGE library (libmunge), you
+ *  can redistribute it and/or modify it under the terms of the GNU Lesser
+ *  General Public License as published by the Free Software Foundation,
+ *  either version 3 of the License, or (at your option) any later version.
+ *
+ *  MUNGE is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  and GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  and GNU Lesser General Public License along with MUNGE.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+
+#if HAVE_CONFIG_H
+#  include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+#include "conf.h"
+#include "gids.h"
+#include "log.h"
+#include "tap.h"
+
+
+/*****************************************************************************
+ *  Exercises the validation of the gid map snapshot loaded at startup.
+ *    Snapshots are written here in the on-disk format of gids.c since the
+ *    daemon only writes well-formed ones.
+ *****************************************************************************/
+
+#define MAP_FILE_MAGIC  0x6D474944      /* "mGID" */
+#define MAP_FILE_VERSION 1
+
+#define INTERVAL_SECS   60
+
+struct map_file_hdr {
+    uint32_t            magic;
+    uint32_t            version;
+    uint32_t            uid_size;
+    uint32_t            gid_size;
+    uint32_t            n_uids;
+    uint32_t            n_gids;
+};
+
+#define MAP_FILE_LEN    (sizeof (struct map_file_hdr) + (2 * sizeof (uid_t)) \
+                        + (3 * sizeof (uint32_t)) + (3 * sizeof (gid_t)))
+
+struct conf test_conf;
+conf_t conf = &test_conf;
+
+static char dir[] = "gids_test.XXXXXX";
+static char path[PATH_MAX];
+static char link_path[PATH_MAX];
+static FILE *log_fp;
+
+
+static void
+write_snapshot (const uid_t uids[2], const gid_t gids[3], int trim)
+{
+/*  Writes a snapshot mapping the two [uids] to the three [gids]; the first
+ *    UID has the first two GIDs, and the second UID has the last one.
+ *    The last [trim] bytes are omitted.
+ */
+    struct map_file_hdr hdr;
+    uint32_t offsets[3] = { 0, 2, 3 };
+    unsigned char buf[MAP_FILE_LEN];
+    unsigned char *p = buf;
+    int fd;
+
+    hdr.magic = MAP_FILE_MAGIC;
+    hdr.version = MAP_FILE_VERSION;
+    hdr.uid_size = sizeof (uid_t);
+    hdr.gid_size = sizeof (gid_t);
+    hdr.n_uids = 2;
+    hdr.n_gids = 3;
+    memcpy (p, &hdr, sizeof (hdr));
+    p += sizeof (hdr);
+    memcpy (p, uids, sizeof (uid_t) * 2);
+    p += sizeof (uid_t) * 2;
+    memcpy (p, offsets, sizeof (offsets));
+    p += sizeof (offsets);
+    memcpy (p, gids, sizeof (gid_t) * 3);
+
+    (void) unlink (path);
+    if (((fd = open (path, O_WRONLY | O_CREAT | O_EXCL, 0600)) < 0)
+            || (write (fd, buf, sizeof (buf) - trim)
+                != (ssize_t) (sizeof (buf) - trim))
+            || (close (fd) < 0)) {
+        BAIL_OUT ("Failed to write snapshot \"%s\"", path);
+    }
+}
+
+
+static void
+age_snapshot (time_t secs)
+{
+/*  Sets the mtime of the snapshot to [secs] seconds ago.
+ */
+    struct timeval tv[2];
+
+    tv[0].tv_sec = tv[1].tv_sec = time (NULL) - secs;
+    tv[0].tv_usec = tv[1].tv_usec = 0;
+    if (utimes (path, tv) < 0) {
+        BAIL_OUT ("Failed to set mtime of snapshot \"%s\"", path);
+    }
+}
+
+
+static const char *
+load_snapshot (const char *name, int interval_secs, int *is_member)
+{
+/*  Creates a gids mapping with the snapshot [name], setting [*is_member] to
+ *    whether the memberships in that snapshot are found.
+ *  Since the timer thread is not running, the initial update never replaces
+ *    the map loaded from the snapshot.
+ *  Returns the messages logged while loading the snapshot.
+ */
+    static char buf[4096];
+    gids_t gids;
+    size_t n;
+
+    rewind (log_fp);
+    if (ftruncate (fileno (log_fp), 0) < 0) {
+        BAIL_OUT ("Failed to truncate log");
+    }
+    gids = gids_create (interval_secs, 0, 0, name);
+    if (!gids) {
+        BAIL_OUT ("Failed to create gids");
+    }
+    *is_member = gids_is_member (gids, 1001, 2001)
+        && gids_is_member (gids, 1001, 2002)
+        && gids_is_member (gids, 1002, 2003)
+        && !gids_is_member (gids, 1002, 2001);
+    gids_destroy (gids);
+
+    rewind (log_fp);
+    n = fread (buf, 1, sizeof (buf) - 1, log_fp);
+    buf[n] = '\0';
+    return (buf);
+}
+
+
+static int
+is_ignored (const char *name, int interval_secs, const char *reason)
+{
+/*  Returns true if the snapshot [name] is ignored for the given [reason].
+ */
+    char msg[PATH_MAX + 64];
+    const char *log;
+    int is_member;
+
+    (void) snprintf (msg, sizeof (msg), "Ignoring gid map snapshot \"%s\": %s",
+            name, reason);
+    log = load_snapshot (name, interval_secs, &is_member);
+    if (!strstr (log, msg)) {
+        diag ("%s", log);
+        return (0);
+    }
+    return (!is_member);
+}
+
+
+static int
+is_loaded (const char *name, int interval_secs)
+{
+/*  Returns true if the snapshot [name] is loaded.
+ */
+    char msg[PATH_MAX + 64];
+    const char *log;
+    int is_member;
+
+    (void) snprintf (msg, sizeof (msg),
+            "Loaded 2 users with supplementary groups from \"%s\"", name);
+    log = load_snapshot (name, interval_secs, &is_member);
+    if (!strstr (log, msg)) {
+        diag ("%s", log);
+        return (0);
+    }
+    return (is_member);
+}
+
+
+int
+main (int argc, char *argv[])
+{
+    const uid_t uids[2] = { 1001, 1002 };
+    const uid_t uids_misordered[2] = { 1002, 1001 };
+    const gid_t gids[3] = { 2001, 2002, 2003 };
+    const gid_t gids_misordered[3] = { 2002, 2001, 2003 };
+
+    plan (10);
+
+    if (!(log_fp = tmpfile ())
+            || (log_open_file (log_fp, NULL, LOG_INFO, LOG_OPT_NONE) < 0)) {
+        BAIL_OUT ("Failed to open log");
+    }
+    if (!mkdtemp (dir)) {
+        BAIL_OUT ("Failed to create directory");
+    }
+    (void) snprintf (path, sizeof (path), "%s/gids.map", dir);
+    (void) snprintf (link_path, sizeof (link_path), "%s/gids.link", dir);
+
+    write_snapshot (uids, gids, 0);
+    ok (is_loaded (path, INTERVAL_SECS), "Loaded valid snapshot");
+
+    if (symlink ("gids.map", link_path) < 0) {
+        BAIL_OUT ("Failed to create symlink \"%s\"", link_path);
+    }
+    ok (is_ignored (link_path, INTERVAL_SECS, "must not be a symbolic link"),
+            "Ignored snapshot via symbolic link");
+
+    if (chmod (path, 0620) < 0) {
+        BAIL_OUT ("Failed to chmod snapshot \"%s\"", path);
+    }
+    ok (is_ignored (path, INTERVAL_SECS,
+            "must not be writable by group or other"),
+            "Ignored group-writable snapshot");
+
+    write_snapshot (uids, gids, sizeof (gid_t));
+    ok (is_ignored (path, INTERVAL_SECS, "invalid length"),
+            "Ignored truncated snapshot");
+
+    write_snapshot (uids, gids, MAP_FILE_LEN - (sizeof (uint32_t) * 3));
+    ok (is_ignored (path, INTERVAL_SECS, "truncated header"),
+            "Ignored snapshot with truncated header");
+
+    write_snapshot (uids_misordered, gids, 0);
+    ok (is_ignored (path, INTERVAL_SECS, "invalid ordering"),
+            "Ignored snapshot with misordered UIDs");
+
+    write_snapshot (uids, gids_misordered, 0);
+    ok (is_ignored (path, INTERVAL_SECS, "invalid ordering"),
+            "Ignored snapshot with misordered GIDs");
+
+    write_snapshot (uids, gids, 0);
+    age_snapshot (INTERVAL_SECS * 2);
+    ok (is_ignored (path, INTERVAL_SECS, "older than maximum age"),
+            "Ignored snapshot older than update interval");
+
+    ok (is_loaded (path, 0),
+            "Loaded snapshot within default age when updates are disabled");
+
+    age_snapshot (-INTERVAL_SECS);
+    ok (is_ignored (path, INTERVAL_SECS, "modified in the future"),
+            "Ignored snapshot modified in the future");
+
+    (void) unlink (link_path);
+    (void) unlink (path);
+    (void) rmdir (dir);
+    log_close_file ();
+    done_testing ();
+}
@@ -46,6 +46,9 @@
 
 #define HASH_DEF_SIZE           1213
 #define HASH_NODE_ALLOC_NUM     1024
+#define HASH_LOAD_MAX           2       /* grow if more items/slot than this */
+#define HASH_LOAD_MIN_DIV       8       /* shrink if fewer slots/item        */
+#define HASH_MIGRATE_NUM        16      /* slots to migrate per insert/remove*/
 
 
 /*****************************************************************************
@@ -61,10 +64,16 @@ struct hash_node {
 struct hash {
     int                 count;          /* number of items in hash table     */
     int                 size;           /* num slots allocated in hash table */
+    int                 min_size;       /* min num slots when shrinking      */
     struct hash_node  **table;          /* hash table array of node ptrs     */
+    int                 old_size;       /* num slots in table being resized  */
+    int                 old_index;      /* next old table slot to migrate    */
+    struct hash_node  **old_table;      /* table being resized or NULL       */
     hash_cmp_f          cmp_f;          /* key comparison function           */
     hash_del_f          del_f;          /* item deletion function            */
     hash_key_f          key_f;          /* key hash function                 */
+    struct hash_node   *mem_list;       /* list of node block allocations    */
+    struct hash_node   *free_list;      /* list of nodes available for use   */
 #if WITH_PTHREADS
     pthread_mutex_t     mutex;          /* mutex to protect access to hash   */
 #endif /* WITH_PTHREADS */
@@ -75,38 +84,19 @@ struct hash {
  *  Prototypes
  *****************************************************************************/
 
-static struct hash_node * hash_node_alloc (void);
+static struct hash_node ** hash_slot (hash_t h, const void *key);
 
-static void hash_node_free (struct hash_node *node);
+static void hash_resize (hash_t h);
 
+static void hash_migrate (hash_t h, int n);
 
-/*****************************************************************************
- *  Variables
- *****************************************************************************/
+static void hash_free_nodes (hash_t h, struct hash_node **table, int size);
 
-static struct hash_node *hash_mem_list = NULL;
-/*
- *  Singly-linked list for tracking memory allocations from hash_node_alloc()
- *    for eventual de-allocation via hash_drop_memory().  Each block allocation
- *    begins with a pointer for chaining these allocations together.  The block
- *    is broken up into individual hash_node structs and placed on the
- *    hash_free_list.
- */
+static struct hash_node * hash_node_alloc (hash_t h);
 
-static struct hash_node *hash_free_list = NULL;
-/*
- *  Singly-linked list of hash_node structs available for use.  These are
- *    allocated via hash_node_alloc() in blocks of HASH_NODE_ALLOC_NUM.  This
- *    bulk approach uses less RAM and CPU than allocating/de-allocating objects
- *    individually as needed.
- */
+static void hash_node_free (hash_t h, struct hash_node *node);
 
-#if WITH_PTHREADS
-static pthread_mutex_t hash_free_list_lock = PTHREAD_MUTEX_INITIALIZER;
-/*
- *  Mutex for protecting access to hash_mem_list and hash_free_list.
- */
-#endif /* WITH_PTHREADS */
+static void hash_node_drop_memory (hash_t h);
 
 
 /*****************************************************************************
@@ -134,9 +124,15 @@ hash_create (int size, hash_key_f key_f, hash_cmp_f cmp_f, hash_del_f del_f)
     }
     h->count = 0;
     h->size = size;
+    h->min_size = size;
+    h->old_size = 0;
+    h->old_index = 0;
+    h->old_table = NULL;
     h->cmp_f = cmp_f;
     h->del_f = del_f;
     h->key_f = key_f;
+    h->mem_list = NULL;
+    h->free_list = NULL;
     lsd_mutex_init (&h->mutex);
     return (h);
 }
@@ -145,22 +141,17 @@ hash_create (int size, hash_key_f key_f, hash_cmp_f cmp_f, hash_del_f del_f)
 void
 hash_destroy (hash_t h)
 {
-    int i;
-    struct hash_node *p, *q;
-
     if (!h) {
         errno = EINVAL;
         return;
     }
     lsd_mutex_lock (&h->mutex);
-    for (i = 0; i < h->size; i++) {
-        for (p = h->table[i]; p != NULL; p = q) {
-            q = p->next;
-            if (h->del_f)
-                h->del_f (p->data);
-            hash_node_free (p);
-        }
+    hash_free_nodes (h, h->table, h->size);
+    if (h->old_table) {
+        hash_free_nodes (h, h->old_table, h->old_size);
+        free (h->old_table);
     }
+    hash_node_drop_memory (h);
     lsd_mutex_unlock (&h->mutex);
     lsd_mutex_destroy (&h->mutex);
     free (h->table);
@@ -171,22 +162,18 @@ hash_destroy (hash_t h)
 
 void hash_reset (hash_t h)
 {
-    int i;
-    struct hash_node *p, *q;
-
     if (!h) {
         errno = EINVAL;
         return;
     }
     lsd_mutex_lock (&h->mutex);
-    for (i = 0; i < h->size; i++) {
-        for (p = h->table[i]; p != NULL; p = q) {
-            q = p->next;
-            if (h->del_f)
-                h->del_f (p->data);
-            hash_node_free (p);
-        }
-        h->table[i] = NULL;
+    hash_free_nodes (h, h->table, h->size);
+    if (h->old_table) {
+        hash_free_nodes (h, h->old_table, h->old_size);
+        free (h->old_table);
+        h->old_table = NULL;
+        h->old_size = 0;
+        h->old_index = 0;
     }
     h->count = 0;
     lsd_mutex_unlock (&h->mutex);
@@ -229,7 +216,6 @@ hash_count (hash_t h)
 void *
 hash_find (hash_t h, const void *key)
 {
-    unsigned int slot;
     int cmpval;
     struct hash_node *p;
     void *data = NULL;
@@ -240,8 +226,7 @@ hash_find (hash_t h, const void *key)
     }
     errno = 0;
     lsd_mutex_lock (&h->mutex);
-    slot = h->key_f (key) % h->size;
-    for (p = h->table[slot]; p != NULL; p = p->next) {
+    for (p = *hash_slot (h, key); p != NULL; p = p->next) {
         cmpval = h->cmp_f (p->hkey, key);
         if (cmpval < 0) {
             continue;
@@ -259,7 +244,6 @@ hash_find (hash_t h, const void *key)
 void *
 hash_insert (hash_t h, const void *key, void *data)
 {
-    unsigned int slot;
     int cmpval;
     struct hash_node **pp;
     struct hash_node *p;
@@ -269,8 +253,8 @@ hash_insert (hash_t h, const void *key, void *data)
         return (NULL);
     }
     lsd_mutex_lock (&h->mutex);
-    slot = h->key_f (key) % h->size;
-    for (pp = &(h->table[slot]); (p = *pp) != NULL; pp = &(p->next)) {
+    hash_migrate (h, HASH_MIGRATE_NUM);
+    for (pp = hash_slot (h, key); (p = *pp) != NULL; pp = &(p->next)) {
         cmpval = h->cmp_f (p->hkey, key);
         if (cmpval < 0) {
             continue;
@@ -282,7 +266,7 @@ hash_insert (hash_t h, const void *key, void *data)
         }
         break;
     }
-    if (!(p = hash_node_alloc ())) {
+    if (!(p = hash_node_alloc (h))) {
         data = NULL;
         goto end;
     }
@@ -291,6 +275,7 @@ hash_insert (hash_t h, const void *key, void *data)
     p->next = *pp;
     *pp = p;
     h->count++;
+    hash_resize (h);
 
 end:
     lsd_mutex_unlock (&h->mutex);
@@ -301,7 +286,6 @@ end:
 void *
 hash_remove (hash_t h, const void *key)
 {
-    unsigned int slot;
     int cmpval;
     struct hash_node **pp;
     struct hash_node *p;
@@ -313,8 +297,8 @@ hash_remove (hash_t h, const void *key)
     }
     errno = 0;
     lsd_mutex_lock (&h->mutex);
-    slot = h->key_f (key) % h->size;
-    for (pp = &(h->table[slot]); (p = *pp) != NULL; pp = &(p->next)) {
+    hash_migrate (h, HASH_MIGRATE_NUM);
+    for (pp = hash_slot (h, key); (p = *pp) != NULL; pp = &(p->next)) {
         cmpval = h->cmp_f (p->hkey, key);
         if (cmpval < 0) {
             continue;
@@ -322,8 +306,9 @@ hash_remove (hash_t h, const void *key)
         if (cmpval == 0) {
             data = p->data;
             *pp = p->next;
-            hash_node_free (p);
+            hash_node_free (h, p);
             h->count--;
+            hash_resize (h);
         }
         break;
     }
@@ -345,6 +330,10 @@ hash_delete_if (hash_t h, hash_arg_f arg_f, void *arg)
         return (-1);
     }
     lsd_mutex_lock (&h->mutex);
+    /*
+     *  Complete any resize in progress since every slot will be visited.
+     */
+    hash_migrate (h, h->old_size);
     for (i = 0; i < h->size; i++) {
         pp = &(h->table[i]);
         while ((p = *pp) != NULL) {
@@ -352,7 +341,7 @@ hash_delete_if (hash_t h, hash_arg_f arg_f, void *arg)
                 if (h->del_f)
                     h->del_f (p->data);
                 *pp = p->next;
-                hash_node_free (p);
+                hash_node_free (h, p);
                 h->count--;
                 n++;
             }
@@ -361,6 +350,7 @@ hash_delete_if (hash_t h, hash_arg_f arg_f, void *arg)
             }
         }
     }
+    hash_resize (h);
     lsd_mutex_unlock (&h->mutex);
     return (n);
 }
@@ -385,25 +375,48 @@ hash_for_each (hash_t h, hash_arg_f arg_f, void *arg)
             }
         }
     }
+    for (i = h->old_index; i < h->old_size; i++) {
+        for (p = h->old_table[i]; p != NULL; p = p->next) {
+            if (arg_f (p->data, p->hkey, arg) > 0) {
+                n++;
+            }
+        }
+    }
     lsd_mutex_unlock (&h->mutex);
     return (n);
 }
 
 
-void
-hash_drop_memory (void)
+int
+hash_stats (hash_t h, struct hash_stats *stats)
 {
+    int i;
+    int n;
     struct hash_node *p;
 
-    lsd_mutex_lock (&hash_free_list_lock);
-    while (hash_mem_list != NULL) {
-        p = hash_mem_list;
-        hash_mem_list = p->next;
-        free (p);
+    if (!h || !stats) {
+        errno = EINVAL;
+        return (-1);
     }
-    hash_free_list = NULL;
-    lsd_mutex_unlock (&hash_free_list_lock);
-    return;
+    memset (stats, 0, sizeof (*stats));
+    lsd_mutex_lock (&h->mutex);
+    stats->count = h->count;
+    stats->size = h->size;
+    stats->old_size = h->old_size;
+    for (i = 0; i < h->size + h->old_size; i++) {
+        p = (i < h->size) ? h->table[i] : h->old_table[i - h->size];
+        for (n = 0; p != NULL; p = p->next) {
+            n++;
+        }
+        if (n > 0) {
+            stats->slots_used++;
+        }
+        if (n > stats->chain_max) {
+            stats->chain_max = n;
+        }
+    }
+    lsd_mutex_unlock (&h->mutex);
+    return (0);
 }
 
 
@@ -429,10 +442,137 @@ hash_key_string (const char *str)
  *  Internal Functions
  *****************************************************************************/
 
+static struct hash_node **
+hash_slot (hash_t h, const void *key)
+{
+/*  Returns a ptr to the head of the chain in which [key] is stored.
+ *  While a resize is in progress, a key is in the old table unless its
+ *    old slot has already been migrated to the new table.
+ *  The hash's mutex must be locked by the caller.
+ */
+    unsigned int hval;
+    unsigned int slot;
+
+    hval = h->key_f (key);
+    if (h->old_table) {
+        slot = hval % h->old_size;
+        if (slot >= (unsigned int) h->old_index) {
+            return (&(h->old_table[slot]));
+        }
+    }
+    return (&(h->table[hval % h->size]));
+}
+
+
+static void
+hash_resize (hash_t h)
+{
+/*  Starts resizing the hash [h] if its load factor is out of bounds and no
+ *    resize is already in progress.  The table is grown when it averages
+ *    more than HASH_LOAD_MAX items per slot, and shrunk (but never below its
+ *    initial size) when fewer than 1 in HASH_LOAD_MIN_DIV slots would be used.
+ *  Items are then migrated a few slots at a time by subsequent inserts and
+ *    removes so no single operation bears the full cost of the resize.
+ *  If the new table cannot be allocated, the hash continues at its
+ *    current size.
+ *  The hash's mutex must be locked by the caller.
+ */
+    int                 size;
+    struct hash_node  **table;
+
+    if (h->old_table) {
+        return;
+    }
+    if (h->count / HASH_LOAD_MAX >= h->size) {
+        size = (h->size * 2) + 1;
+    }
+    else if ((h->size > h->min_size)
+            && (h->count < h->size / HASH_LOAD_MIN_DIV)) {
+        size = h->size / 2;
+        if (size < h->min_size) {
+            size = h->min_size;
+        }
+    }
+    else {
+        return;
+    }
+    if (!(table = calloc (size, sizeof (struct hash_node *)))) {
+        return;
+    }
+    h->old_table = h->table;
+    h->old_size = h->size;
+    h->old_index = 0;
+    h->table = table;
+    h->size = size;
+    return;
+}
+
+
+static void
+hash_migrate (hash_t h, int n)
+{
+/*  Migrates up to [n] slots from the old table of hash [h] into the new
+ *    table, preserving the sorted order of each chain.
+ *  The hash's mutex must be locked by the caller.
+ */
+    struct hash_node  **pp;
+    struct hash_node   *p;
+    struct hash_node   *q;
+
+    while ((h->old_table != NULL) && (n-- > 0)) {
+        for (p = h->old_table[h->old_index]; p != NULL; p = q) {
+            q = p->next;
+            pp = &(h->table[h->key_f (p->hkey) % h->size]);
+            while ((*pp != NULL) && (h->cmp_f ((*pp)->hkey, p->hkey) < 0)) {
+                pp = &((*pp)->next);
+            }
+            p->next = *pp;
+            *pp = p;
+        }
+        h->old_table[h->old_index] = NULL;
+        if (++h->old_index >= h->old_size) {
+            free (h->old_table);
+            h->old_table = NULL;
+            h->old_size = 0;
+            h->old_index = 0;
+        }
+    }
+    return;
+}
+
+
+static void
+hash_free_nodes (hash_t h, struct hash_node **table, int size)
+{
+/*  De-allocates every node in [table] of [size] slots of hash [h],
+ *    calling the hash's deletion function (if any) for each item.
+ *  The hash's mutex must be locked by the caller.
+ */
+    int i;
+    struct hash_node *p, *q;
+
+    for (i = 0; i < size; i++) {
+        for (p = table[i]; p != NULL; p = q) {
+            q = p->next;
+            if (h->del_f)
+                h->del_f (p->data);
+            hash_node_free (h, p);
+        }
+        table[i] = NULL;
+    }
+    return;
+}
+
 static struct hash_node *
-hash_node_alloc (void)
+hash_node_alloc (hash_t h)
 {
-/*  Allocates a hash node from the freelist.
+/*  Allocates a hash node from the freelist of hash table [h].
+ *    Nodes are allocated in blocks of HASH_NODE_ALLOC_NUM.  This bulk approach
+ *    uses less RAM and CPU than allocating/de-allocating objects individually
+ *    as needed.  Each block allocation begins with a pointer for chaining
+ *    these allocations together on the [h] mem_list.
+ *  Since each table has its own freelist, it is protected by the table's
+ *    mutex which must be held by the caller.
  *  Returns a ptr to the object, or NULL if memory allocation fails.
  */
     size_t size;
@@ -440,46 +580,66 @@ hash_node_alloc (void)
     int i;
 
     assert (HASH_NODE_ALLOC_NUM > 0);
-    lsd_mutex_lock (&hash_free_list_lock);
+    assert (lsd_mutex_is_locked (&h->mutex));
 
-    if (!hash_free_list) {
+    if (!h->free_list) {
         size = sizeof (p) + (HASH_NODE_ALLOC_NUM * sizeof (*p));
         p = malloc (size);
 
         if (p != NULL) {
-            p->next = hash_mem_list;
-            hash_mem_list = p;
-            hash_free_list = (struct hash_node *)
+            p->next = h->mem_list;
+            h->mem_list = p;
+            h->free_list = (struct hash_node *)
                     ((unsigned char *) p + sizeof (p));
 
             for (i = 0; i < HASH_NODE_ALLOC_NUM - 1; i++) {
-                hash_free_list[i].next = &hash_free_list[i+1];
+                h->free_list[i].next = &h->free_list[i+1];
             }
-            hash_free_list[i].next = NULL;
+            h->free_list[i].next = NULL;
         }
     }
-    if (hash_free_list) {
-        p = hash_free_list;
-        hash_free_list = p->next;
+    if (h->free_list) {
+        p = h->free_list;
+        h->free_list = p->next;
         memset (p, 0, sizeof (*p));
     }
     else {
         errno = ENOMEM;
     }
-    lsd_mutex_unlock (&hash_free_list_lock);
     return (p);
 }
 
 
 static void
-hash_node_free (struct hash_node *node)
+hash_node_free (hash_t h, struct hash_node *node)
 {
-/*  De-allocates the object [node], returning it to the freelist.
+/*  De-allocates the object [node], returning it to the freelist of [h].
  */
     assert (node != NULL);
-    lsd_mutex_lock (&hash_free_list_lock);
-    node->next = hash_free_list;
-    hash_free_list = node;
-    lsd_mutex_unlock (&hash_free_list_lock);
+    assert (lsd_mutex_is_locked (&h->mutex));
+
+    node->next = h->free_list;
+    h->free_list = node;
+    return;
+}
+
+
+static void
+hash_node_drop_memory (hash_t h)
+{
+/*  Frees memory that has been internally allocated for the nodes of [h].
+ *  This routine should only be called via hash_destroy() after every node
+ *    has been returned to the freelist.
+ */
+    struct hash_node *p;
+
+    assert (lsd_mutex_is_locked (&h->mutex));
+
+    while (h->mem_list != NULL) {
+        p = h->mem_list;
+        h->mem_list = p->next;
+        free (p);
+    }
+    h->free_list = NULL;
     return;
 }
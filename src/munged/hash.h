@@ -78,6 +78,17 @@ typedef int (*hash_arg_f) (void *data, const void *key, void *arg);
  *    with the item's [key] and the specified [arg] being passed in as args.
  */
 
+struct hash_stats {
+    int count;                          /* number of items in hash table     */
+    int size;                           /* num slots in current table        */
+    int old_size;                       /* num slots in table being resized  */
+    int slots_used;                     /* num slots containing >= 1 item    */
+    int chain_max;                      /* num items in the longest chain    */
+};
+/*
+ *  Hash table statistics as returned by hash_stats().
+ */
+
 
 /*****************************************************************************
  *  Functions
@@ -89,9 +100,12 @@ hash_t hash_create (int size,
  *  Creates and returns a new hash table on success.
  *    Returns NULL with errno=EINVAL if [keyf] or [cmpf] is not specified.
  *    Returns NULL with errno=ENOMEM if memory allocation fails.
- *  The [size] is the number of slots in the table; a larger table requires
- *    more memory, but generally provide quicker access times.  If set <= 0,
- *    the default size is used.
+ *  The [size] is the initial number of slots in the table; a larger table
+ *    requires more memory, but generally provide quicker access times.
+ *    If set <= 0, the default size is used.  The table grows as items are
+ *    inserted to bound the average chain length, and shrinks back towards
+ *    its initial size as items are removed.  Resizing is performed
+ *    incrementally across subsequent inserts and removes.
  *  The [keyf] function converts a key into a hash value.
  *  The [cmpf] function determines whether two keys are equal.
  *  The [delf] function de-allocates memory used by items in the hash;
@@ -169,18 +183,18 @@ int hash_for_each (hash_t h, hash_arg_f argf, void *arg);
  *    Returns -1 with errno=EINVAL if [argf] is not specified.
  */
 
-unsigned int hash_key_string (const char *str);
+int hash_stats (hash_t h, struct hash_stats *stats);
 /*
- *  A hash_key_f function that hashes the string [str].
+ *  Fills [stats] with the current occupancy of hash table [h], counting
+ *    slots and chains across both tables while a resize is in progress.
+ *    This walks every slot and is intended for diagnostics.
+ *  Returns 0 on success, or -1 with errno=EINVAL if [h] or [stats]
+ *    is not specified.
  */
 
-void hash_drop_memory (void);
+unsigned int hash_key_string (const char *str);
 /*
- *  Frees memory that has been internally allocated.  No reference counting is
- *    performed to determine whether memory regions are still in use.
- *  This may be useful for explicitly de-allocating memory before program
- *    termination when checking for memory leaks.
- *  WARNING: Do not call this routine until ALL hashes have been destroyed.
+ *  A hash_key_f function that hashes the string [str].
  */
 
 
@@ -0,0 +1,156 @@
+/*****************************************************************************
+ *  This file is part of the MUNGE Uid 'N' Gid Emporium (MUNGE).
+ *  For details, see <https://dun.github.io/munge/>.
+ *
+ *  MUNGE is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.  Additionally for the MUNGE library (libmunge), you
+ *  can redistribute it and/or modify it under the terms of the GNU Lesser
+ *  General Public License as published by the Free Software Foundation,
+ *  either version 3 of the License, or (at your option) any later version.
+ *
+ *  MUNGE is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  and GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  and GNU Lesser General Public License along with MUNGE.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+
+#if HAVE_CONFIG_H
+#  include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "hash.h"
+#include "tap.h"
+
+
+/*****************************************************************************
+ *  Exercises incremental resizing of the hash table.
+ *****************************************************************************/
+
+#define NUM_ITEMS       20000
+#define NUM_KEEP        100
+#define INIT_SIZE       13
+
+
+static unsigned int
+key_f (const void *key)
+{
+    return (*(const unsigned int *) key);
+}
+
+
+static int
+cmp_f (const void *key1, const void *key2)
+{
+    unsigned int k1 = *(const unsigned int *) key1;
+    unsigned int k2 = *(const unsigned int *) key2;
+
+    return ((k1 < k2) ? -1 : (k1 > k2));
+}
+
+
+static int
+count_f (void *data, const void *key, void *arg)
+{
+    return (data == key);
+}
+
+
+static int
+odd_f (void *data, const void *key, void *arg)
+{
+    return ((*(const unsigned int *) key) & 1);
+}
+
+
+int
+main (int argc, char *argv[])
+{
+    hash_t h;
+    struct hash_stats stats;
+    unsigned int *keys;
+    int i;
+    int n;
+    int size;
+
+    plan (13);
+
+    if (!(keys = malloc (NUM_ITEMS * sizeof (*keys)))) {
+        BAIL_OUT ("Failed to allocate keys");
+    }
+    for (i = 0; i < NUM_ITEMS; i++) {
+        keys[i] = (unsigned int) i * 2654435761U;
+    }
+    if (!(h = hash_create (INIT_SIZE, key_f, cmp_f, NULL))) {
+        BAIL_OUT ("Failed to create hash");
+    }
+    for (i = 0, n = 0; i < NUM_ITEMS; i++) {
+        if (hash_insert (h, &keys[i], &keys[i]) == &keys[i]) {
+            n++;
+        }
+    }
+    ok (n == NUM_ITEMS, "Inserted %d items", NUM_ITEMS);
+
+    ok (hash_insert (h, &keys[0], &keys[0]) == NULL,
+            "Rejected duplicate key");
+
+    ok (hash_stats (h, &stats) == 0 && stats.count == NUM_ITEMS,
+            "Stats count matches");
+
+    ok (stats.size > INIT_SIZE, "Table grew to %d slots", stats.size);
+    size = stats.size;
+
+    ok (stats.chain_max <= 16, "Longest chain is %d", stats.chain_max);
+
+    for (i = 0, n = 0; i < NUM_ITEMS; i++) {
+        if (hash_find (h, &keys[i]) == &keys[i]) {
+            n++;
+        }
+    }
+    ok (n == NUM_ITEMS, "Found all items after growth");
+
+    ok (hash_for_each (h, count_f, NULL) == NUM_ITEMS,
+            "Iterated over all items");
+
+    for (i = NUM_KEEP, n = 0; i < NUM_ITEMS; i++) {
+        if (hash_remove (h, &keys[i]) == &keys[i]) {
+            n++;
+        }
+    }
+    ok (n == NUM_ITEMS - NUM_KEEP, "Removed %d items", n);
+
+    for (i = 0, n = 0; i < NUM_KEEP; i++) {
+        if (hash_find (h, &keys[i]) == &keys[i]) {
+            n++;
+        }
+    }
+    ok (n == NUM_KEEP, "Found remaining items after removal");
+
+    (void) hash_stats (h, &stats);
+    ok (stats.size < size, "Table shrank to %d slots", stats.size);
+
+    n = hash_delete_if (h, odd_f, NULL);
+    ok (hash_count (h) == NUM_KEEP - n, "Deleted %d odd-keyed items", n);
+
+    for (i = 0, n = 0; i < NUM_KEEP; i++) {
+        if ((hash_find (h, &keys[i]) == &keys[i]) == !(keys[i] & 1)) {
+            n++;
+        }
+    }
+    ok (n == NUM_KEEP, "Found only even-keyed items after deletion");
+
+    hash_reset (h);
+    ok (hash_is_empty (h) == 1, "Reset hash is empty");
+
+    hash_destroy (h);
+    free (keys);
+    done_testing ();
+}
@@ -35,17 +35,21 @@
 #include <errno.h>
 #include <munge.h>
 #include <netinet/in.h>                 /* for INET_ADDRSTRLEN */
+#include <pthread.h>
 #include <signal.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
 #include <unistd.h>
 #include "conf.h"
+#include "conn.h"
 #include "dec.h"
 #include "enc.h"
 #include "fd.h"
 #include "log.h"
 #include "m_msg.h"
 #include "munge_defs.h"
+#include "reactor.h"
 #include "str.h"
 #include "work.h"
 
@@ -58,11 +62,35 @@ extern volatile sig_atomic_t got_reconfig;      /* defined in munged.c       */
 extern volatile sig_atomic_t got_terminate;     /* defined in munged.c       */
 
 
+/*****************************************************************************
+ *  Private Data Types
+ *****************************************************************************/
+
+#if HAVE_EPOLL_CREATE1
+typedef struct job_loop {
+    pthread_t           tid;            /* thread dispatching the reactor    */
+    reactor_p           r;              /* reactor accepting client requests */
+    work_p              w;              /* work crew processing its requests */
+} job_loop_t, *job_loop_p;
+#endif /* HAVE_EPOLL_CREATE1 */
+
+
 /*****************************************************************************
  *  Private Prototypes
  *****************************************************************************/
 
+static work_p _job_work_create (work_func_t f, int n_threads,
+    int n_threads_max);
+#if HAVE_EPOLL_CREATE1
+static int _job_share (int n, int n_loops, int i);
+static void * _job_loop (void *arg);
+#endif /* HAVE_EPOLL_CREATE1 */
+#if ! HAVE_EPOLL_CREATE1
+static void _job_accept (int ld, work_p w);
 static void _job_exec (m_msg_t m);
+#endif /* !HAVE_EPOLL_CREATE1 */
+static void _job_process (m_msg_t m);
+static void _job_log_err (m_msg_t m);
 
 
 /*****************************************************************************
@@ -72,20 +100,57 @@ static void _job_exec (m_msg_t m);
 void
 job_accept (conf_t conf)
 {
-    work_p  w;
-    m_msg_t m;
-    int     sd;
+#if HAVE_EPOLL_CREATE1
+    job_loop_p  loops;
+    int         n_loops;
+    int         i;
+#else  /* !HAVE_EPOLL_CREATE1 */
+    work_p      w;
+#endif /* !HAVE_EPOLL_CREATE1 */
 
     assert (conf != NULL);
     assert (conf->ld >= 0);
 
-    if (!(w = work_init ((work_func_t) _job_exec, conf->nthreads))) {
-        log_errno (EMUNGE_SNAFU, LOG_ERR,
-            "Failed to create %d work thread%s", conf->nthreads,
-            ((conf->nthreads > 1) ? "s" : ""));
+#if HAVE_EPOLL_CREATE1
+    /*  Requests are received by the reactors, so the work crews only process
+     *    messages that have already been read off the socket.
+     *  Each accept loop has its own reactor sharing the listening socket and
+     *    its own work crew; the work threads are divided between them.
+     *    The first loop is dispatched by this thread so it continues to
+     *    handle signals.
+     */
+    n_loops = conf->naccept_loops;
+    if (!(loops = calloc (n_loops, sizeof (*loops)))) {
+        log_errno (EMUNGE_NO_MEMORY, LOG_ERR,
+            "Failed to allocate %d accept loop%s", n_loops,
+            ((n_loops > 1) ? "s" : ""));
+    }
+    for (i = 0; i < n_loops; i++) {
+        loops[i].w = _job_work_create ((work_func_t) _job_process,
+                _job_share (conf->nthreads, n_loops, i),
+                _job_share (conf->nthreads_max, n_loops, i));
+        if (!(loops[i].r = reactor_create (conf->ld, loops[i].w))) {
+            log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to create reactor");
+        }
+    }
+    for (i = 1; i < n_loops; i++) {
+        if ((errno = pthread_create
+                    (&loops[i].tid, NULL, _job_loop, &loops[i])) != 0) {
+            log_errno (EMUNGE_SNAFU, LOG_ERR,
+                "Failed to create accept loop #%d", i+1);
+        }
     }
-    log_msg (LOG_INFO, "Created %d work thread%s", conf->nthreads,
-            ((conf->nthreads > 1) ? "s" : ""));
+    if (n_loops > 1) {
+        log_msg (LOG_INFO, "Created %d accept loops", n_loops);
+    }
+#else  /* !HAVE_EPOLL_CREATE1 */
+    if (conf->naccept_loops > 1) {
+        log_msg (LOG_WARNING,
+            "Ignoring num-accept-loops: not supported on this platform");
+    }
+    w = _job_work_create ((work_func_t) _job_exec,
+            conf->nthreads, conf->nthreads_max);
+#endif /* !HAVE_EPOLL_CREATE1 */
 
     while (!got_terminate) {
         if (got_reconfig) {
@@ -94,58 +159,38 @@ job_accept (conf_t conf)
             got_reconfig = 0;
             gids_update (conf->gids);
         }
-        if ((sd = accept (conf->ld, NULL, NULL)) < 0) {
-            switch (errno) {
-                case ECONNABORTED:
-                case EINTR:
-                    continue;
-                case EMFILE:
-                case ENFILE:
-                case ENOBUFS:
-                case ENOMEM:
-                    log_msg (LOG_INFO,
-                        "Suspended new connections while processing backlog");
-                    work_wait (w);
-                    continue;
-                default:
-                    log_errno (EMUNGE_SNAFU, LOG_ERR,
-                        "Failed to accept connection");
-                    break;
-            }
-        }
-        /*  With fd_timed_read_n(), a poll() is performed before any read()
-         *    in order to provide timeouts and ensure the read() won't block.
-         *    As such, it shouldn't be necessary to set the client socket as
-         *    non-blocking.  However according to the Linux poll(2) and
-         *    select(2) manpages, spurious readiness notifications can occur.
-         *    poll()/select() may report a socket as ready for reading while
-         *    the subsequent read() blocks.  This could happen when data has
-         *    arrived, but upon examination is discarded due to an invalid
-         *    checksum.  To protect against this, the client socket is set
-         *    non-blocking and EAGAIN is handled appropriately.
-         */
-        if (fd_set_nonblocking (sd) < 0) {
-            close (sd);
-            log_msg (LOG_WARNING,
-                "Failed to set nonblocking client socket: %s",
-                strerror (errno));
-        }
-        else if (m_msg_create (&m) != EMUNGE_SUCCESS) {
-            close (sd);
-            log_msg (LOG_WARNING, "Failed to create client request");
-        }
-        else if (m_msg_bind (m, sd) != EMUNGE_SUCCESS) {
-            m_msg_destroy (m);
-            log_msg (LOG_WARNING, "Failed to bind socket for client request");
-        }
-        else if (work_queue (w, m) < 0) {
-            m_msg_destroy (m);
-            log_msg (LOG_WARNING, "Failed to queue client request");
+#if HAVE_EPOLL_CREATE1
+        if ((reactor_dispatch (loops[0].r) < 0) && (errno != EINTR)) {
+            log_errno (EMUNGE_SNAFU, LOG_ERR,
+                "Failed to process client connections");
         }
+#else  /* !HAVE_EPOLL_CREATE1 */
+        _job_accept (conf->ld, w);
+#endif /* !HAVE_EPOLL_CREATE1 */
     }
     log_msg (LOG_NOTICE, "Exiting on signal %d (%s)",
             got_terminate, strsignal (got_terminate));
+#if HAVE_EPOLL_CREATE1
+    for (i = 1; i < n_loops; i++) {
+        if (reactor_wakeup (loops[i].r) < 0) {
+            log_errno (EMUNGE_SNAFU, LOG_ERR,
+                "Failed to wake accept loop #%d", i+1);
+        }
+    }
+    for (i = 1; i < n_loops; i++) {
+        if ((errno = pthread_join (loops[i].tid, NULL)) != 0) {
+            log_errno (EMUNGE_SNAFU, LOG_ERR,
+                "Failed to join accept loop #%d", i+1);
+        }
+    }
+    for (i = 0; i < n_loops; i++) {
+        reactor_destroy (loops[i].r);
+        work_fini (loops[i].w, 1);
+    }
+    free (loops);
+#else  /* !HAVE_EPOLL_CREATE1 */
     work_fini (w, 1);
+#endif /* !HAVE_EPOLL_CREATE1 */
     return;
 }
 
@@ -154,18 +199,165 @@ job_accept (conf_t conf)
  *  Private Functions
  *****************************************************************************/
 
+static work_p
+_job_work_create (work_func_t f, int n_threads, int n_threads_max)
+{
+/*  Creates a work crew of [n_threads] workers to process requests via [f],
+ *    allowing it to grow to [n_threads_max] workers as load increases.
+ */
+    work_p w;
+
+    if (!(w = work_init (f, n_threads))) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR,
+            "Failed to create %d work thread%s", n_threads,
+            ((n_threads > 1) ? "s" : ""));
+    }
+    log_msg (LOG_INFO, "Created %d work thread%s", n_threads,
+            ((n_threads > 1) ? "s" : ""));
+    if (n_threads_max > n_threads) {
+        if (work_set_adaptive (w, n_threads_max, conf->threads_idle_secs,
+                conf->threads_queue_depth, conf->threads_queue_msecs) < 0) {
+            log_errno (EMUNGE_SNAFU, LOG_ERR,
+                "Failed to allow up to %d work threads", n_threads_max);
+        }
+        log_msg (LOG_INFO, "Allowing up to %d work threads", n_threads_max);
+    }
+    return (w);
+}
+
+
+#if HAVE_EPOLL_CREATE1
+static int
+_job_share (int n, int n_loops, int i)
+{
+/*  Returns the share of [n] threads for accept loop [i] of [n_loops],
+ *    distributing any remainder to the first loops.  Since [n_loops] cannot
+ *    exceed [n], each loop is given at least one thread.
+ */
+    assert (n_loops > 0);
+    assert (n >= n_loops);
+
+    return ((n / n_loops) + ((i < n % n_loops) ? 1 : 0));
+}
+
+
+static void *
+_job_loop (void *arg)
+{
+/*  The thread for an additional accept loop.  It dispatches its reactor
+ *    until the daemon is terminated, at which point the reactor is woken by
+ *    job_accept().  Signals are blocked so they are handled by the thread
+ *    dispatching the first loop.
+ */
+    job_loop_p  loop = arg;
+    sigset_t    sigset;
+
+    assert (loop != NULL);
+
+    if (sigfillset (&sigset)) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to init accept loop sigset");
+    }
+    if (pthread_sigmask (SIG_SETMASK, &sigset, NULL) != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to set accept loop sigset");
+    }
+    while (!got_terminate) {
+        if ((reactor_dispatch (loop->r) < 0) && (errno != EINTR)) {
+            log_errno (EMUNGE_SNAFU, LOG_ERR,
+                "Failed to process client connections");
+        }
+    }
+    return (NULL);
+}
+#endif /* HAVE_EPOLL_CREATE1 */
+
+
+#if ! HAVE_EPOLL_CREATE1
+static void
+_job_accept (int ld, work_p w)
+{
+/*  Accepts a connection on the listening socket [ld] and queues it for the
+ *    work crew [w] to receive and process its request.
+ */
+    m_msg_t m;
+    int     sd;
+
+    if ((sd = accept (ld, NULL, NULL)) < 0) {
+        switch (errno) {
+            case ECONNABORTED:
+            case EINTR:
+                return;
+            case EMFILE:
+            case ENFILE:
+            case ENOBUFS:
+            case ENOMEM:
+                log_msg (LOG_INFO,
+                    "Suspended new connections while processing backlog");
+                work_wait (w);
+                return;
+            default:
+                log_errno (EMUNGE_SNAFU, LOG_ERR,
+                    "Failed to accept connection");
+                break;
+        }
+    }
+    /*  With fd_timed_read_n(), a poll() is performed before any read()
+     *    in order to provide timeouts and ensure the read() won't block.
+     *    As such, it shouldn't be necessary to set the client socket as
+     *    non-blocking.  However according to the Linux poll(2) and
+     *    select(2) manpages, spurious readiness notifications can occur.
+     *    poll()/select() may report a socket as ready for reading while
+     *    the subsequent read() blocks.  This could happen when data has
+     *    arrived, but upon examination is discarded due to an invalid
+     *    checksum.  To protect against this, the client socket is set
+     *    non-blocking and EAGAIN is handled appropriately.
+     */
+    if (fd_set_nonblocking (sd) < 0) {
+        close (sd);
+        log_msg (LOG_WARNING,
+            "Failed to set nonblocking client socket: %s",
+            strerror (errno));
+    }
+    else if (m_msg_create (&m) != EMUNGE_SUCCESS) {
+        close (sd);
+        log_msg (LOG_WARNING, "Failed to create client request");
+    }
+    else if (m_msg_bind (m, sd) != EMUNGE_SUCCESS) {
+        m_msg_destroy (m);
+        log_msg (LOG_WARNING, "Failed to bind socket for client request");
+    }
+    else if (work_queue (w, m) < 0) {
+        m_msg_destroy (m);
+        log_msg (LOG_WARNING, "Failed to queue client request");
+    }
+    return;
+}
+
+
 static void
 _job_exec (m_msg_t m)
 {
 /*  Receives and responds to the message request [m].
  */
-    munge_err_t  e;
-    const char  *p;
+    assert (m != NULL);
+
+    (void) m_msg_recv (m, MUNGE_MSG_UNDEF, MUNGE_MAXIMUM_REQ_LEN);
+    _job_process (m);
+    return;
+}
+#endif /* !HAVE_EPOLL_CREATE1 */
+
+
+static void
+_job_process (m_msg_t m)
+{
+/*  Responds to the received message request [m].
+ *  If the request could not be received, [m] will contain the error.
+ */
+    uint32_t i;
 
     assert (m != NULL);
 
-    e = m_msg_recv (m, MUNGE_MSG_UNDEF, MUNGE_MAXIMUM_REQ_LEN);
-    if (e == EMUNGE_SUCCESS) {
+    if (m->error_num == EMUNGE_SUCCESS) {
         switch (m->type) {
             case MUNGE_MSG_ENC_REQ:
                 enc_process_msg (m);
@@ -173,17 +365,45 @@ _job_exec (m_msg_t m)
             case MUNGE_MSG_DEC_REQ:
                 dec_process_msg (m);
                 break;
+            case MUNGE_MSG_BATCH_REQ:
+                if (m->batch_type == MUNGE_MSG_ENC_REQ) {
+                    enc_process_batch (m);
+                }
+                else {
+                    dec_process_batch (m);
+                }
+                break;
             default:
                 m_msg_set_err (m, EMUNGE_SNAFU,
                     strdupf ("Invalid message type %d", m->type));
                 break;
         }
     }
-    /*  For certain MUNGE "cred" errors, the credential has been successfully
-     *    decoded but is deemed invalid for other reasons.  In these cases,
-     *    the origin IP address is added to the logged error message to aid
-     *    in troubleshooting.
-     */
+    _job_log_err (m);
+    for (i = 0; (m->batch != NULL) && (i < m->batch_len); i++) {
+        if (m->batch[i] != NULL) {
+            _job_log_err (m->batch[i]);
+        }
+    }
+    conn_detach (m);
+    m_msg_destroy (m);
+    return;
+}
+
+
+static void
+_job_log_err (m_msg_t m)
+{
+/*  Logs the error (if any) for the message [m].
+ *  For certain MUNGE "cred" errors, the credential has been successfully
+ *    decoded but is deemed invalid for other reasons.  In these cases,
+ *    the origin IP address is added to the logged error message to aid
+ *    in troubleshooting.
+ */
+    const char  *p;
+
+    assert (m != NULL);
+
     if (m->error_num != EMUNGE_SUCCESS) {
         p = (m->error_str != NULL)
             ? m->error_str
@@ -206,6 +426,5 @@ _job_exec (m_msg_t m)
                 break;
         }
     }
-    m_msg_destroy (m);
     return;
 }
@@ -0,0 +1,633 @@
+/*****************************************************************************
+ *  This file is part of the MUNGE Uid 'N' Gid Emporium (MUNGE).
+ *  For details, see <https://dun.github.io/munge/>.
+ *
+ *  MUNGE is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.  Additionally for the MUNGE library (libmunge), you
+ *  can redistribute it and/or modify it under the terms of the GNU Lesser
+ *  General Public License as published by the Free Software Foundation,
+ *  either version 3 of the License, or (at your option) any later version.
+ *
+ *  MUNGE is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  and GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  and GNU Lesser General Public License along with MUNGE.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <assert.h>
+#include <errno.h>
+#include <munge.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include "log.h"
+#include "logq.h"
+
+
+/*****************************************************************************
+ *  Constants
+ *****************************************************************************/
+
+/*  Maximum length of a queued message (including the terminating NUL).
+ *    This matches the buffer used by log.c to format messages; a longer
+ *    message is written synchronously by the logging thread.
+ */
+#define LOGQ_MSG_MAXLEN         1024
+
+/*  Maximum number of messages written between flushes of the logfile.
+ */
+#define LOGQ_BATCH_LEN          64
+
+
+/*****************************************************************************
+ *  Private Data Types
+ *****************************************************************************/
+
+typedef struct logq_slot {
+    unsigned long       seq;            /* sequence # for claiming the slot  */
+    int                 priority;       /* priority level of the message     */
+    int                 sys_offset;     /* offset of syslog text, or -1      */
+    char                msg [LOGQ_MSG_MAXLEN];  /* formatted message w/ NUL  */
+} logq_slot_t, *logq_slot_p;
+
+typedef struct logq {
+    unsigned long       head;           /* ring position of next dequeue     */
+    unsigned long       tail;           /* ring position of next enqueue     */
+    logq_slot_p         ring;           /* ring of preallocated queue slots  */
+    unsigned long       mask;           /* ring size - 1                     */
+    unsigned long       n_dropped;      /* num msgs dropped with ring full   */
+    unsigned long       n_reported;     /* num dropped msgs already reported */
+    unsigned long       n_idle;         /* num writers parked awaiting msgs  */
+    int                 got_stop;       /* true if writer is to exit         */
+    pthread_t           tid;            /* writer thread ID                  */
+    pthread_mutex_t     lock;           /* mutex for parking the writer      */
+    pthread_mutex_t     write_lock;     /* mutex for serializing dequeues    */
+    pthread_cond_t      received_msg;   /* cond for when new msg is queued   */
+#if ! HAVE_ATOMIC_BUILTINS
+    pthread_mutex_t     ring_lock;      /* mutex for accessing ring & counts */
+#endif /* !HAVE_ATOMIC_BUILTINS */
+} logq_t, *logq_p;
+
+
+/*****************************************************************************
+ *  Private Prototypes
+ *****************************************************************************/
+
+static int _logq_push (int priority, const char *msg, int len,
+        int sys_offset);
+static void _logq_flush (void);
+static void * _logq_thread (void *arg);
+static int _logq_drain (logq_p q);
+static void _logq_report (logq_p q);
+static int _logq_enqueue (logq_p q, int priority, const char *msg, int len,
+        int sys_offset);
+static logq_slot_p _logq_peek (logq_p q);
+static void _logq_release (logq_p q, logq_slot_p slot);
+static unsigned long _logq_count_add (logq_p q, unsigned long *count, int n);
+static unsigned long _logq_count_get (logq_p q, unsigned long *count);
+
+
+/*****************************************************************************
+ *  Private Variables
+ *****************************************************************************/
+
+/*  The log queue is a singleton since log.c has only one set of destinations.
+ */
+static logq_p _logq = NULL;
+
+
+/*****************************************************************************
+ *  Public Functions
+ *****************************************************************************/
+
+int
+logq_start (int len)
+{
+    logq_p          q;
+    unsigned long   size;
+    unsigned long   i;
+
+    if (len <= 0) {
+        errno = EINVAL;
+        return (-1);
+    }
+    if (_logq != NULL) {
+        errno = EEXIST;
+        return (-1);
+    }
+    for (size = 1; size < (unsigned long) len; size <<= 1) {
+        ;
+    }
+    if (!(q = calloc (1, sizeof (*q)))) {
+        return (-1);
+    }
+    if (!(q->ring = calloc (size, sizeof (logq_slot_t)))) {
+        free (q);
+        errno = ENOMEM;
+        return (-1);
+    }
+    for (i = 0; i < size; i++) {
+        q->ring[i].seq = i;
+    }
+    q->mask = size - 1;
+
+    if ((errno = pthread_mutex_init (&q->lock, NULL)) != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to init log queue mutex");
+    }
+    if ((errno = pthread_mutex_init (&q->write_lock, NULL)) != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR,
+            "Failed to init log queue write mutex");
+    }
+#if ! HAVE_ATOMIC_BUILTINS
+    if ((errno = pthread_mutex_init (&q->ring_lock, NULL)) != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR,
+            "Failed to init log queue ring mutex");
+    }
+#endif /* !HAVE_ATOMIC_BUILTINS */
+    if ((errno = pthread_cond_init (&q->received_msg, NULL)) != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR,
+            "Failed to init log queue condition");
+    }
+    _logq = q;
+
+    if ((errno = pthread_create (&q->tid, NULL, _logq_thread, q)) != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to create log queue thread");
+    }
+    log_set_queue (_logq_push, _logq_flush);
+    log_msg (LOG_INFO, "Queueing up to %lu log message%s for writing",
+            size, ((size > 1) ? "s" : ""));
+    return (0);
+}
+
+
+void
+logq_stop (void)
+{
+    logq_p q = _logq;
+
+    if (q == NULL) {
+        return;
+    }
+    /*  Messages logged from here on are written synchronously, so the writer
+     *    only has to drain the messages already queued before it exits.
+     */
+    log_set_queue (NULL, NULL);
+
+    if ((errno = pthread_mutex_lock (&q->lock)) != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to lock log queue mutex");
+    }
+    q->got_stop = 1;
+
+    if ((errno = pthread_cond_signal (&q->received_msg)) != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR,
+            "Failed to signal log queue condition");
+    }
+    if ((errno = pthread_mutex_unlock (&q->lock)) != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to unlock log queue mutex");
+    }
+    if ((errno = pthread_join (q->tid, NULL)) != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to join log queue thread");
+    }
+    _logq = NULL;
+
+    (void) pthread_cond_destroy (&q->received_msg);
+#if ! HAVE_ATOMIC_BUILTINS
+    (void) pthread_mutex_destroy (&q->ring_lock);
+#endif /* !HAVE_ATOMIC_BUILTINS */
+    (void) pthread_mutex_destroy (&q->write_lock);
+    (void) pthread_mutex_destroy (&q->lock);
+    free (q->ring);
+    free (q);
+    return;
+}
+
+
+/*****************************************************************************
+ *  Private Functions
+ *****************************************************************************/
+
+static int
+_logq_push (int priority, const char *msg, int len, int sys_offset)
+{
+/*  The log_queue_f for log.c.  Queues the formatted message [msg] for the
+ *    writer thread, dropping it if the queue is full.
+ *  An error (or more severe) message is never dropped since it may be the
+ *    reason for a fatal exit.  Instead, the messages already queued are
+ *    written and the message is then written synchronously.
+ *  Returns 0 if the message was consumed, or -1 if it must be written
+ *    synchronously.
+ */
+    logq_p q = _logq;
+
+    if ((q == NULL) || (len >= LOGQ_MSG_MAXLEN)) {
+        return (-1);
+    }
+    if (priority <= LOG_ERR) {
+        _logq_flush ();
+        return (-1);
+    }
+    if (_logq_enqueue (q, priority, msg, len, sys_offset) < 0) {
+        (void) _logq_count_add (q, &q->n_dropped, 1);
+        return (0);
+    }
+    /*  Awaken the writer if it is parked.
+     */
+    if (_logq_count_get (q, &q->n_idle) > 0) {
+        if ((errno = pthread_mutex_lock (&q->lock)) != 0) {
+            log_errno (EMUNGE_SNAFU, LOG_ERR,
+                "Failed to lock log queue mutex");
+        }
+        if ((errno = pthread_cond_signal (&q->received_msg)) != 0) {
+            log_errno (EMUNGE_SNAFU, LOG_ERR,
+                "Failed to signal log queue condition");
+        }
+        if ((errno = pthread_mutex_unlock (&q->lock)) != 0) {
+            log_errno (EMUNGE_SNAFU, LOG_ERR,
+                "Failed to unlock log queue mutex");
+        }
+    }
+    return (0);
+}
+
+
+static void
+_logq_flush (void)
+{
+/*  The log_flush_f for log.c.  Writes all queued messages before returning.
+ *    This is invoked before a fatal error exits the program.
+ */
+    logq_p q = _logq;
+
+    if (q == NULL) {
+        return;
+    }
+    while (_logq_drain (q) > 0) {
+        ;
+    }
+    return;
+}
+
+
+static void *
+_logq_thread (void *arg)
+{
+/*  The writer thread.  It writes queued messages in batches, parking on the
+ *    received_msg condition whenever the queue is empty.
+ *  The n_idle count is raised before re-checking the queue so a thread
+ *    enqueueing concurrently is guaranteed to either publish a message seen
+ *    by the re-check or see the count and signal.
+ */
+    logq_p      q = arg;
+    sigset_t    sigset;
+
+    assert (q != NULL);
+
+    if (sigfillset (&sigset)) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to init log queue sigset");
+    }
+    if (pthread_sigmask (SIG_SETMASK, &sigset, NULL) != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to set log queue sigset");
+    }
+    for (;;) {
+        if (_logq_drain (q) > 0) {
+            _logq_report (q);
+            continue;
+        }
+        if ((errno = pthread_mutex_lock (&q->lock)) != 0) {
+            log_errno (EMUNGE_SNAFU, LOG_ERR,
+                "Failed to lock log queue mutex");
+        }
+        (void) _logq_count_add (q, &q->n_idle, 1);
+        while (!q->got_stop && (_logq_peek (q) == NULL)) {
+            if ((errno = pthread_cond_wait
+                        (&q->received_msg, &q->lock)) != 0) {
+                log_errno (EMUNGE_SNAFU, LOG_ERR,
+                    "Failed to wait on log queue condition");
+            }
+        }
+        (void) _logq_count_add (q, &q->n_idle, -1);
+
+        if (q->got_stop && (_logq_peek (q) == NULL)) {
+            if ((errno = pthread_mutex_unlock (&q->lock)) != 0) {
+                log_errno (EMUNGE_SNAFU, LOG_ERR,
+                    "Failed to unlock log queue mutex");
+            }
+            break;
+        }
+        if ((errno = pthread_mutex_unlock (&q->lock)) != 0) {
+            log_errno (EMUNGE_SNAFU, LOG_ERR,
+                "Failed to unlock log queue mutex");
+        }
+    }
+    /*  Report any messages dropped since the last report.  Messages are now
+     *    written synchronously, so this is not queued.
+     */
+    _logq_report (q);
+    return (NULL);
+}
+
+
+static int
+_logq_drain (logq_p q)
+{
+/*  Writes up to LOGQ_BATCH_LEN queued messages from the [q] log queue,
+ *    flushing the logfile once afterwards.
+ *  Returns the number of messages written.
+ */
+    logq_slot_p slot;
+    int         n;
+
+    assert (q != NULL);
+
+    if ((errno = pthread_mutex_lock (&q->write_lock)) != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR,
+            "Failed to lock log queue write mutex");
+    }
+    for (n = 0; n < LOGQ_BATCH_LEN; n++) {
+        if (!(slot = _logq_peek (q))) {
+            break;
+        }
+        log_write (slot->priority, slot->msg, slot->sys_offset);
+        _logq_release (q, slot);
+    }
+    if (n > 0) {
+        log_flush ();
+    }
+    if ((errno = pthread_mutex_unlock (&q->write_lock)) != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR,
+            "Failed to unlock log queue write mutex");
+    }
+    return (n);
+}
+
+
+static void
+_logq_report (logq_p q)
+{
+/*  Logs the number of messages dropped by the [q] log queue since the
+ *    previous report.  Only the writer thread updates n_reported.
+ */
+    unsigned long n_dropped;
+    unsigned long n;
+
+    assert (q != NULL);
+
+    n_dropped = _logq_count_get (q, &q->n_dropped);
+    if (n_dropped == q->n_reported) {
+        return;
+    }
+    n = n_dropped - q->n_reported;
+    q->n_reported = n_dropped;
+    log_msg (LOG_WARNING, "Dropped %lu log message%s: queue full (%lu total)",
+            n, ((n > 1) ? "s" : ""), n_dropped);
+    return;
+}
+
+
+#if HAVE_ATOMIC_BUILTINS
+
+static int
+_logq_enqueue (logq_p q, int priority, const char *msg, int len,
+        int sys_offset)
+{
+/*  Enqueue a copy of the message [msg] of [len] chars at the tail of the [q]
+ *    log queue.
+ *  The queue is a bounded multi-producer/single-consumer ring where each
+ *    slot carries a sequence number, as in work.c.  A slot is free for the
+ *    enqueue at position [pos] when its sequence equals [pos], and holds a
+ *    message for the dequeue at position [pos] when its sequence equals
+ *    [pos + 1].
+ *  Returns 0 on success, or -1 if the queue is full.
+ */
+    logq_slot_p    slot;
+    unsigned long  pos;
+    long           dif;
+
+    assert (q != NULL);
+    assert (msg != NULL);
+    assert (len < LOGQ_MSG_MAXLEN);
+
+    pos = __atomic_load_n (&q->tail, __ATOMIC_RELAXED);
+    for (;;) {
+        slot = &q->ring[pos & q->mask];
+        dif = (long) __atomic_load_n (&slot->seq, __ATOMIC_ACQUIRE)
+            - (long) pos;
+        if (dif == 0) {
+            if (__atomic_compare_exchange_n (&q->tail, &pos, pos + 1, 1,
+                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        }
+        else if (dif < 0) {
+            return (-1);
+        }
+        else {
+            pos = __atomic_load_n (&q->tail, __ATOMIC_RELAXED);
+        }
+    }
+    slot->priority = priority;
+    slot->sys_offset = sys_offset;
+    memcpy (slot->msg, msg, len);
+    slot->msg[len] = '\0';
+    __atomic_store_n (&slot->seq, pos + 1, __ATOMIC_RELEASE);
+    /*
+     *  Order the enqueue before the caller checks for a parked writer.
+     */
+    __atomic_thread_fence (__ATOMIC_SEQ_CST);
+    return (0);
+}
+
+
+static logq_slot_p
+_logq_peek (logq_p q)
+{
+/*  Returns the slot at the head of the [q] log queue, or NULL if it is empty.
+ *  The slot remains queued until released by _logq_release().
+ */
+    logq_slot_p    slot;
+    unsigned long  pos;
+
+    assert (q != NULL);
+
+    pos = __atomic_load_n (&q->head, __ATOMIC_RELAXED);
+    slot = &q->ring[pos & q->mask];
+    if (__atomic_load_n (&slot->seq, __ATOMIC_ACQUIRE) != pos + 1) {
+        return (NULL);
+    }
+    return (slot);
+}
+
+
+static void
+_logq_release (logq_p q, logq_slot_p slot)
+{
+/*  Frees the [slot] at the head of the [q] log queue for reuse.
+ *  The write_lock must be held, so there is only a single consumer.
+ */
+    unsigned long pos;
+
+    assert (q != NULL);
+    assert (slot != NULL);
+
+    pos = __atomic_load_n (&q->head, __ATOMIC_RELAXED);
+    assert (slot == &q->ring[pos & q->mask]);
+    __atomic_store_n (&q->head, pos + 1, __ATOMIC_RELAXED);
+    __atomic_store_n (&slot->seq, pos + q->mask + 1, __ATOMIC_RELEASE);
+    return;
+}
+
+
+static unsigned long
+_logq_count_add (logq_p q, unsigned long *count, int n)
+{
+/*  Adds [n] to the [count] of the [q] log queue.
+ *  Returns the new value.
+ */
+    return (__atomic_add_fetch (count, n, __ATOMIC_SEQ_CST));
+}
+
+
+static unsigned long
+_logq_count_get (logq_p q, unsigned long *count)
+{
+/*  Returns the [count] of the [q] log queue.
+ */
+    return (__atomic_load_n (count, __ATOMIC_SEQ_CST));
+}
+
+#else  /* !HAVE_ATOMIC_BUILTINS */
+
+static int
+_logq_enqueue (logq_p q, int priority, const char *msg, int len,
+        int sys_offset)
+{
+/*  Enqueue a copy of the message [msg] of [len] chars at the tail of the [q]
+ *    log queue.
+ *  Without atomic builtins, the ring and its counts are protected by the
+ *    ring_lock mutex which is only held for the duration of the operation.
+ *  Returns 0 on success, or -1 if the queue is full.
+ */
+    logq_slot_p slot;
+    int rc = -1;
+
+    assert (q != NULL);
+    assert (msg != NULL);
+    assert (len < LOGQ_MSG_MAXLEN);
+
+    if ((errno = pthread_mutex_lock (&q->ring_lock)) != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to lock log queue mutex");
+    }
+    if (q->tail - q->head <= q->mask) {
+        slot = &q->ring[q->tail & q->mask];
+        slot->priority = priority;
+        slot->sys_offset = sys_offset;
+        memcpy (slot->msg, msg, len);
+        slot->msg[len] = '\0';
+        q->tail++;
+        rc = 0;
+    }
+    if ((errno = pthread_mutex_unlock (&q->ring_lock)) != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to unlock log queue mutex");
+    }
+    return (rc);
+}
+
+
+static logq_slot_p
+_logq_peek (logq_p q)
+{
+/*  Returns the slot at the head of the [q] log queue, or NULL if it is empty.
+ *  The slot remains queued (and so will not be overwritten) until released
+ *    by _logq_release().
+ */
+    logq_slot_p slot = NULL;
+
+    assert (q != NULL);
+
+    if ((errno = pthread_mutex_lock (&q->ring_lock)) != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to lock log queue mutex");
+    }
+    if (q->head != q->tail) {
+        slot = &q->ring[q->head & q->mask];
+    }
+    if ((errno = pthread_mutex_unlock (&q->ring_lock)) != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to unlock log queue mutex");
+    }
+    return (slot);
+}
+
+
+static void
+_logq_release (logq_p q, logq_slot_p slot)
+{
+/*  Frees the [slot] at the head of the [q] log queue for reuse.
+ *  The write_lock must be held, so there is only a single consumer.
+ */
+    assert (q != NULL);
+    assert (slot != NULL);
+
+    if ((errno = pthread_mutex_lock (&q->ring_lock)) != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to lock log queue mutex");
+    }
+    assert (slot == &q->ring[q->head & q->mask]);
+    q->head++;
+
+    if ((errno = pthread_mutex_unlock (&q->ring_lock)) != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to unlock log queue mutex");
+    }
+    return;
+}
+
+
+static unsigned long
+_logq_count_add (logq_p q, unsigned long *count, int n)
+{
+/*  Adds [n] to the [count] of the [q] log queue.
+ *  Returns the new value.
+ */
+    unsigned long val;
+
+    if ((errno = pthread_mutex_lock (&q->ring_lock)) != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to lock log queue mutex");
+    }
+    val = (*count += n);
+
+    if ((errno = pthread_mutex_unlock (&q->ring_lock)) != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to unlock log queue mutex");
+    }
+    return (val);
+}
+
+
+static unsigned long
+_logq_count_get (logq_p q, unsigned long *count)
+{
+/*  Returns the [count] of the [q] log queue.
+ */
+    unsigned long val;
+
+    if ((errno = pthread_mutex_lock (&q->ring_lock)) != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to lock log queue mutex");
+    }
+    val = *count;
+
+    if ((errno = pthread_mutex_unlock (&q->ring_lock)) != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to unlock log queue mutex");
+    }
+    return (val);
+}
+
+#endif /* !HAVE_ATOMIC_BUILTINS */
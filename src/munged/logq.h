@@ -0,0 +1,69 @@
+/*****************************************************************************
+ *  This file is part of the MUNGE Uid 'N' Gid Emporium (MUNGE).
+ *  For details, see <https://dun.github.io/munge/>.
+ *
+ *  MUNGE is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.  Additionally for the MUNGE library (libmunge), you
+ *  can redistribute it and/or modify it under the terms of the GNU Lesser
+ *  General Public License as published by the Free Software Foundation,
+ *  either version 3 of the License, or (at your option) any later version.
+ *
+ *  MUNGE is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  and GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  and GNU Lesser General Public License along with MUNGE.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+
+
+#ifndef LOGQ_H
+#define LOGQ_H
+
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+
+/*****************************************************************************
+ *  Notes
+ *****************************************************************************/
+/*
+ *  The log queue moves the writing of log messages off the threads that log
+ *    them.  Each message is still formatted (and timestamped) by the logging
+ *    thread, but is then pushed onto a bounded ring from which a background
+ *    thread writes messages in batches to the logfile or syslog.
+ *  A message logged while the ring is full is dropped rather than blocking
+ *    the logging thread.  The number of dropped messages is logged once the
+ *    writer catches up.
+ *  Messages at LOG_ERR or higher priority bypass the ring and are written
+ *    synchronously (after any messages already queued) so they are never
+ *    dropped.
+ */
+
+
+/*****************************************************************************
+ *  Prototypes
+ *****************************************************************************/
+
+int logq_start (int len);
+/*
+ *  Starts diverting log messages to a queue of at least [len] messages
+ *    which is drained by a background writer thread.
+ *  Returns 0 on success, or -1 on error (with errno set).
+ */
+
+void logq_stop (void);
+/*
+ *  Restores writing log messages synchronously, and stops the background
+ *    writer thread once it has written all queued messages.
+ */
+
+
+#endif /* !LOGQ_H */
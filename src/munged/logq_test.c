@@ -0,0 +1,242 @@
+/*****************************************************************************
+ *  This file is part of the MUNGE Uid 'N' Gid Emporium (MUNGE).
+ *  For details, see <https://dun.github.io/munge/>.
+ *
+ *  MUNGE is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.  Additionally for the MUNGE library (libmunge), you
+ *  can redistribute it and/or modify it under the terms of the GNU Lesser
+ *  General Public License as published by the Free Software Foundation,
+ *  either version 3 of the License, or (at your option) any later version.
+ *
+ *  MUNGE is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  and GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  and GNU Lesser General Public License along with MUNGE.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+
+
+#if HAVE_CONFIG_H
+#  include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "log.h"
+#include "logq.h"
+#include "tap.h"
+
+
+/*****************************************************************************
+ *  Exercises queueing, dropping, and writing log messages.
+ *****************************************************************************/
+
+#define QUEUE_LEN       8
+#define NUM_MSGS        20000
+#define OUTPUT_MAXLEN   (4 * 1024 * 1024)
+
+
+struct reader_args {
+    int fd;
+    char *buf;
+    size_t len;
+};
+
+
+static void *
+reader_f (void *arg)
+{
+/*  Reads the pipe until EOF so the log queue's writer thread can proceed.
+ */
+    struct reader_args *a = arg;
+    ssize_t n;
+
+    while (a->len < OUTPUT_MAXLEN - 1) {
+        n = read (a->fd, a->buf + a->len, OUTPUT_MAXLEN - 1 - a->len);
+        if (n <= 0) {
+            break;
+        }
+        a->len += n;
+    }
+    a->buf[a->len] = '\0';
+    return (NULL);
+}
+
+
+static void
+test_fatal (void)
+{
+/*  Overflows the queue in a child process which then logs a fatal error.
+ *    The error must be written before the child exits.
+ */
+    int fds[2];
+    int ready[2];
+    FILE *fp;
+    struct reader_args args;
+    pid_t pid;
+    int status;
+    char c;
+    int i;
+
+    if ((pipe (fds) < 0) || (pipe (ready) < 0)) {
+        BAIL_OUT ("Failed to create pipe");
+    }
+    (void) fflush (stdout);
+    if ((pid = fork ()) < 0) {
+        BAIL_OUT ("Failed to fork");
+    }
+    if (pid == 0) {
+        (void) close (fds[0]);
+        (void) close (ready[0]);
+        if (!(fp = fdopen (fds[1], "w"))
+                || (log_open_file (fp, NULL, LOG_INFO, LOG_OPT_NONE) < 0)
+                || (logq_start (QUEUE_LEN) < 0)) {
+            _exit (EXIT_SUCCESS);
+        }
+        for (i = 0; i < NUM_MSGS; i++) {
+            log_msg (LOG_INFO, "msg %d", i);
+        }
+        if (write (ready[1], "", 1) != 1) {
+            _exit (EXIT_SUCCESS);
+        }
+        log_err (EXIT_FAILURE, LOG_ERR, "fatal");
+        _exit (EXIT_SUCCESS);           /* not reached */
+    }
+    (void) close (fds[1]);
+    (void) close (ready[1]);
+    if (read (ready[0], &c, 1) != 1) {
+        BAIL_OUT ("Failed to read from child");
+    }
+    /*  Give the child time to log the error while the queue is still full.
+     */
+    (void) usleep (100 * 1000);
+    if (!(args.buf = malloc (OUTPUT_MAXLEN))) {
+        BAIL_OUT ("Failed to allocate output buffer");
+    }
+    args.fd = fds[0];
+    args.len = 0;
+    (void) reader_f (&args);
+    (void) close (fds[0]);
+    (void) close (ready[0]);
+
+    if (waitpid (pid, &status, 0) < 0) {
+        BAIL_OUT ("Failed to wait for child");
+    }
+    ok (WIFEXITED (status) && (WEXITSTATUS (status) == EXIT_FAILURE),
+            "Exited on fatal error");
+    ok ((args.len >= 7)
+            && (strcmp (args.buf + args.len - 7, "\nfatal\n") == 0),
+            "Wrote fatal error with queue full");
+    free (args.buf);
+}
+
+
+int
+main (int argc, char *argv[])
+{
+    int fds[2];
+    FILE *fp;
+    struct reader_args args;
+    pthread_t tid;
+    char *line;
+    char *next;
+    unsigned long n_dropped = 0;
+    unsigned long u;
+    int n_written = 0;
+    int is_ordered = 1;
+    int last = -1;
+    int got_sync = 0;
+    int i;
+
+    plan (9);
+
+    errno = 0;
+    ok ((logq_start (0) == -1) && (errno == EINVAL),
+            "Rejected zero-length queue");
+
+    if (pipe (fds) < 0) {
+        BAIL_OUT ("Failed to create pipe");
+    }
+    if (!(fp = fdopen (fds[1], "w"))) {
+        BAIL_OUT ("Failed to open pipe stream");
+    }
+    if (log_open_file (fp, NULL, LOG_INFO, LOG_OPT_NONE) < 0) {
+        BAIL_OUT ("Failed to open log");
+    }
+    ok (logq_start (QUEUE_LEN) == 0, "Started queue of %d messages",
+            QUEUE_LEN);
+
+    errno = 0;
+    ok ((logq_start (QUEUE_LEN) == -1) && (errno == EEXIST),
+            "Rejected second queue");
+
+    /*  Nothing reads the pipe yet, so the writer blocks once the pipe fills
+     *    and the queue overflows.
+     */
+    for (i = 0; i < NUM_MSGS; i++) {
+        log_msg (LOG_INFO, "msg %d", i);
+    }
+    if (!(args.buf = malloc (OUTPUT_MAXLEN))) {
+        BAIL_OUT ("Failed to allocate output buffer");
+    }
+    args.fd = fds[0];
+    args.len = 0;
+    if ((errno = pthread_create (&tid, NULL, reader_f, &args)) != 0) {
+        BAIL_OUT ("Failed to create reader thread");
+    }
+    logq_stop ();
+    log_msg (LOG_INFO, "sync");
+    log_close_file ();
+    if ((errno = pthread_join (tid, NULL)) != 0) {
+        BAIL_OUT ("Failed to join reader thread");
+    }
+    (void) close (fds[0]);
+
+    for (line = args.buf; *line != '\0'; line = next) {
+        if ((next = strchr (line, '\n'))) {
+            *next++ = '\0';
+        }
+        else {
+            next = line + strlen (line);
+        }
+        if (sscanf (line, "msg %d", &i) == 1) {
+            if (i <= last) {
+                is_ordered = 0;
+            }
+            last = i;
+            n_written++;
+        }
+        else if (sscanf (line, "Dropped %*lu log message%*[s]: queue full "
+                    "(%lu total)", &u) == 1) {
+            n_dropped = u;
+        }
+        else if (sscanf (line, "Dropped %*lu log message: queue full "
+                    "(%lu total)", &u) == 1) {
+            n_dropped = u;
+        }
+        else if (strcmp (line, "sync") == 0) {
+            got_sync = 1;
+        }
+    }
+    ok (n_dropped > 0, "Dropped %lu messages with queue full", n_dropped);
+    ok (n_written + n_dropped == NUM_MSGS,
+            "Accounted for all %d messages", NUM_MSGS);
+    ok (is_ordered, "Wrote messages in order");
+    ok (got_sync, "Wrote message synchronously after stopping queue");
+
+    free (args.buf);
+    test_fatal ();
+    done_testing ();
+}
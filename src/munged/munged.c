@@ -51,13 +51,14 @@
 #include "cipher.h"
 #include "common.h"
 #include "conf.h"
+#include "cred.h"
 #include "crypto.h"
 #include "daemonpipe.h"
 #include "gids.h"
-#include "hash.h"
 #include "job.h"
 #include "lock.h"
 #include "log.h"
+#include "logq.h"
 #include "md.h"
 #include "missing.h"
 #include "munge_defs.h"
@@ -129,6 +130,11 @@ main (int argc, char *argv[])
     }
     log_msg (LOG_NOTICE, "Starting %s-%s daemon (pid %d)",
         PACKAGE, VERSION, (int) getpid ());
+    if (conf->log_queue_len > 0) {
+        if (logq_start (conf->log_queue_len) < 0) {
+            log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to start log queue");
+        }
+    }
     handle_signals ();
     write_origin_addr (conf);
     if (conf->got_mlockall) {
@@ -144,7 +150,9 @@ main (int argc, char *argv[])
         }
     }
     create_subkeys (conf);
-    conf->gids = gids_create (conf->gids_update_secs, conf->got_group_stat);
+    conf->gids = gids_create (conf->gids_update_secs, conf->got_group_stat,
+            conf->got_group_watch, conf->group_map_name);
+    cred_init ();
     replay_init ();
     timer_init ();
     sock_create (conf);
@@ -158,14 +166,15 @@ main (int argc, char *argv[])
     sock_destroy (conf);
     timer_fini ();
     replay_fini ();
+    cred_fini ();
     gids_destroy (conf->gids);
-    hash_drop_memory ();
     random_fini (conf->seed_name);
     crypto_fini ();
     destroy_conf (conf, 1);
 
     log_msg (LOG_NOTICE, "Stopping %s-%s daemon (pid %d)",
         PACKAGE, VERSION, (int) getpid ());
+    logq_stop ();
     log_close_all ();
 
     exit (EMUNGE_SUCCESS);
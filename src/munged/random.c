@@ -34,18 +34,22 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <munge.h>
+#include <pthread.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include "common.h"
 #include "conf.h"
 #include "crypto.h"
+#include "drbg.h"
 #include "entropy.h"
 #include "log.h"
 #include "munge_defs.h"
 #include "path.h"
 #include "random.h"
+#include "str.h"
 #include "timer.h"
 
 
@@ -81,6 +85,35 @@
  */
 #define RANDOM_STIR_MAX_SECS            32768
 
+/*  Integer for the number of bytes of pseudo-random data a per-thread DRBG
+ *    generates before it is rekeyed from the PRNG entropy pool.  A DRBG is
+ *    also rekeyed after each stirring of the entropy pool.
+ */
+#define RANDOM_DRBG_RESEED_BYTES        (1024 * 1024)
+
+/*  Integer for the number of bytes of entropy each thread buffers before
+ *    adding them to the PRNG entropy pool in a single batch.
+ */
+#define RANDOM_ADD_BATCH_BYTES          256
+
+
+/*****************************************************************************
+ *  Private Data Types
+ *****************************************************************************/
+
+/*  A per-thread deterministic random bit generator (see "drbg.h"), along
+ *    with the state for rekeying it and batching the thread's entropy.
+ */
+struct random_drbg {
+    drbg_t          drbg;               /* ChaCha20 fast-key-erasure DRBG    */
+    long            num_bytes;          /* num bytes output since rekeying   */
+    unsigned        epoch;              /* stir epoch at time of rekeying    */
+    unsigned char   add_buf [RANDOM_ADD_BATCH_BYTES];   /* pending entropy   */
+    int             add_len;            /* num bytes of entropy pending      */
+};
+
+typedef struct random_drbg * random_drbg_p;
+
 
 /*****************************************************************************
  *  Private Data
@@ -90,6 +123,12 @@ static long _random_timer_id = 0;       /* timer ID for entropy pool stir    */
 
 static int  _random_stir_secs;          /* secs between entropy pool stirs   */
 
+static unsigned _random_epoch = 0;      /* count of entropy pool stirs       */
+
+static pthread_key_t _random_drbg_key;  /* key for per-thread DRBG           */
+
+static int  _random_drbg_is_init = 0;   /* true if _random_drbg_key created  */
+
 
 /*****************************************************************************
  *  Private Prototypes
@@ -103,6 +142,12 @@ static int  _random_write_seed (const char *path, int num_bytes);
 static int  _random_check_entropy (unsigned char *buf, int n);
 static void _random_stir_entropy (void *_arg_not_used_);
 
+static random_drbg_p _random_drbg_get (void);
+static void _random_drbg_destroy (void *arg);
+static void _random_drbg_flush (random_drbg_p d);
+static void _random_drbg_seed (random_drbg_p d);
+static unsigned _random_epoch_get (void);
+
 static void _random_cleanup (void);
 static void _random_add (const void *buf, int n);
 static void _random_bytes (void *buf, int n);
@@ -120,6 +165,14 @@ random_init (const char *seed_path)
     int got_bad_seed = 0;
     int n;
 
+    if (!_random_drbg_is_init) {
+        if ((errno = pthread_key_create (&_random_drbg_key,
+                _random_drbg_destroy)) != 0) {
+            log_errno (EMUNGE_SNAFU, LOG_ERR,
+                    "Failed to create PRNG thread-specific data key");
+        }
+        _random_drbg_is_init = 1;
+    }
     /*  Fill the entropy pool.
      */
     n = _random_read_entropy_from_kernel ();
@@ -182,6 +235,19 @@ random_fini (const char *seed_path)
     if (_random_timer_id > 0) {
         timer_cancel (_random_timer_id);
     }
+    /*  Release the calling thread's DRBG, adding any pending entropy to the
+     *    pool before it is written to the seed file.  The DRBGs of other
+     *    threads have been released when those threads exited.
+     */
+    if (_random_drbg_is_init) {
+        random_drbg_p d = pthread_getspecific (_random_drbg_key);
+        if (d != NULL) {
+            (void) pthread_setspecific (_random_drbg_key, NULL);
+            _random_drbg_destroy (d);
+        }
+        (void) pthread_key_delete (_random_drbg_key);
+        _random_drbg_is_init = 0;
+    }
     if (seed_path != NULL) {
         (void) _random_write_seed (seed_path, RANDOM_SEED_BYTES);
     }
@@ -193,10 +259,20 @@ random_fini (const char *seed_path)
 void
 random_add (const void *buf, int n)
 {
+    random_drbg_p d;
+
     if (!buf || (n <= 0)) {
         return;
     }
-    _random_add (buf, n);
+    if ((n > RANDOM_ADD_BATCH_BYTES) || !(d = _random_drbg_get ())) {
+        _random_add (buf, n);
+        return;
+    }
+    if (d->add_len + n > sizeof (d->add_buf)) {
+        _random_drbg_flush (d);
+    }
+    memcpy (d->add_buf + d->add_len, buf, n);
+    d->add_len += n;
     return;
 }
 
@@ -215,10 +291,21 @@ random_bytes (void *buf, int n)
 void
 random_pseudo_bytes (void *buf, int n)
 {
+    random_drbg_p d;
+
     if (!buf || (n <= 0)) {
         return;
     }
-    _random_pseudo_bytes (buf, n);
+    if (!(d = _random_drbg_get ())) {
+        _random_pseudo_bytes (buf, n);
+        return;
+    }
+    if ((d->num_bytes >= RANDOM_DRBG_RESEED_BYTES)
+            || (d->epoch != _random_epoch_get ())) {
+        _random_drbg_seed (d);
+    }
+    d->num_bytes += n;
+    drbg_generate (&d->drbg, buf, n);
     return;
 }
 
@@ -529,6 +616,14 @@ _random_stir_entropy (void *_arg_not_used_)
     if (entropy_read_uint (&buf) != -1) {
         _random_add (&buf, sizeof (buf));
     }
+    /*  Rekey the per-thread DRBGs from the stirred pool on their next use.
+     */
+#if HAVE_ATOMIC_BUILTINS
+    (void) __atomic_add_fetch (&_random_epoch, 1, __ATOMIC_RELEASE);
+#else  /* !HAVE_ATOMIC_BUILTINS */
+    _random_epoch++;
+#endif /* !HAVE_ATOMIC_BUILTINS */
+
     /*  Perform an exponential backoff up to the maximum timeout.  This allows
      *    for vigorous stirring of the entropy pool when the daemon is started.
      */
@@ -550,6 +645,104 @@ _random_stir_entropy (void *_arg_not_used_)
 }
 
 
+/*****************************************************************************
+ *  Private Functions (Per-Thread DRBG)
+ *****************************************************************************/
+
+static random_drbg_p
+_random_drbg_get (void)
+{
+/*  Returns the calling thread's DRBG, creating and seeding it on first use.
+ *  Returns NULL if the DRBG cannot be created, in which case the caller
+ *    falls back to the PRNG entropy pool.
+ */
+    random_drbg_p d;
+
+    if (!_random_drbg_is_init) {
+        return (NULL);
+    }
+    d = pthread_getspecific (_random_drbg_key);
+    if (d != NULL) {
+        return (d);
+    }
+    if (!(d = calloc (1, sizeof (*d)))) {
+        return (NULL);
+    }
+    if ((errno = pthread_setspecific (_random_drbg_key, d)) != 0) {
+        free (d);
+        return (NULL);
+    }
+    _random_drbg_seed (d);
+    return (d);
+}
+
+
+static void
+_random_drbg_destroy (void *arg)
+{
+/*  Destroys the DRBG [arg] when its thread exits, first adding any pending
+ *    entropy to the PRNG entropy pool.
+ */
+    random_drbg_p d = arg;
+
+    if (d == NULL) {
+        return;
+    }
+    _random_drbg_flush (d);
+    memburn (d, 0, sizeof (*d));
+    free (d);
+    return;
+}
+
+
+static void
+_random_drbg_flush (random_drbg_p d)
+{
+/*  Adds the entropy pending in the DRBG [d] to the PRNG entropy pool.
+ */
+    assert (d != NULL);
+
+    if (d->add_len > 0) {
+        _random_add (d->add_buf, d->add_len);
+        memburn (d->add_buf, 0, d->add_len);
+        d->add_len = 0;
+    }
+    return;
+}
+
+
+static void
+_random_drbg_seed (random_drbg_p d)
+{
+/*  Rekeys the DRBG [d] from the PRNG entropy pool, discarding any unused
+ *    keystream.
+ */
+    unsigned char seed [DRBG_KEY_LEN];
+
+    assert (d != NULL);
+
+    d->epoch = _random_epoch_get ();
+    _random_bytes (seed, sizeof (seed));
+    drbg_seed (&d->drbg, seed);
+    memburn (seed, 0, sizeof (seed));
+    d->num_bytes = 0;
+    return;
+}
+
+
+static unsigned
+_random_epoch_get (void)
+{
+/*  Returns the number of times the entropy pool has been stirred.
+ */
+#if HAVE_ATOMIC_BUILTINS
+    return (__atomic_load_n (&_random_epoch, __ATOMIC_ACQUIRE));
+#else  /* !HAVE_ATOMIC_BUILTINS */
+    return (_random_epoch);
+#endif /* !HAVE_ATOMIC_BUILTINS */
+}
+
+
 /*****************************************************************************
  *  Private Functions (Libgcrypt)
  *****************************************************************************/
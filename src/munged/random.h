@@ -45,6 +45,8 @@ void random_fini (const char *seed_path);
 void random_add (const void *buf, int n);
 /*
  *  Adds [n] bytes of entropy from [buf] to the PRNG entropy pool.
+ *  Small additions are buffered by the calling thread and added to the pool
+ *    in batches.
  */
 
 void random_bytes (void *buf, int n);
@@ -55,6 +57,8 @@ void random_bytes (void *buf, int n);
 void random_pseudo_bytes (void *buf, int n);
 /*
  *  Places [n] bytes of pseudo-random data into [buf].
+ *  The data is generated by a per-thread DRBG that is periodically rekeyed
+ *    from the PRNG entropy pool, so concurrent callers do not contend on it.
  *  This should not be used for purposes such as key generation.
  */
 
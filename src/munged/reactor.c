@@ -0,0 +1,743 @@
+/*****************************************************************************
+ *  This file is part of the MUNGE Uid 'N' Gid Emporium (MUNGE).
+ *  For details, see <https://dun.github.io/munge/>.
+ *
+ *  MUNGE is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.  Additionally for the MUNGE library (libmunge), you
+ *  can redistribute it and/or modify it under the terms of the GNU Lesser
+ *  General Public License as published by the Free Software Foundation,
+ *  either version 3 of the License, or (at your option) any later version.
+ *
+ *  MUNGE is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  and GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  and GNU Lesser General Public License along with MUNGE.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *****************************************************************************
+ *  Refer to "reactor.h" for documentation on public functions.
+ *****************************************************************************/
+
+
+#if HAVE_CONFIG_H
+#  include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#if HAVE_EPOLL_CREATE1
+
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <munge.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include "conn.h"
+#include "fd.h"
+#include "log.h"
+#include "m_msg.h"
+#include "munge_defs.h"
+#include "reactor.h"
+#include "str.h"
+#include "work.h"
+
+
+/*****************************************************************************
+ *  Constants
+ *****************************************************************************/
+
+/*  Maximum number of events returned by a single call to epoll_wait().
+ */
+#define REACTOR_MAX_EVENTS              64
+
+/*  Number of milliseconds new connections are suspended after accept() fails
+ *    for lack of descriptors or memory.
+ */
+#define REACTOR_ACCEPT_BACKOFF_MSECS    100
+
+
+/*****************************************************************************
+ *  Private Data Types
+ *****************************************************************************/
+
+typedef struct reactor_conn {
+    struct reactor_conn *prev;          /* prev conn in deadline list        */
+    struct reactor_conn *next;          /* next conn in deadline list        */
+    int                  sd;            /* client socket descriptor          */
+    conn_p               conn;          /* persistent conn once negotiated   */
+    m_msg_t              m;             /* msg being received on this conn   */
+    struct timespec      deadline;      /* monotonic time for recv timeout   */
+    uint32_t             hdr_cnt;       /* num bytes of msg hdr received     */
+    uint32_t             pkt_cnt;       /* num bytes of msg body received    */
+    uint8_t              hdr [MUNGE_MSG_HDR_SIZE];  /* msg hdr buffer        */
+} reactor_conn_t, *reactor_conn_p;
+
+typedef struct reactor {
+    int                  ld;            /* listening socket descriptor       */
+    int                  ep;            /* epoll instance descriptor         */
+    int                  efd;           /* eventfd for waking the reactor    */
+    work_p               wp;            /* work crew for received requests   */
+    reactor_conn_p       head;          /* conn with the earliest deadline   */
+    reactor_conn_p       tail;          /* conn with the latest deadline     */
+    struct timespec      resume;        /* monotonic time to resume accepts  */
+    unsigned             is_suspended:1;    /* true if ld is not registered  */
+    unsigned             is_backlogged:1;   /* true if suspension was logged */
+    struct epoll_event   events [REACTOR_MAX_EVENTS];
+} reactor_t;
+
+
+/*****************************************************************************
+ *  Private Prototypes
+ *****************************************************************************/
+
+static int  _reactor_listen (reactor_p rp);
+static int  _reactor_accept (reactor_p rp);
+static void _reactor_suspend (reactor_p rp, int errnum);
+static void _reactor_resume (reactor_p rp);
+static void _reactor_read (reactor_p rp, reactor_conn_p rc);
+static void _reactor_complete (reactor_p rp, reactor_conn_p rc);
+static void _reactor_fail (reactor_p rp, reactor_conn_p rc);
+static void _reactor_expire (reactor_p rp);
+static int  _reactor_get_timeout (reactor_p rp);
+static void _reactor_set_deadline (struct timespec *tsp, long msecs);
+static int  _reactor_is_expired (const struct timespec *tsp,
+                const struct timespec *now);
+static void _reactor_queue (reactor_p rp, m_msg_t m);
+static void _reactor_remove (reactor_p rp, reactor_conn_p rc);
+static void _reactor_append (reactor_p rp, reactor_conn_p rc);
+static void _reactor_unlink (reactor_p rp, reactor_conn_p rc);
+
+
+/*****************************************************************************
+ *  Public Functions
+ *****************************************************************************/
+
+reactor_p
+reactor_create (int ld, work_p wp)
+{
+    reactor_p           rp;
+    struct epoll_event  ev;
+
+    if ((ld < 0) || (wp == NULL)) {
+        errno = EINVAL;
+        return (NULL);
+    }
+    if (fd_set_nonblocking (ld) < 0) {
+        return (NULL);
+    }
+    if (!(rp = malloc (sizeof (*rp)))) {
+        return (NULL);
+    }
+    rp->ld = ld;
+    rp->wp = wp;
+    rp->head = NULL;
+    rp->tail = NULL;
+    rp->is_suspended = 0;
+    rp->is_backlogged = 0;
+
+    if ((rp->ep = epoll_create1 (EPOLL_CLOEXEC)) < 0) {
+        free (rp);
+        return (NULL);
+    }
+    if ((rp->efd = eventfd (0, EFD_CLOEXEC | EFD_NONBLOCK)) < 0) {
+        int errno_bak = errno;
+        (void) close (rp->ep);
+        free (rp);
+        errno = errno_bak;
+        return (NULL);
+    }
+    /*  The eventfd is registered with a ptr to the reactor to distinguish it
+     *    from client connections.
+     */
+    memset (&ev, 0, sizeof (ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = rp;
+    if (epoll_ctl (rp->ep, EPOLL_CTL_ADD, rp->efd, &ev) < 0) {
+        goto err;
+    }
+    if (_reactor_listen (rp) < 0) {
+        goto err;
+    }
+    return (rp);
+
+err:
+    {
+        int errno_bak = errno;
+        (void) close (rp->efd);
+        (void) close (rp->ep);
+        free (rp);
+        errno = errno_bak;
+    }
+    return (NULL);
+}
+
+
+void
+reactor_destroy (reactor_p rp)
+{
+    if (rp == NULL) {
+        return;
+    }
+    while (rp->head != NULL) {
+        _reactor_remove (rp, rp->head);
+    }
+    (void) close (rp->efd);
+    (void) close (rp->ep);
+    free (rp);
+    return;
+}
+
+
+int
+reactor_dispatch (reactor_p rp)
+{
+    int             n;
+    int             i;
+    reactor_conn_p  rc;
+
+    if (rp == NULL) {
+        errno = EINVAL;
+        return (-1);
+    }
+    n = epoll_wait (rp->ep, rp->events, REACTOR_MAX_EVENTS,
+            _reactor_get_timeout (rp));
+    if (n < 0) {
+        return (-1);
+    }
+    for (i = 0; i < n; i++) {
+        rc = rp->events[i].data.ptr;
+        if (rc == (reactor_conn_p) rp) {
+            uint64_t val;
+            (void) read (rp->efd, &val, sizeof (val));
+        }
+        else if (rc == NULL) {
+            if (_reactor_accept (rp) < 0) {
+                return (-1);
+            }
+        }
+        else {
+            _reactor_read (rp, rc);
+        }
+    }
+    _reactor_expire (rp);
+    _reactor_resume (rp);
+    return (0);
+}
+
+
+int
+reactor_wakeup (reactor_p rp)
+{
+    uint64_t val = 1;
+
+    if (rp == NULL) {
+        errno = EINVAL;
+        return (-1);
+    }
+    if (write (rp->efd, &val, sizeof (val)) < 0) {
+        if (errno != EAGAIN) {
+            return (-1);
+        }
+    }
+    return (0);
+}
+
+
+/*****************************************************************************
+ *  Private Functions
+ *****************************************************************************/
+
+static int
+_reactor_listen (reactor_p rp)
+{
+/*  Registers the listening socket for read events.
+ *  The listening socket is registered with a NULL data ptr to distinguish it
+ *    from client connections.
+ *  Multiple reactors may share the listening socket, each running in its
+ *    own thread.  EPOLLEXCLUSIVE prevents a new connection from waking
+ *    every reactor; it is dropped if unsupported by the running kernel.
+ *  Returns 0 on success, or -1 on error (with errno set).
+ */
+    struct epoll_event ev;
+
+    memset (&ev, 0, sizeof (ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+#ifdef EPOLLEXCLUSIVE
+    ev.events |= EPOLLEXCLUSIVE;
+    if (epoll_ctl (rp->ep, EPOLL_CTL_ADD, rp->ld, &ev) == 0) {
+        return (0);
+    }
+    if (errno != EINVAL) {
+        return (-1);
+    }
+    ev.events &= ~EPOLLEXCLUSIVE;
+#endif /* EPOLLEXCLUSIVE */
+    return (epoll_ctl (rp->ep, EPOLL_CTL_ADD, rp->ld, &ev));
+}
+
+
+static int
+_reactor_accept (reactor_p rp)
+{
+/*  Accepts all pending connections on the listening socket, registering each
+ *    for read events and appending it to the deadline list.
+ *  Returns 0 on success, or -1 on a fatal error (with errno set).
+ */
+    int                 sd;
+    m_msg_t             m;
+    reactor_conn_p      rc;
+    struct epoll_event  ev;
+
+    for (;;) {
+        if ((sd = accept (rp->ld, NULL, NULL)) < 0) {
+            switch (errno) {
+                case EAGAIN:
+#if EAGAIN != EWOULDBLOCK
+                case EWOULDBLOCK:
+#endif /* EAGAIN != EWOULDBLOCK */
+                    return (0);
+                case ECONNABORTED:
+                case EINTR:
+                    continue;
+                case EMFILE:
+                case ENFILE:
+                case ENOBUFS:
+                case ENOMEM:
+                    _reactor_suspend (rp, errno);
+                    return (0);
+                default:
+                    return (-1);
+            }
+        }
+        if (rp->is_backlogged) {
+            log_msg (LOG_INFO, "Resumed new connections");
+            rp->is_backlogged = 0;
+        }
+        if (fd_set_nonblocking (sd) < 0) {
+            close (sd);
+            log_msg (LOG_WARNING,
+                "Failed to set nonblocking client socket: %s",
+                strerror (errno));
+            continue;
+        }
+        if (m_msg_create (&m) != EMUNGE_SUCCESS) {
+            close (sd);
+            log_msg (LOG_WARNING, "Failed to create client request");
+            continue;
+        }
+        if (!(rc = malloc (sizeof (*rc)))) {
+            close (sd);
+            m_msg_destroy (m);
+            log_msg (LOG_WARNING, "Failed to allocate client connection");
+            continue;
+        }
+        rc->sd = sd;
+        rc->conn = NULL;
+        rc->m = m;
+        rc->hdr_cnt = 0;
+        rc->pkt_cnt = 0;
+
+        memset (&ev, 0, sizeof (ev));
+        ev.events = EPOLLIN;
+        ev.data.ptr = rc;
+        if (epoll_ctl (rp->ep, EPOLL_CTL_ADD, sd, &ev) < 0) {
+            log_msg (LOG_WARNING, "Failed to register client connection: %s",
+                strerror (errno));
+            close (sd);
+            m_msg_destroy (m);
+            free (rc);
+            continue;
+        }
+        _reactor_append (rp, rc);
+    }
+}
+
+
+static void
+_reactor_suspend (reactor_p rp, int errnum)
+{
+/*  Suspends new connections after accept() failed with [errnum] for lack of
+ *    descriptors or memory.  Since the listening socket is level-triggered,
+ *    it is removed from the epoll set until a connection closes or the
+ *    backoff expires; otherwise, the reactor would spin on the failing
+ *    accept().  The suspension is only logged once per episode; its end is
+ *    logged by the next successful accept().
+ */
+    if (!rp->is_suspended) {
+        if (epoll_ctl (rp->ep, EPOLL_CTL_DEL, rp->ld, NULL) < 0) {
+            log_msg (LOG_WARNING,
+                "Failed to suspend new connections: %s", strerror (errno));
+        }
+        rp->is_suspended = 1;
+    }
+    if (!rp->is_backlogged) {
+        log_msg (LOG_INFO,
+            "Suspended new connections while processing backlog: %s",
+            strerror (errnum));
+        rp->is_backlogged = 1;
+    }
+    _reactor_set_deadline (&rp->resume, REACTOR_ACCEPT_BACKOFF_MSECS);
+    return;
+}
+
+
+static void
+_reactor_resume (reactor_p rp)
+{
+/*  Resumes new connections once the suspension's backoff has expired.
+ *  If the listening socket cannot be re-registered, the backoff is restarted.
+ */
+    struct timespec now;
+
+    if (!rp->is_suspended) {
+        return;
+    }
+    (void) clock_gettime (CLOCK_MONOTONIC, &now);
+    if (!_reactor_is_expired (&rp->resume, &now)) {
+        return;
+    }
+    if (_reactor_listen (rp) < 0) {
+        log_msg (LOG_WARNING,
+            "Failed to resume new connections: %s", strerror (errno));
+        _reactor_set_deadline (&rp->resume, REACTOR_ACCEPT_BACKOFF_MSECS);
+        return;
+    }
+    rp->is_suspended = 0;
+    return;
+}
+
+
+static void
+_reactor_read (reactor_p rp, reactor_conn_p rc)
+{
+/*  Reads as much of the request on connection [rc] as is available without
+ *    blocking.  Once the request has been completely received or an error
+ *    occurs, it is passed to the work crew.
+ */
+    m_msg_t m = rc->m;
+    ssize_t n;
+
+    assert (m != NULL);
+
+    while (rc->hdr_cnt < MUNGE_MSG_HDR_SIZE) {
+        n = read (rc->sd, rc->hdr + rc->hdr_cnt,
+                MUNGE_MSG_HDR_SIZE - rc->hdr_cnt);
+        if (n < 0) {
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+                return;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            m_msg_set_err (m, EMUNGE_SOCKET,
+                strdupf ("Failed to receive message header: %s",
+                    strerror (errno)));
+            _reactor_fail (rp, rc);
+            return;
+        }
+        if (n == 0) {
+            /*  A client closing its persistent connection between requests
+             *    is not an error.
+             */
+            if ((rc->conn != NULL) && (rc->hdr_cnt == 0)) {
+                _reactor_remove (rp, rc);
+                return;
+            }
+            m_msg_set_err (m, EMUNGE_SOCKET,
+                strdupf ("Received incomplete message header: %d of %d bytes",
+                    rc->hdr_cnt, MUNGE_MSG_HDR_SIZE));
+            _reactor_fail (rp, rc);
+            return;
+        }
+        rc->hdr_cnt += n;
+        if (rc->hdr_cnt == MUNGE_MSG_HDR_SIZE) {
+            if (m_msg_recv_hdr (m, rc->hdr, MUNGE_MSG_UNDEF,
+                    MUNGE_MAXIMUM_REQ_LEN) != EMUNGE_SUCCESS) {
+                _reactor_fail (rp, rc);
+                return;
+            }
+        }
+    }
+    while (rc->pkt_cnt < m->pkt_len) {
+        n = read (rc->sd, (uint8_t *) m->pkt + rc->pkt_cnt,
+                m->pkt_len - rc->pkt_cnt);
+        if (n < 0) {
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+                return;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            m_msg_set_err (m, EMUNGE_SOCKET,
+                strdupf ("Failed to receive message body: %s",
+                    strerror (errno)));
+            _reactor_fail (rp, rc);
+            return;
+        }
+        if (n == 0) {
+            m_msg_set_err (m, EMUNGE_SOCKET,
+                strdupf ("Received incomplete message body: %d of %d bytes",
+                    rc->pkt_cnt, m->pkt_len));
+            _reactor_fail (rp, rc);
+            return;
+        }
+        rc->pkt_cnt += n;
+    }
+    if (m_msg_recv_body (m) != EMUNGE_SUCCESS) {
+        _reactor_fail (rp, rc);
+        return;
+    }
+    _reactor_complete (rp, rc);
+    return;
+}
+
+
+static void
+_reactor_complete (reactor_p rp, reactor_conn_p rc)
+{
+/*  Passes the completely-received request on connection [rc] to the work
+ *    crew.  A version 4 request is the last one on its connection.
+ *    A later version request makes the connection persistent, allowing the
+ *    client to pipeline further requests on it; these are each passed to the
+ *    work crew as soon as they arrive so responses can be sent out of order.
+ */
+    m_msg_t m = rc->m;
+
+    rc->m = NULL;
+    rc->hdr_cnt = 0;
+    rc->pkt_cnt = 0;
+
+    if (m->version > MUNGE_MSG_VERSION_MIN) {
+        if ((rc->conn == NULL) && !(rc->conn = conn_create (rc->sd))) {
+            m_msg_set_err (m, EMUNGE_NO_MEMORY,
+                strdup ("Failed to create persistent connection"));
+            _reactor_remove (rp, rc);
+        }
+        else {
+            conn_attach (rc->conn, m);
+            if (m_msg_create (&rc->m) != EMUNGE_SUCCESS) {
+                log_msg (LOG_WARNING, "Failed to create client request");
+                _reactor_remove (rp, rc);
+            }
+            else {
+                _reactor_unlink (rp, rc);
+                _reactor_append (rp, rc);
+            }
+        }
+    }
+    else if (rc->conn != NULL) {
+        conn_attach (rc->conn, m);
+        _reactor_remove (rp, rc);
+    }
+    else {
+        /*  Ownership of the socket passes to the request.
+         */
+        (void) epoll_ctl (rp->ep, EPOLL_CTL_DEL, rc->sd, NULL);
+        (void) m_msg_bind (m, rc->sd);
+        rc->sd = -1;
+        _reactor_remove (rp, rc);
+    }
+    _reactor_queue (rp, m);
+    return;
+}
+
+
+static void
+_reactor_fail (reactor_p rp, reactor_conn_p rc)
+{
+/*  Closes connection [rc] after failing to receive its request.  The request
+ *    is still passed to the work crew so the error is logged by the worker.
+ */
+    m_msg_t m = rc->m;
+
+    rc->m = NULL;
+    _reactor_remove (rp, rc);
+    _reactor_queue (rp, m);
+    return;
+}
+
+
+static void
+_reactor_expire (reactor_p rp)
+{
+/*  Times-out connections whose deadline has passed.  An idle persistent
+ *    connection is closed without error.
+ */
+    struct timespec now;
+    reactor_conn_p  rc;
+
+    (void) clock_gettime (CLOCK_MONOTONIC, &now);
+
+    while ((rc = rp->head) != NULL) {
+        if (!_reactor_is_expired (&rc->deadline, &now)) {
+            break;
+        }
+        if ((rc->conn != NULL) && (rc->hdr_cnt == 0)) {
+            _reactor_remove (rp, rc);
+            continue;
+        }
+        m_msg_set_err (rc->m, EMUNGE_SOCKET,
+            strdup ((rc->hdr_cnt < MUNGE_MSG_HDR_SIZE)
+                ? "Failed to receive message header: Timed-out"
+                : "Failed to receive message body: Timed-out"));
+        _reactor_fail (rp, rc);
+    }
+    return;
+}
+
+
+static int
+_reactor_get_timeout (reactor_p rp)
+{
+/*  Returns the number of milliseconds until the earliest connection deadline
+ *    or the end of a suspension, or -1 if there is neither.
+ */
+    struct timespec         now;
+    const struct timespec  *tsp;
+    long                    msecs;
+
+    if (rp->head == NULL) {
+        tsp = rp->is_suspended ? &rp->resume : NULL;
+    }
+    else if (rp->is_suspended
+            && _reactor_is_expired (&rp->resume, &rp->head->deadline)) {
+        tsp = &rp->resume;
+    }
+    else {
+        tsp = &rp->head->deadline;
+    }
+    if (tsp == NULL) {
+        return (-1);
+    }
+    (void) clock_gettime (CLOCK_MONOTONIC, &now);
+    msecs = ((tsp->tv_sec - now.tv_sec) * 1000)
+        + ((tsp->tv_nsec - now.tv_nsec + 999999) / 1000000);
+    return ((msecs > 0) ? (int) msecs : 0);
+}
+
+
+static void
+_reactor_set_deadline (struct timespec *tsp, long msecs)
+{
+/*  Sets [tsp] to the monotonic time [msecs] milliseconds from now.
+ */
+    (void) clock_gettime (CLOCK_MONOTONIC, tsp);
+    tsp->tv_sec += msecs / 1000;
+    tsp->tv_nsec += (msecs % 1000) * 1000000;
+    if (tsp->tv_nsec >= 1000000000) {
+        tsp->tv_sec++;
+        tsp->tv_nsec -= 1000000000;
+    }
+    return;
+}
+
+
+static int
+_reactor_is_expired (const struct timespec *tsp, const struct timespec *now)
+{
+/*  Returns non-zero if the deadline [tsp] is at or before [now].
+ */
+    return ((tsp->tv_sec < now->tv_sec) ||
+            ((tsp->tv_sec == now->tv_sec) && (tsp->tv_nsec <= now->tv_nsec)));
+}
+
+
+static void
+_reactor_queue (reactor_p rp, m_msg_t m)
+{
+/*  Queues the request [m] for processing by the work crew.
+ */
+    if (work_queue (rp->wp, m) < 0) {
+        conn_detach (m);
+        m_msg_destroy (m);
+        log_msg (LOG_WARNING, "Failed to queue client request");
+    }
+    return;
+}
+
+
+static void
+_reactor_remove (reactor_p rp, reactor_conn_p rc)
+{
+/*  Removes connection [rc] from the reactor.  Its socket is closed unless
+ *    ownership has passed elsewhere, or it is still in use by requests
+ *    pipelined on the persistent connection.
+ */
+    if (rc->sd >= 0) {
+        (void) epoll_ctl (rp->ep, EPOLL_CTL_DEL, rc->sd, NULL);
+    }
+    _reactor_unlink (rp, rc);
+
+    if (rc->m != NULL) {
+        m_msg_destroy (rc->m);
+    }
+    if (rc->conn != NULL) {
+        conn_release (rc->conn);
+    }
+    else if (rc->sd >= 0) {
+        (void) close (rc->sd);
+    }
+    free (rc);
+
+    /*  Closing a connection frees a descriptor, so end any suspension.
+     */
+    if (rp->is_suspended) {
+        (void) clock_gettime (CLOCK_MONOTONIC, &rp->resume);
+    }
+    return;
+}
+
+
+static void
+_reactor_append (reactor_p rp, reactor_conn_p rc)
+{
+/*  Appends connection [rc] to the deadline list with a new deadline.
+ *  Since every connection is given the same timeout, appending it to the
+ *    tail keeps the list sorted by deadline.
+ */
+    _reactor_set_deadline (&rc->deadline, MUNGE_SOCKET_TIMEOUT_MSECS);
+    rc->next = NULL;
+    rc->prev = rp->tail;
+    if (rp->tail != NULL) {
+        rp->tail->next = rc;
+    }
+    else {
+        rp->head = rc;
+    }
+    rp->tail = rc;
+    return;
+}
+
+
+static void
+_reactor_unlink (reactor_p rp, reactor_conn_p rc)
+{
+/*  Removes connection [rc] from the deadline list.
+ */
+    if (rc->prev != NULL) {
+        rc->prev->next = rc->next;
+    }
+    else {
+        rp->head = rc->next;
+    }
+    if (rc->next != NULL) {
+        rc->next->prev = rc->prev;
+    }
+    else {
+        rp->tail = rc->prev;
+    }
+    rc->prev = rc->next = NULL;
+    return;
+}
+
+
+#endif /* HAVE_EPOLL_CREATE1 */
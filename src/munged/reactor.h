@@ -0,0 +1,82 @@
+/*****************************************************************************
+ *  This file is part of the MUNGE Uid 'N' Gid Emporium (MUNGE).
+ *  For details, see <https://dun.github.io/munge/>.
+ *
+ *  MUNGE is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.  Additionally for the MUNGE library (libmunge), you
+ *  can redistribute it and/or modify it under the terms of the GNU Lesser
+ *  General Public License as published by the Free Software Foundation,
+ *  either version 3 of the License, or (at your option) any later version.
+ *
+ *  MUNGE is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  and GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  and GNU Lesser General Public License along with MUNGE.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+
+#ifndef REACTOR_H
+#define REACTOR_H
+
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include "work.h"
+
+
+/*****************************************************************************
+ *  Data Types
+ *****************************************************************************/
+
+typedef struct reactor * reactor_p;
+
+
+/*****************************************************************************
+ *  Functions
+ *****************************************************************************/
+
+reactor_p reactor_create (int ld, work_p wp);
+/*
+ *  Creates an event-driven front-end for accepting client connections on
+ *    the listening socket [ld] and reading their requests.  A request is only
+ *    passed to the work crew [wp] once it has been received in its entirety
+ *    (or has failed to be received), so slow or idle clients cannot tie up
+ *    a worker thread.
+ *  The listening socket [ld] is set non-blocking.  It may be shared by
+ *    several reactors, each dispatched by its own thread.
+ *  Returns a ptr to the reactor, or NULL on error (with errno set).
+ */
+
+void reactor_destroy (reactor_p rp);
+/*
+ *  Destroys the reactor [rp], closing all connections for which a request
+ *    has not yet been passed to the work crew.  The listening socket is not
+ *    closed.
+ */
+
+int reactor_dispatch (reactor_p rp);
+/*
+ *  Waits for events on the reactor [rp] and processes them, accepting new
+ *    connections, reading pending requests, and timing-out connections that
+ *    have not delivered a complete request within MUNGE_SOCKET_TIMEOUT_MSECS.
+ *  Returns 0 on success, or -1 on error (with errno set).  An errno of EINTR
+ *    indicates the wait was interrupted by a signal.
+ */
+
+int reactor_wakeup (reactor_p rp);
+/*
+ *  Wakes the reactor [rp] if it is waiting for events in reactor_dispatch(),
+ *    causing it to return.  This can be called from any thread.
+ *  Returns 0 on success, or -1 on error (with errno set).
+ */
+
+
+#endif /* !REACTOR_H */
@@ -33,11 +33,11 @@
 #include <assert.h>
 #include <errno.h>
 #include <pthread.h>
+#include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include "conf.h"
 #include "cred.h"
-#include "hash.h"
 #include "log.h"
 #include "m_msg.h"
 #include "munge_defs.h"
@@ -50,74 +50,116 @@
  *  Private Constants
  *****************************************************************************/
 
-#define REPLAY_HASH_SIZE        65537
-#define REPLAY_NODE_ALLOC_NUM   1024
+#define REPLAY_SHARD_NUM        64
+#define REPLAY_TABLE_SIZE       1024    /* initial slots per shard (2^n)     */
+#define REPLAY_LOAD_MAX_NUM     3       /* grow if more than 3/4 slots used  */
+#define REPLAY_LOAD_MAX_DEN     4
+#define REPLAY_LOAD_MIN_DIV     8       /* shrink if fewer than 1/8 used     */
+#define REPLAY_WHEEL_SIZE       64
+#define REPLAY_WHEEL_SECS       MUNGE_REPLAY_PURGE_SECS
+#define REPLAY_BUCKET_SIZE      64      /* initial slot indices per bucket   */
 
 
 /*****************************************************************************
  *  Private Data Types
  *****************************************************************************/
 
-union replay_node {
-    struct {
-        union replay_node *next;        /* ptr for chaining by allocator     */
-    } alloc;
-    struct {
-        time_t             t_expired;   /* time after which cred expires     */
-        unsigned char      mac [MUNGE_MINIMUM_MD_LEN];  /* msg auth code     */
-    } data;
+struct replay_slot {
+    time_t             t_expired;       /* time after which cred expires     */
+    unsigned int       pos;             /* index of slot in its wheel bucket */
+    unsigned char      bucket;          /* wheel bucket holding this slot    */
+    unsigned char      mac [MUNGE_MINIMUM_MD_LEN];  /* msg auth code         */
 };
 
-typedef union replay_node * replay_t;
+typedef struct replay_slot * replay_t;
+
+struct replay_bucket {
+    unsigned int      *slots;           /* indices of slots expiring in intv */
+    unsigned int       size;            /* num indices allocated             */
+    unsigned int       count;           /* num indices in use                */
+};
+
+struct replay_shard {
+    replay_t           table;           /* array of slots for decoded creds  */
+    unsigned int       size;            /* num slots in table (power of 2)   */
+    unsigned int       count;           /* num creds in table                */
+    struct replay_bucket wheel [REPLAY_WHEEL_SIZE]; /* slots by expiration   */
+    time_t             wheel_tick;      /* next wheel interval to be purged  */
+    pthread_mutex_t    mutex;           /* mutex protecting table & wheel    */
+};
+
+typedef struct replay_shard * replay_shard_t;
 
 
 /*****************************************************************************
  *  Private Prototypes
  *****************************************************************************/
 
-static unsigned int replay_key_f (const replay_t r);
+static replay_shard_t replay_shard (const unsigned char *mac);
 
-static int replay_cmp_f (const replay_t r1, const replay_t r2);
+static void replay_key (replay_t r, munge_cred_t c);
 
-static int replay_is_expired (replay_t r, void *key, time_t *pnow);
+static unsigned int replay_home (const struct replay_slot *r,
+    unsigned int mask);
 
-static replay_t replay_alloc (void);
+static int replay_table_insert (replay_shard_t s, const struct replay_slot *r);
 
-static void replay_free (replay_t r);
+static int replay_table_remove (replay_shard_t s, const struct replay_slot *r);
 
-static void replay_drop_memory (void);
+static void replay_table_delete (replay_shard_t s, unsigned int i);
 
+static int replay_table_resize (replay_shard_t s, unsigned int size);
 
-/*****************************************************************************
- *  Private Variables
- *****************************************************************************/
+static void replay_table_shrink (replay_shard_t s);
 
-static hash_t replay_hash = NULL;
-/*
- *  Hash table for tracking decoded credentials until they have expired
- *    in order to prevent reuse.
- */
+static int replay_wheel_reserve (replay_shard_t s, const struct replay_slot *r);
 
-static replay_t replay_mem_list = NULL;
-/*
- *  Singly-linked list for tracking memory allocations from replay_alloc() for
- *    eventual de-allocation via replay_drop_memory().  Each block allocation
- *    begins with a pointer for chaining these allocations together.  The block
- *    is broken up into individual replay_t objects and placed on the
- *    replay_free_list.
- */
+static unsigned int replay_wheel_bucket (replay_shard_t s,
+    const struct replay_slot *r);
 
-static replay_t replay_free_list = NULL;
-/*
- *  Singly-linked list of replay_t objects available for use.  These are
- *    allocated via replay_alloc() in blocks of REPLAY_NODE_ALLOC_NUM.  This
- *    bulk approach uses less RAM and CPU than allocating/de-allocating objects
- *    individually as needed.
- */
+static int replay_wheel_grow (struct replay_bucket *b, unsigned int count);
+
+static void replay_wheel_link (replay_shard_t s, unsigned int i);
+
+static void replay_wheel_unlink (replay_shard_t s, unsigned int i);
+
+static void replay_wheel_move (replay_shard_t s, unsigned int i);
 
-static pthread_mutex_t replay_free_list_lock = PTHREAD_MUTEX_INITIALIZER;
+static int replay_wheel_purge (replay_shard_t s, time_t tick, time_t now);
+
+
+/*****************************************************************************
+ *  Private Variables
+ *****************************************************************************/
+
+static struct replay_shard *replay_shards = NULL;
 /*
- *  Mutex for protecting access to replay_mem_list and replay_free_list.
+ *  Array of REPLAY_SHARD_NUM shards for tracking decoded credentials until
+ *    they have expired in order to prevent reuse.  A credential is assigned
+ *    to a shard by its MAC.  Each shard has its own table and mutex so
+ *    decoders working on different credentials rarely contend.
+ *
+ *  Each shard's table is an open-addressed array of replay slots using
+ *    linear probing with robin hood ordering: an entry is never placed
+ *    further from its home slot than the entry it displaces.  Each slot
+ *    holds the MAC prefix and expiration time inline so a lookup usually
+ *    touches a single cache line, and no per-entry allocation is needed.
+ *    An empty slot has a t_expired of 0.  Entries are deleted by shifting
+ *    the following entries of the probe sequence back by one slot, so the
+ *    table never accumulates tombstones.
+ *
+ *  Each shard's timing wheel is a ring of REPLAY_WHEEL_SIZE buckets, each
+ *    holding the indices of the table slots whose credentials expire within
+ *    the same interval of REPLAY_WHEEL_SECS.  Purging a shard only visits
+ *    the buckets whose interval has elapsed since it was last purged, so its
+ *    cost is proportional to the number of expired credentials rather than
+ *    the size of the table.  A credential whose ttl exceeds the span of the
+ *    wheel is kept in its bucket until a later revolution.
+ *  Since entries move within the table as others are inserted and deleted,
+ *    each slot records its bucket and its position within that bucket so
+ *    the bucket can be updated in constant time whenever the entry moves.
+ *    A bucket is an unordered array; an index is removed by moving the last
+ *    index of the bucket into its position.
  */
 
 
@@ -130,19 +172,30 @@ replay_init (void)
 {
 /*  Initializes the replay detection engine.
  */
-    hash_key_f keyf = (hash_key_f) replay_key_f;
-    hash_cmp_f cmpf = (hash_cmp_f) replay_cmp_f;
-    hash_del_f delf = (hash_del_f) replay_free;
+    time_t  now;
+    int     i;
 
-    if (replay_hash != NULL) {
+    if (replay_shards != NULL) {
         return;
     }
     if (conf->got_benchmark) {
         log_msg (LOG_INFO, "Disabled replay hash");
         return;
     }
-    if (!(replay_hash = hash_create (REPLAY_HASH_SIZE, keyf, cmpf, delf))) {
-        log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to allocate replay hash");
+    if (time (&now) == (time_t) -1) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to query current time");
+    }
+    replay_shards = calloc (REPLAY_SHARD_NUM, sizeof (*replay_shards));
+    if (!replay_shards) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to allocate replay shards");
+    }
+    for (i = 0; i < REPLAY_SHARD_NUM; i++) {
+        if (replay_table_resize (&replay_shards[i], REPLAY_TABLE_SIZE) < 0) {
+            log_errno (EMUNGE_SNAFU, LOG_ERR,
+                "Failed to allocate replay table");
+        }
+        replay_shards[i].wheel_tick = now / REPLAY_WHEEL_SECS;
+        lsd_mutex_init (&replay_shards[i].mutex);
     }
     if (timer_set_relative (
       (callback_f) replay_purge, NULL, MUNGE_REPLAY_PURGE_SECS * 1000) < 0) {
@@ -162,12 +215,21 @@ replay_fini (void)
  *    is canceled via timer_fini() as soon as munged's event loop is exited.
  *    And shortly _thereafter_, this routine is invoked.
  */
-    if (!replay_hash) {
+    int i;
+    int j;
+
+    if (!replay_shards) {
         return;
     }
-    hash_destroy (replay_hash);
-    replay_hash = NULL;
-    replay_drop_memory ();
+    for (i = 0; i < REPLAY_SHARD_NUM; i++) {
+        free (replay_shards[i].table);
+        for (j = 0; j < REPLAY_WHEEL_SIZE; j++) {
+            free (replay_shards[i].wheel[j].slots);
+        }
+        lsd_mutex_destroy (&replay_shards[i].mutex);
+    }
+    free (replay_shards);
+    replay_shards = NULL;
     return;
 }
 
@@ -175,7 +237,7 @@ replay_fini (void)
 int
 replay_insert (munge_cred_t c)
 {
-/*  Inserts the credential [c] into the replay hash.
+/*  Inserts the credential [c] into its shard of the replay hash.
  *    The credential is identified by the first N bytes of the MAC, where N
  *    is the minimum message digest length used by MUNGE.  Limiting the MAC
  *    length here helps to reduce the replay cache memory requirements.
@@ -183,11 +245,11 @@ replay_insert (munge_cred_t c)
  *    Returns 1 if the credential is already present (ie, replay).
  *    Returns -1 on error with errno set.
  */
-    m_msg_t   m;
-    int       e;
-    replay_t  r;
+    struct replay_slot  rslot;
+    replay_shard_t      s;
+    int                 rc;
 
-    if (!replay_hash) {
+    if (!replay_shards) {
         if (conf->got_benchmark)
             return (0);
         errno = EPERM;
@@ -197,31 +259,13 @@ replay_insert (munge_cred_t c)
         errno = EINVAL;
         return (-1);
     }
-    m = c->msg;
-
-    if (!(r = replay_alloc ())) {
-        return (-1);
-    }
-    r->data.t_expired = (time_t) (m->time0 + m->ttl);
-    assert (c->mac_len >= sizeof (r->data.mac));
-    memcpy (r->data.mac, c->mac, sizeof (r->data.mac));
-    /*
-     *  The replay hash key is just the replay_t object itself.
-     */
-    if (hash_insert (replay_hash, r, r) != NULL) {
-        return (0);
-    }
-    e = errno;
-    replay_free (r);
+    replay_key (&rslot, c);
+    s = replay_shard (rslot.mac);
 
-    if (e == EEXIST) {
-        return (1);
-    }
-    if (e == EINVAL) {
-        log_err (EMUNGE_SNAFU, LOG_ERR,
-            "Attempted to insert cred into hash using invalid args");
-    }
-    return (-1);
+    lsd_mutex_lock (&s->mutex);
+    rc = replay_table_insert (s, &rslot);
+    lsd_mutex_unlock (&s->mutex);
+    return (rc);
 }
 
 
@@ -230,11 +274,11 @@ replay_remove (munge_cred_t c)
 {
 /*  Removes the credential [c] from the replay hash.
  */
-    m_msg_t            m;
-    union replay_node  rnode;
-    replay_t           r;
+    struct replay_slot  rslot;
+    replay_shard_t      s;
+    int                 rc;
 
-    if (!replay_hash) {
+    if (!replay_shards) {
         if (conf->got_benchmark)
             return (0);
         errno = EPERM;
@@ -244,19 +288,13 @@ replay_remove (munge_cred_t c)
         errno = EINVAL;
         return (-1);
     }
-    m = c->msg;
-
-    /*  Compute the cred's "hash key".
-     */
-    rnode.data.t_expired = (time_t) (m->time0 + m->ttl);
-    assert (c->mac_len >= sizeof (rnode.data.mac));
-    memcpy (rnode.data.mac, c->mac, sizeof (rnode.data.mac));
+    replay_key (&rslot, c);
+    s = replay_shard (rslot.mac);
 
-    r = hash_remove (replay_hash, &rnode);
-    if (r != NULL) {
-        replay_free (r);
-    }
-    return (r ? 0 : -1);
+    lsd_mutex_lock (&s->mutex);
+    rc = replay_table_remove (s, &rslot);
+    lsd_mutex_unlock (&s->mutex);
+    return (rc);
 }
 
 
@@ -264,17 +302,24 @@ void
 replay_purge (void)
 {
 /*  Purges the replay hash of any expired credentials.
+ *  Each shard is locked only while purging a single wheel bucket.
  */
     time_t  now;
-    int     n;
+    time_t  tick;
+    int     i;
+    int     n = 0;
 
-    if (!replay_hash) {
+    if (!replay_shards) {
         return;
     }
     if (time (&now) == (time_t) -1) {
         log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to query current time");
     }
-    n = hash_delete_if (replay_hash, (hash_arg_f) replay_is_expired, &now);
+    tick = now / REPLAY_WHEEL_SECS;
+
+    for (i = 0; i < REPLAY_SHARD_NUM; i++) {
+        n += replay_wheel_purge (&replay_shards[i], tick, now);
+    }
     assert (n >= 0);
     if (n > 0) {
         log_msg (LOG_DEBUG, "Purged %d credential%s from replay hash",
@@ -292,123 +337,440 @@ replay_purge (void)
  *  Private Functions
  *****************************************************************************/
 
+static replay_shard_t
+replay_shard (const unsigned char *mac)
+{
+/*  Returns the shard for the cred's [mac].
+ *  The shard is selected by the 4 bytes of the cred's mac following those
+ *    used to select the home slot so that each shard's table remains
+ *    evenly loaded.
+ */
+    unsigned int u;
+
+    assert (MUNGE_MINIMUM_MD_LEN >= 2 * sizeof (u));
+
+    memcpy (&u, mac + sizeof (u), sizeof (u));
+    return (&replay_shards[u % REPLAY_SHARD_NUM]);
+}
+
+
+static void
+replay_key (replay_t r, munge_cred_t c)
+{
+/*  Fills the replay slot [r] with the key identifying credential [c].
+ */
+    m_msg_t m = c->msg;
+
+    assert (c->mac_len >= sizeof (r->mac));
+
+    r->t_expired = (time_t) (m->time0 + m->ttl);
+    memcpy (r->mac, c->mac, sizeof (r->mac));
+    /*
+     *  A t_expired of 0 denotes an empty slot.  A cred could only expire at
+     *    the epoch if its time0 were bogus, in which case it is off by one.
+     */
+    if (r->t_expired == 0) {
+        r->t_expired = 1;
+    }
+    return;
+}
+
+
 static unsigned int
-replay_key_f (const replay_t r)
+replay_home (const struct replay_slot *r, unsigned int mask)
 {
-/*  Use the first 4 bytes of the cred's mac as the hash key.
+/*  Returns the home slot of the replay entry [r] in a table of [mask] + 1
+ *    slots.  Use the first 4 bytes of the cred's mac as the hash value.
  *  While the results of this conversion are dependent on byte sex,
  *    we can ignore it since this data is local to the node.
  */
-    return (* (unsigned int *) r->data.mac);
+    unsigned int u;
+
+    memcpy (&u, r->mac, sizeof (u));
+    return (u & mask);
 }
 
 
 static int
-replay_cmp_f (const replay_t r1, const replay_t r2)
+replay_table_insert (replay_shard_t s, const struct replay_slot *r)
 {
-/*  Returns an integer that is less than zero if [r1] is less than [r2],
- *    equal to zero if [r1] is equal to [r2], and greater than zero
- *    if [r1] is greater than [r2].
+/*  Inserts the replay entry [r] into the table of shard [s], growing the
+ *    table if it has become too heavily loaded.
+ *  The shard's mutex must be locked by the caller.
+ *  Returns 0 if the entry is inserted, 1 if the entry is already present,
+ *    or -1 with errno=ENOMEM if the table is full and cannot be grown.
  */
-    int cmpval;
-
-    cmpval = memcmp (r1->data.mac, r2->data.mac, sizeof (r1->data.mac));
-    if (cmpval != 0) {
-        return (cmpval);
+    struct replay_slot  x;
+    struct replay_slot  tmp;
+    unsigned int        mask;
+    unsigned int        i;
+    unsigned int        dist;
+    unsigned int        d;
+    int                 is_displaced = 0;
+
+    assert (lsd_mutex_is_locked (&s->mutex));
+
+    if ((s->count + 1) * REPLAY_LOAD_MAX_DEN > s->size * REPLAY_LOAD_MAX_NUM) {
+        if ((replay_table_resize (s, s->size * 2) < 0)
+                && (s->count + 1 >= s->size)) {
+            errno = ENOMEM;
+            return (-1);
+        }
     }
-    if (r1->data.t_expired < r2->data.t_expired) {
+    if (replay_wheel_reserve (s, r) < 0) {
+        errno = ENOMEM;
         return (-1);
     }
-    if (r1->data.t_expired > r2->data.t_expired) {
-        return (1);
+    x = *r;
+    mask = s->size - 1;
+    i = replay_home (&x, mask);
+
+    for (dist = 0; s->table[i].t_expired != 0; dist++) {
+        /*
+         *  Until an entry has been displaced, [x] is the entry being inserted.
+         *    Robin hood ordering guarantees a matching entry would be found
+         *    before reaching an entry closer to its home slot than [x].
+         */
+        if (!is_displaced
+                && (s->table[i].t_expired == x.t_expired)
+                && (memcmp (s->table[i].mac, x.mac, sizeof (x.mac)) == 0)) {
+            return (1);
+        }
+        d = (i - replay_home (&s->table[i], mask)) & mask;
+        if (d < dist) {
+            tmp = s->table[i];
+            s->table[i] = x;
+            if (is_displaced) {
+                replay_wheel_move (s, i);
+            }
+            else {
+                replay_wheel_link (s, i);
+            }
+            x = tmp;
+            dist = d;
+            is_displaced = 1;
+        }
+        i = (i + 1) & mask;
+    }
+    s->table[i] = x;
+    if (is_displaced) {
+        replay_wheel_move (s, i);
     }
+    else {
+        replay_wheel_link (s, i);
+    }
+    s->count++;
     return (0);
 }
 
 
 static int
-replay_is_expired (replay_t r, void *key, time_t *pnow)
+replay_table_remove (replay_shard_t s, const struct replay_slot *r)
 {
-/*  Returns true if replay_t object [r] has expired based on the time [pnow].
+/*  Removes the replay entry [r] from the table of shard [s].
+ *  The shard's mutex must be locked by the caller.
+ *  Returns 0 if the entry is removed, or -1 if it is not found.
  */
-    if (r->data.t_expired < *pnow) {
-        return (1);
+    unsigned int mask;
+    unsigned int i;
+    unsigned int dist;
+
+    assert (lsd_mutex_is_locked (&s->mutex));
+
+    mask = s->size - 1;
+    i = replay_home (r, mask);
+
+    for (dist = 0; s->table[i].t_expired != 0; dist++) {
+        if (((i - replay_home (&s->table[i], mask)) & mask) < dist) {
+            break;
+        }
+        if ((s->table[i].t_expired == r->t_expired)
+                && (memcmp (s->table[i].mac, r->mac, sizeof (r->mac)) == 0)) {
+            replay_table_delete (s, i);
+            return (0);
+        }
+        i = (i + 1) & mask;
     }
-    return (0);
+    return (-1);
 }
 
 
-static replay_t
-replay_alloc (void)
+static void
+replay_table_delete (replay_shard_t s, unsigned int i)
 {
-/*  Allocates a replay_t object.
- *  Returns a ptr to the object, or NULL if memory allocation fails.
+/*  Deletes the entry at slot [i] of the table of shard [s] by shifting
+ *    each following entry that is not in its home slot back by one slot
+ *    until reaching an empty slot or an entry in its home slot.
+ *  The shard's mutex must be locked by the caller.
  */
-    size_t    size;
-    replay_t  r;
-    int       i;
+    unsigned int mask;
+    unsigned int j;
 
-    assert (REPLAY_NODE_ALLOC_NUM > 0);
-    lsd_mutex_lock (&replay_free_list_lock);
+    assert (s->table[i].t_expired != 0);
 
-    if (!replay_free_list) {
-        size = sizeof (r) + (REPLAY_NODE_ALLOC_NUM * sizeof (*r));
-        r = malloc (size);
+    replay_wheel_unlink (s, i);
 
-        if (r != NULL) {
-            r->alloc.next = replay_mem_list;
-            replay_mem_list = r;
-            replay_free_list = (replay_t) ((unsigned char *) r + sizeof (r));
+    mask = s->size - 1;
+    for (j = (i + 1) & mask; s->table[j].t_expired != 0; j = (j + 1) & mask) {
+        if (replay_home (&s->table[j], mask) == j) {
+            break;
+        }
+        s->table[i] = s->table[j];
+        replay_wheel_move (s, i);
+        i = j;
+    }
+    s->table[i].t_expired = 0;
+    s->count--;
+    return;
+}
 
-            for (i = 0; i < REPLAY_NODE_ALLOC_NUM - 1; i++) {
-                replay_free_list[i].alloc.next = &replay_free_list[i+1];
-            }
-            replay_free_list[i].alloc.next = NULL;
+
+static int
+replay_table_resize (replay_shard_t s, unsigned int size)
+{
+/*  Resizes the table of shard [s] to [size] slots, re-inserting each entry.
+ *    The [size] must be a power of 2 large enough to hold every entry.
+ *  Since every entry moves, the wheel buckets are emptied and refilled as
+ *    the entries are re-inserted.  Each bucket is first grown to hold the
+ *    entries it will receive, so the re-insertions cannot fail.
+ *  The shard's mutex must be locked by the caller (unless initializing).
+ *  Returns 0 on success, or -1 with errno=ENOMEM if memory allocation fails
+ *    (in which case the table is left unchanged).
+ */
+    replay_t      old_table;
+    unsigned int  old_size;
+    unsigned int  counts [REPLAY_WHEEL_SIZE];
+    unsigned int  i;
+
+    assert (size > 0);
+    assert ((size & (size - 1)) == 0);
+    assert (size > s->count);
+
+    old_table = s->table;
+    old_size = s->size;
+
+    memset (counts, 0, sizeof (counts));
+    for (i = 0; i < old_size; i++) {
+        if (old_table[i].t_expired != 0) {
+            counts[replay_wheel_bucket (s, &old_table[i])]++;
         }
     }
-    if (replay_free_list) {
-        r = replay_free_list;
-        replay_free_list = r->alloc.next;
-        memset (r, 0, sizeof (*r));
+    for (i = 0; i < REPLAY_WHEEL_SIZE; i++) {
+        if (replay_wheel_grow (&s->wheel[i], counts[i]) < 0) {
+            errno = ENOMEM;
+            return (-1);
+        }
     }
-    else {
+    s->table = calloc (size, sizeof (struct replay_slot));
+    if (!s->table) {
+        s->table = old_table;
         errno = ENOMEM;
+        return (-1);
+    }
+    s->size = size;
+    s->count = 0;
+
+    for (i = 0; i < REPLAY_WHEEL_SIZE; i++) {
+        s->wheel[i].count = 0;
+    }
+    /*  The new table is below its maximum load and the old entries are
+     *    unique, so neither a nested resize nor a duplicate can occur.
+     */
+    for (i = 0; i < old_size; i++) {
+        if (old_table[i].t_expired != 0) {
+            (void) replay_table_insert (s, &old_table[i]);
+        }
+    }
+    free (old_table);
+    return (0);
+}
+
+
+static void
+replay_table_shrink (replay_shard_t s)
+{
+/*  Shrinks the table of shard [s] if it has become sparsely loaded.
+ *  The shard's mutex must be locked by the caller.
+ */
+    unsigned int size;
+
+    assert (lsd_mutex_is_locked (&s->mutex));
+
+    size = s->size;
+    while ((size > REPLAY_TABLE_SIZE)
+            && (s->count < size / REPLAY_LOAD_MIN_DIV)) {
+        size /= 2;
+    }
+    if (size < s->size) {
+        (void) replay_table_resize (s, size);
+    }
+    return;
+}
+
+
+static int
+replay_wheel_reserve (replay_shard_t s, const struct replay_slot *r)
+{
+/*  Ensures the wheel bucket of shard [s] for the replay entry [r] has room
+ *    for another slot index, so linking [r] into the wheel cannot fail once
+ *    the table has been modified.
+ *  The shard's mutex must be locked by the caller.
+ *  Returns 0 on success, or -1 if memory allocation fails.
+ */
+    struct replay_bucket *b;
+
+    b = &s->wheel[replay_wheel_bucket (s, r)];
+    return (replay_wheel_grow (b, b->count + 1));
+}
+
+
+static unsigned int
+replay_wheel_bucket (replay_shard_t s, const struct replay_slot *r)
+{
+/*  Returns the index of the wheel bucket of shard [s] for the replay entry
+ *    [r].  An entry expiring in an interval that has already been purged is
+ *    placed in the next bucket to be purged.
+ */
+    time_t tick;
+
+    tick = r->t_expired / REPLAY_WHEEL_SECS;
+    if (tick < s->wheel_tick) {
+        tick = s->wheel_tick;
     }
-    lsd_mutex_unlock (&replay_free_list_lock);
-    return (r);
+    return (tick % REPLAY_WHEEL_SIZE);
+}
+
+
+static int
+replay_wheel_grow (struct replay_bucket *b, unsigned int count)
+{
+/*  Ensures the wheel bucket [b] has room for at least [count] slot indices.
+ *  Returns 0 on success, or -1 if memory allocation fails.
+ */
+    unsigned int *slots;
+    unsigned int  size;
+
+    if (count <= b->size) {
+        return (0);
+    }
+    size = (b->size > 0) ? b->size : REPLAY_BUCKET_SIZE;
+    while (size < count) {
+        size *= 2;
+    }
+    slots = realloc (b->slots, size * sizeof (*slots));
+    if (!slots) {
+        return (-1);
+    }
+    b->slots = slots;
+    b->size = size;
+    return (0);
 }
 
 
 static void
-replay_free (replay_t r)
+replay_wheel_link (replay_shard_t s, unsigned int i)
 {
-/*  De-allocates the replay_t object [r].
+/*  Links the new entry at slot [i] of the table of shard [s] into the wheel
+ *    bucket for the interval in which it expires.  The bucket must already
+ *    have room via replay_wheel_reserve().
+ *  The shard's mutex must be locked by the caller.
  */
-    assert (r != NULL);
-    lsd_mutex_lock (&replay_free_list_lock);
-    r->alloc.next = replay_free_list;
-    replay_free_list = r;
-    lsd_mutex_unlock (&replay_free_list_lock);
+    struct replay_bucket *b;
+
+    s->table[i].bucket = replay_wheel_bucket (s, &s->table[i]);
+    b = &s->wheel[s->table[i].bucket];
+
+    assert (b->count < b->size);
+    s->table[i].pos = b->count;
+    b->slots[b->count++] = i;
     return;
 }
 
 
 static void
-replay_drop_memory (void)
+replay_wheel_unlink (replay_shard_t s, unsigned int i)
 {
-/*  Frees memory that has been internally allocated for replay_t objects.
- *  This routine should only be called via replay_fini() after replay_hash
- *    has been destroyed.
+/*  Unlinks the entry at slot [i] of the table of shard [s] from its wheel
+ *    bucket by moving the bucket's last slot index into its position.
+ *  The shard's mutex must be locked by the caller.
  */
-    replay_t r;
+    struct replay_bucket *b;
+    unsigned int          pos;
+    unsigned int          j;
+
+    b = &s->wheel[s->table[i].bucket];
+    pos = s->table[i].pos;
 
-    lsd_mutex_lock (&replay_free_list_lock);
-    while (replay_mem_list != NULL) {
-        r = replay_mem_list;
-        replay_mem_list = r->alloc.next;
-        free (r);
+    assert (pos < b->count);
+    assert (b->slots[pos] == i);
+
+    j = b->slots[--b->count];
+    if (pos < b->count) {
+        b->slots[pos] = j;
+        s->table[j].pos = pos;
     }
-    replay_free_list = NULL;
-    lsd_mutex_unlock (&replay_free_list_lock);
     return;
 }
+
+
+static void
+replay_wheel_move (replay_shard_t s, unsigned int i)
+{
+/*  Updates the wheel bucket of the entry that has just been moved into slot
+ *    [i] of the table of shard [s].
+ *  The shard's mutex must be locked by the caller.
+ */
+    s->wheel[s->table[i].bucket].slots[s->table[i].pos] = i;
+    return;
+}
+
+
+static int
+replay_wheel_purge (replay_shard_t s, time_t tick, time_t now)
+{
+/*  Purges shard [s] of credentials expired by time [now] that are held in
+ *    the wheel buckets for the intervals preceding [tick], shrinking the
+ *    table if it has become sparsely loaded.
+ *  Since deleting an entry moves the bucket's last slot index into its
+ *    position, that position is re-examined after each deletion.
+ *  Returns the number of credentials purged.
+ */
+    struct replay_bucket *b;
+    unsigned int          k;
+    unsigned int          j;
+    int                   i;
+    int                   n = 0;
+
+    for (i = 0; i < REPLAY_WHEEL_SIZE; i++) {
+
+        lsd_mutex_lock (&s->mutex);
+        if (s->wheel_tick >= tick) {
+            lsd_mutex_unlock (&s->mutex);
+            break;
+        }
+        b = &s->wheel[s->wheel_tick % REPLAY_WHEEL_SIZE];
+        k = 0;
+        while (k < b->count) {
+            j = b->slots[k];
+            if (s->table[j].t_expired < now) {
+                replay_table_delete (s, j);
+                n++;
+            }
+            else {
+                k++;
+            }
+        }
+        s->wheel_tick++;
+        lsd_mutex_unlock (&s->mutex);
+    }
+    /*  If the wheel has not been purged for an entire revolution,
+     *    every bucket has now been purged.
+     */
+    lsd_mutex_lock (&s->mutex);
+    if (s->wheel_tick < tick) {
+        s->wheel_tick = tick;
+    }
+    replay_table_shrink (s);
+    lsd_mutex_unlock (&s->mutex);
+    return (n);
+}
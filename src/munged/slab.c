@@ -0,0 +1,387 @@
+/*****************************************************************************
+ *  This file is part of the MUNGE Uid 'N' Gid Emporium (MUNGE).
+ *  For details, see <https://dun.github.io/munge/>.
+ *
+ *  MUNGE is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.  Additionally for the MUNGE library (libmunge), you
+ *  can redistribute it and/or modify it under the terms of the GNU Lesser
+ *  General Public License as published by the Free Software Foundation,
+ *  either version 3 of the License, or (at your option) any later version.
+ *
+ *  MUNGE is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  and GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  and GNU Lesser General Public License along with MUNGE.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include "slab.h"
+#include "thread.h"
+
+
+/*****************************************************************************
+ *  Constants
+ *****************************************************************************/
+
+#define SLAB_DEF_MAG_LEN        32
+#define SLAB_DEF_DEPOT_LEN      64
+
+
+/*****************************************************************************
+ *  Data Types
+ *****************************************************************************/
+
+struct slab_mag {
+    struct slab_mag    *next;           /* next magazine in depot list       */
+    int                 count;          /* number of objs in magazine        */
+    void               *objs[];         /* array of [mag_len] obj ptrs       */
+};
+
+struct slab_cache {
+    slab_t              slab;           /* slab to which cache belongs       */
+    struct slab_mag    *loaded;         /* magazine for allocs & frees       */
+    struct slab_mag    *previous;       /* full or empty magazine in reserve */
+};
+
+struct slab {
+    size_t              size;           /* size of each obj                  */
+    int                 mag_len;        /* num objs per magazine             */
+    int                 depot_len;      /* max num full magazines in depot   */
+    int                 num_full;       /* num full magazines in depot       */
+    struct slab_mag    *full;           /* list of full depot magazines      */
+    struct slab_mag    *empty;          /* list of empty depot magazines     */
+#if WITH_PTHREADS
+    pthread_mutex_t     mutex;          /* mutex to protect access to depot  */
+    pthread_key_t       key;            /* key for per-thread slab_cache     */
+#else  /* !WITH_PTHREADS */
+    struct slab_cache  *cache;          /* slab_cache for single thread      */
+#endif /* !WITH_PTHREADS */
+};
+
+
+/*****************************************************************************
+ *  Prototypes
+ *****************************************************************************/
+
+static struct slab_cache * slab_cache_get (slab_t s);
+
+static void slab_cache_destroy (void *arg);
+
+static struct slab_mag * slab_mag_create (slab_t s);
+
+static void slab_mag_drain (struct slab_mag *mag);
+
+static void slab_mag_put (slab_t s, struct slab_mag *mag);
+
+
+/*****************************************************************************
+ *  Functions
+ *****************************************************************************/
+
+slab_t
+slab_create (size_t size, int mag_len, int depot_len)
+{
+    slab_t s;
+
+    if (size == 0) {
+        errno = EINVAL;
+        return (NULL);
+    }
+    if (!(s = malloc (sizeof (*s)))) {
+        errno = ENOMEM;
+        return (NULL);
+    }
+    s->size = size;
+    s->mag_len = (mag_len > 0) ? mag_len : SLAB_DEF_MAG_LEN;
+    s->depot_len = (depot_len > 0) ? depot_len : SLAB_DEF_DEPOT_LEN;
+    s->num_full = 0;
+    s->full = NULL;
+    s->empty = NULL;
+#if WITH_PTHREADS
+    if ((errno = pthread_key_create (&s->key, slab_cache_destroy)) != 0) {
+        free (s);
+        return (NULL);
+    }
+    lsd_mutex_init (&s->mutex);
+#else  /* !WITH_PTHREADS */
+    s->cache = NULL;
+#endif /* !WITH_PTHREADS */
+    return (s);
+}
+
+
+void
+slab_destroy (slab_t s)
+{
+    struct slab_cache *c;
+    struct slab_mag   *mag;
+
+    if (!s) {
+        errno = EINVAL;
+        return;
+    }
+    /*  Return the calling thread's magazines to the depot.
+     */
+#if WITH_PTHREADS
+    c = pthread_getspecific (s->key);
+    (void) pthread_setspecific (s->key, NULL);
+#else  /* !WITH_PTHREADS */
+    c = s->cache;
+    s->cache = NULL;
+#endif /* !WITH_PTHREADS */
+    if (c != NULL) {
+        slab_cache_destroy (c);
+    }
+    lsd_mutex_lock (&s->mutex);
+    while ((mag = s->full) != NULL) {
+        s->full = mag->next;
+        slab_mag_drain (mag);
+        free (mag);
+    }
+    while ((mag = s->empty) != NULL) {
+        s->empty = mag->next;
+        free (mag);
+    }
+    lsd_mutex_unlock (&s->mutex);
+#if WITH_PTHREADS
+    lsd_mutex_destroy (&s->mutex);
+    (void) pthread_key_delete (s->key);
+#endif /* WITH_PTHREADS */
+    free (s);
+    return;
+}
+
+
+void *
+slab_alloc (slab_t s)
+{
+    struct slab_cache *c;
+    struct slab_mag   *mag;
+    void              *obj;
+
+    assert (s != NULL);
+
+    if (!(c = slab_cache_get (s))) {
+        return (malloc (s->size));
+    }
+    if (c->loaded->count == 0) {
+        /*
+         *  If the previous magazine is full, swap it in.
+         *  Otherwise, exchange it for a full magazine from the depot.
+         */
+        if (c->previous->count > 0) {
+            mag = c->loaded;
+            c->loaded = c->previous;
+            c->previous = mag;
+        }
+        else {
+            lsd_mutex_lock (&s->mutex);
+            if ((mag = s->full) != NULL) {
+                s->full = mag->next;
+                s->num_full--;
+                c->previous->next = s->empty;
+                s->empty = c->previous;
+                c->previous = c->loaded;
+                c->loaded = mag;
+            }
+            lsd_mutex_unlock (&s->mutex);
+
+            if (mag == NULL) {
+                if (!(obj = malloc (s->size))) {
+                    errno = ENOMEM;
+                }
+                return (obj);
+            }
+        }
+    }
+    assert (c->loaded->count > 0);
+    return (c->loaded->objs[--c->loaded->count]);
+}
+
+
+void
+slab_free (slab_t s, void *obj)
+{
+    struct slab_cache *c;
+    struct slab_mag   *mag;
+
+    assert (s != NULL);
+
+    if (!obj) {
+        return;
+    }
+    if (!(c = slab_cache_get (s))) {
+        free (obj);
+        return;
+    }
+    if (c->loaded->count == s->mag_len) {
+        /*
+         *  If the previous magazine is empty, swap it in.
+         *  Otherwise, exchange it for an empty magazine from the depot
+         *    if the depot has room for another full one.
+         */
+        if (c->previous->count == 0) {
+            mag = c->loaded;
+            c->loaded = c->previous;
+            c->previous = mag;
+        }
+        else {
+            mag = NULL;
+            lsd_mutex_lock (&s->mutex);
+            if (s->num_full < s->depot_len) {
+                if ((mag = s->empty) != NULL) {
+                    s->empty = mag->next;
+                }
+                else {
+                    mag = slab_mag_create (s);
+                }
+                if (mag != NULL) {
+                    c->previous->next = s->full;
+                    s->full = c->previous;
+                    s->num_full++;
+                    c->previous = c->loaded;
+                    c->loaded = mag;
+                }
+            }
+            lsd_mutex_unlock (&s->mutex);
+
+            if (mag == NULL) {
+                free (obj);
+                return;
+            }
+        }
+    }
+    assert (c->loaded->count < s->mag_len);
+    c->loaded->objs[c->loaded->count++] = obj;
+    return;
+}
+
+
+/*****************************************************************************
+ *  Internal Functions
+ *****************************************************************************/
+
+static struct slab_cache *
+slab_cache_get (slab_t s)
+{
+/*  Returns the calling thread's cache for slab [s], creating it if needed.
+ *  Returns NULL if the cache cannot be created, in which case objects are
+ *    allocated and freed directly.
+ */
+    struct slab_cache *c;
+
+#if WITH_PTHREADS
+    c = pthread_getspecific (s->key);
+#else  /* !WITH_PTHREADS */
+    c = s->cache;
+#endif /* !WITH_PTHREADS */
+    if (c != NULL) {
+        return (c);
+    }
+    if (!(c = malloc (sizeof (*c)))) {
+        return (NULL);
+    }
+    c->slab = s;
+    c->loaded = slab_mag_create (s);
+    c->previous = slab_mag_create (s);
+    if (!c->loaded || !c->previous) {
+        free (c->loaded);
+        free (c->previous);
+        free (c);
+        return (NULL);
+    }
+#if WITH_PTHREADS
+    if (pthread_setspecific (s->key, c) != 0) {
+        free (c->loaded);
+        free (c->previous);
+        free (c);
+        return (NULL);
+    }
+#else  /* !WITH_PTHREADS */
+    s->cache = c;
+#endif /* !WITH_PTHREADS */
+    return (c);
+}
+
+
+static void
+slab_cache_destroy (void *arg)
+{
+/*  Returns the magazines of the slab_cache [arg] to its slab's depot,
+ *    and frees the cache.  This is invoked when its thread exits.
+ */
+    struct slab_cache *c = arg;
+
+    assert (c != NULL);
+
+    slab_mag_put (c->slab, c->loaded);
+    slab_mag_put (c->slab, c->previous);
+    free (c);
+    return;
+}
+
+
+static struct slab_mag *
+slab_mag_create (slab_t s)
+{
+/*  Returns a new empty magazine for slab [s], or NULL on error.
+ */
+    struct slab_mag *mag;
+
+    mag = malloc (sizeof (*mag) + (s->mag_len * sizeof (mag->objs[0])));
+    if (mag != NULL) {
+        mag->next = NULL;
+        mag->count = 0;
+    }
+    return (mag);
+}
+
+
+static void
+slab_mag_drain (struct slab_mag *mag)
+{
+/*  Frees all objs in magazine [mag].
+ */
+    while (mag->count > 0) {
+        free (mag->objs[--mag->count]);
+    }
+    return;
+}
+
+
+static void
+slab_mag_put (slab_t s, struct slab_mag *mag)
+{
+/*  Places the non-empty magazine [mag] (which may be partially filled) in
+ *    the depot of slab [s] if there is room; otherwise, its objs are freed.
+ *    An empty magazine is freed since its thread no longer needs it.
+ */
+    if (mag->count > 0) {
+        lsd_mutex_lock (&s->mutex);
+        if (s->num_full < s->depot_len) {
+            mag->next = s->full;
+            s->full = mag;
+            s->num_full++;
+            mag = NULL;
+        }
+        lsd_mutex_unlock (&s->mutex);
+    }
+    if (mag != NULL) {
+        slab_mag_drain (mag);
+        free (mag);
+    }
+    return;
+}
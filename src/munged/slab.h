@@ -0,0 +1,100 @@
+/*****************************************************************************
+ *  This file is part of the MUNGE Uid 'N' Gid Emporium (MUNGE).
+ *  For details, see <https://dun.github.io/munge/>.
+ *
+ *  MUNGE is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.  Additionally for the MUNGE library (libmunge), you
+ *  can redistribute it and/or modify it under the terms of the GNU Lesser
+ *  General Public License as published by the Free Software Foundation,
+ *  either version 3 of the License, or (at your option) any later version.
+ *
+ *  MUNGE is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  and GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  and GNU Lesser General Public License along with MUNGE.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+
+#ifndef SLAB_H
+#define SLAB_H
+
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <stddef.h>
+
+
+/*****************************************************************************
+ *  Notes
+ *****************************************************************************/
+/*
+ *  A slab caches free objects of a fixed size for reuse in order to avoid
+ *    malloc() and free() calls (and contention for the allocator's arenas)
+ *    on frequently created and destroyed structs.
+ *
+ *  If WITH_PTHREADS is defined, each thread caches free objects in a pair of
+ *    "magazines" which are accessed without locking.  Full and empty
+ *    magazines are exchanged with a shared "depot" under a mutex once per
+ *    magazine's worth of objects, so objects allocated by one thread and
+ *    freed by another (eg, a request received by a reactor thread and
+ *    processed by a worker thread) still flow back to the allocating thread.
+ *    A thread's magazines are returned to the depot when the thread exits.
+ *    Objects in excess of what the depot can hold are freed.
+ *
+ *  Objects are not cleared when allocated or freed; it is the caller's
+ *    responsibility to initialize them and to burn any sensitive contents.
+ */
+
+
+/*****************************************************************************
+ *  Data Types
+ *****************************************************************************/
+
+typedef struct slab * slab_t;
+/*
+ *  Slab cache opaque data type.
+ */
+
+
+/*****************************************************************************
+ *  Functions
+ *****************************************************************************/
+
+slab_t slab_create (size_t size, int mag_len, int depot_len);
+/*
+ *  Creates and returns a new slab cache for objects of [size] bytes.
+ *  Each thread caches up to 2 magazines of [mag_len] objects, and the depot
+ *    holds up to [depot_len] full magazines.  If set <= 0, the default
+ *    lengths are used.
+ *  Returns NULL with errno=EINVAL if [size] is 0.
+ *  Returns NULL with errno=ENOMEM if memory allocation fails.
+ */
+
+void slab_destroy (slab_t s);
+/*
+ *  Destroys slab cache [s], freeing all objects cached by the depot and
+ *    the calling thread.  This must not be called until all other threads
+ *    using [s] have exited.
+ */
+
+void * slab_alloc (slab_t s);
+/*
+ *  Returns a ptr to an uninitialized object from slab cache [s].
+ *    Returns NULL with errno=ENOMEM if memory allocation fails.
+ */
+
+void slab_free (slab_t s, void *obj);
+/*
+ *  Returns the object [obj] allocated by slab_alloc() to slab cache [s].
+ */
+
+
+#endif /* !SLAB_H */
@@ -0,0 +1,156 @@
+/*****************************************************************************
+ *  This file is part of the MUNGE Uid 'N' Gid Emporium (MUNGE).
+ *  For details, see <https://dun.github.io/munge/>.
+ *
+ *  MUNGE is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.  Additionally for the MUNGE library (libmunge), you
+ *  can redistribute it and/or modify it under the terms of the GNU Lesser
+ *  General Public License as published by the Free Software Foundation,
+ *  either version 3 of the License, or (at your option) any later version.
+ *
+ *  MUNGE is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  and GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  and GNU Lesser General Public License along with MUNGE.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+
+#if HAVE_CONFIG_H
+#  include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "slab.h"
+#include "tap.h"
+
+
+/*****************************************************************************
+ *  Exercises the per-thread caches and the shared depot of the slab.
+ *****************************************************************************/
+
+#define OBJ_SIZE        100
+#define MAG_LEN         4
+#define DEPOT_LEN       8
+#define NUM_OBJS        (MAG_LEN * 4)
+
+
+struct free_args {
+    slab_t s;
+    void **objs;
+    int n;
+};
+
+
+static void *
+free_f (void *arg)
+{
+    struct free_args *a = arg;
+    int i;
+
+    for (i = 0; i < a->n; i++) {
+        slab_free (a->s, a->objs[i]);
+    }
+    return (NULL);
+}
+
+
+static int
+count_found (void **objs, int n, void *obj)
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+        if (objs[i] == obj) {
+            return (1);
+        }
+    }
+    return (0);
+}
+
+
+int
+main (int argc, char *argv[])
+{
+    slab_t s;
+    void *objs[NUM_OBJS];
+    void *objs2[NUM_OBJS];
+    void *p, *q;
+    struct free_args args;
+    pthread_t tid;
+    int i;
+    int n;
+
+    plan (7);
+
+    ok (slab_create (0, 0, 0) == NULL, "Rejected zero-sized objects");
+
+    if (!(s = slab_create (OBJ_SIZE, MAG_LEN, DEPOT_LEN))) {
+        BAIL_OUT ("Failed to create slab");
+    }
+    if (!(p = slab_alloc (s))) {
+        BAIL_OUT ("Failed to allocate object");
+    }
+    memset (p, 0xA5, OBJ_SIZE);
+    slab_free (s, p);
+    q = slab_alloc (s);
+    ok (q == p, "Reused most recently freed object");
+    slab_free (s, q);
+
+    for (i = 0, n = 0; i < NUM_OBJS; i++) {
+        if ((objs[i] = slab_alloc (s)) != NULL) {
+            memset (objs[i], i, OBJ_SIZE);
+            n++;
+        }
+    }
+    ok (n == NUM_OBJS, "Allocated %d objects", NUM_OBJS);
+
+    for (i = 0, n = 0; i < NUM_OBJS; i++) {
+        if (((unsigned char *) objs[i])[OBJ_SIZE - 1] == (unsigned char) i) {
+            n++;
+        }
+    }
+    ok (n == NUM_OBJS, "Objects do not overlap");
+
+    for (i = 0; i < NUM_OBJS; i++) {
+        slab_free (s, objs[i]);
+    }
+    for (i = 0, n = 0; i < NUM_OBJS; i++) {
+        objs2[i] = slab_alloc (s);
+        n += count_found (objs, NUM_OBJS, objs2[i]);
+    }
+    memcpy (objs, objs2, sizeof (objs));
+    ok (n == NUM_OBJS, "Reused objects from magazines and depot");
+
+    args.s = s;
+    args.objs = objs;
+    args.n = NUM_OBJS;
+    if ((errno = pthread_create (&tid, NULL, free_f, &args)) != 0) {
+        BAIL_OUT ("Failed to create thread");
+    }
+    if ((errno = pthread_join (tid, NULL)) != 0) {
+        BAIL_OUT ("Failed to join thread");
+    }
+    for (i = 0, n = 0; i < NUM_OBJS; i++) {
+        objs2[i] = slab_alloc (s);
+        n += count_found (objs, NUM_OBJS, objs2[i]);
+    }
+    memcpy (objs, objs2, sizeof (objs));
+    ok (n == NUM_OBJS, "Reused objects freed by exited thread");
+
+    for (i = 0; i < NUM_OBJS; i++) {
+        slab_free (s, objs[i]);
+    }
+    slab_destroy (s);
+    ok (1, "Destroyed slab");
+
+    done_testing ();
+}
@@ -38,10 +38,16 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <poll.h>
 #include <pthread.h>
 #include <signal.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/time.h>
+#if HAVE_TIMERFD_CREATE
+#include <sys/timerfd.h>
+#endif /* HAVE_TIMERFD_CREATE */
 #include <time.h>
 #include <unistd.h>
 #include <munge.h>
@@ -50,16 +56,41 @@
 #include "timer.h"
 
 
+/*****************************************************************************
+ *  Constants
+ *****************************************************************************/
+
+/*  Initial number of slots allocated for the _timer_heap array.
+ *    The array is doubled in size whenever it fills.
+ */
+#define TIMER_HEAP_SIZE                 64
+
+/*  Number of chains in the _timer_hash table (a power of 2).
+ */
+#define TIMER_HASH_SIZE                 256
+
+/*  Timers are dispatched by a dedicated timer thread.  Where available, the
+ *    thread blocks on a timerfd on the monotonic clock; otherwise, it waits
+ *    on a condition variable until the next timer expires.
+ */
+#if HAVE_TIMERFD_CREATE
+#  define TIMER_USE_TIMERFD             1
+#else  /* !HAVE_TIMERFD_CREATE */
+#  define TIMER_USE_TIMERFD             0
+#endif /* !HAVE_TIMERFD_CREATE */
+
+
 /*****************************************************************************
  *  Private Data Types
  *****************************************************************************/
 
 struct timer {
     long               id;              /* timer ID                          */
-    struct timespec    ts;              /* expiration time                   */
+    struct timespec    ts;              /* expiration time (internal clock)  */
     callback_f         f;               /* callback function                 */
     void              *arg;             /* callback function arg             */
-    struct timer      *next;            /* next timer in list                */
+    int                heap_idx;        /* index into heap, or -1 if !active */
+    struct timer      *next;            /* next timer in hash chain or list  */
 };
 
 typedef struct timer * timer_p;
@@ -71,32 +102,70 @@ typedef struct timer * timer_p;
 
 static void * _timer_thread (void *arg);
 
+#if ! TIMER_USE_TIMERFD
 static void _timer_thread_cleanup (void *arg);
+#endif /* !TIMER_USE_TIMERFD */
+
+static long _timer_set (callback_f cb, void *arg, const struct timespec *tsp);
+
+static void _timer_expire (void);
+
+static void _timer_arm (void);
 
 static timer_p _timer_alloc (void);
 
 static void _timer_get_timespec (struct timespec *tsp);
 
+static void _timer_from_realtime (struct timespec *tsp);
+
 static int _timer_is_timespec_ge (
         struct timespec *tsp0, struct timespec *tsp1);
 
+static int _timer_is_before (timer_p t0, timer_p t1);
+
+static int _timer_heap_insert (timer_p t);
+
+static void _timer_heap_remove (timer_p t);
+
+static void _timer_heap_sift_up (int i);
+
+static void _timer_heap_sift_down (int i);
+
+static void _timer_hash_insert (timer_p t);
+
+static timer_p _timer_hash_remove (long id);
+
 
 /*****************************************************************************
  *  Private Variables
  *****************************************************************************/
 
-static pthread_t       _timer_tid = 0;
+#if TIMER_USE_TIMERFD
+static int             _timer_fd = -1;
+#else  /* !TIMER_USE_TIMERFD */
 static pthread_cond_t  _timer_cond = PTHREAD_COND_INITIALIZER;
+#endif /* !TIMER_USE_TIMERFD */
+static pthread_t       _timer_tid = 0;
 static pthread_mutex_t _timer_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 /*  The _timer_id is the ID of the last timer that was set.
  */
 static long            _timer_id = 0;
 
-/*  The _timer_active list contains timers waiting to be dispatched, sorted in
- *    order of increasing timespecs; the list head is the next timer to expire.
+/*  The _timer_heap array is a binary min-heap of timers waiting to be
+ *    dispatched, ordered by increasing timespecs; the root (index 0) is the
+ *    next timer to expire.  Each active timer records its heap index so it
+ *    can be removed in O(log n) when canceled.
  */
-static timer_p         _timer_active = NULL;
+static timer_p        *_timer_heap = NULL;
+static int             _timer_heap_len = 0;
+static int             _timer_heap_size = 0;
+
+/*  The _timer_hash table maps the IDs of active timers to the timers
+ *    themselves so timer_cancel() can locate a timer without a linear scan.
+ *    Active timers are chained through their [next] field.
+ */
+static timer_p         _timer_hash[TIMER_HASH_SIZE];
 
 /*  The _timer_inactive list contains timers that have been dispatched and can
  *    be reused without allocating more memory.
@@ -117,6 +186,12 @@ timer_init (void)
     if (_timer_tid != 0) {
         return;
     }
+#if TIMER_USE_TIMERFD
+    _timer_fd = timerfd_create (CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (_timer_fd < 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to create timerfd");
+    }
+#endif /* TIMER_USE_TIMERFD */
     if ((errno = pthread_attr_init (&tattr)) != 0) {
         log_errno (EMUNGE_SNAFU, LOG_ERR,
                 "Failed to init timer thread attribute");
@@ -142,6 +217,18 @@ timer_init (void)
         log_errno (EMUNGE_SNAFU, LOG_ERR,
                 "Failed to destroy timer thread attribute");
     }
+#if TIMER_USE_TIMERFD
+    /*  Arm the timerfd for any timers set before it was created.
+     */
+    if ((errno = pthread_mutex_lock (&_timer_mutex)) != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to lock timer mutex");
+    }
+    _timer_arm ();
+
+    if ((errno = pthread_mutex_unlock (&_timer_mutex)) != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to unlock timer mutex");
+    }
+#endif /* TIMER_USE_TIMERFD */
     return;
 }
 
@@ -150,8 +237,8 @@ void
 timer_fini (void)
 {
     void    *result;
-    timer_p *t_prev_ptr;
     timer_p  t;
+    int      i;
 
     if (_timer_tid == 0) {
         return;
@@ -167,19 +254,27 @@ timer_fini (void)
     }
     _timer_tid = 0;
 
+#if TIMER_USE_TIMERFD
+    if (close (_timer_fd) < 0) {
+        log_msg (LOG_WARNING, "Failed to close timerfd: %s", strerror (errno));
+    }
+    _timer_fd = -1;
+#endif /* TIMER_USE_TIMERFD */
+
     if ((errno = pthread_mutex_lock (&_timer_mutex)) != 0) {
         log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to lock timer mutex");
     }
     /*  Cancel pending timers by moving active timers to the inactive list.
      */
-    if (_timer_active) {
-        t_prev_ptr = &_timer_active;
-        while (*t_prev_ptr) {
-            t_prev_ptr = &(*t_prev_ptr)->next;
-        }
-        *t_prev_ptr = _timer_inactive;
-        _timer_inactive = _timer_active;
-        _timer_active = NULL;
+    for (i = 0; i < _timer_heap_len; i++) {
+        t = _timer_heap[i];
+        t->heap_idx = -1;
+        t->next = _timer_inactive;
+        _timer_inactive = t;
+    }
+    _timer_heap_len = 0;
+    for (i = 0; i < TIMER_HASH_SIZE; i++) {
+        _timer_hash[i] = NULL;
     }
     /*  De-allocate timers.
      */
@@ -188,6 +283,10 @@ timer_fini (void)
         _timer_inactive = _timer_inactive->next;
         free (t);
     }
+    free (_timer_heap);
+    _timer_heap = NULL;
+    _timer_heap_size = 0;
+
     if ((errno = pthread_mutex_unlock (&_timer_mutex)) != 0) {
         log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to unlock timer mutex");
     }
@@ -198,57 +297,17 @@ timer_fini (void)
 long
 timer_set_absolute (callback_f cb, void *arg, const struct timespec *tsp)
 {
-    timer_p  t;
-    timer_p *t_prev_ptr;
-    int      do_signal = 0;
+    struct timespec ts;
 
     if (!cb || !tsp) {
         errno = EINVAL;
         return (-1);
     }
-    if ((errno = pthread_mutex_lock (&_timer_mutex)) != 0) {
-        log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to lock timer mutex");
-    }
-    if (!(t = _timer_alloc ())) {
-        log_errno (EMUNGE_NO_MEMORY, LOG_ERR, "Failed to allocate timer");
-    }
-    /*  Initialize the timer.
-     */
-    _timer_id++;
-    if (_timer_id <= 0) {
-        _timer_id = 1;
-    }
-    t->id = _timer_id;
-    t->f = cb;
-    t->arg = arg;
-    t->ts = *tsp;
-
-    /*  Insert the timer into the active list.
-     */
-    t_prev_ptr = &_timer_active;
-    while (*t_prev_ptr && _timer_is_timespec_ge (&t->ts, &(*t_prev_ptr)->ts)) {
-        t_prev_ptr = &(*t_prev_ptr)->next;
-    }
-    t->next = *t_prev_ptr;
-    *t_prev_ptr = t;
-
-    /*  Only signal the timer thread if the active timer has changed.
-     *  Set a flag here so the signal can be done outside the monitor lock.
+    /*  Convert the wall-clock time into the internal clock.
      */
-    if (t_prev_ptr == &_timer_active) {
-        do_signal = 1;
-    }
-    if ((errno = pthread_mutex_unlock (&_timer_mutex)) != 0) {
-        log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to unlock timer mutex");
-    }
-    if (do_signal) {
-        if ((errno = pthread_cond_signal (&_timer_cond)) != 0) {
-            log_errno (EMUNGE_SNAFU, LOG_ERR,
-                    "Failed to signal timer condition");
-        }
-    }
-    assert (t->id > 0);
-    return (t->id);
+    ts = *tsp;
+    _timer_from_realtime (&ts);
+    return (_timer_set (cb, arg, &ts));
 }
 
 
@@ -257,6 +316,10 @@ timer_set_relative (callback_f cb, void *arg, long msec)
 {
     struct timespec ts;
 
+    if (!cb) {
+        errno = EINVAL;
+        return (-1);
+    }
     /*  Convert the relative time offset into an absolute timespec from now.
      */
     _timer_get_timespec (&ts);
@@ -269,15 +332,14 @@ timer_set_relative (callback_f cb, void *arg, long msec)
             ts.tv_nsec %= 1000000000;
         }
     }
-    return (timer_set_absolute (cb, arg, &ts));
+    return (_timer_set (cb, arg, &ts));
 }
 
 
 int
 timer_cancel (long id)
 {
-    timer_p *t_prev_ptr;
-    timer_p  t = NULL;
+    timer_p  t;
     int      do_signal = 0;
 
     if (id <= 0) {
@@ -287,36 +349,41 @@ timer_cancel (long id)
     if ((errno = pthread_mutex_lock (&_timer_mutex)) != 0) {
         log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to lock timer mutex");
     }
-    /*  Locate the active timer specified by [id].
+    /*  Locate the active timer specified by [id] and remove it from the hash.
      */
-    t_prev_ptr = &_timer_active;
-    while (*t_prev_ptr && (id != (*t_prev_ptr)->id)) {
-        t_prev_ptr = &(*t_prev_ptr)->next;
-    }
-    /*  Remove the located timer from the active list.
+    t = _timer_hash_remove (id);
+
+    /*  Remove the located timer from the active heap.
      */
-    if (*t_prev_ptr) {
-        t = *t_prev_ptr;
-        *t_prev_ptr = t->next;
-        t->next = _timer_inactive;
-        _timer_inactive = t;
+    if (t) {
         /*
-         *  Only signal the timer thread if the active timer was canceled.
-         *  Set a flag here so the signal can be done outside the monitor lock.
+         *  Only rearm the timer if the active timer was canceled.
          */
-        if (t_prev_ptr == &_timer_active) {
+        if (t->heap_idx == 0) {
             do_signal = 1;
         }
+        _timer_heap_remove (t);
+        t->next = _timer_inactive;
+        _timer_inactive = t;
+    }
+#if TIMER_USE_TIMERFD
+    if (do_signal) {
+        _timer_arm ();
     }
+#endif /* TIMER_USE_TIMERFD */
     if ((errno = pthread_mutex_unlock (&_timer_mutex)) != 0) {
         log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to unlock timer mutex");
     }
+#if ! TIMER_USE_TIMERFD
+    /*  The timer thread is signaled outside the monitor lock.
+     */
     if (do_signal) {
         if ((errno = pthread_cond_signal (&_timer_cond)) != 0) {
             log_errno (EMUNGE_SNAFU, LOG_ERR,
                 "Failed to signal timer condition");
         }
     }
+#endif /* !TIMER_USE_TIMERFD */
     return (t ? 1 : 0);
 }
 
@@ -330,12 +397,17 @@ _timer_thread (void *arg)
 {
 /*  The timer thread.  It waits until the next active timer expires,
  *    at which point it invokes the timer's callback function.
+ *  When timers are driven by a timerfd, the thread blocks on the timerfd
+ *    itself rather than on the timer condition.  A dedicated thread is kept
+ *    (instead of dispatching from the reactor) so lengthy callbacks such as
+ *    a gids map update do not stall accepting and reading requests.
  */
     sigset_t         sigset;
     int              cancel_state;
-    struct timespec  ts_now;
-    timer_p         *t_prev_ptr;
-    timer_p          timer_expired;
+#if TIMER_USE_TIMERFD
+    struct pollfd    pfd;
+    uint64_t         n;
+#endif /* TIMER_USE_TIMERFD */
 
     if (sigfillset (&sigset)) {
         log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to init timer sigset");
@@ -343,6 +415,59 @@ _timer_thread (void *arg)
     if (pthread_sigmask (SIG_SETMASK, &sigset, NULL) != 0) {
         log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to set timer sigset");
     }
+#if TIMER_USE_TIMERFD
+    pfd.fd = _timer_fd;
+    pfd.events = POLLIN;
+
+    for (;;) {
+        /*
+         *  Wait until the timerfd has expired.  The mutex is not held here
+         *    so timers can be set and canceled (rearming the timerfd) while
+         *    the thread is blocked.
+         *  Cancellation point.
+         */
+        if (poll (&pfd, 1, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to poll timerfd");
+        }
+        /*  Drain the expiration count so the timerfd stops polling as
+         *    readable until it is rearmed.
+         */
+        if ((read (_timer_fd, &n, sizeof (n)) < 0) && (errno != EAGAIN)) {
+            log_msg (LOG_WARNING, "Failed to read timerfd: %s",
+                    strerror (errno));
+        }
+        /*  Disable the thread's cancellation state in case any
+         *    callback functions contain cancellation points.
+         */
+        errno = pthread_setcancelstate (PTHREAD_CANCEL_DISABLE, &cancel_state);
+        if (errno != 0) {
+            log_errno (EMUNGE_SNAFU, LOG_ERR,
+                    "Failed to disable timer thread cancellation");
+        }
+        if ((errno = pthread_mutex_lock (&_timer_mutex)) != 0) {
+            log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to lock timer mutex");
+        }
+        _timer_expire ();
+        _timer_arm ();
+
+        if ((errno = pthread_mutex_unlock (&_timer_mutex)) != 0) {
+            log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to unlock timer mutex");
+        }
+        /*  Enable the thread's cancellation state.
+         *  The poll() at the top of the for-loop serves as the cancellation
+         *    point for a pending cancel request.
+         */
+        errno = pthread_setcancelstate (cancel_state, &cancel_state);
+        if (errno != 0) {
+            log_errno (EMUNGE_SNAFU, LOG_ERR,
+                    "Failed to enable timer thread cancellation");
+        }
+    }
+    assert (1);                         /* not reached */
+#else  /* !TIMER_USE_TIMERFD */
     if ((errno = pthread_mutex_lock (&_timer_mutex)) != 0) {
         log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to lock timer mutex");
     }
@@ -350,9 +475,9 @@ _timer_thread (void *arg)
 
     for (;;) {
         /*
-         *  Wait until a timer has been added to the active list.
+         *  Wait until a timer has been added to the active heap.
          */
-        while (!_timer_active) {
+        while (_timer_heap_len == 0) {
             /*
              *  Cancellation point.
              */
@@ -370,60 +495,15 @@ _timer_thread (void *arg)
             log_errno (EMUNGE_SNAFU, LOG_ERR,
                     "Failed to disable timer thread cancellation");
         }
-        _timer_get_timespec (&ts_now);
+        _timer_expire ();
 
-        /*  Select expired timers.
-         */
-        t_prev_ptr = &_timer_active;
-        while (*t_prev_ptr
-                && _timer_is_timespec_ge (&ts_now, &(*t_prev_ptr)->ts)) {
-            t_prev_ptr = &(*t_prev_ptr)->next;
-        }
-        if (t_prev_ptr != &_timer_active) {
-            /*
-             *  Move expired timers from the active list onto an expired list.
-             *  All expired timers are dispatched before the active list is
-             *    rescanned.  This protects against an erroneous ts_now set in
-             *    the future from causing recurring timers to be continually
-             *    dispatched since ts_now will be requeried once the expired
-             *    list is processed.  (Issue 15)
-             */
-            timer_expired = _timer_active;
-            _timer_active = *t_prev_ptr;
-            *t_prev_ptr = NULL;
-            /*
-             *  Unlock the mutex while dispatching callback functions in case
-             *    any need to set/cancel timers.
-             */
-            if ((errno = pthread_mutex_unlock (&_timer_mutex)) != 0) {
-                log_errno (EMUNGE_SNAFU, LOG_ERR,
-                        "Failed to unlock timer mutex");
-            }
-            /*  Dispatch expired timers.
-             */
-            t_prev_ptr = &timer_expired;
-            while (*t_prev_ptr) {
-                (*t_prev_ptr)->f ((*t_prev_ptr)->arg);
-                t_prev_ptr = &(*t_prev_ptr)->next;
-            }
-            if ((errno = pthread_mutex_lock (&_timer_mutex)) != 0) {
-                log_errno (EMUNGE_SNAFU, LOG_ERR,
-                        "Failed to lock timer mutex");
-            }
-            /*  Move the expired timers onto the inactive list.
-             *  At the end of the previous while-loop, t_prev_ptr is the
-             *    address of the terminating NULL of the timer_expired list.
-             */
-            *t_prev_ptr = _timer_inactive;
-            _timer_inactive = timer_expired;
-        }
         /*  Enable the thread's cancellation state.
          *  Since enabling cancellation is not a cancellation point,
          *    a pending cancel request must be tested for.  But a
          *    pthread_testcancel() is not needed here.  If active timers
-         *    are present, the pthread_cond_timedwait() at the bottom of
-         *    the for-loop will serve as the cancellation point; otherwise,
-         *    the pthread_cond_wait() at the top of the for-loop will.
+         *    are present, the pthread_cond_timedwait() at the bottom of the
+         *    for-loop will serve as the cancellation point; otherwise, the
+         *    pthread_cond_wait() at the top of the for-loop will.
          */
         errno = pthread_setcancelstate (cancel_state, &cancel_state);
         if (errno != 0) {
@@ -433,12 +513,12 @@ _timer_thread (void *arg)
         /*  Wait until the next active timer is set to expire,
          *    or until the active timer changes.
          */
-        while (_timer_active) {
+        while (_timer_heap_len > 0) {
             /*
              *  Cancellation point.
              */
             errno = pthread_cond_timedwait (
-                    &_timer_cond, &_timer_mutex, &(_timer_active->ts));
+                    &_timer_cond, &_timer_mutex, &(_timer_heap[0]->ts));
 
             if (errno == EINTR) {
                 continue;
@@ -452,10 +532,12 @@ _timer_thread (void *arg)
     }
     assert (1);                         /* not reached */
     pthread_cleanup_pop (1);
+#endif /* !TIMER_USE_TIMERFD */
     return (NULL);
 }
 
 
+#if ! TIMER_USE_TIMERFD
 static void
 _timer_thread_cleanup (void *arg)
 {
@@ -467,6 +549,168 @@ _timer_thread_cleanup (void *arg)
     }
     return;
 }
+#endif /* !TIMER_USE_TIMERFD */
+
+
+static long
+_timer_set (callback_f cb, void *arg, const struct timespec *tsp)
+{
+/*  Sets a timer to invoke [cb] with [arg] at the time [tsp] specified
+ *    in the internal clock.
+ *  Returns the timer ID.
+ */
+    timer_p  t;
+    int      do_signal = 0;
+
+    assert (cb != NULL);
+    assert (tsp != NULL);
+
+    if ((errno = pthread_mutex_lock (&_timer_mutex)) != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to lock timer mutex");
+    }
+    if (!(t = _timer_alloc ())) {
+        log_errno (EMUNGE_NO_MEMORY, LOG_ERR, "Failed to allocate timer");
+    }
+    /*  Initialize the timer.
+     */
+    _timer_id++;
+    if (_timer_id <= 0) {
+        _timer_id = 1;
+    }
+    t->id = _timer_id;
+    t->f = cb;
+    t->arg = arg;
+    t->ts = *tsp;
+
+    /*  Insert the timer into the active heap and hash.
+     */
+    if (_timer_heap_insert (t) < 0) {
+        log_errno (EMUNGE_NO_MEMORY, LOG_ERR, "Failed to allocate timer heap");
+    }
+    _timer_hash_insert (t);
+
+    /*  Only rearm the timer if the active timer has changed.
+     */
+    if (t->heap_idx == 0) {
+        do_signal = 1;
+    }
+#if TIMER_USE_TIMERFD
+    if (do_signal) {
+        _timer_arm ();
+    }
+#endif /* TIMER_USE_TIMERFD */
+    if ((errno = pthread_mutex_unlock (&_timer_mutex)) != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to unlock timer mutex");
+    }
+#if ! TIMER_USE_TIMERFD
+    /*  The timer thread is signaled outside the monitor lock.
+     */
+    if (do_signal) {
+        if ((errno = pthread_cond_signal (&_timer_cond)) != 0) {
+            log_errno (EMUNGE_SNAFU, LOG_ERR,
+                    "Failed to signal timer condition");
+        }
+    }
+#endif /* !TIMER_USE_TIMERFD */
+    assert (t->id > 0);
+    return (t->id);
+}
+
+
+static void
+_timer_expire (void)
+{
+/*  Dispatches all timers that have expired.
+ *  The mutex must be locked before calling this routine; it is released
+ *    while the callback functions are invoked.
+ */
+    struct timespec  ts_now;
+    timer_p          t;
+    timer_p         *t_prev_ptr;
+    timer_p          timer_expired;
+
+    assert (lsd_mutex_is_locked (&_timer_mutex));
+
+    _timer_get_timespec (&ts_now);
+
+    /*  Pop expired timers off the active heap onto an expired list.
+     *  All expired timers are dispatched as a batch before the active
+     *    heap is rechecked.  This protects against an erroneous ts_now
+     *    set in the future from causing recurring timers to be
+     *    continually dispatched since ts_now will be requeried once the
+     *    expired list is processed.  (Issue 15)
+     */
+    timer_expired = NULL;
+    t_prev_ptr = &timer_expired;
+    while ((_timer_heap_len > 0)
+            && _timer_is_timespec_ge (&ts_now, &_timer_heap[0]->ts)) {
+        t = _timer_heap[0];
+        _timer_heap_remove (t);
+        (void) _timer_hash_remove (t->id);
+        t->next = NULL;
+        *t_prev_ptr = t;
+        t_prev_ptr = &t->next;
+    }
+    if (!timer_expired) {
+        return;
+    }
+    /*  Unlock the mutex while dispatching callback functions in case
+     *    any need to set/cancel timers.
+     */
+    if ((errno = pthread_mutex_unlock (&_timer_mutex)) != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to unlock timer mutex");
+    }
+    /*  Dispatch expired timers in order of expiration.
+     */
+    for (t = timer_expired; t != NULL; t = t->next) {
+        t->f (t->arg);
+    }
+    if ((errno = pthread_mutex_lock (&_timer_mutex)) != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to lock timer mutex");
+    }
+    /*  Move the expired timers onto the inactive list.
+     *  At the end of the previous while-loop, t_prev_ptr is the
+     *    address of the terminating NULL of the timer_expired list.
+     */
+    *t_prev_ptr = _timer_inactive;
+    _timer_inactive = timer_expired;
+    return;
+}
+
+
+static void
+_timer_arm (void)
+{
+/*  Arms the timerfd to expire along with the next active timer,
+ *    or disarms it if no timers are active.
+ *  The mutex must be locked before calling this routine.
+ */
+#if TIMER_USE_TIMERFD
+    struct itimerspec its;
+
+    assert (lsd_mutex_is_locked (&_timer_mutex));
+
+    if (_timer_fd < 0) {
+        return;
+    }
+    memset (&its, 0, sizeof (its));
+    if (_timer_heap_len > 0) {
+        its.it_value = _timer_heap[0]->ts;
+        /*
+         *  An it_value of zero would disarm the timerfd instead of
+         *    expiring it immediately.
+         */
+        if ((its.it_value.tv_sec <= 0) && (its.it_value.tv_nsec <= 0)) {
+            its.it_value.tv_sec = 0;
+            its.it_value.tv_nsec = 1;
+        }
+    }
+    if (timerfd_settime (_timer_fd, TFD_TIMER_ABSTIME, &its, NULL) < 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to arm timerfd");
+    }
+#endif /* TIMER_USE_TIMERFD */
+    return;
+}
 
 
 static timer_p
@@ -487,6 +731,9 @@ _timer_alloc (void)
     else {
         t = malloc (sizeof (struct timer));
     }
+    if (t) {
+        t->heap_idx = -1;
+    }
     return (t);
 }
 
@@ -494,8 +741,17 @@ _timer_alloc (void)
 static void
 _timer_get_timespec (struct timespec *tsp)
 {
-/*  Sets the timespec [tsp] to the current time.
+/*  Sets the timespec [tsp] to the current time of the internal clock.
+ *  This is the monotonic clock when timers are driven by a timerfd so
+ *    wall-clock adjustments do not delay or hasten expirations.
  */
+#if TIMER_USE_TIMERFD
+    assert (tsp != NULL);
+
+    if (clock_gettime (CLOCK_MONOTONIC, tsp) < 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to query monotonic time");
+    }
+#else  /* !TIMER_USE_TIMERFD */
     struct timeval tv;
 
     assert (tsp != NULL);
@@ -505,6 +761,46 @@ _timer_get_timespec (struct timespec *tsp)
     }
     tsp->tv_sec = tv.tv_sec;
     tsp->tv_nsec = tv.tv_usec * 1000;
+#endif /* !TIMER_USE_TIMERFD */
+    return;
+}
+
+
+static void
+_timer_from_realtime (struct timespec *tsp)
+{
+/*  Converts the wall-clock time [tsp] into the internal clock by applying
+ *    its offset from the current wall-clock time to the current time of the
+ *    internal clock.  The result is normalized.
+ */
+#if TIMER_USE_TIMERFD
+    struct timeval  tv;
+    struct timespec ts_now;
+    long            nsec;
+
+    assert (tsp != NULL);
+
+    if (gettimeofday (&tv, NULL) < 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to query current time");
+    }
+    _timer_get_timespec (&ts_now);
+
+    nsec = (tsp->tv_nsec % 1000000000) - (tv.tv_usec * 1000) + ts_now.tv_nsec;
+    tsp->tv_sec += (tsp->tv_nsec / 1000000000) - tv.tv_sec + ts_now.tv_sec;
+    while (nsec < 0) {
+        nsec += 1000000000;
+        tsp->tv_sec--;
+    }
+    tsp->tv_sec += nsec / 1000000000;
+    tsp->tv_nsec = nsec % 1000000000;
+
+    /*  A time before the internal clock's epoch has already expired.
+     */
+    if (tsp->tv_sec < 0) {
+        tsp->tv_sec = 0;
+        tsp->tv_nsec = 0;
+    }
+#endif /* TIMER_USE_TIMERFD */
     return;
 }
 
@@ -533,3 +829,190 @@ _timer_is_timespec_ge (struct timespec *tsp0, struct timespec *tsp1)
         return (tsp0->tv_sec >= tsp1->tv_sec);
     }
 }
+
+
+static int
+_timer_is_before (timer_p t0, timer_p t1)
+{
+/*  Returns non-zero if timer [t0] is to be dispatched before timer [t1].
+ *  Timers with identical timespecs are dispatched in the order they were set.
+ */
+    assert (t0 != NULL);
+    assert (t1 != NULL);
+
+    if (!_timer_is_timespec_ge (&t0->ts, &t1->ts)) {
+        return (1);
+    }
+    if (!_timer_is_timespec_ge (&t1->ts, &t0->ts)) {
+        return (0);
+    }
+    return (t0->id < t1->id);
+}
+
+
+static int
+_timer_heap_insert (timer_p t)
+{
+/*  Inserts timer [t] into the active heap.
+ *  Returns 0 on success, or -1 on memory allocation failure.
+ *  The mutex must be locked before calling this routine.
+ */
+    timer_p *heap;
+    int      size;
+
+    assert (t != NULL);
+    assert (t->heap_idx < 0);
+    assert (lsd_mutex_is_locked (&_timer_mutex));
+
+    if (_timer_heap_len >= _timer_heap_size) {
+        size = (_timer_heap_size > 0) ? _timer_heap_size * 2 : TIMER_HEAP_SIZE;
+        heap = realloc (_timer_heap, size * sizeof (timer_p));
+        if (!heap) {
+            return (-1);
+        }
+        _timer_heap = heap;
+        _timer_heap_size = size;
+    }
+    t->heap_idx = _timer_heap_len;
+    _timer_heap[_timer_heap_len++] = t;
+    _timer_heap_sift_up (t->heap_idx);
+    return (0);
+}
+
+
+static void
+_timer_heap_remove (timer_p t)
+{
+/*  Removes timer [t] from the active heap.
+ *  The mutex must be locked before calling this routine.
+ */
+    int i;
+
+    assert (t != NULL);
+    assert (t->heap_idx >= 0);
+    assert (t->heap_idx < _timer_heap_len);
+    assert (_timer_heap[t->heap_idx] == t);
+    assert (lsd_mutex_is_locked (&_timer_mutex));
+
+    i = t->heap_idx;
+    t->heap_idx = -1;
+    _timer_heap_len--;
+
+    if (i == _timer_heap_len) {
+        return;
+    }
+    /*  Fill the hole with the last timer, then restore the heap property by
+     *    moving it either up or down.
+     */
+    _timer_heap[i] = _timer_heap[_timer_heap_len];
+    _timer_heap[i]->heap_idx = i;
+
+    if ((i > 0)
+            && _timer_is_before (_timer_heap[i], _timer_heap[(i - 1) / 2])) {
+        _timer_heap_sift_up (i);
+    }
+    else {
+        _timer_heap_sift_down (i);
+    }
+    return;
+}
+
+
+static void
+_timer_heap_sift_up (int i)
+{
+/*  Moves the timer at heap index [i] towards the root until its parent
+ *    expires no later than it does.
+ */
+    timer_p t;
+    int     parent;
+
+    t = _timer_heap[i];
+    while (i > 0) {
+        parent = (i - 1) / 2;
+        if (!_timer_is_before (t, _timer_heap[parent])) {
+            break;
+        }
+        _timer_heap[i] = _timer_heap[parent];
+        _timer_heap[i]->heap_idx = i;
+        i = parent;
+    }
+    _timer_heap[i] = t;
+    t->heap_idx = i;
+    return;
+}
+
+
+static void
+_timer_heap_sift_down (int i)
+{
+/*  Moves the timer at heap index [i] towards the leaves until neither of its
+ *    children expires before it does.
+ */
+    timer_p t;
+    int     child;
+
+    t = _timer_heap[i];
+    for (;;) {
+        child = (2 * i) + 1;
+        if (child >= _timer_heap_len) {
+            break;
+        }
+        if ((child + 1 < _timer_heap_len) && _timer_is_before (
+                    _timer_heap[child + 1], _timer_heap[child])) {
+            child++;
+        }
+        if (!_timer_is_before (_timer_heap[child], t)) {
+            break;
+        }
+        _timer_heap[i] = _timer_heap[child];
+        _timer_heap[i]->heap_idx = i;
+        i = child;
+    }
+    _timer_heap[i] = t;
+    t->heap_idx = i;
+    return;
+}
+
+
+static void
+_timer_hash_insert (timer_p t)
+{
+/*  Inserts active timer [t] into the ID hash.
+ *  The mutex must be locked before calling this routine.
+ */
+    timer_p *t_head_ptr;
+
+    assert (t != NULL);
+    assert (lsd_mutex_is_locked (&_timer_mutex));
+
+    t_head_ptr = &_timer_hash[t->id & (TIMER_HASH_SIZE - 1)];
+    t->next = *t_head_ptr;
+    *t_head_ptr = t;
+    return;
+}
+
+
+static timer_p
+_timer_hash_remove (long id)
+{
+/*  Removes the active timer specified by [id] from the ID hash.
+ *  Returns the timer, or NULL if [id] did not match an active timer.
+ *  The mutex must be locked before calling this routine.
+ */
+    timer_p *t_prev_ptr;
+    timer_p  t;
+
+    assert (lsd_mutex_is_locked (&_timer_mutex));
+
+    t_prev_ptr = &_timer_hash[id & (TIMER_HASH_SIZE - 1)];
+    while (*t_prev_ptr && (id != (*t_prev_ptr)->id)) {
+        t_prev_ptr = &(*t_prev_ptr)->next;
+    }
+    t = *t_prev_ptr;
+    if (t) {
+        *t_prev_ptr = t->next;
+        t->next = NULL;
+    }
+    return (t);
+}
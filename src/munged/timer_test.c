@@ -0,0 +1,188 @@
+/*****************************************************************************
+ *  This file is part of the MUNGE Uid 'N' Gid Emporium (MUNGE).
+ *  For details, see <https://dun.github.io/munge/>.
+ *
+ *  MUNGE is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.  Additionally for the MUNGE library (libmunge), you
+ *  can redistribute it and/or modify it under the terms of the GNU Lesser
+ *  General Public License as published by the Free Software Foundation,
+ *  either version 3 of the License, or (at your option) any later version.
+ *
+ *  MUNGE is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  and GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  and GNU Lesser General Public License along with MUNGE.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+
+
+#if HAVE_CONFIG_H
+#  include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <errno.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <time.h>
+#include "tap.h"
+#include "timer.h"
+
+
+/*****************************************************************************
+ *  Exercises the ordering, cancellation, and dispatch of timers.
+ *****************************************************************************/
+
+#define NUM_TIMERS      200             /* must be coprime to KEY_STRIDE     */
+#define KEY_STRIDE      37
+#define WAIT_MSECS      5000
+
+
+static pthread_mutex_t fired_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int fired[NUM_TIMERS + 1];
+static int num_fired = 0;
+static int keys[NUM_TIMERS + 1];
+static int is_main_thread = 0;
+static pthread_t main_tid;
+
+
+static void
+timer_f (void *arg)
+{
+    pthread_mutex_lock (&fired_mutex);
+    fired[num_fired++] = *(int *) arg;
+    if (pthread_equal (pthread_self (), main_tid)) {
+        is_main_thread = 1;
+    }
+    pthread_mutex_unlock (&fired_mutex);
+}
+
+
+static int
+wait_fired (int n)
+{
+/*  Waits up to WAIT_MSECS for [n] timers to have fired.
+ *  Returns the number of timers that have fired.
+ */
+    struct timespec ts = { 0, 1000000 };
+    int i;
+    int m;
+
+    for (i = 0; i < WAIT_MSECS; i++) {
+        pthread_mutex_lock (&fired_mutex);
+        m = num_fired;
+        pthread_mutex_unlock (&fired_mutex);
+        if (m >= n) {
+            break;
+        }
+        nanosleep (&ts, NULL);
+    }
+    return (m);
+}
+
+
+int
+main (int argc, char *argv[])
+{
+    struct timeval tv;
+    struct timespec ts;
+    long ids[NUM_TIMERS];
+    int idx[NUM_TIMERS + 1];
+    int i;
+    int n;
+    int n_expected;
+    int is_ordered;
+    int is_canceled;
+
+    plan (11);
+    main_tid = pthread_self ();
+
+    errno = 0;
+    ok ((timer_set_relative (NULL, NULL, 0) == -1) && (errno == EINVAL),
+            "Rejected timer without callback");
+    errno = 0;
+    ok ((timer_cancel (0) == -1) && (errno == EINVAL),
+            "Rejected cancel of invalid timer ID");
+
+    /*  Set timers that have already expired in a scrambled order so they are
+     *    all dispatched as a single batch once the timer thread starts.
+     */
+    if (gettimeofday (&tv, NULL) < 0) {
+        BAIL_OUT ("Failed to query current time");
+    }
+    for (i = 0; i < NUM_TIMERS; i++) {
+        idx[i] = i;
+        keys[i] = (i * KEY_STRIDE) % NUM_TIMERS;
+        ts.tv_sec = tv.tv_sec - 10;
+        ts.tv_nsec = keys[i] * 1000000;
+        ids[i] = timer_set_absolute (timer_f, &idx[i], &ts);
+        if (ids[i] <= 0) {
+            BAIL_OUT ("Failed to set timer %d", i);
+        }
+    }
+    for (i = 0, n = 0; i < NUM_TIMERS; i += 3) {
+        n += timer_cancel (ids[i]);
+    }
+    n_expected = NUM_TIMERS - n;
+    ok (n == (NUM_TIMERS + 2) / 3, "Canceled %d active timers", n);
+
+    for (i = 0, n = 0; i < NUM_TIMERS; i += 3) {
+        n += timer_cancel (ids[i]);
+    }
+    ok (n == 0, "Did not cancel previously canceled timers");
+
+    timer_init ();
+    n = wait_fired (n_expected);
+    ok (n == n_expected, "Dispatched %d expired timers", n);
+
+    for (i = 1, is_ordered = 1; i < n; i++) {
+        if (keys[fired[i - 1]] >= keys[fired[i]]) {
+            is_ordered = 0;
+        }
+    }
+    ok (is_ordered, "Dispatched timers in order of expiration");
+
+    for (i = 0, is_canceled = 1; i < n; i++) {
+        if (fired[i] % 3 == 0) {
+            is_canceled = 0;
+        }
+    }
+    ok (is_canceled, "Did not dispatch canceled timers");
+
+    ok (!is_main_thread, "Dispatched timers from the timer thread");
+
+    if (gettimeofday (&tv, NULL) < 0) {
+        BAIL_OUT ("Failed to query current time");
+    }
+    ts.tv_sec = tv.tv_sec;
+    ts.tv_nsec = (tv.tv_usec * 1000) + 50000000;
+    if (timer_set_absolute (timer_f, &idx[0], &ts) <= 0) {
+        BAIL_OUT ("Failed to set absolute timer");
+    }
+    n_expected++;
+    n = wait_fired (n_expected);
+    ok ((n == n_expected) && (fired[n - 1] == 0),
+            "Dispatched timer set at wall-clock time");
+
+    idx[NUM_TIMERS] = NUM_TIMERS;
+    keys[NUM_TIMERS] = NUM_TIMERS;
+    if (timer_set_relative (timer_f, &idx[NUM_TIMERS], 50) <= 0) {
+        BAIL_OUT ("Failed to set relative timer");
+    }
+    n = wait_fired (n_expected + 1);
+    ok ((n == n_expected + 1) && (fired[n - 1] == NUM_TIMERS),
+            "Dispatched relative timer");
+
+    if ((ids[0] = timer_set_relative (timer_f, &idx[0], 60000)) <= 0) {
+        BAIL_OUT ("Failed to set pending timer");
+    }
+    timer_fini ();
+    ok (timer_cancel (ids[0]) == 0, "Stopped timers");
+
+    done_testing ();
+}
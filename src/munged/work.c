@@ -38,32 +38,77 @@
 #include <signal.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 #include <munge.h>
 #include "log.h"
 #include "work.h"
 
 
+/*****************************************************************************
+ *  Private Constants
+ *****************************************************************************/
+
+/*  Number of slots in the work queue ring (must be a power of 2).
+ *  If the ring is full, work_queue() blocks until a slot is freed.
+ */
+#define WORK_QUEUE_SIZE         1024
+
+/*  Size of a cache line for separating the ring's head and tail cursors.
+ */
+#define WORK_CACHELINE_SIZE     64
+
+/*  States of a worker thread entry.
+ */
+#define WORK_THREAD_UNUSED      0
+#define WORK_THREAD_RUNNING     1
+#define WORK_THREAD_EXITED      2
+
+
 /*****************************************************************************
  *  Private Data Types
  *****************************************************************************/
 
-typedef struct work_arg {
-    struct work_arg    *next;           /* next work element in queue        */
+typedef struct work_slot {
+    unsigned long       seq;            /* sequence # for claiming the slot  */
     void               *arg;            /* arg describing work to be done    */
-} work_arg_t, *work_arg_p;
+    struct timespec     t_queued;       /* time work was queued if adaptive  */
+} work_slot_t, *work_slot_p;
+
+typedef struct work_thread {
+    pthread_t           tid;            /* worker thread ID                  */
+    int                 state;          /* WORK_THREAD_* state of the entry  */
+} work_thread_t, *work_thread_p;
 
 typedef struct work {
-    pthread_mutex_t     lock;           /* mutex for accessing struct        */
+    unsigned long       head;           /* ring position of next dequeue     */
+    unsigned char       head_pad [WORK_CACHELINE_SIZE];
+    unsigned long       tail;           /* ring position of next enqueue     */
+    unsigned char       tail_pad [WORK_CACHELINE_SIZE];
+    work_slot_p         ring;           /* ring of preallocated queue slots  */
+    unsigned long       mask;           /* ring size - 1                     */
+    int                 n_pending;      /* num work elements not yet done    */
+    int                 n_idle;         /* num workers parked awaiting work  */
+    int                 n_blocked;      /* num producers awaiting free slot  */
+    int                 n_starting;     /* num workers not yet running       */
+    int                 got_fini;       /* true prevents new work after fini */
+    pthread_mutex_t     lock;           /* mutex for parking threads         */
     pthread_cond_t      received_work;  /* cond for when new work is recv'd  */
+    pthread_cond_t      dequeued_work;  /* cond for when a slot is freed     */
     pthread_cond_t      finished_work;  /* cond for when all work is done    */
-    pthread_t          *workers;        /* ptr to array of worker thread IDs */
+    pthread_attr_t      tattr;          /* attributes for new worker threads */
+    work_thread_p       workers;        /* ptr to array of worker threads    */
     work_func_t         work_func;      /* function to perform work in queue */
-    work_arg_p          work_head;      /* head of the work queue            */
-    work_arg_p          work_tail;      /* tail of the work queue            */
-    int                 n_workers;      /* number of worker threads (total)  */
-    int                 n_working;      /* number of worker threads working  */
-    int                 got_fini;       /* true prevents new work after fini */
+    int                 n_workers;      /* number of worker threads running  */
+    int                 n_workers_min;  /* min number of worker threads      */
+    int                 n_workers_max;  /* max number of worker threads      */
+    int                 idle_secs;      /* secs before excess worker exits   */
+    int                 max_depth;      /* queue depth to add a worker       */
+    int                 max_wait_msecs; /* queue wait msecs to add a worker  */
+    int                 is_adaptive;    /* true if n_workers may vary        */
+#if ! HAVE_ATOMIC_BUILTINS
+    pthread_mutex_t     ring_lock;      /* mutex for accessing ring & counts */
+#endif /* !HAVE_ATOMIC_BUILTINS */
 } work_t;
 
 
@@ -73,8 +118,17 @@ typedef struct work {
 
 static void * _work_exec (void *arg);
 static void   _work_exec_cleanup (void *arg);
-static void * _work_enqueue (work_p wp, void *work);
-static void * _work_dequeue (work_p wp);
+static void * _work_park (work_p wp, struct timespec *t_queued);
+static void   _work_wake (work_p wp, int *n_waiting, pthread_cond_t *cond,
+                  int do_broadcast);
+static int    _work_spawn (work_p wp);
+static void   _work_retire (work_p wp);
+static void   _work_grow (work_p wp, const struct timespec *t_queued);
+static int    _work_enqueue (work_p wp, void *work);
+static void * _work_dequeue (work_p wp, struct timespec *t_queued);
+static unsigned long _work_depth (work_p wp);
+static int    _work_count_add (work_p wp, int *count, int n);
+static int    _work_count_get (work_p wp, int *count);
 
 
 /*****************************************************************************
@@ -85,9 +139,8 @@ work_p
 work_init (work_func_t f, int n_threads)
 {
     work_p wp;
-    pthread_attr_t tattr;
     size_t stacksize = 256 * 1024;
-    int i;
+    unsigned long i;
 
     /*  Check args.
      */
@@ -105,22 +158,27 @@ work_init (work_func_t f, int n_threads)
         log_errno (EMUNGE_NO_MEMORY, LOG_ERR,
             "Failed to allocate work thread struct");
     }
-    if (!(wp->workers = malloc (sizeof (*wp->workers) * n_threads))) {
+    if (!(wp->workers = calloc (n_threads, sizeof (*wp->workers)))) {
         log_errno (EMUNGE_NO_MEMORY, LOG_ERR,
             "Failed to allocate tid array for work thread struct");
     }
+    assert ((WORK_QUEUE_SIZE & (WORK_QUEUE_SIZE - 1)) == 0);
+    if (!(wp->ring = malloc (sizeof (*wp->ring) * WORK_QUEUE_SIZE))) {
+        log_errno (EMUNGE_NO_MEMORY, LOG_ERR,
+            "Failed to allocate work queue ring");
+    }
     /*  Initialize struct.
      */
-    if ((errno = pthread_attr_init (&tattr)) != 0) {
+    if ((errno = pthread_attr_init (&wp->tattr)) != 0) {
         log_errno (EMUNGE_SNAFU, LOG_ERR,
             "Failed to init work thread attribute");
     }
 #ifdef _POSIX_THREAD_ATTR_STACKSIZE
-    if ((errno = pthread_attr_setstacksize (&tattr, stacksize)) != 0) {
+    if ((errno = pthread_attr_setstacksize (&wp->tattr, stacksize)) != 0) {
         log_errno (EMUNGE_SNAFU, LOG_ERR,
             "Failed to set work thread stacksize");
     }
-    if ((errno = pthread_attr_getstacksize (&tattr, &stacksize)) != 0) {
+    if ((errno = pthread_attr_getstacksize (&wp->tattr, &stacksize)) != 0) {
         log_errno (EMUNGE_SNAFU, LOG_ERR,
             "Failed to get work thread stacksize");
     }
@@ -131,115 +189,219 @@ work_init (work_func_t f, int n_threads)
         log_errno (EMUNGE_SNAFU, LOG_ERR,
             "Failed to init work thread mutex");
     }
+#if ! HAVE_ATOMIC_BUILTINS
+    if ((errno = pthread_mutex_init (&wp->ring_lock, NULL)) != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR,
+            "Failed to init work queue mutex");
+    }
+#endif /* !HAVE_ATOMIC_BUILTINS */
     if ((errno = pthread_cond_init (&wp->received_work, NULL)) != 0) {
         log_errno (EMUNGE_SNAFU, LOG_ERR,
             "Failed to init work thread condition for received work");
     }
+    if ((errno = pthread_cond_init (&wp->dequeued_work, NULL)) != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR,
+            "Failed to init work thread condition for dequeued work");
+    }
     if ((errno = pthread_cond_init (&wp->finished_work, NULL)) != 0) {
         log_errno (EMUNGE_SNAFU, LOG_ERR,
             "Failed to init work thread condition for finished work");
     }
-    wp->work_func = f;
-    wp->work_head = wp->work_tail = NULL;
-    wp->n_workers = n_threads;
-    wp->n_working = 0;
+    for (i = 0; i < WORK_QUEUE_SIZE; i++) {
+        wp->ring[i].seq = i;
+        wp->ring[i].arg = NULL;
+    }
+    wp->head = wp->tail = 0;
+    wp->mask = WORK_QUEUE_SIZE - 1;
+    wp->n_pending = 0;
+    wp->n_idle = 0;
+    wp->n_blocked = 0;
+    wp->n_starting = 0;
     wp->got_fini = 0;
+    wp->work_func = f;
+    wp->n_workers = 0;
+    wp->n_workers_min = n_threads;
+    wp->n_workers_max = n_threads;
+    wp->idle_secs = 0;
+    wp->max_depth = 0;
+    wp->max_wait_msecs = 0;
+    wp->is_adaptive = 0;
     /*
      *  Start worker thread(s).
      */
-    for (i = 0; i < wp->n_workers; i++) {
-        if ((errno = pthread_create
-                    (&wp->workers[i], &tattr, _work_exec, wp)) != 0) {
+    if ((errno = pthread_mutex_lock (&wp->lock)) != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR,
+            "Failed to lock work thread mutex");
+    }
+    for (i = 0; i < (unsigned long) n_threads; i++) {
+        if (_work_spawn (wp) < 0) {
             log_errno (EMUNGE_SNAFU, LOG_ERR,
-                "Failed to create work thread #%d", i+1);
+                "Failed to create work thread #%d", (int) i+1);
         }
     }
-    /*  Cleanup.
-     */
-    if ((errno = pthread_attr_destroy (&tattr)) != 0) {
+    if ((errno = pthread_mutex_unlock (&wp->lock)) != 0) {
         log_errno (EMUNGE_SNAFU, LOG_ERR,
-            "Failed to destroy work thread attribute");
+            "Failed to unlock work thread mutex");
     }
     return (wp);
 }
 
 
+int
+work_set_adaptive (work_p wp, int max_threads, int idle_secs,
+                   int max_depth, int max_wait_msecs)
+{
+    work_thread_p workers;
+    int rc = 0;
+
+    if (!wp || (idle_secs <= 0) || (max_depth < 0) || (max_wait_msecs < 0)) {
+        errno = EINVAL;
+        return (-1);
+    }
+    if ((errno = pthread_mutex_lock (&wp->lock)) != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR,
+            "Failed to lock work thread mutex");
+    }
+    if (max_threads < wp->n_workers_min) {
+        errno = EINVAL;
+        rc = -1;
+    }
+    else if (max_threads > wp->n_workers_max) {
+        /*
+         *  Worker threads locate their own entries by thread ID under the
+         *    mutex, so the array can be safely moved while it is held.
+         */
+        workers = realloc (wp->workers, max_threads * sizeof (*workers));
+        if (!workers) {
+            errno = ENOMEM;
+            rc = -1;
+        }
+        else {
+            memset (workers + wp->n_workers_max, 0,
+                (max_threads - wp->n_workers_max) * sizeof (*workers));
+            wp->workers = workers;
+        }
+    }
+    if (rc == 0) {
+        wp->n_workers_max = max_threads;
+        wp->idle_secs = idle_secs;
+        wp->max_depth = max_depth;
+        wp->max_wait_msecs = max_wait_msecs;
+        wp->is_adaptive = (wp->n_workers_max > wp->n_workers_min);
+    }
+    if ((errno = pthread_mutex_unlock (&wp->lock)) != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR,
+            "Failed to unlock work thread mutex");
+    }
+    return (rc);
+}
+
+
 void
 work_fini (work_p wp, int do_wait)
 {
     int i;
+    int *is_canceled;
 
     if (!wp) {
         errno = EINVAL;
         return;
     }
+    /*  Prevent new work from being queued and new workers from being started.
+     */
     if ((errno = pthread_mutex_lock (&wp->lock)) != 0) {
         log_errno (EMUNGE_SNAFU, LOG_ERR,
             "Failed to lock work thread mutex");
     }
-    /*  Prevent new work from being queued.
-     */
-    wp->got_fini = 1;
-    /*
-     *  Process remaining work if requested.
+    (void) _work_count_add (wp, &wp->got_fini, 1);
+
+    if ((errno = pthread_mutex_unlock (&wp->lock)) != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR,
+            "Failed to unlock work thread mutex");
+    }
+    /*  Process remaining work if requested.
      */
     if (do_wait) {
-        /*
-         *  Calling work_wait() won't work here since the wait wouldn't
-         *    be atomic with the mutex being dropped between function calls.
-         */
-        while ((wp->n_working != 0) && (wp->work_head != NULL)) {
-            if ((errno = pthread_cond_wait
-                        (&wp->finished_work, &wp->lock)) != 0) {
-                log_errno (EMUNGE_SNAFU, LOG_ERR,
-                    "Failed to wait on work thread for finished work");
-            }
-        }
+        work_wait (wp);
     }
     /*  Stop worker thread(s).
-     *  The mutex must be unlocked in order to cancel the worker
-     *    thread(s) which may be blocked on pthread_cond_wait().
-     *    When a pthread_cond_wait() is canceled, the mutex is
-     *    re-acquired before the cleanup handlers are invoked.
+     *  Idle workers are canceled while blocked on pthread_cond_wait().
+     *    When a pthread_cond_wait() is canceled, the mutex is re-acquired
+     *    before the cleanup handlers are invoked.
+     *  Since got_fini is set, no worker will exit on its own once the
+     *    mutex is released.
      */
-    if ((errno = pthread_mutex_unlock (&wp->lock)) != 0) {
+    if (!(is_canceled = calloc (wp->n_workers_max, sizeof (*is_canceled)))) {
+        log_errno (EMUNGE_NO_MEMORY, LOG_ERR,
+            "Failed to allocate work thread cancellation array");
+    }
+    if ((errno = pthread_mutex_lock (&wp->lock)) != 0) {
         log_errno (EMUNGE_SNAFU, LOG_ERR,
-            "Failed to unlock work thread mutex");
+            "Failed to lock work thread mutex");
     }
-    for (i = 0; i < wp->n_workers; i++) {
-        if ((errno = pthread_cancel (wp->workers[i])) != 0) {
+    for (i = 0; i < wp->n_workers_max; i++) {
+        if (wp->workers[i].state != WORK_THREAD_RUNNING) {
+            continue;
+        }
+        if ((errno = pthread_cancel (wp->workers[i].tid)) != 0) {
             log_errno (EMUNGE_SNAFU, LOG_ERR,
                 "Failed to cancel work thread #%d", i+1);
         }
+        is_canceled[i] = 1;
+    }
+    if ((errno = pthread_mutex_unlock (&wp->lock)) != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR,
+            "Failed to unlock work thread mutex");
     }
-    for (i = 0; i < wp->n_workers; i++) {
+    for (i = 0; i < wp->n_workers_max; i++) {
         void *result;
-        if ((errno = pthread_join (wp->workers[i], &result)) != 0) {
+        if (wp->workers[i].state == WORK_THREAD_UNUSED) {
+            continue;
+        }
+        if ((errno = pthread_join (wp->workers[i].tid, &result)) != 0) {
             log_errno (EMUNGE_SNAFU, LOG_ERR,
                 "Failed to join work thread #%d", i+1);
         }
-        if (result != PTHREAD_CANCELED) {
+        if (is_canceled[i] && (result != PTHREAD_CANCELED)) {
             log_err (EMUNGE_SNAFU, LOG_ERR,
                 "Work thread #%d was not canceled", i+1);
         }
-        wp->workers[i] = 0;
+        wp->workers[i].state = WORK_THREAD_UNUSED;
     }
-    /*  Reclaim allocated resources.
+    free (is_canceled);
+    /*
+     *  Reclaim allocated resources.
      */
+    if ((errno = pthread_attr_destroy (&wp->tattr)) != 0) {
+        log_msg (LOG_ERR,
+            "Failed to destroy work thread attribute: %s", strerror (errno));
+    }
     if ((errno = pthread_cond_destroy (&wp->finished_work)) != 0) {
         log_msg (LOG_ERR,
             "Failed to destroy work thread condition for finished work: %s",
             strerror (errno));
     }
+    if ((errno = pthread_cond_destroy (&wp->dequeued_work)) != 0) {
+        log_msg (LOG_ERR,
+            "Failed to destroy work thread condition for dequeued work: %s",
+            strerror (errno));
+    }
     if ((errno = pthread_cond_destroy (&wp->received_work)) != 0) {
         log_msg (LOG_ERR,
             "Failed to destroy work thread condition for received work: %s",
             strerror (errno));
     }
+#if ! HAVE_ATOMIC_BUILTINS
+    if ((errno = pthread_mutex_destroy (&wp->ring_lock)) != 0) {
+        log_msg (LOG_ERR,
+            "Failed to destroy work queue mutex: %s", strerror (errno));
+    }
+#endif /* !HAVE_ATOMIC_BUILTINS */
     if ((errno = pthread_mutex_destroy (&wp->lock)) != 0) {
         log_msg (LOG_ERR,
             "Failed to destroy work thread mutex: %s", strerror (errno));
     }
+    free (wp->ring);
     free (wp->workers);
     free (wp);
     return;
@@ -249,43 +411,48 @@ work_fini (work_p wp, int do_wait)
 int
 work_queue (work_p wp, void *work)
 {
-    int rc = 0;
-    int do_signal = 0;
-
     if (!wp || !work) {
         errno = EINVAL;
         return (-1);
     }
-    if ((errno = pthread_mutex_lock (&wp->lock)) != 0) {
-        log_errno (EMUNGE_SNAFU, LOG_ERR,
-            "Failed to lock work thread mutex");
-    }
-    if (wp->got_fini) {
+    if (_work_count_get (wp, &wp->got_fini)) {
         errno = EPERM;
-        rc = -1;
-    }
-    else if (_work_enqueue (wp, work) == NULL) {
-        errno = EINVAL;
-        rc = -1;
+        return (-1);
     }
-    else if ((wp->n_workers - wp->n_working) > 0) {
+    (void) _work_count_add (wp, &wp->n_pending, 1);
+
+    if (_work_enqueue (wp, work) < 0) {
         /*
-         *  Awaken an idle worker if possible.
-         *  Set a flag here so the signal can be done outside the monitor lock.
+         *  The ring is full, so wait for a worker to free a slot.
+         *  The n_blocked count is raised before re-checking the ring so
+         *    a worker dequeueing concurrently is guaranteed to either free
+         *    a slot seen by the re-check or see the count and signal.
          */
-        do_signal = 1;
-    }
-    if ((errno = pthread_mutex_unlock (&wp->lock)) != 0) {
-        log_errno (EMUNGE_SNAFU, LOG_ERR,
-            "Failed to unlock work thread mutex");
-    }
-    if (do_signal) {
-        if ((errno = pthread_cond_signal (&wp->received_work)) != 0) {
+        if ((errno = pthread_mutex_lock (&wp->lock)) != 0) {
             log_errno (EMUNGE_SNAFU, LOG_ERR,
-                "Failed to signal work thread for received work");
+                "Failed to lock work thread mutex");
+        }
+        (void) _work_count_add (wp, &wp->n_blocked, 1);
+        while (_work_enqueue (wp, work) < 0) {
+            if ((errno = pthread_cond_wait
+                        (&wp->dequeued_work, &wp->lock)) != 0) {
+                log_errno (EMUNGE_SNAFU, LOG_ERR,
+                    "Failed to wait on work thread for dequeued work");
+            }
+        }
+        (void) _work_count_add (wp, &wp->n_blocked, -1);
+
+        if ((errno = pthread_mutex_unlock (&wp->lock)) != 0) {
+            log_errno (EMUNGE_SNAFU, LOG_ERR,
+                "Failed to unlock work thread mutex");
         }
     }
-    return (rc);
+    /*  Awaken an idle worker if needed, or start another if the queue is
+     *    backing up.
+     */
+    _work_wake (wp, &wp->n_idle, &wp->received_work, 0);
+    _work_grow (wp, NULL);
+    return (0);
 }
 
 
@@ -302,7 +469,7 @@ work_wait (work_p wp)
     }
     /*  Wait until all the queued work is finished.
      */
-    while ((wp->n_working != 0) && (wp->work_head != NULL)) {
+    while (_work_count_get (wp, &wp->n_pending) != 0) {
         if ((errno = pthread_cond_wait (&wp->finished_work, &wp->lock)) != 0) {
             log_errno (EMUNGE_SNAFU, LOG_ERR,
                 "Failed to wait on work thread for finished work");
@@ -324,12 +491,14 @@ static void *
 _work_exec (void *arg)
 {
 /*  The worker thread.  It continually removes the next element
- *    from the work queue and processes it -- until it's canceled.
+ *    from the work queue and processes it -- until it's canceled,
+ *    or until it retires after being idle in an adaptive work crew.
  */
-    work_p    wp;
-    sigset_t  sigset;
-    int       cancel_state;
-    void     *work;
+    work_p           wp;
+    sigset_t         sigset;
+    int              cancel_state;
+    void            *work;
+    struct timespec  t_queued;
 
     assert (arg != NULL);
     wp = arg;
@@ -340,23 +509,17 @@ _work_exec (void *arg)
     if (pthread_sigmask (SIG_SETMASK, &sigset, NULL) != 0) {
         log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to set work thread sigset");
     }
-    if ((errno = pthread_mutex_lock (&wp->lock)) != 0) {
-        log_errno (EMUNGE_SNAFU, LOG_ERR,
-            "Failed to lock work thread mutex");
-    }
-    pthread_cleanup_push (_work_exec_cleanup, wp);
+    (void) _work_count_add (wp, &wp->n_starting, -1);
 
     for (;;) {
 
         pthread_testcancel ();
         /*
-         *  Wait for new work if none is currently queued.
+         *  Park until new work arrives if none is currently queued.
          */
-        while (!wp->work_head) {
-            if ((errno = pthread_cond_wait
-                        (&wp->received_work, &wp->lock)) != 0) {
-                log_errno (EMUNGE_SNAFU, LOG_ERR,
-                    "Failed to wait on work thread for received work");
+        if (!(work = _work_dequeue (wp, &t_queued))) {
+            if (!(work = _work_park (wp, &t_queued))) {
+                break;
             }
         }
         /*  Disable the thread's cancellation state.
@@ -366,26 +529,22 @@ _work_exec (void *arg)
             log_errno (EMUNGE_SNAFU, LOG_ERR,
                 "Failed to disable work thread cancellation");
         }
-        /*  Process the work.
+        /*  Awaken a producer waiting for the slot just freed, and start
+         *    another worker if the work waited too long in the queue.
+         */
+        _work_wake (wp, &wp->n_blocked, &wp->dequeued_work, 0);
+        _work_grow (wp, &t_queued);
+        /*
+         *  Process the work.
          */
-        work = _work_dequeue (wp);
-        assert (work != NULL);
-
-        wp->n_working++;
-
-        if ((errno = pthread_mutex_unlock (&wp->lock)) != 0) {
-            log_errno (EMUNGE_SNAFU, LOG_ERR,
-                "Failed to unlock work thread mutex");
-        }
         wp->work_func (work);
-
-        if ((errno = pthread_mutex_lock (&wp->lock)) != 0) {
-            log_errno (EMUNGE_SNAFU, LOG_ERR,
-                "Failed to lock work thread mutex");
-        }
-        wp->n_working--;
         /*
-         *  Enable the thread's cancellation state.
+         *  Check to see if all the queued work is now finished.
+         */
+        if (_work_count_add (wp, &wp->n_pending, -1) == 0) {
+            _work_wake (wp, NULL, &wp->finished_work, 1);
+        }
+        /*  Enable the thread's cancellation state.
          *    Since enabling cancellation is not a cancellation point,
          *    a pending cancel request must be tested for.  Consequently,
          *    pthread_testcancel() is called at the top of the for-loop
@@ -396,17 +555,7 @@ _work_exec (void *arg)
             log_errno (EMUNGE_SNAFU, LOG_ERR,
                 "Failed to enable work thread cancellation");
         }
-        /*  Check to see if all the queued work is now finished.
-         */
-        if ((wp->n_working == 0) && (!wp->work_head)) {
-            if ((errno = pthread_cond_signal (&wp->finished_work)) != 0) {
-                log_errno (EMUNGE_SNAFU, LOG_ERR,
-                    "Failed to signal work thread for finished work");
-            }
-        }
     }
-    assert (1);                         /* not reached */
-    pthread_cleanup_pop (1);
     return (NULL);
 }
 
@@ -431,58 +580,470 @@ _work_exec_cleanup (void *arg)
 
 
 static void *
-_work_enqueue (work_p wp, void *work)
+_work_park (work_p wp, struct timespec *t_queued)
 {
-/*  Enqueue the [work] element at the tail of the [wp] work queue.
+/*  Blocks the calling worker until it dequeues an element from the
+ *    [wp] work queue, setting [t_queued] as per _work_dequeue().
+ *  The n_idle count is raised before re-checking the queue so a producer
+ *    enqueueing concurrently is guaranteed to either have its work seen by
+ *    the re-check or see the count and signal.  The mutex is only taken
+ *    here and by threads signaling a parked worker, so it is uncontended
+ *    while there is work in the queue.
+ *  In an adaptive work crew, a worker in excess of the minimum exits after
+ *    being idle for idle_secs.
+ *  Returns the work element, or NULL if the calling worker is to exit.
+ */
+    void            *work;
+    struct timespec  ts;
+
+    if ((errno = pthread_mutex_lock (&wp->lock)) != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR,
+            "Failed to lock work thread mutex");
+    }
+    pthread_cleanup_push (_work_exec_cleanup, wp);
+
+    if (wp->is_adaptive) {
+        (void) clock_gettime (CLOCK_REALTIME, &ts);
+        ts.tv_sec += wp->idle_secs;
+    }
+    (void) _work_count_add (wp, &wp->n_idle, 1);
+    while (!(work = _work_dequeue (wp, t_queued))) {
+        if (wp->is_adaptive
+                && (_work_count_get (wp, &wp->n_workers) > wp->n_workers_min)
+                && !_work_count_get (wp, &wp->got_fini)) {
+            errno = pthread_cond_timedwait
+                (&wp->received_work, &wp->lock, &ts);
+            /*  Other workers may have retired while this one was waiting,
+             *    so the number of workers is re-checked before retiring.
+             */
+            if (errno == ETIMEDOUT) {
+                errno = 0;
+                if (_work_count_get (wp, &wp->n_workers) > wp->n_workers_min) {
+                    if (!(work = _work_dequeue (wp, t_queued))) {
+                        _work_retire (wp);
+                    }
+                    break;
+                }
+            }
+        }
+        else {
+            errno = pthread_cond_wait (&wp->received_work, &wp->lock);
+        }
+        if (errno != 0) {
+            log_errno (EMUNGE_SNAFU, LOG_ERR,
+                "Failed to wait on work thread for received work");
+        }
+    }
+    (void) _work_count_add (wp, &wp->n_idle, -1);
+
+    pthread_cleanup_pop (1);
+    return (work);
+}
+
+
+static void
+_work_wake (work_p wp, int *n_waiting, pthread_cond_t *cond, int do_broadcast)
+{
+/*  Signals the condition [cond] of the [wp] work crew if the [n_waiting]
+ *    count indicates a thread may be waiting on it.  If [n_waiting] is NULL,
+ *    the condition is always signaled.  If [do_broadcast] is non-zero,
+ *    all waiting threads are awakened.
+ *  The signal is sent with the mutex held since the waiter re-checks its
+ *    predicate under the mutex before waiting.
+ */
+    if ((n_waiting != NULL) && (_work_count_get (wp, n_waiting) == 0)) {
+        return;
+    }
+    if ((errno = pthread_mutex_lock (&wp->lock)) != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR,
+            "Failed to lock work thread mutex");
+    }
+    if (do_broadcast) {
+        errno = pthread_cond_broadcast (cond);
+    }
+    else {
+        errno = pthread_cond_signal (cond);
+    }
+    if (errno != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR,
+            "Failed to signal work thread condition");
+    }
+    if ((errno = pthread_mutex_unlock (&wp->lock)) != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR,
+            "Failed to unlock work thread mutex");
+    }
+    return;
+}
+
+
+static int
+_work_spawn (work_p wp)
+{
+/*  Starts a new worker thread for the [wp] work crew, reaping the entry of
+ *    a previously-retired worker if needed.
+ *  Returns 0 on success, or -1 on error (with errno set).
  *
  *  LOCKING PROTOCOL:
  *    This routine requires the caller to have locked the [wp]'s mutex.
  */
-    work_arg_p wap;
+    int i;
 
-    assert (wp != NULL);
+    for (i = 0; i < wp->n_workers_max; i++) {
+        if (wp->workers[i].state != WORK_THREAD_RUNNING) {
+            break;
+        }
+    }
+    if (i >= wp->n_workers_max) {
+        errno = EAGAIN;
+        return (-1);
+    }
+    if (wp->workers[i].state == WORK_THREAD_EXITED) {
+        if ((errno = pthread_join (wp->workers[i].tid, NULL)) != 0) {
+            log_errno (EMUNGE_SNAFU, LOG_ERR,
+                "Failed to join work thread #%d", i+1);
+        }
+        wp->workers[i].state = WORK_THREAD_UNUSED;
+    }
+    (void) _work_count_add (wp, &wp->n_starting, 1);
+    errno = pthread_create (&wp->workers[i].tid, &wp->tattr, _work_exec, wp);
+    if (errno != 0) {
+        (void) _work_count_add (wp, &wp->n_starting, -1);
+        return (-1);
+    }
+    wp->workers[i].state = WORK_THREAD_RUNNING;
+    (void) _work_count_add (wp, &wp->n_workers, 1);
+    return (0);
+}
 
-    if (!work) {
-        return (NULL);
+
+static void
+_work_retire (work_p wp)
+{
+/*  Marks the entry of the calling worker thread of the [wp] work crew as
+ *    exited.  Its thread is reaped when the entry is next reused or when
+ *    the work crew is stopped.
+ *
+ *  LOCKING PROTOCOL:
+ *    This routine requires the caller to have locked the [wp]'s mutex.
+ */
+    pthread_t tid = pthread_self ();
+    int i;
+
+    for (i = 0; i < wp->n_workers_max; i++) {
+        if ((wp->workers[i].state == WORK_THREAD_RUNNING)
+                && pthread_equal (wp->workers[i].tid, tid)) {
+            break;
+        }
+    }
+    assert (i < wp->n_workers_max);
+    wp->workers[i].state = WORK_THREAD_EXITED;
+    (void) _work_count_add (wp, &wp->n_workers, -1);
+    log_msg (LOG_INFO, "Stopped idle work thread (%d remaining)",
+        _work_count_get (wp, &wp->n_workers));
+    return;
+}
+
+
+static void
+_work_grow (work_p wp, const struct timespec *t_queued)
+{
+/*  Starts another worker for the adaptive [wp] work crew if none are idle
+ *    and requests are backing up in the queue.  If [t_queued] is NULL, the
+ *    queue depth is checked against max_depth; otherwise, the time at which
+ *    the work just dequeued was queued is checked against max_wait_msecs.
+ *  Only one new worker is started at a time so a burst of requests does
+ *    not start more workers than it needs.
+ */
+    struct timespec  now;
+    long             msecs;
+
+    if (!wp->is_adaptive) {
+        return;
     }
-    if (!(wap = malloc (sizeof (*wap)))) {
-        log_errno (EMUNGE_NO_MEMORY, LOG_ERR, "Failed to enqueue work");
+    if ((_work_count_get (wp, &wp->n_idle) > 0)
+            || (_work_count_get (wp, &wp->n_starting) > 0)
+            || (_work_count_get (wp, &wp->n_workers) >= wp->n_workers_max)) {
+        return;
     }
-    wap->next = NULL;
-    wap->arg = work;
-    if (!wp->work_tail) {
-        wp->work_tail = wp->work_head = wap;
+    if (t_queued == NULL) {
+        if (_work_depth (wp) <= (unsigned long) wp->max_depth) {
+            return;
+        }
     }
     else {
-        wp->work_tail->next = wap;
-        wp->work_tail = wap;
+        if (_work_depth (wp) == 0) {
+            return;
+        }
+        (void) clock_gettime (CLOCK_MONOTONIC, &now);
+        msecs = ((now.tv_sec - t_queued->tv_sec) * 1000)
+            + ((now.tv_nsec - t_queued->tv_nsec) / 1000000);
+        if (msecs <= wp->max_wait_msecs) {
+            return;
+        }
+    }
+    if ((errno = pthread_mutex_lock (&wp->lock)) != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR,
+            "Failed to lock work thread mutex");
+    }
+    if (!_work_count_get (wp, &wp->got_fini)
+            && (_work_count_get (wp, &wp->n_starting) == 0)
+            && (_work_count_get (wp, &wp->n_workers) < wp->n_workers_max)) {
+        if (_work_spawn (wp) < 0) {
+            log_msg (LOG_WARNING, "Failed to create work thread: %s",
+                strerror (errno));
+        }
+        else {
+            log_msg (LOG_INFO, "Started work thread (%d running)",
+                _work_count_get (wp, &wp->n_workers));
+        }
+    }
+    if ((errno = pthread_mutex_unlock (&wp->lock)) != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR,
+            "Failed to unlock work thread mutex");
+    }
+    return;
+}
+
+
+#if HAVE_ATOMIC_BUILTINS
+
+static int
+_work_enqueue (work_p wp, void *work)
+{
+/*  Enqueue the [work] element at the tail of the [wp] work queue.
+ *  The queue is a bounded multi-producer/multi-consumer ring where each slot
+ *    carries a sequence number.  A slot is free for the enqueue at position
+ *    [pos] when its sequence equals [pos], and holds an element for the
+ *    dequeue at position [pos] when its sequence equals [pos + 1].  A thread
+ *    claims a position by advancing the head or tail cursor with a
+ *    compare-and-swap, then publishes the slot by updating its sequence.
+ *  Returns 0 on success, or -1 if the queue is full.
+ */
+    work_slot_p    slot;
+    unsigned long  pos;
+    long           dif;
+
+    assert (wp != NULL);
+    assert (work != NULL);
+
+    pos = __atomic_load_n (&wp->tail, __ATOMIC_RELAXED);
+    for (;;) {
+        slot = &wp->ring[pos & wp->mask];
+        dif = (long) __atomic_load_n (&slot->seq, __ATOMIC_ACQUIRE)
+            - (long) pos;
+        if (dif == 0) {
+            if (__atomic_compare_exchange_n (&wp->tail, &pos, pos + 1, 1,
+                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        }
+        else if (dif < 0) {
+            return (-1);
+        }
+        else {
+            pos = __atomic_load_n (&wp->tail, __ATOMIC_RELAXED);
+        }
+    }
+    slot->arg = work;
+    if (wp->is_adaptive) {
+        (void) clock_gettime (CLOCK_MONOTONIC, &slot->t_queued);
+    }
+    __atomic_store_n (&slot->seq, pos + 1, __ATOMIC_RELEASE);
+    /*
+     *  Order the enqueue before the caller checks for idle workers.
+     */
+    __atomic_thread_fence (__ATOMIC_SEQ_CST);
+    return (0);
+}
+
+
+static void *
+_work_dequeue (work_p wp, struct timespec *t_queued)
+{
+/*  Dequeue the work element at the head of the [wp] work queue.
+ *  If [t_queued] is not NULL, it is set to the time at which the element
+ *    was queued (in an adaptive work crew).
+ *  Returns the work element, or NULL if the queue is empty.
+ */
+    work_slot_p    slot;
+    unsigned long  pos;
+    long           dif;
+    void          *work;
+
+    assert (wp != NULL);
+
+    pos = __atomic_load_n (&wp->head, __ATOMIC_RELAXED);
+    for (;;) {
+        slot = &wp->ring[pos & wp->mask];
+        dif = (long) __atomic_load_n (&slot->seq, __ATOMIC_ACQUIRE)
+            - (long) (pos + 1);
+        if (dif == 0) {
+            if (__atomic_compare_exchange_n (&wp->head, &pos, pos + 1, 1,
+                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        }
+        else if (dif < 0) {
+            return (NULL);
+        }
+        else {
+            pos = __atomic_load_n (&wp->head, __ATOMIC_RELAXED);
+        }
     }
+    work = slot->arg;
+    if (t_queued != NULL) {
+        *t_queued = slot->t_queued;
+    }
+    __atomic_store_n (&slot->seq, pos + wp->mask + 1, __ATOMIC_RELEASE);
+    /*
+     *  Order the dequeue before the caller checks for blocked producers.
+     */
+    __atomic_thread_fence (__ATOMIC_SEQ_CST);
     return (work);
 }
 
 
+static unsigned long
+_work_depth (work_p wp)
+{
+/*  Returns the approximate number of elements in the [wp] work queue.
+ */
+    unsigned long head = __atomic_load_n (&wp->head, __ATOMIC_RELAXED);
+    unsigned long tail = __atomic_load_n (&wp->tail, __ATOMIC_RELAXED);
+
+    return ((tail > head) ? (tail - head) : 0);
+}
+
+
+static int
+_work_count_add (work_p wp, int *count, int n)
+{
+/*  Adds [n] to the [count] of the [wp] work crew.
+ *  Returns the new value.
+ */
+    return (__atomic_add_fetch (count, n, __ATOMIC_SEQ_CST));
+}
+
+
+static int
+_work_count_get (work_p wp, int *count)
+{
+/*  Returns the current value of the [count] of the [wp] work crew.
+ */
+    return (__atomic_load_n (count, __ATOMIC_SEQ_CST));
+}
+
+#else  /* !HAVE_ATOMIC_BUILTINS */
+
+static int
+_work_enqueue (work_p wp, void *work)
+{
+/*  Enqueue the [work] element at the tail of the [wp] work queue.
+ *  Without atomic builtins, the ring and its counts are protected by the
+ *    ring_lock mutex which is only held for the duration of the operation.
+ *  Returns 0 on success, or -1 if the queue is full.
+ */
+    work_slot_p slot;
+    int rc = -1;
+
+    assert (wp != NULL);
+    assert (work != NULL);
+
+    if ((errno = pthread_mutex_lock (&wp->ring_lock)) != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to lock work queue mutex");
+    }
+    if (wp->tail - wp->head <= wp->mask) {
+        slot = &wp->ring[wp->tail & wp->mask];
+        slot->arg = work;
+        if (wp->is_adaptive) {
+            (void) clock_gettime (CLOCK_MONOTONIC, &slot->t_queued);
+        }
+        wp->tail++;
+        rc = 0;
+    }
+    if ((errno = pthread_mutex_unlock (&wp->ring_lock)) != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to unlock work queue mutex");
+    }
+    return (rc);
+}
+
+
 static void *
-_work_dequeue (work_p wp)
+_work_dequeue (work_p wp, struct timespec *t_queued)
 {
 /*  Dequeue the work element at the head of the [wp] work queue.
- *
- *  LOCKING PROTOCOL:
- *    This routine requires the caller to have locked the [wp]'s mutex.
+ *  If [t_queued] is not NULL, it is set to the time at which the element
+ *    was queued (in an adaptive work crew).
+ *  Returns the work element, or NULL if the queue is empty.
  */
-    work_arg_p  wap;
-    void       *work;
+    work_slot_p slot;
+    void *work = NULL;
 
     assert (wp != NULL);
 
-    wap = wp->work_head;
-    if (!wap) {
-        return (NULL);
+    if ((errno = pthread_mutex_lock (&wp->ring_lock)) != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to lock work queue mutex");
     }
-    wp->work_head = wap->next;
-    work = wap->arg;
-    free (wap);
-    if (!wp->work_head) {
-        wp->work_tail = NULL;
+    if (wp->head != wp->tail) {
+        slot = &wp->ring[wp->head & wp->mask];
+        work = slot->arg;
+        if (t_queued != NULL) {
+            *t_queued = slot->t_queued;
+        }
+        wp->head++;
+    }
+    if ((errno = pthread_mutex_unlock (&wp->ring_lock)) != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to unlock work queue mutex");
     }
     return (work);
 }
+
+
+static unsigned long
+_work_depth (work_p wp)
+{
+/*  Returns the number of elements in the [wp] work queue.
+ */
+    unsigned long n;
+
+    if ((errno = pthread_mutex_lock (&wp->ring_lock)) != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to lock work queue mutex");
+    }
+    n = wp->tail - wp->head;
+
+    if ((errno = pthread_mutex_unlock (&wp->ring_lock)) != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to unlock work queue mutex");
+    }
+    return (n);
+}
+
+
+static int
+_work_count_add (work_p wp, int *count, int n)
+{
+/*  Adds [n] to the [count] of the [wp] work crew.
+ *  Returns the new value.
+ */
+    int val;
+
+    if ((errno = pthread_mutex_lock (&wp->ring_lock)) != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to lock work queue mutex");
+    }
+    val = (*count += n);
+
+    if ((errno = pthread_mutex_unlock (&wp->ring_lock)) != 0) {
+        log_errno (EMUNGE_SNAFU, LOG_ERR, "Failed to unlock work queue mutex");
+    }
+    return (val);
+}
+
+
+static int
+_work_count_get (work_p wp, int *count)
+{
+/*  Returns the current value of the [count] of the [wp] work crew.
+ */
+    return (_work_count_add (wp, count, 0));
+}
+
+#endif /* !HAVE_ATOMIC_BUILTINS */
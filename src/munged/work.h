@@ -56,6 +56,19 @@ work_p work_init (work_func_t f, int n_threads);
  *  Returns a ptr to the work crew, or NULL on error (with errno set).
  */
 
+int work_set_adaptive (work_p wp, int max_threads, int idle_secs,
+    int max_depth, int max_wait_msecs);
+/*
+ *  Allows the work crew [wp] to grow to [max_threads] workers as load
+ *    increases.  Another worker is started (one at a time) if none are idle
+ *    and either more than [max_depth] elements are queued or an element
+ *    waited more than [max_wait_msecs] in the queue.  A worker in excess of
+ *    the number specified to work_init() exits after being idle for
+ *    [idle_secs].  If [max_threads] equals the number of workers specified
+ *    to work_init(), the work crew remains fixed in size.
+ *  Returns 0 on success, or -1 on error (with errno set).
+ */
+
 void work_fini (work_p wp, int do_wait);
 /*
  *  Stops the work crew [wp], canceling all worker threads and releasing
@@ -68,6 +81,8 @@ int work_queue (work_p wp, void *work);
 /*
  *  Queues the [work] element for processing by the work crew [wp].
  *    The [work] will be passed to the function specified during work_init().
+ *    The work queue is bounded; if it is full, this call blocks until
+ *    a worker dequeues an element.
  *  Returns 0 on success, or -1 on error (with errno set).
  */
 
@@ -0,0 +1,33 @@
+#!/bin/sh
+
+test_description='Check munged persistent client connections'
+
+. "$(dirname "$0")/sharness.sh"
+
+test_expect_success 'setup' '
+    munged_setup_env &&
+    munged_create_key &&
+    munged_start_daemon
+'
+
+test_expect_success 'encode and decode credentials over persistent connections' '
+    "${REMUNGE}" --socket="${MUNGE_SOCKET}" --persistent --decode \
+            --num-creds=1000 --num-threads=4 >out.$$ 2>&1 &&
+    cat out.$$ &&
+    ! grep -i "error" out.$$
+'
+
+test_expect_success 'encode and decode credentials without persistent connections' '
+    "${MUNGE}" --socket="${MUNGE_SOCKET}" </dev/null >cred.$$ &&
+    "${UNMUNGE}" --socket="${MUNGE_SOCKET}" <cred.$$ >/dev/null
+'
+
+test_expect_success 'stop munged' '
+    munged_stop_daemon
+'
+
+test_expect_success 'check logfile for errors' '
+    ! grep -E "Failed|invalid message" "${MUNGE_LOGFILE}"
+'
+
+test_done
@@ -0,0 +1,37 @@
+#!/bin/sh
+
+test_description='Check munged batch encode/decode requests'
+
+. "$(dirname "$0")/sharness.sh"
+
+test_expect_success 'setup' '
+    munged_setup_env &&
+    munged_create_key &&
+    munged_start_daemon
+'
+
+test_expect_success 'encode and decode credentials in batches' '
+    "${REMUNGE}" --socket="${MUNGE_SOCKET}" --batch=10 --decode \
+            --length=100 --num-creds=1000 --num-threads=4 >out.$$ 2>&1 &&
+    cat out.$$ &&
+    grep "Processed 1000 credentials" out.$$ &&
+    ! grep -i "error\|failed" out.$$
+'
+
+test_expect_success 'encode and decode a partial batch over persistent connections' '
+    "${REMUNGE}" --socket="${MUNGE_SOCKET}" --batch=7 --persistent --decode \
+            --num-creds=100 --num-threads=2 >out.$$ 2>&1 &&
+    cat out.$$ &&
+    grep "Processed 100 credentials" out.$$ &&
+    ! grep -i "error\|failed" out.$$
+'
+
+test_expect_success 'stop munged' '
+    munged_stop_daemon
+'
+
+test_expect_success 'check logfile for errors' '
+    ! grep -E "Failed|Invalid|invalid message" "${MUNGE_LOGFILE}"
+'
+
+test_done
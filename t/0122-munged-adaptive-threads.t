@@ -0,0 +1,66 @@
+#!/bin/sh
+
+test_description='Check munged adaptive work thread pool'
+
+. "$(dirname "$0")/sharness.sh"
+
+test_expect_success 'setup' '
+    munged_setup_env &&
+    munged_create_key
+'
+
+test_expect_success 'munged --max-threads less than --num-threads' '
+    test_must_fail "${MUNGED}" --num-threads=4 --max-threads=2 2>err.$$ &&
+    grep "Invalid value 2 for max-threads" err.$$
+'
+
+test_expect_success 'start munged with adaptive work threads' '
+    munged_start_daemon --num-threads=1 --max-threads=8 \
+            --thread-idle-time=1 --thread-queue-depth=0 \
+            --thread-queue-wait=0 &&
+    munged_wait_logfile "Allowing up to 8 work threads"
+'
+
+test_expect_success 'encode and decode credentials under load' '
+    "${REMUNGE}" --socket="${MUNGE_SOCKET}" --decode \
+            --num-creds=5000 --num-threads=16 >out.$$ 2>&1 &&
+    cat out.$$ &&
+    ! grep -i "error" out.$$
+'
+
+test_expect_success 'start work threads under load' '
+    grep "Started work thread" "${MUNGE_LOGFILE}" >started.$$ &&
+    cat started.$$
+'
+
+# Every work thread started under load must exit once it has been idle for
+#   the thread-idle-time, leaving only the num-threads minimum.
+test_expect_success 'stop idle work threads' '
+    local N I=0 &&
+    N=$(wc -l <started.$$) &&
+    while test "$(grep -c "Stopped idle work thread" "${MUNGE_LOGFILE}")" \
+            -lt "${N}" && test "${I}" -lt 10; do
+        sleep 1
+        I=$((I + 1))
+    done &&
+    grep "Stopped idle work thread" "${MUNGE_LOGFILE}" >stopped.$$ &&
+    cat stopped.$$ &&
+    test "$(wc -l <stopped.$$)" -eq "${N}" &&
+    tail -n 1 stopped.$$ | grep "Stopped idle work thread (1 remaining)"
+'
+
+test_expect_success 'encode and decode credentials after idle threads exit' '
+    "${REMUNGE}" --socket="${MUNGE_SOCKET}" --decode \
+            --num-creds=100 >out.$$ 2>&1 &&
+    ! grep -i "error" out.$$
+'
+
+test_expect_success 'stop munged' '
+    munged_stop_daemon
+'
+
+test_expect_success 'check logfile for errors' '
+    ! grep -E "Failed|Error" "${MUNGE_LOGFILE}"
+'
+
+test_done
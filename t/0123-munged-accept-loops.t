@@ -0,0 +1,86 @@
+#!/bin/sh
+
+test_description='Check munged with multiple accept loops'
+
+. "$(dirname "$0")/sharness.sh"
+
+test_expect_success 'setup' '
+    munged_setup_env &&
+    munged_create_key
+'
+
+test_expect_success 'munged --num-accept-loops invalid value' '
+    test_must_fail "${MUNGED}" --num-accept-loops=0 2>err.$$ &&
+    grep "Invalid value \"0\" for num-accept-loops" err.$$
+'
+
+test_expect_success 'munged --num-accept-loops greater than --num-threads' '
+    test_must_fail "${MUNGED}" --num-accept-loops=3 --num-threads=2 \
+            2>err.$$ &&
+    grep "Invalid value 3 for num-accept-loops: greater than num-threads 2" \
+            err.$$
+'
+
+test_expect_success 'start munged with multiple accept loops' '
+    munged_start_daemon --num-accept-loops=4 --num-threads=4 &&
+    munged_wait_logfile "Created 4 accept loops"
+'
+
+test_expect_success 'encode and decode credentials across accept loops' '
+    "${REMUNGE}" --socket="${MUNGE_SOCKET}" --decode \
+            --num-creds=5000 --num-threads=8 >out.$$ 2>&1 &&
+    cat out.$$ &&
+    ! grep -i "error" out.$$
+'
+
+test_expect_success 'encode and decode credentials over persistent connections' '
+    "${REMUNGE}" --socket="${MUNGE_SOCKET}" --persistent --decode \
+            --num-creds=5000 --num-threads=8 >out.$$ 2>&1 &&
+    cat out.$$ &&
+    ! grep -i "error" out.$$
+'
+
+test_expect_success 'stop munged' '
+    munged_stop_daemon
+'
+
+test_expect_success 'check logfile for errors' '
+    ! grep -E "Failed|Error" "${MUNGE_LOGFILE}"
+'
+
+# Exhaust munged's descriptors by holding more persistent connections open
+#   than it can accept.  New connections must be suspended without the
+#   reactor spinning on the failed accept(), and resumed once the held
+#   connections are closed.
+test_expect_success 'start munged with a low descriptor limit' '
+    ( ulimit -n 40 && munged_start_daemon --num-threads=2 )
+'
+
+test_expect_success 'suspend new connections when out of descriptors' '
+    "${REMUNGE}" --socket="${MUNGE_SOCKET}" --persistent --decode \
+            --duration=60 --num-threads=64 >out.$$ 2>&1 &
+    echo $! >remunge.pid.$$ &&
+    munged_wait_logfile "Suspended new connections" 30
+'
+
+test_expect_success 'resume new connections once descriptors are released' '
+    local I=0 &&
+    kill "$(cat remunge.pid.$$)" &&
+    while kill -0 "$(cat remunge.pid.$$)" 2>/dev/null && test "${I}" -lt 10
+    do
+        sleep 1
+        I=$((I + 1))
+    done &&
+    "${MUNGE}" --socket="${MUNGE_SOCKET}" --no-input |
+    "${UNMUNGE}" --socket="${MUNGE_SOCKET}" &&
+    grep -E "(Suspended|Resumed) new connections" "${MUNGE_LOGFILE}" \
+            >suspended.$$ &&
+    tail -n 1 suspended.$$ | grep "Resumed new connections" &&
+    test "$(wc -l <suspended.$$)" -lt 1000
+'
+
+test_expect_success 'stop munged with a low descriptor limit' '
+    munged_stop_daemon
+'
+
+test_done
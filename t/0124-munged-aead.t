@@ -0,0 +1,171 @@
+#!/bin/sh
+
+test_description='Check munged authentication of AEAD credentials'
+
+. "$(dirname "$0")/sharness.sh"
+
+# Decodes the base64 payload of the credential in file [$1] into file [$2].
+#
+aead_cred_unpack()
+{
+    sed -e 's/^MUNGE://' -e 's/:$//' "$1" | base64 -d >"$2"
+}
+
+# Encodes the binary credential in file [$1] into the credential file [$2].
+#
+aead_cred_pack()
+{
+    { printf "MUNGE:" && base64 <"$1" | tr -d "\n" && printf ":\n"; } >"$2"
+}
+
+# Overwrites the byte at offset [$2] in file [$1] with the value [$3].
+#
+aead_cred_set_byte()
+{
+    printf "\\$(printf "%o" "$3")" |
+    dd of="$1" bs=1 seek="$2" count=1 conv=notrunc 2>/dev/null
+}
+
+# Inverts the low bit of the byte at offset [$2] in file [$1].
+#
+aead_cred_flip_byte()
+{
+    aead_cred_set_byte "$1" "$2" "$(( $(dd if="$1" bs=1 skip="$2" count=1 \
+            2>/dev/null | od -An -tu1) ^ 1 ))"
+}
+
+# Checks whether the version string [$1] is at least [$2].[$3].
+#
+aead_version_ge()
+{
+    echo "$1" | awk -F. -v maj="$2" -v min="$3" \
+            '{ exit !(($1 > maj) || (($1 == maj) && ($2 >= min))) }'
+}
+
+# Checks whether config.h defines [$1].
+#
+aead_config_has()
+{
+    grep -q "^#define $1 1" "${MUNGE_BUILD_DIR}/config.h" 2>/dev/null
+}
+
+# Sets the GCM_EXPECTED and CHACHA20_EXPECTED prereqs if the configured crypto
+#   library is known to support the corresponding AEAD ciphers.  For Libgcrypt,
+#   this is determined from its version rather than from configure's checks so
+#   a broken check cannot silently skip the AEAD tests.  GCM is supported as of
+#   Libgcrypt 1.6, and ChaCha20-Poly1305 as of 1.7.
+#
+aead_set_expected_prereqs()
+{
+    local V
+    if aead_config_has HAVE_LIBGCRYPT; then
+        V=$( (libgcrypt-config --version || \
+                pkg-config --modversion libgcrypt) 2>/dev/null | head -n 1)
+        if test -n "${V}" && aead_version_ge "${V}" 1 6; then
+            test_set_prereq GCM_EXPECTED
+        fi
+        if test -n "${V}" && aead_version_ge "${V}" 1 7; then
+            test_set_prereq CHACHA20_EXPECTED
+        fi
+    elif aead_config_has HAVE_OPENSSL; then
+        if aead_config_has HAVE_EVP_AES_128_GCM; then
+            test_set_prereq GCM_EXPECTED
+        fi
+        if aead_config_has HAVE_EVP_CHACHA20_POLY1305; then
+            test_set_prereq CHACHA20_EXPECTED
+        fi
+    fi
+}
+
+if command -v base64 >/dev/null 2>&1; then
+    test_set_prereq BASE64
+fi
+
+aead_set_expected_prereqs
+
+test_expect_success 'setup' '
+    munged_setup_env &&
+    munged_create_key
+'
+
+test_expect_success 'start munged' '
+    munged_start_daemon
+'
+
+test_expect_success 'check for AEAD ciphers' '
+    "${MUNGE}" --list-ciphers >ciphers.out &&
+    for CIPHER in aes128-gcm aes256-gcm chacha20-poly1305; do
+        if grep -q "^ *${CIPHER} " ciphers.out; then
+            test_set_prereq "$(echo "${CIPHER}" | tr "a-z-" "A-Z_")"
+        fi
+    done
+'
+
+test_expect_success GCM_EXPECTED 'list AES-GCM ciphers' '
+    grep "^ *aes128-gcm " ciphers.out &&
+    grep "^ *aes256-gcm " ciphers.out
+'
+
+test_expect_success CHACHA20_EXPECTED 'list ChaCha20-Poly1305 cipher' '
+    grep "^ *chacha20-poly1305 " ciphers.out
+'
+
+for CIPHER in aes128-gcm aes256-gcm chacha20-poly1305; do
+
+    PREREQ=$(echo "${CIPHER}" | tr "a-z-" "A-Z_")
+
+    test_expect_success "${PREREQ}" "encode ${CIPHER} credential" '
+        "${MUNGE}" --socket="${MUNGE_SOCKET}" --no-input \
+                --cipher="${CIPHER}" --output=cred.aead &&
+        "${UNMUNGE}" --socket="${MUNGE_SOCKET}" --input=cred.aead \
+                --metadata=meta.$$ &&
+        grep "^CIPHER:.*${CIPHER}" meta.$$
+    '
+
+    test_expect_success "${PREREQ},BASE64" \
+            "decode ${CIPHER} credential with modified header" '
+        aead_cred_unpack cred.aead cred.bin &&
+        aead_cred_flip_byte cred.bin 8 &&
+        aead_cred_pack cred.bin cred.$$ &&
+        test_must_fail "${UNMUNGE}" --socket="${MUNGE_SOCKET}" \
+                --input=cred.$$ >out.$$ 2>&1 &&
+        grep "Invalid credential" out.$$
+    '
+
+    test_expect_success "${PREREQ},BASE64" \
+            "decode ${CIPHER} credential with modified payload" '
+        aead_cred_unpack cred.aead cred.bin &&
+        aead_cred_flip_byte cred.bin "$(( $(wc -c <cred.bin) - 1 ))" &&
+        aead_cred_pack cred.bin cred.$$ &&
+        test_must_fail "${UNMUNGE}" --socket="${MUNGE_SOCKET}" \
+                --input=cred.$$ >out.$$ 2>&1 &&
+        grep "Invalid credential" out.$$
+    '
+
+    test_expect_success "${PREREQ},BASE64" \
+            "decode ${CIPHER} credential as non-AEAD version" '
+        aead_cred_unpack cred.aead cred.bin &&
+        aead_cred_set_byte cred.bin 0 3 &&
+        aead_cred_pack cred.bin cred.$$ &&
+        test_must_fail "${UNMUNGE}" --socket="${MUNGE_SOCKET}" \
+                --input=cred.$$ >out.$$ 2>&1 &&
+        grep "Invalid cipher type" out.$$
+    '
+done
+
+test_expect_success BASE64 'decode non-AEAD credential as AEAD version' '
+    "${MUNGE}" --socket="${MUNGE_SOCKET}" --no-input --cipher=aes128 \
+            --output=cred.cbc &&
+    aead_cred_unpack cred.cbc cred.bin &&
+    aead_cred_set_byte cred.bin 0 4 &&
+    aead_cred_pack cred.bin cred.$$ &&
+    test_must_fail "${UNMUNGE}" --socket="${MUNGE_SOCKET}" --input=cred.$$ \
+            >out.$$ 2>&1 &&
+    grep "Invalid cipher type" out.$$
+'
+
+test_expect_success 'stop munged' '
+    munged_stop_daemon
+'
+
+test_done
@@ -111,6 +111,25 @@ munged_start_daemon()
             "$@"
 }
 
+##
+# Wait up to SECS seconds (defaulting to 10) for a line matching the extended
+#   regular expression PATTERN to be written to the munged logfile.
+# Messages logged after munged has daemonized may not yet have been written
+#   when munged_start_daemon() returns.
+##
+munged_wait_logfile()
+{
+    local PATTERN="$1" SECS="${2:-10}" &&
+    while ! grep -E -q "${PATTERN}" "${MUNGE_LOGFILE}" 2>/dev/null; do
+        if test "${SECS}" -le 0; then
+            echo "Timed out waiting for \"${PATTERN}\" in ${MUNGE_LOGFILE}"
+            return 1
+        fi
+        SECS=$((SECS - 1))
+        sleep 1
+    done
+}
+
 ##
 # Stop munged.
 # The following leading args are recognized: